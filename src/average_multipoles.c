@@ -28,15 +28,13 @@
 #include "background.h"
 #include "integrals.h"
 #include "functions.h"
+#include "integrators.h"
+#include "multipoles.h"
 #include "average_multipoles.h"
 
-#ifdef HAVE_CUBA
-#include "cuba.h"
-#else
-#include <gsl/gsl_monte.h>
-#include <gsl/gsl_monte_plain.h>
-#include <gsl/gsl_monte_miser.h>
-#include <gsl/gsl_monte_vegas.h>
+
+#ifndef AVERAGE_MULTIPOLES_KAISER_ORDER
+#define AVERAGE_MULTIPOLES_KAISER_ORDER 64 /* nodes of the quadrature in z of the control variate */
 #endif
 
 struct average_multipoles_params
@@ -45,7 +43,11 @@ struct average_multipoles_params
     struct coffe_parameters_t *par;
     struct coffe_integrals_t *integral;
     double sep;
-    int l;
+    const int *l; /* all of the multipoles are integrated at once */
+    size_t l_len;
+    int l_max;
+    const struct functions_contributions *contributions; /* NULL for just the sum */
+    int kaiser; /* whether the flat-sky Kaiser limit is subtracted (control variate) */
 };
 
 
@@ -104,24 +106,16 @@ static int average_multipoles_check_range(
 
 
 
-/* integrand of nonintegrated terms for redshift averaged multipoles */
+/* the redshift, and its weight, at the point var of the unit interval */
 
-#ifdef HAVE_CUBA
-static int average_multipoles_nonintegrated_integrand(
-    const int *ndim, const cubareal var[],
-    const int *ncomp, cubareal value[],
-    void *p
+static double average_multipoles_redshift(
+    struct average_multipoles_params *params,
+    double var,
+    double *weight
 )
-#else
-static double average_multipoles_nonintegrated_integrand(
-    double *var, size_t dim, void *p
-)
-#endif
 {
-    struct average_multipoles_params *params = (struct average_multipoles_params *) p;
     struct coffe_parameters_t *par = params->par;
     struct coffe_background_t *bg = params->bg;
-    struct coffe_integrals_t *integral = params->integral;
     double sep = params->sep;
 
     double z1 =
@@ -135,208 +129,173 @@ static double average_multipoles_nonintegrated_integrand(
             interp_spline(&bg->comoving_distance, par->z_max) - sep/2.
         );
 
-    double z = (z2 - z1)*var[0] + z1;
-    double mu = 2*var[1] - 1;
-
-#ifdef HAVE_CUBA
-    if (params->l == 0){
-        value[0] = functions_nonintegrated(
-            par, bg, integral, z, mu, sep
-        )
-       /interp_spline(&bg->conformal_Hz, z)/(1 + z);
-        return EXIT_SUCCESS;
-    }
-    else{
-        value[0] = functions_nonintegrated(
-            par, bg, integral, z, mu, sep
-        )
-       *gsl_sf_legendre_Pl(params->l, mu)
-       /interp_spline(&bg->conformal_Hz, z)/(1 + z);
-        return EXIT_SUCCESS;
-    }
-#else
-    if (params->l == 0){
-        return functions_nonintegrated(
-            par, bg, integral, z, mu, sep
-        )
-       /interp_spline(&bg->conformal_Hz, z)/(1 + z);
-    }
-    else{
-        return functions_nonintegrated(
-            par, bg, integral, z, mu, sep
-        )
-       *gsl_sf_legendre_Pl(params->l, mu)
-       /interp_spline(&bg->conformal_Hz, z)/(1 + z);
-    }
-#endif
+    double z = (z2 - z1)*var + z1;
+    *weight = 1./interp_spline(&bg->conformal_Hz, z)/(1 + z);
+    return z;
 }
 
 
-/* computes the average multipole of non-integrated terms for given l and separation */
+/**
+    maps var in [0, 1] to mu in [-1, 1], or just [0, 1] for
+    auto-correlations since the integrands are even in mu
+**/
 
-static double average_multipoles_nonintegrated(
-    struct coffe_parameters_t *par,
-    struct coffe_background_t *bg,
-    struct coffe_integrals_t *integral,
-    double sep,
-    int l
+static double average_multipoles_mu(
+    const struct coffe_parameters_t *par,
+    double var
 )
 {
-    const int dims = 2;
+    return par->autocorrelation ? var : 2*var - 1;
+}
 
-    struct average_multipoles_params test;
-    test.par = par;
-    test.bg = bg;
-    test.integral = integral;
-    test.sep = sep;
-    test.l = l;
 
-    int flag = 0;
-    int len = par->correlation_sources_len*(par->correlation_sources_len + 1)/2;
-    for (int i = 0; i<len; ++i){
-        if (
-            strcmp(par->corr_terms[i], "00") == 0 ||
-            strcmp(par->corr_terms[i], "11") == 0 ||
-            strcmp(par->corr_terms[i], "22") == 0 ||
-            strcmp(par->corr_terms[i], "33") == 0 ||
-            strcmp(par->corr_terms[i], "44") == 0 ||
-            strcmp(par->corr_terms[i], "55") == 0 ||
-            strcmp(par->corr_terms[i], "66") == 0 ||
-            strcmp(par->corr_terms[i], "01") == 0 ||
-            strcmp(par->corr_terms[i], "10") == 0 ||
-            strcmp(par->corr_terms[i], "02") == 0 ||
-            strcmp(par->corr_terms[i], "20") == 0 ||
-            strcmp(par->corr_terms[i], "03") == 0 ||
-            strcmp(par->corr_terms[i], "30") == 0 ||
-            strcmp(par->corr_terms[i], "04") == 0 ||
-            strcmp(par->corr_terms[i], "40") == 0 ||
-            strcmp(par->corr_terms[i], "05") == 0 ||
-            strcmp(par->corr_terms[i], "50") == 0 ||
-            strcmp(par->corr_terms[i], "06") == 0 ||
-            strcmp(par->corr_terms[i], "60") == 0 ||
-            strcmp(par->corr_terms[i], "12") == 0 ||
-            strcmp(par->corr_terms[i], "21") == 0 ||
-            strcmp(par->corr_terms[i], "13") == 0 ||
-            strcmp(par->corr_terms[i], "31") == 0 ||
-            strcmp(par->corr_terms[i], "14") == 0 ||
-            strcmp(par->corr_terms[i], "41") == 0 ||
-            strcmp(par->corr_terms[i], "15") == 0 ||
-            strcmp(par->corr_terms[i], "51") == 0 ||
-            strcmp(par->corr_terms[i], "16") == 0 ||
-            strcmp(par->corr_terms[i], "61") == 0 ||
-            strcmp(par->corr_terms[i], "23") == 0 ||
-            strcmp(par->corr_terms[i], "32") == 0 ||
-            strcmp(par->corr_terms[i], "24") == 0 ||
-            strcmp(par->corr_terms[i], "42") == 0 ||
-            strcmp(par->corr_terms[i], "25") == 0 ||
-            strcmp(par->corr_terms[i], "52") == 0 ||
-            strcmp(par->corr_terms[i], "26") == 0 ||
-            strcmp(par->corr_terms[i], "62") == 0 ||
-            strcmp(par->corr_terms[i], "34") == 0 ||
-            strcmp(par->corr_terms[i], "43") == 0 ||
-            strcmp(par->corr_terms[i], "35") == 0 ||
-            strcmp(par->corr_terms[i], "53") == 0 ||
-            strcmp(par->corr_terms[i], "36") == 0 ||
-            strcmp(par->corr_terms[i], "63") == 0 ||
-            strcmp(par->corr_terms[i], "45") == 0 ||
-            strcmp(par->corr_terms[i], "54") == 0 ||
-            strcmp(par->corr_terms[i], "46") == 0 ||
-            strcmp(par->corr_terms[i], "64") == 0 ||
-            strcmp(par->corr_terms[i], "56") == 0 ||
-            strcmp(par->corr_terms[i], "65") == 0
-        ) ++flag;
-    }
-    if (flag == 0) return 0;
-
-#ifdef HAVE_CUBA
-    int nregions, neval, fail;
-    double result[1], error[1], prob[1];
-    Cuhre(dims, 1,
-        average_multipoles_nonintegrated_integrand,
-        (void *)&test, 1,
-        1e-3, 0, 0,
-        1, par->integration_bins, 7,
-        NULL, NULL,
-        &nregions, &neval, &fail, result, error, prob
-    );
-    return (2*l + 1)*result[0]
-    /interp_spline(&bg->D1, 0)/interp_spline(&bg->D1, 0);
-#else
-    gsl_monte_function integrand;
-    integrand.f = &average_multipoles_nonintegrated_integrand;
-    integrand.dim = dims;
-    integrand.params = &test;
-    gsl_rng *random;
-    gsl_rng_env_setup();
-    const gsl_rng_type *T = gsl_rng_default;
-    random = gsl_rng_alloc(T);
-    double result, error;
-    double lower[dims];
-    double upper[dims];
-    for (int i = 0; i<dims; ++i){
-        lower[i] = 0.0;
-        upper[i] = 1.0;
+/**
+    the component of the integrands belonging to the multipole
+    with index i and (if computing the separate terms) the term
+    with index t is i*(number of terms) + t; returns the index of
+    the multipole of the component, and the terms to evaluate for it
+**/
+
+static size_t average_multipoles_component(
+    const struct average_multipoles_params *params,
+    int component,
+    uint64_t *terms
+)
+{
+    const struct functions_contributions *c = params->contributions;
+    if (c == NULL){
+        *terms = params->par->terms;
+        return (size_t)component;
     }
-    switch (par->integration_method){
-        case 0:{
-            gsl_monte_plain_state *state =
-                gsl_monte_plain_alloc(dims);
-            gsl_monte_plain_integrate(
-                &integrand, lower, upper,
-                dims, par->integration_bins, random,
-                state,
-                &result, &error
-            );
-            gsl_monte_plain_free(state);
-            break;
-        }
-        case 1:{
-            gsl_monte_miser_state *state =
-                gsl_monte_miser_alloc(dims);
-            gsl_monte_miser_integrate(
-                &integrand, lower, upper,
-                dims, par->integration_bins, random,
-                state,
-                &result, &error
-            );
-            gsl_monte_miser_free(state);
-            break;
+    *terms = UINT64_C(1) << c->index[component % c->len];
+    return (size_t)(component/c->len);
+}
+
+
+/**
+    fills all of the components of value from the sum of the
+    terms (total), or from the separate terms (all), times weight,
+    with all of the Legendre polynomials from a single recurrence
+**/
+
+static int average_multipoles_fill(
+    const struct average_multipoles_params *params,
+    double mu,
+    double weight,
+    double total,
+    const double all[],
+    double value[]
+)
+{
+    const struct functions_contributions *c = params->contributions;
+    double legendre[params->l_max + 1];
+    gsl_sf_legendre_Pl_array(params->l_max, mu, legendre);
+
+    for (size_t i = 0; i<params->l_len; ++i){
+        const double p = legendre[params->l[i]]*weight;
+        if (c == NULL){
+            value[i] = total*p;
         }
-        case 2:{
-            gsl_monte_vegas_state *state =
-                gsl_monte_vegas_alloc(dims);
-            gsl_monte_vegas_integrate(
-                &integrand, lower, upper,
-                dims, par->integration_bins, random,
-                state,
-                &result, &error
-            );
-            gsl_monte_vegas_free(state);
-            break;
+        else{
+            for (int t = 0; t<c->len; ++t)
+                value[i*c->len + t] = all[c->index[t]]*p;
         }
     }
+    return EXIT_SUCCESS;
+}
 
-    gsl_rng_free(random);
 
-    return (2*l + 1)*result
-    /interp_spline(&bg->D1, 0)/interp_spline(&bg->D1, 0);
-#endif
+/**
+    subtracts the control variate, the flat-sky (Kaiser) limit of the
+    den-den, den-rsd and rsd-rsd terms, from the components of value
+    (only from value[0] if component >= 0)
+**/
+
+static int average_multipoles_kaiser_subtract(
+    const struct average_multipoles_params *params,
+    double z,
+    double mu,
+    double weight,
+    int component,
+    double value[]
+)
+{
+    const struct functions_contributions *c = params->contributions;
+    const int ncomp = (int)params->l_len*(c != NULL ? c->len : 1);
+    const double p2 = (3*mu*mu - 1)/2., p4 = (35*pow(mu, 4) - 30*mu*mu + 3)/8.;
+    double coefficient[3][3], term[3];
+    double legendre[params->l_max + 1];
+
+    functions_flatsky_coefficients(
+        params->par, params->bg, params->integral, z, params->sep, coefficient
+    );
+    for (int k = 0; k<3; ++k)
+        term[k] = (coefficient[k][0] + coefficient[k][1]*p2 + coefficient[k][2]*p4)*weight;
+    gsl_sf_legendre_Pl_array(params->l_max, mu, legendre);
+
+    const int first = component >= 0 ? component : 0;
+    const int last = component >= 0 ? component + 1 : ncomp;
+    for (int n = first; n<last; ++n){
+        uint64_t terms;
+        const size_t i = average_multipoles_component(params, n, &terms);
+        double approximation = 0;
+        for (int k = 0; k<3; ++k)
+            if (terms & (UINT64_C(1) << functions_flatsky_terms[k]))
+                approximation += term[k];
+        value[n - first] -= approximation*legendre[params->l[i]];
+    }
+    return EXIT_SUCCESS;
 }
 
 
-/* integrand of single integrated terms for redshift averaged multipoles */
+/**
+    adds the exact integral of the control variate to the components
+    of integral_value; in mu it is just the orthogonality of the Legendre
+    polynomials (also on [0, 1] for auto-correlations, since they are all
+    even there), in z it is done with a fixed Gauss-Legendre quadrature
+**/
 
-#ifdef HAVE_CUBA
-static int average_multipoles_single_integrated_integrand(
-    const int *ndim, const cubareal var[],
-    const int *ncomp, cubareal value[],
-    void *p
+static int average_multipoles_kaiser_integral(
+    struct average_multipoles_params *params,
+    double integral_value[]
 )
-#else
-static double average_multipoles_single_integrated_integrand(
-    double *var, size_t dim, void *p
+{
+    const struct functions_contributions *c = params->contributions;
+    const int ncomp = (int)params->l_len*(c != NULL ? c->len : 1);
+    gsl_integration_glfixed_table *table =
+        gsl_integration_glfixed_table_alloc(AVERAGE_MULTIPOLES_KAISER_ORDER);
+
+    for (size_t k = 0; k<AVERAGE_MULTIPOLES_KAISER_ORDER; ++k){
+        double x, node_weight, weight, coefficient[3][3];
+        gsl_integration_glfixed_point(0, 1, k, &x, &node_weight, table);
+        const double z = average_multipoles_redshift(params, x, &weight);
+        functions_flatsky_coefficients(
+            params->par, params->bg, params->integral, z, params->sep, coefficient
+        );
+
+        for (int n = 0; n<ncomp; ++n){
+            uint64_t terms;
+            const int l = params->l[average_multipoles_component(params, n, &terms)];
+            if (l % 2 != 0 || l > 4) continue;
+            for (int t = 0; t<3; ++t)
+                if (terms & (UINT64_C(1) << functions_flatsky_terms[t]))
+                    integral_value[n] +=
+                        node_weight*weight*coefficient[t][l/2]/(2*l + 1);
+        }
+    }
+    gsl_integration_glfixed_table_free(table);
+    return EXIT_SUCCESS;
+}
+
+
+/* integrand of nonintegrated terms for redshift averaged multipoles */
+
+static int average_multipoles_nonintegrated_integrand(
+    const double var[],
+    int component,
+    double value[],
+    void *p
 )
-#endif
 {
     struct average_multipoles_params *params = (struct average_multipoles_params *) p;
     struct coffe_parameters_t *par = params->par;
@@ -344,208 +303,99 @@ static double average_multipoles_single_integrated_integrand(
     struct coffe_integrals_t *integral = params->integral;
     double sep = params->sep;
 
-    double z1 =
-        interp_spline(
-            &bg->z_as_chi,
-            interp_spline(&bg->comoving_distance, par->z_min) + sep/2.
-        );
-    double z2 =
-        interp_spline(
-            &bg->z_as_chi,
-            interp_spline(&bg->comoving_distance, par->z_max) - sep/2.
-        );
-
-    double z = (z2 - z1)*var[0] + z1;
-    double mu = 2*var[1] - 1;
-    double x = var[2];
-
-#ifdef HAVE_CUBA
-    if (params->l == 0){
-        value[0] = functions_single_integrated(
-            par, bg, integral, z, mu, sep, x
-        )
-       /interp_spline(&bg->conformal_Hz, z)/(1 + z);
-        return EXIT_SUCCESS;
+    double weight;
+    double z = average_multipoles_redshift(params, var[0], &weight);
+    double mu = average_multipoles_mu(par, var[1]);
+
+    if (component >= 0){
+        uint64_t terms;
+        const size_t i = average_multipoles_component(params, component, &terms);
+        value[0] = (
+            params->contributions == NULL ?
+            functions_nonintegrated(par, bg, integral, z, mu, sep) :
+            functions_nonintegrated_terms(
+                par, bg, integral, z, mu, sep, terms, NULL
+            )
+        )*gsl_sf_legendre_Pl(params->l[i], mu)*weight;
     }
-    else{
-        value[0] = functions_single_integrated(
-            par, bg, integral, z, mu, sep, x
-        )
-       *gsl_sf_legendre_Pl(params->l, mu)
-       /interp_spline(&bg->conformal_Hz, z)/(1 + z);
-        return EXIT_SUCCESS;
-    }
-#else
-    if (params->l == 0){
-        return functions_single_integrated(
-            par, bg, integral, z, mu, sep, x
-        )
-       /interp_spline(&bg->conformal_Hz, z)/(1 + z);
+    else if (params->contributions == NULL){
+        average_multipoles_fill(
+            params, mu, weight,
+            functions_nonintegrated(par, bg, integral, z, mu, sep),
+            NULL, value
+        );
     }
     else{
-        return functions_single_integrated(
-            par, bg, integral, z, mu, sep, x
-        )
-       *gsl_sf_legendre_Pl(params->l, mu)
-       /interp_spline(&bg->conformal_Hz, z)/(1 + z);
+        double all[COFFE_TERMS_LEN];
+        functions_nonintegrated_terms(
+            par, bg, integral, z, mu, sep, par->terms, all
+        );
+        average_multipoles_fill(params, mu, weight, 0, all, value);
     }
-#endif
+    if (params->kaiser)
+        average_multipoles_kaiser_subtract(params, z, mu, weight, component, value);
+    return EXIT_SUCCESS;
 }
 
 
-/* computes the average multipole of single integrated terms for given l and separation */
+/* integrand of single integrated terms for redshift averaged multipoles */
 
-static double average_multipoles_single_integrated(
-    struct coffe_parameters_t *par,
-    struct coffe_background_t *bg,
-    struct coffe_integrals_t *integral,
-    double sep,
-    int l
+static int average_multipoles_single_integrated_integrand(
+    const double var[],
+    int component,
+    double value[],
+    void *p
 )
 {
-    const int dims = 3;
-
-    struct average_multipoles_params test;
-    test.par = par;
-    test.bg = bg;
-    test.integral = integral;
-    test.sep = sep;
-    test.l = l;
+    struct average_multipoles_params *params = (struct average_multipoles_params *) p;
+    struct coffe_parameters_t *par = params->par;
+    struct coffe_background_t *bg = params->bg;
+    struct coffe_integrals_t *integral = params->integral;
+    double sep = params->sep;
 
-    int flag = 0;
-    int len = par->correlation_sources_len*(par->correlation_sources_len + 1)/2;
-    for (int i = 0; i<len; ++i){
-        if (
-            strcmp(par->corr_terms[i], "17") == 0 ||
-            strcmp(par->corr_terms[i], "71") == 0 ||
-            strcmp(par->corr_terms[i], "18") == 0 ||
-            strcmp(par->corr_terms[i], "81") == 0 ||
-            strcmp(par->corr_terms[i], "19") == 0 ||
-            strcmp(par->corr_terms[i], "91") == 0 ||
-            strcmp(par->corr_terms[i], "27") == 0 ||
-            strcmp(par->corr_terms[i], "72") == 0 ||
-            strcmp(par->corr_terms[i], "28") == 0 ||
-            strcmp(par->corr_terms[i], "82") == 0 ||
-            strcmp(par->corr_terms[i], "29") == 0 ||
-            strcmp(par->corr_terms[i], "92") == 0 ||
-            strcmp(par->corr_terms[i], "37") == 0 ||
-            strcmp(par->corr_terms[i], "73") == 0 ||
-            strcmp(par->corr_terms[i], "38") == 0 ||
-            strcmp(par->corr_terms[i], "83") == 0 ||
-            strcmp(par->corr_terms[i], "39") == 0 ||
-            strcmp(par->corr_terms[i], "93") == 0 ||
-            strcmp(par->corr_terms[i], "47") == 0 ||
-            strcmp(par->corr_terms[i], "74") == 0 ||
-            strcmp(par->corr_terms[i], "48") == 0 ||
-            strcmp(par->corr_terms[i], "84") == 0 ||
-            strcmp(par->corr_terms[i], "49") == 0 ||
-            strcmp(par->corr_terms[i], "94") == 0 ||
-            strcmp(par->corr_terms[i], "57") == 0 ||
-            strcmp(par->corr_terms[i], "75") == 0 ||
-            strcmp(par->corr_terms[i], "58") == 0 ||
-            strcmp(par->corr_terms[i], "85") == 0 ||
-            strcmp(par->corr_terms[i], "59") == 0 ||
-            strcmp(par->corr_terms[i], "95") == 0 ||
-            strcmp(par->corr_terms[i], "67") == 0 ||
-            strcmp(par->corr_terms[i], "76") == 0 ||
-            strcmp(par->corr_terms[i], "68") == 0 ||
-            strcmp(par->corr_terms[i], "86") == 0 ||
-            strcmp(par->corr_terms[i], "69") == 0 ||
-            strcmp(par->corr_terms[i], "96") == 0
-        ) ++flag;
+    double weight;
+    double z = average_multipoles_redshift(params, var[0], &weight);
+    double mu = average_multipoles_mu(par, var[1]);
+    double x;
+    weight *= functions_los_transform(par->integration_transforms[0], var[2], &x);
+
+    if (component >= 0){
+        uint64_t terms;
+        const size_t i = average_multipoles_component(params, component, &terms);
+        value[0] = (
+            params->contributions == NULL ?
+            functions_single_integrated(par, bg, integral, z, mu, sep, x) :
+            functions_single_integrated_terms(
+                par, bg, integral, z, mu, sep, x, terms, NULL
+            )
+        )*gsl_sf_legendre_Pl(params->l[i], mu)*weight;
     }
-    if (flag == 0) return 0;
-
-#ifdef HAVE_CUBA
-    int nregions, neval, fail;
-    double result[1], error[1], prob[1];
-    Cuhre(dims, 1,
-        average_multipoles_single_integrated_integrand,
-        (void *)&test, 1,
-        5e-4, 0, 0,
-        1, par->integration_bins, 7,
-        NULL, NULL,
-        &nregions, &neval, &fail, result, error, prob
-    );
-    return (2*l + 1)*result[0]
-    /interp_spline(&bg->D1, 0)/interp_spline(&bg->D1, 0);
-#else
-    gsl_monte_function integrand;
-    integrand.f = &average_multipoles_single_integrated_integrand;
-    integrand.dim = dims;
-    integrand.params = &test;
-    gsl_rng *random;
-    gsl_rng_env_setup();
-    const gsl_rng_type *T = gsl_rng_default;
-    random = gsl_rng_alloc(T);
-    double result, error;
-    double lower[dims];
-    double upper[dims];
-    for (int i = 0; i<dims; ++i){
-        lower[i] = 0.0;
-        upper[i] = 1.0;
+    else if (params->contributions == NULL){
+        average_multipoles_fill(
+            params, mu, weight,
+            functions_single_integrated(par, bg, integral, z, mu, sep, x),
+            NULL, value
+        );
     }
-
-    switch (par->integration_method){
-        case 0:{
-            gsl_monte_plain_state *state =
-                gsl_monte_plain_alloc(dims);
-            gsl_monte_plain_integrate(
-                &integrand, lower, upper,
-                dims, par->integration_bins, random,
-                state,
-                &result, &error
-            );
-            gsl_monte_plain_free(state);
-            break;
-        }
-        case 1:{
-            gsl_monte_miser_state *state =
-                gsl_monte_miser_alloc(dims);
-            gsl_monte_miser_integrate(
-                &integrand, lower, upper,
-                dims, par->integration_bins, random,
-                state,
-                &result, &error
-            );
-            gsl_monte_miser_free(state);
-            break;
-        }
-        case 2:{
-            gsl_monte_vegas_state *state =
-                gsl_monte_vegas_alloc(dims);
-            gsl_monte_vegas_integrate(
-                &integrand, lower, upper,
-                dims, par->integration_bins, random,
-                state,
-                &result, &error
-            );
-            gsl_monte_vegas_free(state);
-            break;
-        }
+    else{
+        double all[COFFE_TERMS_LEN];
+        functions_single_integrated_terms(
+            par, bg, integral, z, mu, sep, x, par->terms, all
+        );
+        average_multipoles_fill(params, mu, weight, 0, all, value);
     }
-
-    gsl_rng_free(random);
-
-    return (2*l + 1)*result
-    /interp_spline(&bg->D1, 0)/interp_spline(&bg->D1, 0);
-#endif
+    return EXIT_SUCCESS;
 }
 
 
 /* integrand of double integrated terms for redshift averaged multipoles */
 
-#ifdef HAVE_CUBA
 static int average_multipoles_double_integrated_integrand(
-    const int *ndim, const cubareal var[],
-    const int *ncomp, cubareal value[],
+    const double var[],
+    int component,
+    double value[],
     void *p
 )
-#else
-static double average_multipoles_double_integrated_integrand(
-    double *var, size_t dim, void *p
-)
-#endif
 {
     struct average_multipoles_params *params = (struct average_multipoles_params *) p;
     struct coffe_parameters_t *par = params->par;
@@ -553,180 +403,436 @@ static double average_multipoles_double_integrated_integrand(
     struct coffe_integrals_t *integral = params->integral;
     double sep = params->sep;
 
-    double z1 =
-        interp_spline(
-            &bg->z_as_chi,
-            interp_spline(&bg->comoving_distance, par->z_min) + sep/2.
-        );
-    double z2 =
-        interp_spline(
-            &bg->z_as_chi,
-            interp_spline(&bg->comoving_distance, par->z_max) - sep/2.
-        );
-
-    double z = (z2 - z1)*var[0] + z1;
-    double mu = 2*var[1] - 1;
-    double x1 = var[2], x2 = var[3];
-
-#ifdef HAVE_CUBA
-    if (params->l == 0){
-        value[0] = functions_double_integrated(
-            par, bg, integral, z, mu, sep, x1, x2
-        )
-       /interp_spline(&bg->conformal_Hz, z)/(1 + z);
-        return EXIT_SUCCESS;
+    double weight;
+    double z = average_multipoles_redshift(params, var[0], &weight);
+    double mu = average_multipoles_mu(par, var[1]);
+    double x1, x2;
+    weight *=
+        functions_los_transform(par->integration_transforms[1], var[2], &x1)
+       *functions_los_transform(par->integration_transforms[1], var[3], &x2);
+
+    if (component >= 0){
+        uint64_t terms;
+        const size_t i = average_multipoles_component(params, component, &terms);
+        value[0] = (
+            params->contributions == NULL ?
+            functions_double_integrated(par, bg, integral, z, mu, sep, x1, x2) :
+            functions_double_integrated_terms(
+                par, bg, integral, z, mu, sep, x1, x2, terms, NULL
+            )
+        )*gsl_sf_legendre_Pl(params->l[i], mu)*weight;
     }
-    else{
-        value[0] = functions_double_integrated(
-            par, bg, integral, z, mu, sep, x1, x2
-        )
-       *gsl_sf_legendre_Pl(params->l, mu)
-       /interp_spline(&bg->conformal_Hz, z)/(1 + z);
-        return EXIT_SUCCESS;
-    }
-#else
-    if (params->l == 0){
-        return functions_double_integrated(
-            par, bg, integral, z, mu, sep, x1, x2
-        )
-       /interp_spline(&bg->conformal_Hz, z)/(1 + z);
+    else if (params->contributions == NULL){
+        average_multipoles_fill(
+            params, mu, weight,
+            functions_double_integrated(par, bg, integral, z, mu, sep, x1, x2),
+            NULL, value
+        );
     }
     else{
-        return functions_double_integrated(
-            par, bg, integral, z, mu, sep, x1, x2
-        )
-       *gsl_sf_legendre_Pl(params->l, mu)
-       /interp_spline(&bg->conformal_Hz, z)/(1 + z);
+        double all[COFFE_TERMS_LEN];
+        functions_double_integrated_terms(
+            par, bg, integral, z, mu, sep, x1, x2, par->terms, all
+        );
+        average_multipoles_fill(params, mu, weight, 0, all, value);
     }
-#endif
+    return EXIT_SUCCESS;
 }
 
 
-/* computes the average multipole of double integrated terms for given l and separation */
+/**
+    computes the average multipoles l[0], ..., l[l_len - 1] of the
+    terms in the bitmask terms for given separation, all at once;
+    if values is not NULL, each term is also stored separately
+    (as values[i*corr_terms_len + k] for the multipole l[i]);
+    grid is the VEGAS grid kept between separations (or NULL);
+    the estimated errors are stored in errors (the terms share the
+    samples, so their errors are added linearly); for the nonintegrated
+    terms, the flat-sky Kaiser limit is used as a control variate if
+    integration_control_variate is set
+**/
 
-static double average_multipoles_double_integrated(
+static int average_multipoles_compute(
     struct coffe_parameters_t *par,
     struct coffe_background_t *bg,
     struct coffe_integrals_t *integral,
     double sep,
-    int l
+    size_t l_len,
+    const int l[],
+    integrators_function integrand,
+    int dims,
+    const uint64_t terms,
+    double epsrel,
+    struct integrators_grid *grid,
+    double result[],
+    double errors[],
+    double values[]
 )
 {
-    const int dims = 4;
+    for (size_t i = 0; i<l_len; ++i) result[i] = 0, errors[i] = 0;
+    if (!(par->terms & terms)) return EXIT_SUCCESS;
 
     struct average_multipoles_params test;
+    struct functions_contributions c;
     test.par = par;
     test.bg = bg;
     test.integral = integral;
     test.sep = sep;
     test.l = l;
-
-    int flag = 0;
-    int len = par->correlation_sources_len*(par->correlation_sources_len + 1)/2;
-    for (int i = 0; i<len; ++i){
-        if (
-            strcmp(par->corr_terms[i], "77") == 0 || // g4-g4
-            strcmp(par->corr_terms[i], "88") == 0 || // g5-g5
-            strcmp(par->corr_terms[i], "99") == 0 || // len-len
-            strcmp(par->corr_terms[i], "78") == 0 || // g4-g5
-            strcmp(par->corr_terms[i], "87") == 0 || // g5-g4
-            strcmp(par->corr_terms[i], "79") == 0 || // g4-len
-            strcmp(par->corr_terms[i], "97") == 0 || // len-g4
-            strcmp(par->corr_terms[i], "89") == 0 || // g5-len
-            strcmp(par->corr_terms[i], "98") == 0    // len-g5
-        ) ++flag;
+    test.l_len = l_len;
+    test.l_max = 0;
+    for (size_t i = 0; i<l_len; ++i)
+        if (l[i] > test.l_max) test.l_max = l[i];
+    test.contributions = NULL;
+    if (values != NULL){
+        functions_contributions_init(par->terms & terms, &c);
+        test.contributions = &c;
     }
-    if (flag == 0) return 0;
-
-#ifdef HAVE_CUBA
-    int nregions, neval, fail;
-    double result[1], error[1], prob[1];
-    Cuhre(dims, 1,
-        average_multipoles_double_integrated_integrand,
-        (void *)&test, 1,
-        5e-4, 0, 0,
-        1, par->integration_bins, 7,
-        NULL, NULL,
-        &nregions, &neval, &fail, result, error, prob
+    test.kaiser =
+        par->integration_control_variate &&
+        terms == COFFE_TERMS_NONINTEGRATED &&
+        (par->terms & COFFE_TERMS_FLATSKY);
+
+    const int len = values != NULL ? c.len : 1;
+    const int ncomp = (int)l_len*len;
+    double *integral_value = (double *)coffe_malloc(sizeof(double)*2*ncomp);
+    double *error = integral_value + ncomp;
+    const double D1_0 = interp_spline(&bg->D1, 0);
+    integrators_monte(
+        par, terms, integrand, &test, dims, ncomp, epsrel,
+        (2*test.l_max + 1)/D1_0/D1_0, grid, integral_value, error
     );
-    return (2*l + 1)*result[0]
-    /interp_spline(&bg->D1, 0)/interp_spline(&bg->D1, 0);
-#else
-    gsl_monte_function integrand;
-    integrand.f = &average_multipoles_double_integrated_integrand;
-    integrand.dim = dims;
-    integrand.params = &test;
-    gsl_rng *random;
-    gsl_rng_env_setup();
-    const gsl_rng_type *T = gsl_rng_default;
-    random = gsl_rng_alloc(T);
-    double result, error;
-    double lower[dims];
-    double upper[dims];
-    for (int i = 0; i<dims; ++i){
-        lower[i] = 0.0;
-        upper[i] = 1.0;
+    if (test.kaiser)
+        average_multipoles_kaiser_integral(&test, integral_value);
+
+    for (size_t i = 0; i<l_len; ++i){
+        const double factor = (2*l[i] + 1)/D1_0/D1_0;
+        if (values == NULL){
+            result[i] = factor*integral_value[i];
+            errors[i] = factor*error[i];
+        }
+        else{
+            double all[COFFE_TERMS_LEN];
+            for (int t = 0; t<c.len; ++t){
+                all[c.index[t]] = integral_value[i*c.len + t];
+                result[i] += factor*all[c.index[t]];
+                errors[i] += factor*error[i*c.len + t];
+            }
+            functions_contributions_scatter(
+                par, par->terms & terms, all, factor,
+                values + i*par->corr_terms_len
+            );
+        }
     }
+    free(integral_value);
+    return EXIT_SUCCESS;
+}
 
-    switch (par->integration_method){
-        case 0:{
-            gsl_monte_plain_state *state =
-                gsl_monte_plain_alloc(dims);
-            gsl_monte_plain_integrate(
-                &integrand, lower, upper,
-                dims, par->integration_bins, random,
-                state,
-                &result, &error
-            );
-            gsl_monte_plain_free(state);
-            break;
+
+/**
+    the VEGAS grids of the three kinds of terms, kept
+    between separations
+**/
+
+struct average_multipoles_grids
+{
+    struct integrators_grid nonintegrated, single, twice;
+};
+
+
+/**
+    computes all of the average multipoles (all of the terms)
+    for given separation, and their estimated errors
+**/
+
+static int average_multipoles_point(
+    struct coffe_parameters_t *par,
+    struct coffe_background_t *bg,
+    struct coffe_integrals_t *integral,
+    struct average_multipoles_grids *grids,
+    double sep,
+    size_t l_len,
+    const int l[],
+    double result[],
+    double error[],
+    double values[]
+)
+{
+    double temp[l_len], temp_error[l_len];
+    average_multipoles_compute(
+        par, bg, integral, sep, l_len, l,
+        &average_multipoles_nonintegrated_integrand, 2,
+        COFFE_TERMS_NONINTEGRATED, 1e-3,
+        grids != NULL ? &grids->nonintegrated : NULL, result, error, values
+    );
+    for (size_t i = 0; i<l_len; ++i) error[i] *= error[i];
+    average_multipoles_compute(
+        par, bg, integral, sep, l_len, l,
+        &average_multipoles_single_integrated_integrand, 3,
+        COFFE_TERMS_SINGLE_INTEGRATED, 5e-4,
+        grids != NULL ? &grids->single : NULL, temp, temp_error, values
+    );
+    for (size_t i = 0; i<l_len; ++i)
+        result[i] += temp[i], error[i] += temp_error[i]*temp_error[i];
+    average_multipoles_compute(
+        par, bg, integral, sep, l_len, l,
+        &average_multipoles_double_integrated_integrand, 4,
+        COFFE_TERMS_DOUBLE_INTEGRATED, 5e-4,
+        grids != NULL ? &grids->twice : NULL, temp, temp_error, values
+    );
+    for (size_t i = 0; i<l_len; ++i)
+        result[i] += temp[i], error[i] += temp_error[i]*temp_error[i];
+    for (size_t i = 0; i<l_len; ++i) error[i] = sqrt(error[i]);
+    return EXIT_SUCCESS;
+}
+
+
+/**
+    stores the average multipoles at the separation with index j, from the
+    ones which don't vanish by symmetry (in result, error, and values, as
+    in average_multipoles_point); the rest are set to zero
+**/
+
+static int average_multipoles_store(
+    struct coffe_parameters_t *par,
+    struct coffe_average_multipoles_t *ramp,
+    size_t j,
+    const double result[],
+    const double error[],
+    const double values[]
+)
+{
+    for (size_t i = 0, n = 0; i<ramp->l_len; ++i){
+        double *contributions = ramp->contributions == NULL ? NULL :
+            ramp->contributions + (i*ramp->sep_len + j)*ramp->contributions_len;
+        if (coffe_multipole_vanishes(par, ramp->l[i])){
+            ramp->result[i][j] = 0;
+            if (ramp->error != NULL) ramp->error[i*ramp->sep_len + j] = 0;
+            if (contributions != NULL)
+                for (size_t t = 0; t<ramp->contributions_len; ++t)
+                    contributions[t] = 0;
+            continue;
         }
-        case 1:{
-            gsl_monte_miser_state *state =
-                gsl_monte_miser_alloc(dims);
-            gsl_monte_miser_integrate(
-                &integrand, lower, upper,
-                dims, par->integration_bins, random,
-                state,
-                &result, &error
+        ramp->result[i][j] = result[n];
+        if (ramp->error != NULL) ramp->error[i*ramp->sep_len + j] = error[n];
+        if (contributions != NULL)
+            memcpy(
+                contributions,
+                values + n*ramp->contributions_len,
+                sizeof(double)*ramp->contributions_len
             );
-            gsl_monte_miser_free(state);
-            break;
+        ++n;
+    }
+    return EXIT_SUCCESS;
+}
+
+
+/**
+    all of the average multipoles of all of the windows in redshift (the
+    redshift bins) from the multipoles at fixed redshift: for each window
+    and separation, they are computed at the average_multipoles_z_order
+    Gauss-Legendre nodes of its range in redshift (all of the points of
+    all of the windows at once, see coffe_multipoles_points), and summed
+    with the weight 1/(H(z)(1 + z)); the errors of the nodes are added
+    in quadrature
+**/
+
+static int average_multipoles_tabulated(
+    struct coffe_parameters_t *par,
+    struct coffe_background_t *bg,
+    struct coffe_integrals_t *integral,
+    struct coffe_average_multipoles_t ramp[],
+    size_t l_len,
+    const int l[]
+)
+{
+    const size_t order = (size_t)par->average_multipoles_z_order;
+    const size_t contributions_len = ramp[0].contributions_len;
+    size_t len = 0;
+    for (int bin = 0; bin<par->z_bins_len; ++bin)
+        len += ramp[bin].sep_len*order;
+
+    /* all of the points, window after window, with index (offset + j)*order + k */
+    double *z = (double *)coffe_malloc(sizeof(double)*len);
+    double *sep = (double *)coffe_malloc(sizeof(double)*len);
+    double *weight = (double *)coffe_malloc(sizeof(double)*len);
+    gsl_integration_glfixed_table *table = gsl_integration_glfixed_table_alloc(order);
+    for (int bin = 0, offset = 0; bin<par->z_bins_len; offset += ramp[bin].sep_len, ++bin){
+        coffe_redshift_bin(par, bin);
+        for (size_t j = 0; j<ramp[bin].sep_len; ++j){
+            struct average_multipoles_params params;
+            params.par = par;
+            params.bg = bg;
+            params.sep = ramp[bin].sep[j]*COFFE_H0;
+            for (size_t k = 0; k<order; ++k){
+                const size_t index = (offset + j)*order + k;
+                double x, node_weight;
+                gsl_integration_glfixed_point(0, 1, k, &x, &node_weight, table);
+                z[index] = average_multipoles_redshift(&params, x, &weight[index]);
+                weight[index] *= node_weight;
+                sep[index] = ramp[bin].sep[j];
+            }
         }
-        case 2:{
-            gsl_monte_vegas_state *state =
-                gsl_monte_vegas_alloc(dims);
-            gsl_monte_vegas_integrate(
-                &integrand, lower, upper,
-                dims, par->integration_bins, random,
-                state,
-                &result, &error
-            );
-            gsl_monte_vegas_free(state);
-            break;
+    }
+    gsl_integration_glfixed_table_free(table);
+
+    double *points = (double *)coffe_malloc(sizeof(double)*2*len*l_len);
+    double *points_error = points + len*l_len;
+    double *points_values = NULL;
+    if (ramp[0].contributions != NULL)
+        points_values = (double *)coffe_malloc(
+            sizeof(double)*len*l_len*contributions_len
+        );
+    coffe_multipoles_points(
+        par, bg, integral, len, z, sep, l_len, l,
+        points, points_error, points_values
+    );
+
+    double *result = (double *)coffe_malloc(sizeof(double)*2*l_len);
+    double *error = result + l_len;
+    double *values = points_values != NULL ?
+        (double *)coffe_malloc(sizeof(double)*l_len*contributions_len) : NULL;
+    for (int bin = 0, offset = 0; bin<par->z_bins_len; offset += ramp[bin].sep_len, ++bin){
+        for (size_t j = 0; j<ramp[bin].sep_len; ++j){
+            for (size_t n = 0; n<l_len; ++n){
+                result[n] = 0, error[n] = 0;
+                for (size_t t = 0; t<contributions_len && values != NULL; ++t)
+                    values[n*contributions_len + t] = 0;
+            }
+            for (size_t k = 0; k<order; ++k){
+                const size_t index = (offset + j)*order + k;
+                for (size_t n = 0; n<l_len; ++n){
+                    result[n] += weight[index]*points[index*l_len + n];
+                    error[n] += pow(weight[index]*points_error[index*l_len + n], 2);
+                    for (size_t t = 0; t<contributions_len && values != NULL; ++t)
+                        values[n*contributions_len + t] +=
+                            weight[index]*points_values[(index*l_len + n)*contributions_len + t];
+                }
+            }
+            for (size_t n = 0; n<l_len; ++n) error[n] = sqrt(error[n]);
+            average_multipoles_store(par, &ramp[bin], j, result, error, values);
         }
     }
 
-    gsl_rng_free(random);
+    free(z);
+    free(sep);
+    free(weight);
+    free(points);
+    free(points_values);
+    free(result);
+    free(values);
+    return EXIT_SUCCESS;
+}
 
-    return (2*l + 1)*result
-    /interp_spline(&bg->D1, 0)/interp_spline(&bg->D1, 0);
-#endif
+
+/**
+    all of the average multipoles of all of the windows in redshift (the
+    redshift bins) with the Monte Carlo integration over the redshift, with
+    all of the separations of all of the windows done in parallel
+**/
+
+static int average_multipoles_integrated(
+    struct coffe_parameters_t *par,
+    struct coffe_background_t *bg,
+    struct coffe_integrals_t *integral,
+    struct coffe_average_multipoles_t ramp[],
+    size_t l_len,
+    const int l[]
+)
+{
+    /* all of the pairs of windows and separations, largest separations first */
+    size_t len = 0;
+    for (int bin = 0; bin<par->z_bins_len; ++bin)
+        len += ramp[bin].sep_len;
+    int *task_bin = (int *)coffe_malloc(sizeof(int)*len);
+    size_t *task_sep = (size_t *)coffe_malloc(sizeof(size_t)*len);
+    double *cost = (double *)coffe_malloc(sizeof(double)*len);
+    for (int bin = 0, n = 0; bin<par->z_bins_len; ++bin){
+        for (size_t j = 0; j<ramp[bin].sep_len; ++j, ++n){
+            task_bin[n] = bin;
+            task_sep[n] = j;
+            cost[n] = ramp[bin].sep[j];
+        }
+    }
+    size_t *order = (size_t *)coffe_malloc(sizeof(size_t)*len);
+    coffe_order_by_cost(cost, len, order);
+    const int nthreads = coffe_threads_split(par, cost, len);
+
+    #pragma omp parallel num_threads(nthreads)
+    {
+        /* each thread has its own copy of the parameters, with its own window */
+        struct coffe_parameters_t *local =
+            (struct coffe_parameters_t *)coffe_malloc(sizeof(struct coffe_parameters_t));
+        *local = *par;
+
+        /* each thread keeps its own VEGAS grids between the separations */
+        struct average_multipoles_grids grids, *grids_ptr = NULL;
+        if (par->integration_warm_start){
+            integrators_grid_init(&grids.nonintegrated, 2);
+            integrators_grid_init(&grids.single, 3);
+            integrators_grid_init(&grids.twice, 4);
+            grids_ptr = &grids;
+        }
+
+        #pragma omp for schedule(dynamic, 1)
+        for (size_t k = 0; k<len; ++k){
+            const int bin = task_bin[order[k]];
+            const size_t j = task_sep[order[k]];
+            struct coffe_average_multipoles_t *window = &ramp[bin];
+            coffe_redshift_bin(local, bin);
+
+            double *result = (double *)coffe_malloc(sizeof(double)*2*window->l_len);
+            double *error = result + window->l_len;
+            double *values = NULL;
+            if (window->contributions != NULL)
+                values = (double *)coffe_malloc(
+                    sizeof(double)*window->l_len*window->contributions_len
+                );
+
+            if (l_len > 0)
+                average_multipoles_point(
+                    local, bg, integral, grids_ptr,
+                    window->sep[j]*COFFE_H0, l_len, l,
+                    result, error, values
+                );
+
+            average_multipoles_store(par, window, j, result, error, values);
+            free(result);
+            free(values);
+        }
+
+        if (grids_ptr != NULL){
+            integrators_grid_free(&grids.nonintegrated);
+            integrators_grid_free(&grids.single);
+            integrators_grid_free(&grids.twice);
+        }
+        free(local);
+    }
+    par->nthreads_inner = 1;
+    free(task_bin);
+    free(task_sep);
+    free(cost);
+    free(order);
+    return EXIT_SUCCESS;
 }
 
 
+/**
+    computes the average multipoles of all of the windows in redshift
+    (the redshift bins) at once, ramp[bin] for each of them
+**/
+
 int coffe_average_multipoles_init(
     struct coffe_parameters_t *par,
     struct coffe_background_t *bg,
     struct coffe_integrals_t *integral,
-    struct coffe_average_multipoles_t *ramp
+    struct coffe_average_multipoles_t ramp[]
 )
 {
-#ifdef HAVE_CUBA
-    cubacores(0, 10000);
-#endif
+    integrators_init(par);
+    for (int bin = 0; bin<par->z_bins_len; ++bin)
+        ramp[bin].flag = 0;
     if (par->output_type == 3){
-        ramp->flag = 1;
         clock_t start, end;
         printf("Calculating the redshift averaged multipoles...\n");
         start = clock();
@@ -734,58 +840,62 @@ int coffe_average_multipoles_init(
         gsl_error_handler_t *default_handler =
             gsl_set_error_handler_off();
 
-        alloc_double_matrix(
-            &ramp->result,
-            par->multipole_values_len,
-            par->sep_len
-        );
-        ramp->l = (int *)coffe_malloc(sizeof(int)*par->multipole_values_len);
-        for (int i = 0; i<par->multipole_values_len; ++i){
-            ramp->l[i] = (int)par->multipole_values[i];
-        }
-        ramp->l_len = (size_t)par->multipole_values_len;
-
-        ramp->sep = (double *)coffe_malloc(sizeof(double)*par->sep_len);
-        for (size_t i = 0; i<par->sep_len; ++i){
-            ramp->sep[i] = (double)par->sep[i];
-        }
-        ramp->sep_len = (size_t)par->sep_len;
-        average_multipoles_check_range(
-            &ramp->sep, &ramp->sep_len,
-            par->z_min, par->z_max, bg
-        );
+        for (int bin = 0; bin<par->z_bins_len; ++bin){
+            struct coffe_average_multipoles_t *window = &ramp[bin];
+            coffe_redshift_bin(par, bin);
+            window->flag = 1;
 
-        #pragma omp parallel for num_threads(par->nthreads) collapse(2)
-        for (size_t i = 0; i<ramp->l_len; ++i){
-            for (size_t j = 0; j<ramp->sep_len; ++j){
-                ramp->result[i][j] =
-                    average_multipoles_nonintegrated(
-                        par, bg, integral,
-                        ramp->sep[j]*COFFE_H0, ramp->l[i]
-                    );
+            alloc_double_matrix(
+                &window->result,
+                par->multipole_values_len,
+                par->sep_len
+            );
+            window->l = (int *)coffe_malloc(sizeof(int)*par->multipole_values_len);
+            for (int i = 0; i<par->multipole_values_len; ++i){
+                window->l[i] = (int)par->multipole_values[i];
             }
-        }
-        #pragma omp parallel for num_threads(par->nthreads) collapse(2)
-        for (size_t i = 0; i<ramp->l_len; ++i){
-            for (size_t j = 0; j<ramp->sep_len; ++j){
-                ramp->result[i][j] +=
-                    average_multipoles_single_integrated(
-                        par, bg, integral,
-                        ramp->sep[j]*COFFE_H0, ramp->l[i]
-                    );
+            window->l_len = (size_t)par->multipole_values_len;
+
+            window->sep = (double *)coffe_malloc(sizeof(double)*par->sep_len);
+            for (size_t i = 0; i<par->sep_len; ++i){
+                window->sep[i] = (double)par->sep[i];
             }
-        }
-        #pragma omp parallel for num_threads(par->nthreads) collapse(2)
-        for (size_t i = 0; i<ramp->l_len; ++i){
-            for (size_t j = 0; j<ramp->sep_len; ++j){
-                ramp->result[i][j] +=
-                    average_multipoles_double_integrated(
-                        par, bg, integral,
-                        ramp->sep[j]*COFFE_H0, ramp->l[i]
-                    );
+            window->sep_len = (size_t)par->sep_len;
+            average_multipoles_check_range(
+                &window->sep, &window->sep_len,
+                par->z_min, par->z_max, bg
+            );
+
+            window->contributions = NULL;
+            window->contributions_len = 0;
+            if (par->output_contributions){
+                window->contributions_len = (size_t)par->corr_terms_len;
+                window->contributions = (double *)coffe_malloc(
+                    sizeof(double)*window->l_len*window->sep_len*window->contributions_len
+                );
             }
+
+            window->error = NULL;
+            if (par->output_errors)
+                window->error = (double *)coffe_malloc(
+                    sizeof(double)*window->l_len*window->sep_len
+                );
         }
 
+        /* only the multipoles which don't vanish by symmetry are integrated */
+        int *l = (int *)coffe_malloc(sizeof(int)*ramp[0].l_len);
+        size_t l_len = 0;
+        for (size_t i = 0; i<ramp[0].l_len; ++i)
+            if (!coffe_multipole_vanishes(par, ramp[0].l[i]))
+                l[l_len++] = ramp[0].l[i];
+
+        if (par->average_multipoles_z_order > 0)
+            average_multipoles_tabulated(par, bg, integral, ramp, l_len, l);
+        else
+            average_multipoles_integrated(par, bg, integral, ramp, l_len, l);
+        free(l);
+        coffe_redshift_bin(par, 0);
+
         end = clock();
 
         printf("Redshift averaged multipoles calculated in %.2f s\n",
@@ -808,6 +918,8 @@ int coffe_average_multipoles_free(
         free(ramp->result);
         free(ramp->l);
         free(ramp->sep);
+        free(ramp->contributions);
+        free(ramp->error);
         ramp->flag = 0;
     }
     return EXIT_SUCCESS;
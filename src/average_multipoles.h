@@ -26,6 +26,11 @@ struct coffe_average_multipoles_t
     size_t sep_len;
     int *l;
     size_t l_len;
+    /* the separate terms (as in corr_terms) if output_contributions is set, otherwise NULL */
+    double *contributions; /* index = (i*sep_len + j)*contributions_len + term */
+    size_t contributions_len;
+    /* the estimated integration error if output_errors is set, otherwise NULL */
+    double *error; /* index = i*sep_len + j */
     int flag;
 };
 
@@ -33,7 +38,7 @@ int coffe_average_multipoles_init(
     struct coffe_parameters_t *par,
     struct coffe_background_t *bg,
     struct coffe_integrals_t *integral,
-    struct coffe_average_multipoles_t *ramp
+    struct coffe_average_multipoles_t ramp[]
 );
 
 int coffe_average_multipoles_free(
@@ -224,6 +224,26 @@ static double integrand_comoving(
     return integrand;
 }
 
+/**
+    the function G of a population with magnification bias s
+    and evolution bias fevo, which enters the Doppler terms
+**/
+
+static double background_G(
+    double conformal_Hz,
+    double conformal_Hz_prime,
+    double comoving_distance,
+    double s,
+    double fevo
+)
+{
+    return
+        conformal_Hz_prime/pow(conformal_Hz, 2)
+       +(2 - 5*s)/(comoving_distance*conformal_Hz)
+       +5*s
+       -fevo;
+}
+
 /**
     computes and stores all the background functions
 **/
@@ -369,33 +389,20 @@ int coffe_background_init(
 
         (temp_bg->comoving_distance)[i] = temp_comoving_result; // dimensionless
         if (z > 1E-10){
-            (temp_bg->G1)[i] =
-                (temp_bg->conformal_Hz_prime)[i]
-                    /pow((temp_bg->conformal_Hz)[i], 2)
-                    +
-                    (2 - 5*interp_spline(&par->magnification_bias1, z))
-                   /(
-                        (temp_bg->comoving_distance[i])
-                       *(temp_bg->conformal_Hz)[i]
-                    )
-                    +
-                    5*interp_spline(&par->magnification_bias1, z)
-                    -
-                    interp_spline(&par->evolution_bias1, z);
-
-            (temp_bg->G2)[i] =
-                (temp_bg->conformal_Hz_prime)[i]
-                    /pow((temp_bg->conformal_Hz)[i], 2)
-                    +
-                    (2 - 5*interp_spline(&par->magnification_bias2, z))
-                   /(
-                        (temp_bg->comoving_distance[i])
-                       *(temp_bg->conformal_Hz)[i]
-                    )
-                    +
-                    5*interp_spline(&par->magnification_bias2, z)
-                    -
-                    interp_spline(&par->evolution_bias2, z);
+            (temp_bg->G1)[i] = background_G(
+                (temp_bg->conformal_Hz)[i],
+                (temp_bg->conformal_Hz_prime)[i],
+                (temp_bg->comoving_distance)[i],
+                interp_spline(&par->magnification_bias1, z),
+                interp_spline(&par->evolution_bias1, z)
+            );
+            (temp_bg->G2)[i] = background_G(
+                (temp_bg->conformal_Hz)[i],
+                (temp_bg->conformal_Hz_prime)[i],
+                (temp_bg->comoving_distance)[i],
+                interp_spline(&par->magnification_bias2, z),
+                interp_spline(&par->evolution_bias2, z)
+            );
         }
         else{
             (temp_bg->G1)[i] = 0;
@@ -507,6 +514,55 @@ int coffe_background_init(
     return EXIT_SUCCESS;
 }
 
+/**
+    recomputes G1 and G2 for the current populations 1 and 2
+    (see coffe_tracer_pair), on the same redshifts as the rest
+    of the background
+**/
+
+int coffe_background_tracers(
+    struct coffe_parameters_t *par,
+    struct coffe_background_t *bg
+)
+{
+    const size_t len = bg->conformal_Hz.spline->size;
+    const double *z = bg->conformal_Hz.spline->x;
+    double *G1 = (double *)coffe_malloc(sizeof(double)*len);
+    double *G2 = (double *)coffe_malloc(sizeof(double)*len);
+
+    for (size_t i = 0; i<len; ++i){
+        if (z[i] > 1E-10){
+            G1[i] = background_G(
+                bg->conformal_Hz.spline->y[i],
+                bg->conformal_Hz_prime.spline->y[i],
+                bg->comoving_distance.spline->y[i],
+                interp_spline(&par->magnification_bias1, z[i]),
+                interp_spline(&par->evolution_bias1, z[i])
+            );
+            G2[i] = background_G(
+                bg->conformal_Hz.spline->y[i],
+                bg->conformal_Hz_prime.spline->y[i],
+                bg->comoving_distance.spline->y[i],
+                interp_spline(&par->magnification_bias2, z[i]),
+                interp_spline(&par->evolution_bias2, z[i])
+            );
+        }
+        else{
+            G1[i] = 0;
+            G2[i] = 0;
+        }
+    }
+
+    free_spline(&bg->G1);
+    free_spline(&bg->G2);
+    init_spline(&bg->G1, (double *)z, G1, len, par->interp_method);
+    init_spline(&bg->G2, (double *)z, G2, len, par->interp_method);
+
+    free(G1);
+    free(G2);
+    return EXIT_SUCCESS;
+}
+
 int coffe_background_free(
     struct coffe_background_t *bg
 )
@@ -52,6 +52,11 @@ int coffe_background_init(
     struct coffe_background_t *bg
 );
 
+int coffe_background_tracers(
+    struct coffe_parameters_t *par,
+    struct coffe_background_t *bg
+);
+
 int coffe_background_free(
     struct coffe_background_t *bg
 );
@@ -18,6 +18,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <math.h>
 #include <string.h>
 #include <time.h>
 #include <stdarg.h>
@@ -591,3 +592,172 @@ double interp_spline(
     return gsl_spline_eval(interp->spline, value, interp->accel);
 }
 
+
+struct common_task
+{
+    double cost;
+    size_t index;
+};
+
+static int common_compare_tasks(
+    const void *a,
+    const void *b
+)
+{
+    const struct common_task *ta = (const struct common_task *)a;
+    const struct common_task *tb = (const struct common_task *)b;
+    if (ta->cost > tb->cost) return -1;
+    else if (ta->cost < tb->cost) return 1;
+    else if (ta->index < tb->index) return -1;
+    else if (ta->index > tb->index) return 1;
+    else return 0;
+}
+
+
+/**
+    fills order with the indices of the tasks sorted
+    by their (estimated) cost, most expensive first,
+    so that a dynamic schedule doesn't end with a
+    single thread working on an expensive task
+**/
+
+int coffe_order_by_cost(
+    const double cost[],
+    size_t len,
+    size_t order[]
+)
+{
+    struct common_task *tasks =
+        (struct common_task *)coffe_malloc(sizeof(struct common_task)*len);
+    for (size_t i = 0; i<len; ++i){
+        tasks[i].cost = cost[i];
+        tasks[i].index = i;
+    }
+    qsort(tasks, len, sizeof(struct common_task), common_compare_tasks);
+    for (size_t i = 0; i<len; ++i)
+        order[i] = tasks[i].index;
+    free(tasks);
+    return EXIT_SUCCESS;
+}
+
+
+/**
+    divides the threads between the len tasks (done in parallel)
+    and the evaluation of the samples of the integrations within
+    each task: since the calculation can't take less time than
+    the most expensive task, only as many tasks are done at once as
+    fit into the total cost with that time, and the rest of the
+    threads go to each of them; the latter number is stored in
+    par->nthreads_inner, and the former is returned
+**/
+
+int coffe_threads_split(
+    struct coffe_parameters_t *par,
+    const double cost[],
+    size_t len
+)
+{
+    double total = 0, largest = 0;
+    for (size_t i = 0; i<len; ++i){
+        total += cost[i];
+        if (cost[i] > largest) largest = cost[i];
+    }
+
+    int outer = par->nthreads;
+    if (largest > 0 && ceil(total/largest) < outer)
+        outer = (int)ceil(total/largest);
+    if (len < (size_t)outer) outer = (int)len;
+    if (outer < 1) outer = 1;
+
+    par->nthreads_inner = par->nthreads/outer;
+    return outer;
+}
+
+
+/**
+    checks whether two interpolations have the same nodes and values
+**/
+
+int coffe_same_interpolation(
+    const struct coffe_interpolation *a,
+    const struct coffe_interpolation *b
+)
+{
+    if (a->spline->size != b->spline->size) return COFFE_FALSE;
+    for (size_t i = 0; i<a->spline->size; ++i){
+        if (
+            a->spline->x[i] != b->spline->x[i] ||
+            a->spline->y[i] != b->spline->y[i]
+        ) return COFFE_FALSE;
+    }
+    return COFFE_TRUE;
+}
+
+
+/**
+    sets the biases of populations 1 and 2 to the ones of the
+    pair of populations <pair>; the background functions which
+    depend on them need to be recomputed with coffe_background_tracers
+**/
+
+int coffe_tracer_pair(
+    struct coffe_parameters_t *par,
+    int pair
+)
+{
+    if (pair < 0 || pair >= par->tracer_pairs_len){
+        print_error(PROG_VALUE_ERROR);
+        exit(EXIT_FAILURE);
+    }
+    par->tracer_pair = pair;
+    const int first = par->tracer_pairs[2*pair], second = par->tracer_pairs[2*pair + 1];
+    par->matter_bias1 = par->tracer_matter_bias[first];
+    par->matter_bias2 = par->tracer_matter_bias[second];
+    par->magnification_bias1 = par->tracer_magnification_bias[first];
+    par->magnification_bias2 = par->tracer_magnification_bias[second];
+    par->evolution_bias1 = par->tracer_evolution_bias[first];
+    par->evolution_bias2 = par->tracer_evolution_bias[second];
+
+    /* the same population twice, so the correlation function is symmetric in mu */
+    par->autocorrelation =
+        coffe_same_interpolation(&par->matter_bias1, &par->matter_bias2) &&
+        coffe_same_interpolation(&par->magnification_bias1, &par->magnification_bias2) &&
+        coffe_same_interpolation(&par->evolution_bias1, &par->evolution_bias2);
+    return EXIT_SUCCESS;
+}
+
+
+/**
+    sets z_mean, deltaz, z_min and z_max to the ones of redshift bin <bin>
+**/
+
+int coffe_redshift_bin(
+    struct coffe_parameters_t *par,
+    int bin
+)
+{
+    if (bin < 0 || bin >= par->z_bins_len){
+        print_error(PROG_VALUE_ERROR);
+        exit(EXIT_FAILURE);
+    }
+    par->z_bin = bin;
+    if (par->z_mean_bins != NULL) par->z_mean = par->z_mean_bins[bin];
+    if (par->deltaz_bins != NULL) par->deltaz = par->deltaz_bins[bin];
+    if (par->z_min_bins != NULL) par->z_min = par->z_min_bins[bin];
+    if (par->z_max_bins != NULL) par->z_max = par->z_max_bins[bin];
+    return EXIT_SUCCESS;
+}
+
+
+/**
+    for auto-correlations the correlation function is even
+    in mu, so all of the odd multipoles vanish
+**/
+
+int coffe_multipole_vanishes(
+    const struct coffe_parameters_t *par,
+    int l
+)
+{
+    return par->autocorrelation && l % 2 != 0;
+}
@@ -19,6 +19,7 @@
 #ifndef COFFE_COMMON_H
 #define COFFE_COMMON_H
 
+#include <stdint.h>
 #include <gsl/gsl_spline.h>
 #include <gsl/gsl_spline2d.h>
 #include <libconfig.h>
@@ -69,6 +70,64 @@
 #endif
 
 
+/**
+    the terms of the correlation function as a bitmask;
+    COFFE_TERM(i, j) is the bit of the term between the sources
+    i and j (see corr_terms below for the nomenclature), and is
+    symmetric in i and j, so there are 10*11/2 = 55 bits in total
+**/
+
+#define COFFE_TERM_INDEX(i, j) \
+    ((i) <= (j) ? (i)*(19 - (i))/2 + (j) : (j)*(19 - (j))/2 + (i))
+
+#define COFFE_TERM(i, j) (UINT64_C(1) << COFFE_TERM_INDEX(i, j))
+
+/* all the terms containing the source s */
+#define COFFE_TERMS_WITH(s) \
+    (COFFE_TERM(s, 0) | COFFE_TERM(s, 1) | COFFE_TERM(s, 2) | \
+     COFFE_TERM(s, 3) | COFFE_TERM(s, 4) | COFFE_TERM(s, 5) | \
+     COFFE_TERM(s, 6) | COFFE_TERM(s, 7) | COFFE_TERM(s, 8) | \
+     COFFE_TERM(s, 9))
+
+#define COFFE_TERMS_LEN 55
+
+#define COFFE_TERMS_ALL ((UINT64_C(1) << COFFE_TERMS_LEN) - 1)
+
+#define COFFE_TERMS_DOUBLE_INTEGRATED \
+    (COFFE_TERM(7, 7) | COFFE_TERM(8, 8) | COFFE_TERM(9, 9) | \
+     COFFE_TERM(7, 8) | COFFE_TERM(7, 9) | COFFE_TERM(8, 9))
+
+#define COFFE_TERMS_SINGLE_INTEGRATED \
+    ((COFFE_TERMS_WITH(7) | COFFE_TERMS_WITH(8) | COFFE_TERMS_WITH(9)) \
+    & ~COFFE_TERMS_DOUBLE_INTEGRATED)
+
+#define COFFE_TERMS_NONINTEGRATED \
+    (COFFE_TERMS_ALL \
+    & ~(COFFE_TERMS_WITH(7) | COFFE_TERMS_WITH(8) | COFFE_TERMS_WITH(9)))
+
+/* the terms which have a flat-sky (Kaiser) limit */
+#define COFFE_TERMS_FLATSKY \
+    (COFFE_TERM(0, 0) | COFFE_TERM(0, 1) | COFFE_TERM(1, 1))
+
+
+/**
+    the sets of terms for which the kernels in functions.c
+    are compiled separately, so the compiler can throw away
+    everything that is not needed; the format is X(id, name, terms),
+    and id = 0 is reserved for the generic kernel
+**/
+
+#ifndef COFFE_KERNEL_SETS
+#define COFFE_KERNEL_SETS(X) \
+    X(1, den_rsd, \
+        COFFE_TERM(0, 0) | COFFE_TERM(0, 1) | COFFE_TERM(1, 1)) \
+    X(2, den_rsd_len, \
+        COFFE_TERM(0, 0) | COFFE_TERM(0, 1) | COFFE_TERM(1, 1) | \
+        COFFE_TERM(0, 9) | COFFE_TERM(1, 9) | COFFE_TERM(9, 9)) \
+    X(3, all, COFFE_TERMS_ALL)
+#endif
+
+
 /**
     simple wrapper with failsafe for malloc
 **/
@@ -134,9 +193,18 @@ struct coffe_parameters_t
         "g1"  = 4
         "g2"  = 5
         "g3"  = 6
+        "g4"  = 7
+        "g5"  = 8
+        "len" = 9
     cross terms are of the form "MN",
     with M and N one of the above numbers */
 
+    int corr_terms_len; /* number of terms in corr_terms */
+
+    uint64_t terms; /* the same as corr_terms, but as a bitmask (see COFFE_TERM) */
+
+    int terms_kernel; /* which of the COFFE_KERNEL_SETS matches terms (0 if none) */
+
     struct nl_terms nonzero_terms[9];
 
     char **type_bg; /* background values to output */
@@ -163,6 +231,13 @@ struct coffe_parameters_t
 
     double deltaz; /* width of redshift bin */
 
+    /* the redshift bins, each of length z_bins_len (NULL if not used), which in turn set z_mean, deltaz, z_min and z_max */
+    double *z_mean_bins, *deltaz_bins, *z_min_bins, *z_max_bins;
+
+    int z_bins_len;
+
+    int z_bin; /* the current redshift bin */
+
     char file_sep[COFFE_MAX_STRLEN]; /* string with name of file containing separations */
 
     double *sep; /* all the separations */
@@ -171,10 +246,32 @@ struct coffe_parameters_t
 
     int integration_method;
 
+    int integration_methods[3]; /* the methods for the nonintegrated, single and double integrated terms */
+
     int integration_bins;
 
+    int integration_los_order; /* order of the fixed quadrature along the line of sight (0 = adaptive) */
+
+    int integration_transforms[2]; /* substitutions of the line of sight variables of the single and double integrated terms */
+
+    int integration_mu_order; /* initial order of the fixed quadrature in mu for the multipoles (0 = adaptive) */
+
+    int integration_single_precision; /* single precision lookups for the double integrated terms */
+
+    int integration_warm_start; /* whether VEGAS keeps its grid between separations */
+
+    double integration_target_relative; /* relative error targeted by the Monte Carlo integrations (0 = none) */
+
+    double integration_target_absolute; /* absolute error targeted by the Monte Carlo integrations (0 = none) */
+
+    double limber_angle_min; /* smallest angle (in radians) where the len-len term uses the Limber approximation (0 = never) */
+
+    int integration_control_variate; /* whether the flat-sky Kaiser limit is subtracted from the nonintegrated terms of RAMP */
+
     int nthreads; /* how many threads are used for the computation */
 
+    int nthreads_inner; /* how many of them evaluate the samples of each integration */
+
     char file_power_spectrum[COFFE_MAX_STRLEN]; /* file containing the PS */
 
     struct coffe_interpolation power_spectrum;
@@ -189,25 +286,27 @@ struct coffe_parameters_t
 
     double k_max_norm; /* max value to be taken from PS file */
 
-    /* different biases */
-    int read_matter_bias1, read_matter_bias2;
+    /* the biases of each of the tracers_len populations */
+    int tracers_len;
 
-    char file_matter_bias1[COFFE_MAX_STRLEN], file_matter_bias2[COFFE_MAX_STRLEN];
+    struct coffe_interpolation *tracer_matter_bias, *tracer_magnification_bias, *tracer_evolution_bias;
 
-    struct coffe_interpolation matter_bias1, matter_bias2;
+    /* the pairs of populations to correlate, with index 2*pair + (0 or 1), and the current one */
+    int *tracer_pairs;
 
-    int read_magnification_bias1, read_magnification_bias2;
+    int tracer_pairs_len;
 
-    char file_magnification_bias1[COFFE_MAX_STRLEN], file_magnification_bias2[COFFE_MAX_STRLEN];
+    int tracer_pair;
 
-    struct coffe_interpolation magnification_bias1, magnification_bias2;
-
-    int read_evolution_bias1, read_evolution_bias2;
+    /* the biases of the two populations of the current pair */
+    struct coffe_interpolation matter_bias1, matter_bias2;
 
-    char file_evolution_bias1[COFFE_MAX_STRLEN], file_evolution_bias2[COFFE_MAX_STRLEN];
+    struct coffe_interpolation magnification_bias1, magnification_bias2;
 
     struct coffe_interpolation evolution_bias1, evolution_bias2;
 
+    int autocorrelation; /* whether both populations have the same biases */
+
     int divergent; /* flag for divergent integrals */
 
     config_t *conf; /* contains all the settings */
@@ -218,6 +317,12 @@ struct coffe_parameters_t
 
     char output_prefix[COFFE_MAX_STRLEN]; /* output prefix for all the files */
 
+    int output_contributions; /* whether to also output each of the corr_terms separately */
+
+    int output_errors; /* whether to also output the estimated integration error */
+
+    int flatsky; /* whether to use the flat-sky (Kaiser) limit of the den and rsd terms */
+
     int interp_method; /* method used for interpolation (linear, poly, etc.) */
 
     int *multipole_values; /* the multipoles to calculate */
@@ -250,11 +355,26 @@ struct coffe_parameters_t
 
     double covariance_pixelsize;
 
+    int covariance_integral_order; /* nodes per period of the fixed quadrature in k of the covariance (0 = adaptive) */
+
     /* for redshift averaged multipoles */
     double z_min, z_max;
 
+    int average_multipoles_z_order; /* nodes of the quadrature in z of the redshift averaged multipoles (0 = Monte Carlo) */
+
     int theta_len;
 
+    int theta_multipole_max; /* largest multipole of the Legendre expansion of the angular correlation function (0 = none) */
+
+    /* for the 2D correlation function; NULL for the default grid */
+    double *sep_parallel, *sep_perpendicular;
+
+    int sep_parallel_len, sep_perpendicular_len;
+
+    int corrfunc2d_multipole_max; /* largest multipole of the polar grid in (r, mu) (0 = none) */
+
+    int corrfunc2d_sep_sampling; /* number of separations of the polar grid */
+
 #ifdef HAVE_CLASS
     /* stuff for CLASS only */
 
@@ -390,4 +510,36 @@ double common_wfunction(
     double z
 );
 
+int coffe_order_by_cost(
+    const double cost[],
+    size_t len,
+    size_t order[]
+);
+
+int coffe_threads_split(
+    struct coffe_parameters_t *par,
+    const double cost[],
+    size_t len
+);
+
+int coffe_same_interpolation(
+    const struct coffe_interpolation *a,
+    const struct coffe_interpolation *b
+);
+
+int coffe_tracer_pair(
+    struct coffe_parameters_t *par,
+    int pair
+);
+
+int coffe_redshift_bin(
+    struct coffe_parameters_t *par,
+    int bin
+);
+
+int coffe_multipole_vanishes(
+    const struct coffe_parameters_t *par,
+    int l
+);
+
 #endif
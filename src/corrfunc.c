@@ -25,15 +25,6 @@
 #include <gsl/gsl_spline2d.h>
 #include <gsl/gsl_errno.h>
 
-#ifdef HAVE_CUBA
-#include "cuba.h"
-#else
-#include <gsl/gsl_monte_plain.h>
-#include <gsl/gsl_monte.h>
-#include <gsl/gsl_monte_miser.h>
-#include <gsl/gsl_monte_vegas.h>
-#endif
-
 #ifdef _OPENMP
 #include <omp.h>
 #endif
@@ -42,6 +33,7 @@
 #include "background.h"
 #include "integrals.h"
 #include "functions.h"
+#include "integrators.h"
 #include "corrfunc.h"
 
 const double r_parallel[] = {
@@ -57,8 +49,11 @@ struct corrfunc_params
     struct coffe_parameters_t *par;
     struct coffe_background_t *bg;
     struct coffe_integrals_t *integral;
+    const struct functions_float_tables *tables; /* NULL for double precision */
+    const struct functions_contributions *contributions; /* NULL for just the sum */
     double mu;
     double sep;
+    int fold; /* whether to integrate only over x2 < x1 */
 };
 
 static int corrfunc_check_range(
@@ -128,17 +123,32 @@ static double corrfunc_nonintegrated(
     struct coffe_background_t *bg,
     struct coffe_integrals_t integral[],
     double mu,
-    double sep
+    double sep,
+    double values[]
 )
 {
-    return functions_nonintegrated(
+    if (values == NULL){
+        return functions_nonintegrated(
+            par, bg, integral,
+            par->z_mean, mu, sep
+        )/interp_spline(&bg->D1, 0)/interp_spline(&bg->D1, 0);
+    }
+
+    const double D1_0 = interp_spline(&bg->D1, 0);
+    double all[COFFE_TERMS_LEN];
+    double result = functions_nonintegrated_terms(
         par, bg, integral,
-        par->z_mean, mu, sep
-    )/interp_spline(&bg->D1, 0)/interp_spline(&bg->D1, 0);
+        par->z_mean, mu, sep, par->terms, all
+    );
+    functions_contributions_scatter(
+        par, par->terms & COFFE_TERMS_NONINTEGRATED,
+        all, 1./D1_0/D1_0, values
+    );
+    return result/D1_0/D1_0;
 }
 
 static double corrfunc_single_integrated_integrand(
-    double x,
+    double u,
     void *p
 )
 {
@@ -149,79 +159,114 @@ static double corrfunc_single_integrated_integrand(
     struct coffe_integrals_t *integral = test->integral;
     double mu = test->mu;
     double sep = test->sep;
+    double x;
+    const double jacobian =
+        functions_los_transform(par->integration_transforms[0], u, &x);
     return
-        functions_single_integrated(
+        jacobian*functions_single_integrated(
             par, bg, integral,
             par->z_mean, mu, sep, x
         );
 }
 
+static int corrfunc_single_integrated_contributions_integrand(
+    double u,
+    double value[],
+    void *p
+)
+{
+    struct corrfunc_params *test =
+        (struct corrfunc_params *) p;
+    const struct functions_contributions *c = test->contributions;
+    double all[COFFE_TERMS_LEN], x;
+    const double jacobian =
+        functions_los_transform(test->par->integration_transforms[0], u, &x);
+    functions_single_integrated_terms(
+        test->par, test->bg, test->integral,
+        test->par->z_mean, test->mu, test->sep, x,
+        test->par->terms, all
+    );
+    for (int i = 0; i<c->len; ++i)
+        value[i] = jacobian*all[c->index[i]];
+    return EXIT_SUCCESS;
+}
+
 
 static double corrfunc_single_integrated(
     struct coffe_parameters_t *par,
     struct coffe_background_t *bg,
     struct coffe_integrals_t integral[],
     double mu,
-    double sep
+    double sep,
+    double values[],
+    double *error
 )
 {
+    *error = 0;
     struct corrfunc_params test;
     test.par = par;
     test.bg = bg;
     test.integral = integral;
     test.mu = mu;
     test.sep = sep;
-    int flag = 0;
-    int len = par->correlation_sources_len*(par->correlation_sources_len + 1)/2;
-    for (int i = 0; i<len; ++i){
-        if (
-            strcmp(par->corr_terms[i], "07") == 0 ||
-            strcmp(par->corr_terms[i], "70") == 0 ||
-            strcmp(par->corr_terms[i], "08") == 0 ||
-            strcmp(par->corr_terms[i], "80") == 0 ||
-            strcmp(par->corr_terms[i], "09") == 0 ||
-            strcmp(par->corr_terms[i], "90") == 0 ||
-            strcmp(par->corr_terms[i], "17") == 0 ||
-            strcmp(par->corr_terms[i], "71") == 0 ||
-            strcmp(par->corr_terms[i], "18") == 0 ||
-            strcmp(par->corr_terms[i], "81") == 0 ||
-            strcmp(par->corr_terms[i], "19") == 0 ||
-            strcmp(par->corr_terms[i], "91") == 0 ||
-            strcmp(par->corr_terms[i], "27") == 0 ||
-            strcmp(par->corr_terms[i], "72") == 0 ||
-            strcmp(par->corr_terms[i], "28") == 0 ||
-            strcmp(par->corr_terms[i], "82") == 0 ||
-            strcmp(par->corr_terms[i], "29") == 0 ||
-            strcmp(par->corr_terms[i], "92") == 0 ||
-            strcmp(par->corr_terms[i], "37") == 0 ||
-            strcmp(par->corr_terms[i], "73") == 0 ||
-            strcmp(par->corr_terms[i], "38") == 0 ||
-            strcmp(par->corr_terms[i], "83") == 0 ||
-            strcmp(par->corr_terms[i], "39") == 0 ||
-            strcmp(par->corr_terms[i], "93") == 0 ||
-            strcmp(par->corr_terms[i], "47") == 0 ||
-            strcmp(par->corr_terms[i], "74") == 0 ||
-            strcmp(par->corr_terms[i], "48") == 0 ||
-            strcmp(par->corr_terms[i], "84") == 0 ||
-            strcmp(par->corr_terms[i], "49") == 0 ||
-            strcmp(par->corr_terms[i], "94") == 0 ||
-            strcmp(par->corr_terms[i], "57") == 0 ||
-            strcmp(par->corr_terms[i], "75") == 0 ||
-            strcmp(par->corr_terms[i], "58") == 0 ||
-            strcmp(par->corr_terms[i], "85") == 0 ||
-            strcmp(par->corr_terms[i], "59") == 0 ||
-            strcmp(par->corr_terms[i], "95") == 0 ||
-            strcmp(par->corr_terms[i], "67") == 0 ||
-            strcmp(par->corr_terms[i], "76") == 0 ||
-            strcmp(par->corr_terms[i], "68") == 0 ||
-            strcmp(par->corr_terms[i], "86") == 0 ||
-            strcmp(par->corr_terms[i], "69") == 0 ||
-            strcmp(par->corr_terms[i], "96") == 0
-        ) ++flag;
-    }
-    if (flag == 0) return 0;
-
-    double result, error, prec = 1E-5;
+    test.fold = 0;
+    if (!(par->terms & COFFE_TERMS_SINGLE_INTEGRATED)) return 0;
+
+    const double D1_0 = interp_spline(&bg->D1, 0);
+
+    /* fixed quadrature along the line of sight */
+    if (par->integration_los_order > 0){
+        struct functions_los_nodes nodes;
+        double all[COFFE_TERMS_LEN];
+        functions_los_init(
+            &nodes, par->integration_los_order, par->integration_transforms[0]
+        );
+        double result = values == NULL ?
+            functions_single_integrated_los(
+                par, bg, integral,
+                par->z_mean, mu, sep, &nodes
+            ) :
+            functions_single_integrated_los_terms(
+                par, bg, integral,
+                par->z_mean, mu, sep, &nodes,
+                par->terms, all
+            );
+        functions_los_free(&nodes);
+        if (values != NULL)
+            functions_contributions_scatter(
+                par, par->terms & COFFE_TERMS_SINGLE_INTEGRATED,
+                all, 1./D1_0/D1_0, values
+            );
+        return result/D1_0/D1_0;
+    }
+
+    double prec = 1E-5;
+
+    /* all of the terms at once, each with its own error */
+    if (values != NULL){
+        struct functions_contributions c;
+        functions_contributions_init(par->terms & COFFE_TERMS_SINGLE_INTEGRATED, &c);
+        test.contributions = &c;
+
+        double result[COFFE_TERMS_LEN], errors[COFFE_TERMS_LEN];
+        double all[COFFE_TERMS_LEN], total = 0;
+        integrators_qag(
+            &corrfunc_single_integrated_contributions_integrand,
+            &test, 0., 1., c.len, prec, result, errors
+        );
+        for (int i = 0; i<c.len; ++i){
+            all[c.index[i]] = result[i];
+            total += result[i];
+            *error += errors[i]/D1_0/D1_0;
+        }
+        functions_contributions_scatter(
+            par, par->terms & COFFE_TERMS_SINGLE_INTEGRATED,
+            all, 1./D1_0/D1_0, values
+        );
+        return total/D1_0/D1_0;
+    }
+
+    double result;
 
     gsl_function integrand;
     integrand.function = &corrfunc_single_integrated_integrand;
@@ -233,46 +278,72 @@ static double corrfunc_single_integrated(
         &integrand, 0., 1., 0,
         prec, COFFE_MAX_INTSPACE,
         GSL_INTEG_GAUSS61, wspace,
-        &result, &error
+        &result, error
     );
     gsl_integration_workspace_free(wspace);
 
-    return result/interp_spline(&bg->D1, 0)/interp_spline(&bg->D1, 0);
+    *error /= D1_0*D1_0;
+    return result/D1_0/D1_0;
 }
 
 
-#ifdef HAVE_CUBA
 static int corrfunc_double_integrated_integrand(
-    const int *ndim, const cubareal var[],
-    const int *ncomp, cubareal value[],
+    const double var[],
+    int component,
+    double value[],
     void *p
 )
-#else
-static double corrfunc_double_integrated_integrand(
-    double *var, size_t dim, void *p
-)
-#endif
 {
     struct corrfunc_params *test =
         (struct corrfunc_params *) p;
     struct coffe_background_t *bg = test->bg;
     struct coffe_parameters_t *par = test->par;
     struct coffe_integrals_t *integral = test->integral;
+    const struct functions_contributions *c = test->contributions;
     double mu = test->mu;
     double sep = test->sep;
-    double x1 = var[0], x2 = var[1];
-#ifdef HAVE_CUBA
-    value[0] =
-#else
-    return
-#endif
-        functions_double_integrated(
+    double u1 = var[0], u2 = var[1], x1, x2, jacobian = 1;
+
+    /* the triangle x2 < x1, twice (the substitution keeps the order) */
+    if (test->fold){
+        u2 = var[0]*var[1];
+        jacobian = 2*var[0];
+    }
+    jacobian *=
+        functions_los_transform(par->integration_transforms[1], u1, &x1)
+       *functions_los_transform(par->integration_transforms[1], u2, &x2);
+
+    if (c == NULL){
+        value[0] = jacobian*(
+            test->tables != NULL ?
+            functions_double_integrated_float(
+                par, bg, test->tables,
+                par->z_mean, mu, sep, x1, x2
+            ) :
+            functions_double_integrated(
+                par, bg, integral,
+                par->z_mean, mu, sep, x1, x2
+            )
+        );
+    }
+    else if (component >= 0){
+        value[0] = jacobian*functions_double_integrated_terms(
+            par, bg, integral,
+            par->z_mean, mu, sep, x1, x2,
+            UINT64_C(1) << c->index[component], NULL
+        );
+    }
+    else{
+        double all[COFFE_TERMS_LEN];
+        functions_double_integrated_terms(
             par, bg, integral,
-            par->z_mean, mu, sep, x1, x2
+            par->z_mean, mu, sep, x1, x2,
+            par->terms, all
         );
-#ifdef HAVE_CUBA
+        for (int i = 0; i<c->len; ++i)
+            value[i] = jacobian*all[c->index[i]];
+    }
     return EXIT_SUCCESS;
-#endif
 }
 
 
@@ -280,8 +351,13 @@ static double corrfunc_double_integrated(
     struct coffe_parameters_t *par,
     struct coffe_background_t *bg,
     struct coffe_integrals_t integral[],
+    const struct functions_float_tables *tables,
+    struct functions_limber *limber,
+    struct integrators_grid *grid,
     double mu,
-    double sep
+    double sep,
+    double values[],
+    double *error
 )
 {
     const int dims = 2;
@@ -290,100 +366,800 @@ static double corrfunc_double_integrated(
     test.par = par;
     test.bg = bg;
     test.integral = integral;
+    test.tables = tables;
+    test.contributions = NULL;
     test.mu = mu;
     test.sep = sep;
-    int flag = 0;
-    int len = par->correlation_sources_len*(par->correlation_sources_len + 1)/2;
-    for (int i = 0; i<len; ++i){
-        if (
-            strcmp(par->corr_terms[i], "77") == 0 || // g4-g4
-            strcmp(par->corr_terms[i], "88") == 0 || // g5-g5
-            strcmp(par->corr_terms[i], "99") == 0 || // len-len
-            strcmp(par->corr_terms[i], "78") == 0 || // g4-g5
-            strcmp(par->corr_terms[i], "87") == 0 || // g5-g4
-            strcmp(par->corr_terms[i], "79") == 0 || // g4-len
-            strcmp(par->corr_terms[i], "97") == 0 || // len-g4
-            strcmp(par->corr_terms[i], "89") == 0 || // g5-len
-            strcmp(par->corr_terms[i], "98") == 0    // len-g5
-        ) ++flag;
-    }
-    if (flag == 0) return 0;
-
-#ifdef HAVE_CUBA
-    int nregions, neval, fail;
-    double result[1], error[1], prob[1];
-
-    Cuhre(dims, 1,
-        corrfunc_double_integrated_integrand,
-        (void *)&test, 1,
-        5e-4, 0, 0,
-        1, par->integration_bins, 7,
-        NULL, NULL,
-        &nregions, &neval, &fail, result, error, prob
+    /* for auto-correlations at mu = 0 the integrand is symmetric in x1 <-> x2 */
+    test.fold = par->autocorrelation && mu == 0;
+    *error = 0;
+    if (!(par->terms & COFFE_TERMS_DOUBLE_INTEGRATED)) return 0;
+
+    const double D1_0 = interp_spline(&bg->D1, 0);
+
+    /* the Limber approximation (only len-len) beyond limber_angle_min */
+    if (
+        limber != NULL &&
+        functions_limber_angle(bg, par->z_mean, mu, sep) >= par->limber_angle_min
+    ){
+        double all[COFFE_TERMS_LEN];
+        all[COFFE_TERM_INDEX(9, 9)] =
+            functions_limber_lensing(par, bg, limber, par->z_mean, mu, sep);
+        if (values != NULL)
+            functions_contributions_scatter(
+                par, COFFE_TERM(9, 9), all, 1./D1_0/D1_0, values
+            );
+        return all[COFFE_TERM_INDEX(9, 9)]/D1_0/D1_0;
+    }
+
+    /* all of the terms at once (always in double precision) */
+    if (values != NULL){
+        struct functions_contributions c;
+        functions_contributions_init(par->terms & COFFE_TERMS_DOUBLE_INTEGRATED, &c);
+        test.contributions = &c;
+        test.tables = NULL;
+
+        double result[COFFE_TERMS_LEN], errors[COFFE_TERMS_LEN];
+        double all[COFFE_TERMS_LEN], total = 0;
+        integrators_monte(
+            par, COFFE_TERMS_DOUBLE_INTEGRATED,
+            &corrfunc_double_integrated_integrand, &test,
+            dims, c.len, 5e-4, 1./D1_0/D1_0, grid, result, errors
+        );
+        /* the terms share the samples, so their errors are added linearly */
+        for (int i = 0; i<c.len; ++i){
+            all[c.index[i]] = result[i];
+            total += result[i];
+            *error += errors[i]/D1_0/D1_0;
+        }
+        functions_contributions_scatter(
+            par, par->terms & COFFE_TERMS_DOUBLE_INTEGRATED,
+            all, 1./D1_0/D1_0, values
+        );
+        return total/D1_0/D1_0;
+    }
+
+    double result;
+    integrators_monte(
+        par, COFFE_TERMS_DOUBLE_INTEGRATED,
+        &corrfunc_double_integrated_integrand, &test,
+        dims, 1, 5e-4, 1./D1_0/D1_0, grid, &result, error
     );
-    return result[0]/interp_spline(&bg->D1, 0)/interp_spline(&bg->D1, 0);
-#else
-    gsl_monte_function integrand;
-    integrand.dim = dims;
-    integrand.params = &test;
-    integrand.f = &corrfunc_double_integrated_integrand;
-
-    gsl_rng *random;
-    gsl_rng_env_setup();
-    const gsl_rng_type *T = gsl_rng_default;
-    random = gsl_rng_alloc(T);
-    double result, error;
-    double lower[dims];
-    double upper[dims];
-    for (int i = 0; i<dims; ++i){
-        lower[i] = 0.0;
-        upper[i] = 1.0;
-    }
-
-    switch (par->integration_method){
-        case 0:{
-            gsl_monte_plain_state *state =
-                gsl_monte_plain_alloc(dims);
-            gsl_monte_plain_integrate(
-                &integrand, lower, upper,
-                dims, par->integration_bins, random,
-                state,
-                &result, &error
+
+    /* the single precision result is only kept if the loss is well below the error */
+    if (
+        tables != NULL &&
+        functions_double_integrated_float_loss(
+            par, bg, integral, tables,
+            par->z_mean, mu, mu, sep, 0
+        ) > FUNCTIONS_FLOAT_LOSS_FRACTION*(*error)
+    ){
+        fprintf(
+            stderr,
+            "WARNING: single precision not accurate enough "
+            "at mu = %.3f, separation = %.2f Mpc/h; "
+            "recomputing in double precision\n",
+            mu, sep/COFFE_H0
+        );
+        test.tables = NULL;
+        integrators_monte(
+            par, COFFE_TERMS_DOUBLE_INTEGRATED,
+            &corrfunc_double_integrated_integrand, &test,
+            dims, 1, 5e-4, 1./D1_0/D1_0, grid, &result, error
+        );
+    }
+
+    *error /= D1_0*D1_0;
+    return result/D1_0/D1_0;
+}
+
+
+/**
+    the den-den, den-rsd and rsd-rsd terms in the flat-sky
+    (Kaiser) limit, and optionally the separate terms
+**/
+
+static double corrfunc_flatsky(
+    struct coffe_parameters_t *par,
+    struct coffe_background_t *bg,
+    struct coffe_integrals_t integral[],
+    double mu,
+    double sep,
+    double values[]
+)
+{
+    const double D1_0 = interp_spline(&bg->D1, 0);
+    const double legendre[3] = {1, (3*mu*mu - 1)/2., (35*pow(mu, 4) - 30*mu*mu + 3)/8.};
+    double coefficient[3][3], all[COFFE_TERMS_LEN], result = 0;
+    functions_flatsky_coefficients(par, bg, integral, par->z_mean, sep, coefficient);
+
+    for (int k = 0; k<3; ++k){
+        const int t = functions_flatsky_terms[k];
+        all[t] = 0;
+        for (int j = 0; j<3; ++j)
+            all[t] += coefficient[k][j]*legendre[j];
+        result += all[t];
+    }
+    if (values != NULL)
+        functions_contributions_scatter(par, par->terms, all, 1./D1_0/D1_0, values);
+    return result/D1_0/D1_0;
+}
+
+
+/**
+    estimates the wide-angle error of the flat-sky correlation function,
+    by comparing it with the full-sky one at the points with the
+    smallest, middle and largest separation
+**/
+
+static int corrfunc_flatsky_check(
+    struct coffe_parameters_t *par,
+    struct coffe_background_t *bg,
+    struct coffe_integrals_t integral[],
+    size_t len,
+    const double mu[],
+    const double sep[],
+    const double result[]
+)
+{
+    size_t checkpoints[3] = {0, 0, 0};
+    for (size_t n = 0; n<len; ++n){
+        if (sep[n] < sep[checkpoints[0]]) checkpoints[0] = n;
+        if (sep[n] > sep[checkpoints[2]]) checkpoints[2] = n;
+    }
+    const double middle = (sep[checkpoints[0]] + sep[checkpoints[2]])/2;
+    for (size_t n = 0; n<len; ++n)
+        if (fabs(sep[n] - middle) < fabs(sep[checkpoints[1]] - middle))
+            checkpoints[1] = n;
+
+    for (size_t k = 0; k<3 && len > 0; ++k){
+        const size_t n = checkpoints[k];
+        if (k > 0 && n == checkpoints[k - 1]) continue;
+        const double full =
+            corrfunc_nonintegrated(par, bg, integral, mu[n], sep[n], NULL);
+        printf(
+            "Flat-sky correlation function at mu = %.3f, %.2f Mpc/h "
+            "differs from the full-sky one by %.2e\n",
+            mu[n], sep[n]/COFFE_H0,
+            full != 0 ? fabs(result[n] - full)/fabs(full) : fabs(result[n])
+        );
+    }
+    return EXIT_SUCCESS;
+}
+
+
+/**
+    the value of the correlation function (all of the terms)
+    at a single point, and optionally the separate terms;
+    grid is the VEGAS grid kept between points (or NULL),
+    and the estimated error of the integrations is stored in error
+**/
+
+static double corrfunc_point(
+    struct coffe_parameters_t *par,
+    struct coffe_background_t *bg,
+    struct coffe_integrals_t integral[],
+    const struct functions_float_tables *tables,
+    struct functions_limber *limber,
+    struct integrators_grid *grid,
+    double mu,
+    double sep,
+    double values[],
+    double *error
+)
+{
+    if (par->flatsky){
+        *error = 0;
+        return corrfunc_flatsky(par, bg, integral, mu, sep, values);
+    }
+
+    double single, twice;
+    double result =
+        corrfunc_nonintegrated(par, bg, integral, mu, sep, values);
+    result +=
+        corrfunc_single_integrated(par, bg, integral, mu, sep, values, &single);
+    result +=
+        corrfunc_double_integrated(
+            par, bg, integral, tables, limber, grid, mu, sep, values, &twice
+        );
+    *error = sqrt(single*single + twice*twice);
+    return result;
+}
+
+
+/**
+    the consistency check of the Limber approximation: at the point
+    with the smallest angle where it is used, compares it with the
+    full double integral
+**/
+
+static int corrfunc_limber_check(
+    struct coffe_parameters_t *par,
+    struct coffe_background_t *bg,
+    struct coffe_integrals_t integral[],
+    struct functions_limber *limber,
+    size_t len,
+    const double mu[],
+    const double sep[]
+)
+{
+    size_t point = len;
+    double theta_min = 0;
+    for (size_t n = 0; n<len; ++n){
+        const double theta = functions_limber_angle(bg, par->z_mean, mu[n], sep[n]);
+        if (theta >= par->limber_angle_min && (point == len || theta < theta_min))
+            point = n, theta_min = theta;
+    }
+    if (point == len) return EXIT_SUCCESS;
+
+    double approximation_error, full_error;
+    const double approximation = corrfunc_double_integrated(
+        par, bg, integral, NULL, limber, NULL,
+        mu[point], sep[point], NULL, &approximation_error
+    );
+    const double full = corrfunc_double_integrated(
+        par, bg, integral, NULL, NULL, NULL,
+        mu[point], sep[point], NULL, &full_error
+    );
+    printf(
+        "Limber approximation at mu = %.3f, %.2f Mpc/h (angle %.4f rad) "
+        "differs from the full len-len term by %.2e (integration error %.2e)\n",
+        mu[point], sep[point]/COFFE_H0, theta_min,
+        full != 0 ? fabs(approximation - full)/fabs(full) : fabs(approximation),
+        full != 0 ? full_error/fabs(full) : full_error
+    );
+    return EXIT_SUCCESS;
+}
+
+
+/**
+    rough estimate of the cost of corrfunc_point, in units of
+    integrand evaluations; the adaptive integrations need more
+    of them at larger separations
+**/
+
+static double corrfunc_cost(
+    struct coffe_parameters_t *par,
+    double sep,
+    double sep_max
+)
+{
+    double cost = 1;
+    if (par->terms & COFFE_TERMS_SINGLE_INTEGRATED)
+        cost += par->integration_los_order > 0 ?
+            par->integration_los_order : 100;
+    if (par->terms & COFFE_TERMS_DOUBLE_INTEGRATED)
+        cost += par->integration_bins;
+    return cost*(1 + sep/sep_max);
+}
+
+
+/**
+    the band of mu whose VEGAS grid is used at mu; the folded
+    integration at mu = 0 of auto-correlations has a band of its own
+**/
+
+static size_t corrfunc_mu_band(
+    const struct coffe_parameters_t *par,
+    double mu
+)
+{
+    if (par->autocorrelation && mu == 0) return CORRFUNC_MU_BANDS;
+    const double band = floor((mu + 1)/2.*CORRFUNC_MU_BANDS);
+    return (size_t)fmin(fmax(band, 0), CORRFUNC_MU_BANDS - 1);
+}
+
+
+struct corrfunc_task
+{
+    int tier;
+    size_t band;
+    double sep;
+    size_t index;
+};
+
+/* the most expensive tier first, then by band, and by decreasing separation */
+static int corrfunc_compare_tasks(
+    const void *a,
+    const void *b
+)
+{
+    const struct corrfunc_task *ta = (const struct corrfunc_task *)a;
+    const struct corrfunc_task *tb = (const struct corrfunc_task *)b;
+    if (ta->tier != tb->tier) return ta->tier > tb->tier ? -1 : 1;
+    if (ta->band != tb->band) return ta->band < tb->band ? -1 : 1;
+    if (ta->sep != tb->sep) return ta->sep > tb->sep ? -1 : 1;
+    return ta->index < tb->index ? -1 : (ta->index > tb->index);
+}
+
+
+struct corrfunc_key
+{
+    double mu, sep;
+    size_t index;
+};
+
+static int corrfunc_compare_keys(
+    const void *a,
+    const void *b
+)
+{
+    const struct corrfunc_key *ka = (const struct corrfunc_key *)a;
+    const struct corrfunc_key *kb = (const struct corrfunc_key *)b;
+    if (ka->mu != kb->mu) return ka->mu < kb->mu ? -1 : 1;
+    if (ka->sep != kb->sep) return ka->sep < kb->sep ? -1 : 1;
+    return ka->index < kb->index ? -1 : (ka->index > kb->index);
+}
+
+
+/**
+    computes the correlation function at all of the len points
+    (mu[n], sep[n]) in a single parallel pass, with the most
+    expensive points scheduled first (within tiers of similar cost,
+    by band of mu and decreasing separation, so that each of the VEGAS
+    grids of a thread goes along the separations at similar mu); for
+    auto-correlations
+    xi(mu) = xi(-mu), so points which only differ in the sign
+    of mu are computed once; if error is not NULL, the estimated
+    errors of the integrations are stored there; if limber is not NULL,
+    the len-len term is computed in the Limber approximation at the
+    points where the angle is at least limber_angle_min
+**/
+
+static int corrfunc_compute(
+    struct coffe_parameters_t *par,
+    struct coffe_background_t *bg,
+    struct coffe_integrals_t integral[],
+    const struct functions_float_tables *tables,
+    struct functions_limber *limber,
+    size_t len,
+    const double mu[],
+    const double sep[],
+    double result[],
+    double error[],
+    double *contributions,
+    size_t contributions_len
+)
+{
+    double *cost = (double *)coffe_malloc(sizeof(double)*len);
+    size_t *order = (size_t *)coffe_malloc(sizeof(size_t)*len);
+    size_t *same = (size_t *)coffe_malloc(sizeof(size_t)*len);
+    for (size_t n = 0; n<len; ++n) same[n] = n;
+
+    /* same[n] is the first point with the same |mu| and separation */
+    if (par->autocorrelation){
+        struct corrfunc_key *keys =
+            (struct corrfunc_key *)coffe_malloc(sizeof(struct corrfunc_key)*len);
+        for (size_t n = 0; n<len; ++n){
+            keys[n].mu = fabs(mu[n]);
+            keys[n].sep = sep[n];
+            keys[n].index = n;
+        }
+        qsort(keys, len, sizeof(struct corrfunc_key), corrfunc_compare_keys);
+        for (size_t k = 1; k<len; ++k)
+            if (keys[k].mu == keys[k - 1].mu && keys[k].sep == keys[k - 1].sep)
+                same[keys[k].index] = same[keys[k - 1].index];
+        free(keys);
+    }
+
+    double sep_max = 0;
+    for (size_t n = 0; n<len; ++n)
+        if (sep[n] > sep_max) sep_max = sep[n];
+    double cost_min = INFINITY, cost_max = 0;
+    for (size_t n = 0; n<len; ++n){
+        cost[n] = same[n] == n ? corrfunc_cost(par, sep[n], sep_max) : 0;
+        if (same[n] != n) continue;
+        cost_min = fmin(cost_min, cost[n]);
+        cost_max = fmax(cost_max, cost[n]);
+    }
+    struct corrfunc_task *tasks =
+        (struct corrfunc_task *)coffe_malloc(sizeof(struct corrfunc_task)*len);
+    for (size_t n = 0; n<len; ++n){
+        /* the duplicates are skipped, so they go last */
+        tasks[n].tier = -1;
+        if (same[n] == n)
+            tasks[n].tier = cost_max > cost_min ?
+                (int)fmin(
+                    floor(CORRFUNC_COST_TIERS*(cost[n] - cost_min)/(cost_max - cost_min)),
+                    CORRFUNC_COST_TIERS - 1
+                ) : 0;
+        tasks[n].band = corrfunc_mu_band(par, mu[n]);
+        tasks[n].sep = sep[n];
+        tasks[n].index = n;
+    }
+    qsort(tasks, len, sizeof(struct corrfunc_task), corrfunc_compare_tasks);
+    for (size_t k = 0; k<len; ++k)
+        order[k] = tasks[k].index;
+    free(tasks);
+    const int nthreads = coffe_threads_split(par, cost, len);
+
+    #pragma omp parallel num_threads(nthreads)
+    {
+        /* each thread keeps its own VEGAS grid for each band of mu between the points */
+        struct integrators_grid *grids = NULL;
+        if (par->integration_warm_start){
+            grids = (struct integrators_grid *)coffe_malloc(
+                sizeof(struct integrators_grid)*(CORRFUNC_MU_BANDS + 1)
             );
-            gsl_monte_plain_free(state);
-            break;
-        }
-        case 1:{
-            gsl_monte_miser_state *state =
-                gsl_monte_miser_alloc(dims);
-            gsl_monte_miser_integrate(
-                &integrand, lower, upper,
-                dims, par->integration_bins, random,
-                state,
-                &result, &error
+            for (size_t b = 0; b<=CORRFUNC_MU_BANDS; ++b)
+                integrators_grid_init(&grids[b], 2);
+        }
+
+        #pragma omp for schedule(dynamic, 1)
+        for (size_t k = 0; k<len; ++k){
+            const size_t n = order[k];
+            if (same[n] != n) continue;
+            double point_error;
+            result[n] = corrfunc_point(
+                par, bg, integral, tables, limber,
+                grids != NULL ? &grids[corrfunc_mu_band(par, mu[n])] : NULL,
+                mu[n], sep[n],
+                contributions != NULL ? contributions + n*contributions_len : NULL,
+                &point_error
             );
-            gsl_monte_miser_free(state);
-            break;
-        }
-        case 2:{
-            gsl_monte_vegas_state *state =
-                gsl_monte_vegas_alloc(dims);
-            gsl_monte_vegas_integrate(
-                &integrand, lower, upper,
-                dims, par->integration_bins, random,
-                state,
-                &result, &error
+            if (error != NULL) error[n] = point_error;
+        }
+
+        if (grids != NULL){
+            for (size_t b = 0; b<=CORRFUNC_MU_BANDS; ++b)
+                integrators_grid_free(&grids[b]);
+            free(grids);
+        }
+    }
+
+    for (size_t n = 0; n<len; ++n){
+        if (same[n] == n) continue;
+        result[n] = result[same[n]];
+        if (error != NULL) error[n] = error[same[n]];
+        if (contributions != NULL)
+            memcpy(
+                contributions + n*contributions_len,
+                contributions + same[n]*contributions_len,
+                sizeof(double)*contributions_len
             );
-            gsl_monte_vegas_free(state);
-            break;
+    }
+
+    if (par->flatsky)
+        corrfunc_flatsky_check(par, bg, integral, len, mu, sep, result);
+    if (limber != NULL)
+        corrfunc_limber_check(par, bg, integral, limber, len, mu, sep);
+
+    par->nthreads_inner = 1;
+    free(cost);
+    free(order);
+    free(same);
+    return EXIT_SUCCESS;
+}
+
+/**
+    sums a[0] P_0(x) + ... + a[l_max] P_l_max(x), with the coefficients
+    stride apart, using the Clenshaw recurrence for the Legendre polynomials,
+    P_{l + 1} = ((2l + 1) x P_l - l P_{l - 1})/(l + 1)
+**/
+
+static double corrfunc_legendre_sum(
+    const double a[],
+    size_t stride,
+    int l_max,
+    double x
+)
+{
+    double b1 = 0, b2 = 0;
+    for (int l = l_max; l>=1; --l){
+        const double b =
+            a[l*stride] + (2*l + 1)*x/(l + 1)*b1 - (l + 1.)/(l + 2)*b2;
+        b2 = b1, b1 = b;
+    }
+    return a[0] + x*b1 - b2/2;
+}
+
+
+/**
+    the Legendre coefficients up to l_max, (2l + 1)/2 times the integral
+    over x in [-1, 1] of the values times P_l, from the values at the
+    l_max + 1 Gauss-Legendre nodes x with weights weight; the values and
+    the coefficients each have stride components, with P_l(x) from the
+    upward recurrence
+**/
+
+static int corrfunc_legendre_coefficients(
+    size_t len,
+    const double x[],
+    const double weight[],
+    const double nodes[],
+    size_t stride,
+    int l_max,
+    double coefficients[]
+)
+{
+    for (size_t c = 0; c<((size_t)l_max + 1)*stride; ++c)
+        coefficients[c] = 0;
+    for (size_t k = 0; k<len; ++k){
+        double previous = 0, p = 1;
+        for (int l = 0; l<=l_max; ++l){
+            for (size_t c = 0; c<stride; ++c)
+                coefficients[l*stride + c] += (2*l + 1)/2.*weight[k]*nodes[k*stride + c]*p;
+            const double next = ((2*l + 1)*x[k]*p - l*previous)/(l + 1);
+            previous = p, p = next;
         }
-        default:
-            result = 0;
-            break;
     }
-    gsl_rng_free(random);
-    return result/interp_spline(&bg->D1, 0)/interp_spline(&bg->D1, 0);
-#endif
+    return EXIT_SUCCESS;
+}
+
+
+/**
+    bound on the error of the Legendre series at x from the errors of the
+    values at the Gauss-Legendre nodes, each of them propagated with the
+    absolute values of its weights in the coefficients and in the sum, so
+    that errors of different nodes can't cancel
+**/
+
+static double corrfunc_legendre_error(
+    size_t len,
+    const double nodes_x[],
+    const double weight[],
+    const double node_error[],
+    size_t stride,
+    int l_max,
+    double x
+)
+{
+    double result = 0;
+    for (size_t k = 0; k<len; ++k){
+        double previous = 0, p = 1, previous_x = 0, p_x = 1, sum = 0;
+        for (int l = 0; l<=l_max; ++l){
+            sum += (2*l + 1)/2.*fabs(p*p_x);
+            const double next = ((2*l + 1)*nodes_x[k]*p - l*previous)/(l + 1);
+            const double next_x = ((2*l + 1)*x*p_x - l*previous_x)/(l + 1);
+            previous = p, p = next;
+            previous_x = p_x, p_x = next_x;
+        }
+        result += fabs(weight[k]*node_error[k*stride])*sum;
+    }
+    return result;
+}
+
+
+/**
+    the angular correlation function at the angles theta from its
+    Legendre coefficients up to theta_multipole_max, (2l + 1)/2 times the
+    integral over cos(theta) in [-1, 1] of it times P_l, which are computed
+    once with the Gauss-Legendre quadrature on theta_multipole_max + 1 nodes;
+    the separate terms are summed the same way, and the errors of the nodes
+    are propagated with corrfunc_legendre_error
+**/
+
+static int corrfunc_angular_legendre(
+    struct coffe_parameters_t *par,
+    struct coffe_background_t *bg,
+    struct coffe_integrals_t integral[],
+    const struct functions_float_tables *tables,
+    struct functions_limber *limber,
+    size_t theta_len,
+    const double theta[],
+    double result[],
+    double error[],
+    double *contributions,
+    size_t contributions_len
+)
+{
+    const int l_max = par->theta_multipole_max;
+    const size_t len = (size_t)l_max + 1;
+    const double chi_mean = interp_spline(&bg->comoving_distance, par->z_mean);
+
+    /* the value, the error, and the separate terms, at the nodes and as coefficients */
+    const size_t stride = 2 + contributions_len;
+    double *x = (double *)coffe_malloc(sizeof(double)*len);
+    double *weight = (double *)coffe_malloc(sizeof(double)*len);
+    double *mu = (double *)coffe_malloc(sizeof(double)*len);
+    double *sep = (double *)coffe_malloc(sizeof(double)*len);
+    double *nodes = (double *)coffe_malloc(sizeof(double)*len*stride);
+    double *node_values = (double *)coffe_malloc(sizeof(double)*len*(1 + contributions_len));
+    double *coefficients = (double *)coffe_malloc(sizeof(double)*len*stride);
+
+    gsl_integration_glfixed_table *table = gsl_integration_glfixed_table_alloc(len);
+    for (size_t k = 0; k<len; ++k){
+        gsl_integration_glfixed_point(-1, 1, k, &x[k], &weight[k], table);
+        mu[k] = 0;
+        sep[k] = chi_mean*sqrt(2*(1 - x[k]));
+    }
+    gsl_integration_glfixed_table_free(table);
+
+    double *node_error = error != NULL ? node_values + len*contributions_len : NULL;
+    double *node_result = (double *)coffe_malloc(sizeof(double)*len);
+    corrfunc_compute(
+        par, bg, integral, tables, limber,
+        len, mu, sep, node_result, node_error,
+        contributions != NULL ? node_values : NULL, contributions_len
+    );
+    for (size_t k = 0; k<len; ++k){
+        nodes[k*stride] = node_result[k];
+        nodes[k*stride + 1] = node_error != NULL ? node_error[k] : 0;
+        for (size_t t = 0; t<contributions_len; ++t)
+            nodes[k*stride + 2 + t] =
+                contributions != NULL ? node_values[k*contributions_len + t] : 0;
+    }
+
+    corrfunc_legendre_coefficients(len, x, weight, nodes, stride, l_max, coefficients);
+
+    #pragma omp parallel for num_threads(par->nthreads)
+    for (size_t i = 0; i<theta_len; ++i){
+        const double costheta = cos(theta[i]);
+        result[i] = corrfunc_legendre_sum(coefficients, stride, l_max, costheta);
+        if (error != NULL)
+            error[i] = corrfunc_legendre_error(len, x, weight, nodes + 1, stride, l_max, costheta);
+        for (size_t t = 0; t<contributions_len && contributions != NULL; ++t)
+            contributions[i*contributions_len + t] =
+                corrfunc_legendre_sum(coefficients + 2 + t, stride, l_max, costheta);
+    }
+
+    free(x);
+    free(weight);
+    free(mu);
+    free(sep);
+    free(nodes);
+    free(node_values);
+    free(node_result);
+    free(coefficients);
+    return EXIT_SUCCESS;
+}
+
+
+/**
+    the 2D correlation function at all of the (sep_parallel, sep_perpendicular)
+    of cf2d, from its Legendre coefficients in mu up to corrfunc2d_multipole_max,
+    which are computed once on a polar grid of corrfunc2d_sep_sampling
+    logarithmically spaced separations, spanning the ones of the output, times
+    corrfunc2d_multipole_max + 1 Gauss-Legendre nodes in mu, and interpolated
+    in the separation; the separate terms are resampled the same way, while the
+    errors are interpolated at each node in mu and propagated with
+    corrfunc_legendre_error
+**/
+
+static int corrfunc2d_polar(
+    struct coffe_parameters_t *par,
+    struct coffe_background_t *bg,
+    struct coffe_integrals_t integral[],
+    const struct functions_float_tables *tables,
+    struct functions_limber *limber,
+    struct coffe_corrfunc2d_t *cf2d,
+    double result[]
+)
+{
+    const int l_max = par->corrfunc2d_multipole_max;
+    const size_t mu_len = (size_t)l_max + 1;
+    const size_t sep_len = (size_t)par->corrfunc2d_sep_sampling;
+    const size_t contributions_len = cf2d->contributions_len;
+    const size_t output_len = cf2d->sep_parallel_len*cf2d->sep_perpendicular_len;
+
+    /* the range of the separations of the output */
+    double sep_min = INFINITY, sep_max = 0;
+    for (size_t i = 0; i<cf2d->sep_parallel_len; ++i){
+        for (size_t j = 0; j<cf2d->sep_perpendicular_len; ++j){
+            const double r = hypot(cf2d->sep_parallel[i], cf2d->sep_perpendicular[j]);
+            sep_min = fmin(sep_min, r);
+            sep_max = fmax(sep_max, r);
+        }
+    }
+    /* a single separation still needs a range to interpolate over */
+    if (sep_max < 1.01*sep_min) sep_max = 1.01*sep_min;
+
+    double *r = (double *)coffe_malloc(sizeof(double)*sep_len);
+    for (size_t n = 0; n<sep_len; ++n)
+        r[n] = sep_min*pow(sep_max/sep_min, (double)n/(sep_len - 1));
+    r[sep_len - 1] = sep_max;
+
+    double *x = (double *)coffe_malloc(sizeof(double)*mu_len);
+    double *weight = (double *)coffe_malloc(sizeof(double)*mu_len);
+    gsl_integration_glfixed_table *table = gsl_integration_glfixed_table_alloc(mu_len);
+    for (size_t k = 0; k<mu_len; ++k)
+        gsl_integration_glfixed_point(-1, 1, k, &x[k], &weight[k], table);
+    gsl_integration_glfixed_table_free(table);
+
+    /* all of the points of the polar grid, with index n*mu_len + k */
+    const size_t len = sep_len*mu_len;
+    double *mu = (double *)coffe_malloc(sizeof(double)*len);
+    double *sep = (double *)coffe_malloc(sizeof(double)*len);
+    for (size_t n = 0; n<sep_len; ++n){
+        for (size_t k = 0; k<mu_len; ++k){
+            mu[n*mu_len + k] = x[k];
+            sep[n*mu_len + k] = r[n]*COFFE_H0;
+        }
+    }
+
+    double *node_result = (double *)coffe_malloc(sizeof(double)*len);
+    double *node_error = cf2d->error != NULL ?
+        (double *)coffe_malloc(sizeof(double)*len) : NULL;
+    double *node_contributions = cf2d->contributions != NULL ?
+        (double *)coffe_malloc(sizeof(double)*len*contributions_len) : NULL;
+    corrfunc_compute(
+        par, bg, integral, tables, limber,
+        len, mu, sep, node_result, node_error,
+        node_contributions, contributions_len
+    );
+
+    /* the value, the error, and the separate terms, at the nodes and as coefficients */
+    const size_t stride = 2 + contributions_len;
+    double *nodes = (double *)coffe_malloc(sizeof(double)*mu_len*stride);
+    double *coefficients = (double *)coffe_malloc(sizeof(double)*len*stride);
+    for (size_t n = 0; n<sep_len; ++n){
+        for (size_t k = 0; k<mu_len; ++k){
+            const size_t index = n*mu_len + k;
+            nodes[k*stride] = node_result[index];
+            nodes[k*stride + 1] = node_error != NULL ? node_error[index] : 0;
+            for (size_t t = 0; t<contributions_len; ++t)
+                nodes[k*stride + 2 + t] = node_contributions != NULL ?
+                    node_contributions[index*contributions_len + t] : 0;
+        }
+        corrfunc_legendre_coefficients(
+            mu_len, x, weight, nodes, stride, l_max,
+            coefficients + n*mu_len*stride
+        );
+        /* the errors are kept at the nodes, see corrfunc_legendre_error */
+        for (size_t k = 0; k<mu_len; ++k)
+            coefficients[(n*mu_len + k)*stride + 1] = fabs(nodes[k*stride + 1]);
+    }
+
+    /* each of the coefficients (or node errors) as a function of the separation, with index l*stride + c */
+    struct coffe_interpolation *splines = (struct coffe_interpolation *)coffe_malloc(
+        sizeof(struct coffe_interpolation)*mu_len*stride
+    );
+    double *values = (double *)coffe_malloc(sizeof(double)*sep_len);
+    for (size_t c = 0; c<mu_len*stride; ++c){
+        for (size_t n = 0; n<sep_len; ++n)
+            values[n] = coefficients[n*mu_len*stride + c];
+        init_spline(&splines[c], r, values, sep_len, par->interp_method);
+    }
+
+    #pragma omp parallel num_threads(par->nthreads)
+    {
+        double *a = (double *)coffe_malloc(sizeof(double)*mu_len);
+
+        #pragma omp for
+        for (size_t m = 0; m<output_len; ++m){
+            const double sep_parallel = cf2d->sep_parallel[m/cf2d->sep_perpendicular_len];
+            const double sep_perpendicular = cf2d->sep_perpendicular[m%cf2d->sep_perpendicular_len];
+            const double radius = hypot(sep_parallel, sep_perpendicular);
+            const double cosine = sep_parallel/radius;
+            /* guarding against the rounding at the ends of the range */
+            const double s = fmin(fmax(radius, r[0]), r[sep_len - 1]);
+
+            for (size_t c = 0; c<stride; ++c){
+                if (c == 1 && cf2d->error == NULL) continue;
+                if (c >= 2 && cf2d->contributions == NULL) break;
+                /* no accelerator, as it is shared among the threads */
+                for (size_t l = 0; l<mu_len; ++l)
+                    a[l] = gsl_spline_eval(splines[l*stride + c].spline, s, NULL);
+                if (c == 1){
+                    cf2d->error[m] =
+                        corrfunc_legendre_error(mu_len, x, weight, a, 1, l_max, cosine);
+                    continue;
+                }
+                const double sum = corrfunc_legendre_sum(a, 1, l_max, cosine);
+                if (c == 0)
+                    result[m] = sum;
+                else
+                    cf2d->contributions[m*contributions_len + c - 2] = sum;
+            }
+        }
+        free(a);
+    }
+
+    for (size_t c = 0; c<mu_len*stride; ++c)
+        free_spline(&splines[c]);
+    free(splines);
+    free(values);
+    free(r);
+    free(x);
+    free(weight);
+    free(mu);
+    free(sep);
+    free(node_result);
+    free(node_error);
+    free(node_contributions);
+    free(nodes);
+    free(coefficients);
+    return EXIT_SUCCESS;
 }
 
 
@@ -401,9 +1177,25 @@ int coffe_corrfunc_init(
     struct coffe_corrfunc2d_t *cf2d
 )
 {
-#ifdef HAVE_CUBA
-    cubacores(0, 10000);
-#endif
+    integrators_init(par);
+    /* single precision tables for the double integrated terms */
+    struct functions_float_tables tables, *tables_ptr = NULL;
+    if (
+        par->integration_single_precision &&
+        (par->output_type == 0 || par->output_type == 1 || par->output_type == 6) &&
+        (par->terms & COFFE_TERMS_DOUBLE_INTEGRATED)
+    ){
+        functions_float_tables_init(par, bg, integral, &tables);
+        tables_ptr = &tables;
+    }
+
+    /* the projected correlation function for the Limber approximation */
+    struct functions_limber limber, *limber_ptr = NULL;
+    if (par->limber_angle_min > 0 && (par->terms & COFFE_TERM(9, 9))){
+        functions_limber_init(par, integral, &limber);
+        limber_ptr = &limber;
+    }
+
     if (par->output_type == 0){
         cf_ang->flag = 1;
         clock_t start, end;
@@ -421,32 +1213,41 @@ int coffe_corrfunc_init(
 
         cf_ang->result = (double *)coffe_malloc(sizeof(double)*theta_len);
 
-        for (size_t i = 0; i<theta_len; ++i){
-            cf_ang->theta[i] = maxangle*(i + 1)/theta_len;
+        cf_ang->contributions = NULL;
+        cf_ang->contributions_len = 0;
+        if (par->output_contributions){
+            cf_ang->contributions_len = (size_t)par->corr_terms_len;
+            cf_ang->contributions =
+                (double *)coffe_malloc(sizeof(double)*theta_len*cf_ang->contributions_len);
         }
 
-        #pragma omp parallel for num_threads(par->nthreads)
-        for (size_t i = 0; i<theta_len; ++i){
-            (cf_ang->result)[i] =
-                corrfunc_nonintegrated(
-                    par, bg, integral, 0, chi_mean*sqrt(2*(1. - cos(cf_ang->theta[i])))
-                );
-        }
-        #pragma omp parallel for num_threads(par->nthreads)
-        for (size_t i = 0; i<theta_len; ++i){
-            (cf_ang->result)[i] +=
-                corrfunc_single_integrated(
-                    par, bg, integral, 0, chi_mean*sqrt(2*(1. - cos(cf_ang->theta[i])))
-                );
-        }
-        #pragma omp parallel for num_threads(par->nthreads)
+        cf_ang->error = NULL;
+        if (par->output_errors)
+            cf_ang->error = (double *)coffe_malloc(sizeof(double)*theta_len);
+
+        double *mu = (double *)coffe_malloc(sizeof(double)*theta_len);
+        double *sep = (double *)coffe_malloc(sizeof(double)*theta_len);
         for (size_t i = 0; i<theta_len; ++i){
-            (cf_ang->result)[i] +=
-                corrfunc_double_integrated(
-                    par, bg, integral, 0, chi_mean*sqrt(2*(1. - cos(cf_ang->theta[i])))
-                );
+            cf_ang->theta[i] = maxangle*(i + 1)/theta_len;
+            mu[i] = 0;
+            sep[i] = chi_mean*sqrt(2*(1. - cos(cf_ang->theta[i])));
         }
 
+        if (par->theta_multipole_max > 0)
+            corrfunc_angular_legendre(
+                par, bg, integral, tables_ptr, limber_ptr,
+                theta_len, cf_ang->theta, cf_ang->result, cf_ang->error,
+                cf_ang->contributions, cf_ang->contributions_len
+            );
+        else
+            corrfunc_compute(
+                par, bg, integral, tables_ptr, limber_ptr,
+                theta_len, mu, sep, cf_ang->result, cf_ang->error,
+                cf_ang->contributions, cf_ang->contributions_len
+            );
+        free(mu);
+        free(sep);
+
         gsl_set_error_handler(default_handler);
 
         end = clock();
@@ -487,39 +1288,51 @@ int coffe_corrfunc_init(
             corrfunc->mu[i] = par->mu[i];
         }
 
+        corrfunc->contributions = NULL;
+        corrfunc->contributions_len = 0;
+        if (par->output_contributions){
+            corrfunc->contributions_len = (size_t)par->corr_terms_len;
+            corrfunc->contributions = (double *)coffe_malloc(
+                sizeof(double)*corrfunc->mu_len*corrfunc->sep_len*corrfunc->contributions_len
+            );
+        }
+
+        corrfunc->error = NULL;
+        if (par->output_errors)
+            corrfunc->error = (double *)coffe_malloc(
+                sizeof(double)*corrfunc->mu_len*corrfunc->sep_len
+            );
+
         gsl_error_handler_t *default_handler =
             gsl_set_error_handler_off();
 
-        #pragma omp parallel for num_threads(par->nthreads) collapse(2)
+        /* all of the points, with index i*sep_len + j */
+        const size_t len = corrfunc->mu_len*corrfunc->sep_len;
+        double *mu = (double *)coffe_malloc(sizeof(double)*len);
+        double *sep = (double *)coffe_malloc(sizeof(double)*len);
+        double *result = (double *)coffe_malloc(sizeof(double)*len);
         for (size_t i = 0; i<corrfunc->mu_len; ++i){
             for (size_t j = 0; j<corrfunc->sep_len; ++j){
-                (corrfunc->result)[i][j] =
-                    corrfunc_nonintegrated(
-                        par, bg, integral,
-                        corrfunc->mu[i], corrfunc->sep[j]*COFFE_H0
-                    );
+                mu[i*corrfunc->sep_len + j] = corrfunc->mu[i];
+                sep[i*corrfunc->sep_len + j] = corrfunc->sep[j]*COFFE_H0;
             }
         }
-        #pragma omp parallel for num_threads(par->nthreads) collapse(2)
-        for (size_t i = 0; i<corrfunc->mu_len; ++i){
-            for (size_t j = 0; j<corrfunc->sep_len; ++j){
-                (corrfunc->result)[i][j] +=
-                    corrfunc_single_integrated(
-                        par, bg, integral,
-                        corrfunc->mu[i], corrfunc->sep[j]*COFFE_H0
-                    );
-            }
-        }
-        #pragma omp parallel for num_threads(par->nthreads) collapse(2)
+
+        corrfunc_compute(
+            par, bg, integral, tables_ptr, limber_ptr,
+            len, mu, sep, result, corrfunc->error,
+            corrfunc->contributions, corrfunc->contributions_len
+        );
+
         for (size_t i = 0; i<corrfunc->mu_len; ++i){
             for (size_t j = 0; j<corrfunc->sep_len; ++j){
-                (corrfunc->result)[i][j] +=
-                    corrfunc_double_integrated(
-                        par, bg, integral,
-                        corrfunc->mu[i], corrfunc->sep[j]*COFFE_H0
-                    );
+                (corrfunc->result)[i][j] = result[i*corrfunc->sep_len + j];
             }
         }
+        free(mu);
+        free(sep);
+        free(result);
+
         gsl_set_error_handler(default_handler);
 
         end = clock();
@@ -533,8 +1346,41 @@ int coffe_corrfunc_init(
         printf("Calculating the 2D correlation function...\n");
         start = clock();
 
+        /* the grid given in the settings, otherwise the default one */
+        const double *sep_parallel = r_parallel, *sep_perpendicular = r_perpendicular;
+        cf2d->sep_parallel_len = r_p_len, cf2d->sep_perpendicular_len = r_p_len;
+        if (par->sep_parallel != NULL){
+            sep_parallel = par->sep_parallel;
+            cf2d->sep_parallel_len = (size_t)par->sep_parallel_len;
+        }
+        if (par->sep_perpendicular != NULL){
+            sep_perpendicular = par->sep_perpendicular;
+            cf2d->sep_perpendicular_len = (size_t)par->sep_perpendicular_len;
+        }
+
+        cf2d->sep_parallel =
+            (double *)coffe_malloc(sizeof(double)*cf2d->sep_parallel_len);
+        cf2d->sep_perpendicular =
+            (double *)coffe_malloc(sizeof(double)*cf2d->sep_perpendicular_len);
+        double sep_parallel_max = 0;
+        for (size_t i = 0; i<cf2d->sep_parallel_len; ++i){
+            cf2d->sep_parallel[i] = sep_parallel[i];
+            sep_parallel_max = fmax(sep_parallel_max, sep_parallel[i]);
+        }
+        double sep_perpendicular_max = 0;
+        for (size_t j = 0; j<cf2d->sep_perpendicular_len; ++j){
+            cf2d->sep_perpendicular[j] = sep_perpendicular[j];
+            sep_perpendicular_max = fmax(sep_perpendicular_max, sep_perpendicular[j]);
+        }
+        /* the polar grid reaches half of the largest separation along the line of sight */
+        if (par->corrfunc2d_multipole_max > 0)
+            sep_parallel_max = fmax(
+                sep_parallel_max,
+                hypot(sep_parallel_max, sep_perpendicular_max)/2.
+            );
+
         const double chi_mean = interp_spline(&bg->comoving_distance, par->z_mean);
-        if (chi_mean < 320.*COFFE_H0){
+        if (chi_mean < (sep_parallel_max + 20.)*COFFE_H0){
             fprintf(
                 stderr,
                 "ERROR: z_mean too small for 2D correlation function!\n"
@@ -542,57 +1388,64 @@ int coffe_corrfunc_init(
             exit(EXIT_FAILURE);
         }
 
-        /* first index mu, second separations */
+        /* first index sep_parallel, second sep_perpendicular */
         alloc_double_matrix(
-            &cf2d->result, r_p_len, r_p_len
+            &cf2d->result, cf2d->sep_parallel_len, cf2d->sep_perpendicular_len
         );
 
-        cf2d->sep_len = (size_t)r_p_len;
-        cf2d->sep_parallel =
-            (double *)coffe_malloc(sizeof(double)*cf2d->sep_len);
-        cf2d->sep_perpendicular =
-            (double *)coffe_malloc(sizeof(double)*cf2d->sep_len);
-        for (size_t i = 0; i<cf2d->sep_len; ++i){
-            cf2d->sep_parallel[i] = r_parallel[i];
-            cf2d->sep_perpendicular[i] = r_perpendicular[i];
+        /* all of the points, with index i*sep_perpendicular_len + j */
+        const size_t len = cf2d->sep_parallel_len*cf2d->sep_perpendicular_len;
+
+        cf2d->contributions = NULL;
+        cf2d->contributions_len = 0;
+        if (par->output_contributions){
+            cf2d->contributions_len = (size_t)par->corr_terms_len;
+            cf2d->contributions = (double *)coffe_malloc(
+                sizeof(double)*len*cf2d->contributions_len
+            );
         }
 
+        cf2d->error = NULL;
+        if (par->output_errors)
+            cf2d->error = (double *)coffe_malloc(sizeof(double)*len);
+
         gsl_error_handler_t *default_handler =
             gsl_set_error_handler_off();
 
-        #pragma omp parallel for num_threads(par->nthreads) collapse(2)
-        for (size_t i = 0; i<cf2d->sep_len; ++i){
-            for (size_t j = 0; j<cf2d->sep_len; ++j){
-                (cf2d->result)[i][j] =
-                    corrfunc_nonintegrated(
-                        par, bg, integral,
-                        cf2d->sep_parallel[i]/sqrt(pow(cf2d->sep_parallel[i], 2) + pow(cf2d->sep_perpendicular[j], 2)),
-                        sqrt(pow(cf2d->sep_parallel[i], 2) + pow(cf2d->sep_perpendicular[j], 2))*COFFE_H0
-                    );
-            }
+        double *result = (double *)coffe_malloc(sizeof(double)*len);
+        if (par->corrfunc2d_multipole_max > 0){
+            corrfunc2d_polar(
+                par, bg, integral, tables_ptr, limber_ptr, cf2d, result
+            );
         }
-        #pragma omp parallel for num_threads(par->nthreads) collapse(2)
-        for (size_t i = 0; i<cf2d->sep_len; ++i){
-            for (size_t j = 0; j<cf2d->sep_len; ++j){
-                (cf2d->result)[i][j] +=
-                    corrfunc_single_integrated(
-                        par, bg, integral,
-                        cf2d->sep_parallel[i]/sqrt(pow(cf2d->sep_parallel[i], 2) + pow(cf2d->sep_perpendicular[j], 2)),
-                        sqrt(pow(cf2d->sep_parallel[i], 2) + pow(cf2d->sep_perpendicular[j], 2))*COFFE_H0
-                    );
+        else{
+            double *mu = (double *)coffe_malloc(sizeof(double)*len);
+            double *sep = (double *)coffe_malloc(sizeof(double)*len);
+            for (size_t i = 0; i<cf2d->sep_parallel_len; ++i){
+                for (size_t j = 0; j<cf2d->sep_perpendicular_len; ++j){
+                    const size_t index = i*cf2d->sep_perpendicular_len + j;
+                    const double r = sqrt(pow(cf2d->sep_parallel[i], 2) + pow(cf2d->sep_perpendicular[j], 2));
+                    mu[index] = cf2d->sep_parallel[i]/r;
+                    sep[index] = r*COFFE_H0;
+                }
             }
+
+            corrfunc_compute(
+                par, bg, integral, tables_ptr, limber_ptr,
+                len, mu, sep, result, cf2d->error,
+                cf2d->contributions, cf2d->contributions_len
+            );
+            free(mu);
+            free(sep);
         }
-        #pragma omp parallel for num_threads(par->nthreads) collapse(2)
-        for (size_t i = 0; i<cf2d->sep_len; ++i){
-            for (size_t j = 0; j<cf2d->sep_len; ++j){
-                (cf2d->result)[i][j] +=
-                    corrfunc_double_integrated(
-                        par, bg, integral,
-                        cf2d->sep_parallel[i]/sqrt(pow(cf2d->sep_parallel[i], 2) + pow(cf2d->sep_perpendicular[j], 2)),
-                        sqrt(pow(cf2d->sep_parallel[i], 2) + pow(cf2d->sep_perpendicular[j], 2))*COFFE_H0
-                    );
+
+        for (size_t i = 0; i<cf2d->sep_parallel_len; ++i){
+            for (size_t j = 0; j<cf2d->sep_perpendicular_len; ++j){
+                (cf2d->result)[i][j] = result[i*cf2d->sep_perpendicular_len + j];
             }
         }
+        free(result);
+
         gsl_set_error_handler(default_handler);
 
         end = clock();
@@ -600,6 +1453,11 @@ int coffe_corrfunc_init(
             (double)(end - start) / CLOCKS_PER_SEC);
     }
 
+    if (tables_ptr != NULL)
+        functions_float_tables_free(&tables);
+    if (limber_ptr != NULL)
+        functions_limber_free(&limber);
+
     return EXIT_SUCCESS;
 }
 
@@ -610,6 +1468,8 @@ int coffe_corrfunc_ang_free(
     if (cf_ang->flag){
         free(cf_ang->theta);
         free(cf_ang->result);
+        free(cf_ang->contributions);
+        free(cf_ang->error);
         cf_ang->flag = 0;
     }
     return EXIT_SUCCESS;
@@ -626,6 +1486,8 @@ int coffe_corrfunc_free(
         free(cf->result);
         free(cf->sep);
         free(cf->mu);
+        free(cf->contributions);
+        free(cf->error);
         cf->flag = 0;
     }
     return EXIT_SUCCESS;
@@ -636,12 +1498,14 @@ int coffe_corrfunc2d_free(
 )
 {
     if (cf2d->flag){
-        for (size_t i = 0; i<cf2d->sep_len; ++i){
+        for (size_t i = 0; i<cf2d->sep_parallel_len; ++i){
             free(cf2d->result[i]);
         }
         free(cf2d->result);
         free(cf2d->sep_parallel);
         free(cf2d->sep_perpendicular);
+        free(cf2d->contributions);
+        free(cf2d->error);
         cf2d->flag = 0;
     }
     return EXIT_SUCCESS;
@@ -19,11 +19,24 @@
 #ifndef COFFE_CORRFUNC_H
 #define COFFE_CORRFUNC_H
 
+#ifndef CORRFUNC_MU_BANDS
+#define CORRFUNC_MU_BANDS 64 /* bands in mu with their own VEGAS grid (see integration_warm_start) */
+#endif
+
+#ifndef CORRFUNC_COST_TIERS
+#define CORRFUNC_COST_TIERS 8 /* tiers of the cost within which the points are ordered by mu and separation */
+#endif
+
 struct coffe_corrfunc_ang_t
 {
     double *result;
     double *theta;
     size_t theta_len;
+    /* the separate terms (as in corr_terms) if output_contributions is set, otherwise NULL */
+    double *contributions; /* index = i*contributions_len + term */
+    size_t contributions_len;
+    /* the estimated integration error if output_errors is set, otherwise NULL */
+    double *error; /* index = i */
     int flag;
 };
 
@@ -35,6 +48,11 @@ struct coffe_corrfunc_t
 
     size_t sep_len;
     size_t mu_len;
+    /* the separate terms (as in corr_terms) if output_contributions is set, otherwise NULL */
+    double *contributions; /* index = (i*sep_len + j)*contributions_len + term */
+    size_t contributions_len;
+    /* the estimated integration error if output_errors is set, otherwise NULL */
+    double *error; /* index = i*sep_len + j */
     int flag;
 };
 
@@ -42,8 +60,14 @@ struct coffe_corrfunc2d_t
 {
     double **result;
     double *sep_parallel;
+    size_t sep_parallel_len;
     double *sep_perpendicular;
-    size_t sep_len;
+    size_t sep_perpendicular_len;
+    /* the separate terms (as in corr_terms) if output_contributions is set, otherwise NULL */
+    double *contributions; /* index = (i*sep_perpendicular_len + j)*contributions_len + term */
+    size_t contributions_len;
+    /* the estimated integration error if output_errors is set, otherwise NULL */
+    double *error; /* index = i*sep_perpendicular_len + j */
     int flag;
 };
 
@@ -143,6 +143,138 @@ static double covariance_integral(
 }
 
 
+#ifndef COVARIANCE_BLOCK
+#define COVARIANCE_BLOCK 512
+#endif
+
+/**
+    computes all of the integrals of P(k) and P^2(k) above (D_l1l2 and G_l1l2)
+    on the grid of separations (m + 1)*pixelsize with one fixed Gauss-Legendre
+    quadrature in k, whose panels are one period of the fastest oscillation
+    long; the Bessel functions at the nodes are then shared between all of
+    the pairs of separations and multipoles, and every integral is just a
+    weighted sum of their products
+**/
+static int covariance_integrals_fast(
+    struct coffe_parameters_t *par,
+    struct coffe_interpolation *power_spectrum,
+    struct coffe_interpolation *power_spectrum2,
+    const int *l, size_t l_len,
+    double pixelsize, size_t npixels,
+    double **integral_pk,
+    double **integral_pk2
+)
+{
+    int l_max = l[0];
+    for (size_t i = 1; i<l_len; ++i){
+        if (l[i] > l_max) l_max = l[i];
+    }
+    const size_t l_size = (size_t)l_max + 1;
+    const size_t order = (size_t)par->covariance_integral_order;
+    const double chi_max = npixels*pixelsize;
+    const size_t panels =
+        (size_t)fmax(ceil((par->k_max - par->k_min)*chi_max/M_PI), 1);
+    const double panel_width = (par->k_max - par->k_min)/panels;
+    const size_t nodes = panels*order;
+
+    for (size_t i = 0; i<l_len; ++i){
+        for (size_t j = i; j<l_len; ++j){
+            for (size_t m = 0; m<npixels*npixels; ++m){
+                integral_pk[i*l_len + j][m] = 0;
+                integral_pk2[i*l_len + j][m] = 0;
+            }
+        }
+    }
+
+    gsl_integration_glfixed_table *table =
+        gsl_integration_glfixed_table_alloc(order);
+    double *x = (double *)coffe_malloc(sizeof(double)*order);
+    double *w = (double *)coffe_malloc(sizeof(double)*order);
+    for (size_t r = 0; r<order; ++r){
+        gsl_integration_glfixed_point(0, 1, r, &x[r], &w[r], table);
+    }
+    gsl_integration_glfixed_table_free(table);
+
+    double *k = (double *)coffe_malloc(sizeof(double)*COVARIANCE_BLOCK);
+    double *weight_pk = (double *)coffe_malloc(sizeof(double)*COVARIANCE_BLOCK);
+    double *weight_pk2 = (double *)coffe_malloc(sizeof(double)*COVARIANCE_BLOCK);
+    /* bessel[(m*l_size + l)*COVARIANCE_BLOCK + q] = j_l(k_q (m + 1) pixelsize) */
+    double *bessel =
+        (double *)coffe_malloc(sizeof(double)*npixels*l_size*COVARIANCE_BLOCK);
+
+    for (size_t start = 0; start<nodes; start += COVARIANCE_BLOCK){
+        const size_t len =
+            nodes - start < COVARIANCE_BLOCK ? nodes - start : COVARIANCE_BLOCK;
+
+        for (size_t q = 0; q<len; ++q){
+            const size_t panel = (start + q)/order, r = (start + q)%order;
+            k[q] = par->k_min + (panel + x[r])*panel_width;
+            weight_pk[q] =
+                w[r]*panel_width*k[q]*k[q]*interp_spline(power_spectrum, k[q]);
+            weight_pk2[q] =
+                w[r]*panel_width*k[q]*k[q]*interp_spline(power_spectrum2, k[q]);
+        }
+
+        #pragma omp parallel num_threads(par->nthreads)
+        {
+            double *temp = (double *)coffe_malloc(sizeof(double)*l_size);
+            #pragma omp for collapse(2)
+            for (size_t m = 0; m<npixels; ++m){
+                for (size_t q = 0; q<len; ++q){
+                    gsl_sf_bessel_jl_array(l_max, k[q]*(m + 1)*pixelsize, temp);
+                    for (size_t n = 0; n<l_size; ++n){
+                        bessel[(m*l_size + n)*COVARIANCE_BLOCK + q] = temp[n];
+                    }
+                }
+            }
+            free(temp);
+        }
+
+        #pragma omp parallel for num_threads(par->nthreads) collapse(2)
+        for (size_t m = 0; m<npixels; ++m){
+            for (size_t n = 0; n<npixels; ++n){
+                for (size_t i = 0; i<l_len; ++i){
+                    const double *bessel1 =
+                        &bessel[(m*l_size + l[i])*COVARIANCE_BLOCK];
+                    for (size_t j = i; j<l_len; ++j){
+                        const double *bessel2 =
+                            &bessel[(n*l_size + l[j])*COVARIANCE_BLOCK];
+                        double sum_pk = 0, sum_pk2 = 0;
+                        for (size_t q = 0; q<len; ++q){
+                            const double product = bessel1[q]*bessel2[q];
+                            sum_pk += product*weight_pk[q];
+                            sum_pk2 += product*weight_pk2[q];
+                        }
+                        integral_pk[i*l_len + j][npixels*n + m] += sum_pk;
+                        integral_pk2[i*l_len + j][npixels*n + m] += sum_pk2;
+                    }
+                }
+            }
+        }
+    }
+
+    /* same normalization as covariance_integral and the adaptive case */
+    for (size_t i = 0; i<l_len; ++i){
+        for (size_t j = i; j<l_len; ++j){
+            const double prefactor = 2*(2*l[i] + 1)*(2*l[j] + 1)/M_PI/M_PI;
+            for (size_t m = 0; m<npixels*npixels; ++m){
+                integral_pk[i*l_len + j][m] *= prefactor;
+                integral_pk2[i*l_len + j][m] *= prefactor/2.;
+            }
+        }
+    }
+
+    free(x);
+    free(w);
+    free(k);
+    free(weight_pk);
+    free(weight_pk2);
+    free(bessel);
+
+    return EXIT_SUCCESS;
+}
+
+
 /**
     computes the covariance of either multipoles or redshift averaged
     multipoles
@@ -258,32 +390,43 @@ int coffe_covariance_init(
         }
 
         /* calculating the integrals G_l1l2 and D_l1l2 (without the scale factor D1) */
-        for (size_t i = 0; i<cov_mp->l_len; ++i){
-            for (size_t j = i; j<cov_mp->l_len; ++j){
-                #pragma omp parallel for num_threads(par->nthreads) collapse(2)
-                for (size_t m = 0; m<npixels_max; ++m){
-                    for (size_t n = 0; n<npixels_max; ++n){
-                        integral_pk[i*cov_mp->l_len + j][npixels_max*n + m] =
-                            (2*cov_mp->l[i] + 1)*(2*cov_mp->l[j] + 1)
-                           *covariance_integral(
-                                &integrand_pk,
-                                (m + 1)*cov_mp->pixelsize, (n + 1)*cov_mp->pixelsize,
-                                cov_mp->l[i], cov_mp->l[j],
-                                par->k_min, par->k_max
-                            )/M_PI;
+        if (par->covariance_integral_order > 0){
+            covariance_integrals_fast(
+                par,
+                &integrand_pk, &integrand_pk2,
+                cov_mp->l, cov_mp->l_len,
+                cov_mp->pixelsize, npixels_max,
+                integral_pk, integral_pk2
+            );
+        }
+        else {
+            for (size_t i = 0; i<cov_mp->l_len; ++i){
+                for (size_t j = i; j<cov_mp->l_len; ++j){
+                    #pragma omp parallel for num_threads(par->nthreads) collapse(2)
+                    for (size_t m = 0; m<npixels_max; ++m){
+                        for (size_t n = 0; n<npixels_max; ++n){
+                            integral_pk[i*cov_mp->l_len + j][npixels_max*n + m] =
+                                (2*cov_mp->l[i] + 1)*(2*cov_mp->l[j] + 1)
+                               *covariance_integral(
+                                    &integrand_pk,
+                                    (m + 1)*cov_mp->pixelsize, (n + 1)*cov_mp->pixelsize,
+                                    cov_mp->l[i], cov_mp->l[j],
+                                    par->k_min, par->k_max
+                                )/M_PI;
+                        }
                     }
-                }
-                #pragma omp parallel for num_threads(par->nthreads) collapse(2)
-                for (size_t m = 0; m<npixels_max; ++m){
-                    for (size_t n = 0; n<npixels_max; ++n){
-                        integral_pk2[i*cov_mp->l_len + j][npixels_max*n + m] =
-                            (2*cov_mp->l[i] + 1)*(2*cov_mp->l[j] + 1)
-                           *covariance_integral(
-                                &integrand_pk2,
-                                (m + 1)*cov_mp->pixelsize, (n + 1)*cov_mp->pixelsize,
-                                cov_mp->l[i], cov_mp->l[j],
-                                par->k_min, par->k_max
-                            )/2./M_PI;
+                    #pragma omp parallel for num_threads(par->nthreads) collapse(2)
+                    for (size_t m = 0; m<npixels_max; ++m){
+                        for (size_t n = 0; n<npixels_max; ++n){
+                            integral_pk2[i*cov_mp->l_len + j][npixels_max*n + m] =
+                                (2*cov_mp->l[i] + 1)*(2*cov_mp->l[j] + 1)
+                               *covariance_integral(
+                                    &integrand_pk2,
+                                    (m + 1)*cov_mp->pixelsize, (n + 1)*cov_mp->pixelsize,
+                                    cov_mp->l[i], cov_mp->l[j],
+                                    par->k_min, par->k_max
+                                )/2./M_PI;
+                        }
                     }
                 }
             }
@@ -523,32 +666,43 @@ int coffe_covariance_init(
         }
 
         /* calculating the integrals G_l1l2 and D_l1l2 (without the scale factor D1) */
-        for (size_t i = 0; i<cov_ramp->l_len; ++i){
-            for (size_t j = i; j<cov_ramp->l_len; ++j){
-                #pragma omp parallel for num_threads(par->nthreads) collapse(2)
-                for (size_t m = 0; m<npixels_max; ++m){
-                    for (size_t n = 0; n<npixels_max; ++n){
-                        integral_pk[i*cov_ramp->l_len + j][npixels_max*n + m] =
-                            (2*cov_ramp->l[i] + 1)*(2*cov_ramp->l[j] + 1)
-                           *covariance_integral(
-                                &integrand_pk,
-                                (m + 1)*cov_ramp->pixelsize, (n + 1)*cov_ramp->pixelsize,
-                                cov_ramp->l[i], cov_ramp->l[j],
-                                par->k_min, par->k_max
-                            )/M_PI;
+        if (par->covariance_integral_order > 0){
+            covariance_integrals_fast(
+                par,
+                &integrand_pk, &integrand_pk2,
+                cov_ramp->l, cov_ramp->l_len,
+                cov_ramp->pixelsize, npixels_max,
+                integral_pk, integral_pk2
+            );
+        }
+        else {
+            for (size_t i = 0; i<cov_ramp->l_len; ++i){
+                for (size_t j = i; j<cov_ramp->l_len; ++j){
+                    #pragma omp parallel for num_threads(par->nthreads) collapse(2)
+                    for (size_t m = 0; m<npixels_max; ++m){
+                        for (size_t n = 0; n<npixels_max; ++n){
+                            integral_pk[i*cov_ramp->l_len + j][npixels_max*n + m] =
+                                (2*cov_ramp->l[i] + 1)*(2*cov_ramp->l[j] + 1)
+                               *covariance_integral(
+                                    &integrand_pk,
+                                    (m + 1)*cov_ramp->pixelsize, (n + 1)*cov_ramp->pixelsize,
+                                    cov_ramp->l[i], cov_ramp->l[j],
+                                    par->k_min, par->k_max
+                                )/M_PI;
+                        }
                     }
-                }
-                #pragma omp parallel for num_threads(par->nthreads) collapse(2)
-                for (size_t m = 0; m<npixels_max; ++m){
-                    for (size_t n = 0; n<npixels_max; ++n){
-                        integral_pk2[i*cov_ramp->l_len + j][npixels_max*n + m] =
-                            (2*cov_ramp->l[i] + 1)*(2*cov_ramp->l[j] + 1)
-                           *covariance_integral(
-                                &integrand_pk2,
-                                (m + 1)*cov_ramp->pixelsize, (n + 1)*cov_ramp->pixelsize,
-                                cov_ramp->l[i], cov_ramp->l[j],
-                                par->k_min, par->k_max
-                            )/2./M_PI;
+                    #pragma omp parallel for num_threads(par->nthreads) collapse(2)
+                    for (size_t m = 0; m<npixels_max; ++m){
+                        for (size_t n = 0; n<npixels_max; ++n){
+                            integral_pk2[i*cov_ramp->l_len + j][npixels_max*n + m] =
+                                (2*cov_ramp->l[i] + 1)*(2*cov_ramp->l[j] + 1)
+                               *covariance_integral(
+                                    &integrand_pk2,
+                                    (m + 1)*cov_ramp->pixelsize, (n + 1)*cov_ramp->pixelsize,
+                                    cov_ramp->l[i], cov_ramp->l[j],
+                                    par->k_min, par->k_max
+                                )/2./M_PI;
+                        }
                     }
                 }
             }
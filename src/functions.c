@@ -19,25 +19,57 @@
 #include <math.h>
 #include <string.h>
 #include <gsl/gsl_math.h>
+#include <gsl/gsl_integration.h>
+#include <gsl/gsl_rng.h>
+#include <gsl/gsl_sf_legendre.h>
 
 #include "common.h"
 #include "background.h"
 #include "integrals.h"
 #include "functions.h"
 
+/**
+    the kernels below are written once for an arbitrary bitmask of terms;
+    they are forced inline so that, when called with a constant bitmask
+    (see COFFE_KERNEL_SETS), the compiler drops all the terms not in it
+**/
+
+#if defined(__GNUC__)
+#define FUNCTIONS_INLINE static inline __attribute__((always_inline))
+#else
+#define FUNCTIONS_INLINE static inline
+#endif
+
+/**
+    adds a term to the result, and also stores it on its own if
+    the caller wants the individual contributions (an array of
+    COFFE_TERMS_LEN values, indexed by COFFE_TERM_INDEX)
+**/
+
+#define FUNCTIONS_ADD_TERM(I, J, TERM) \
+    do { \
+        result += (TERM); \
+        if (contributions != NULL) \
+            contributions[COFFE_TERM_INDEX(I, J)] = (TERM); \
+    } while (0)
+
 /**
     all the nonintegrated terms in one place
 **/
 
-double functions_nonintegrated(
+FUNCTIONS_INLINE double functions_nonintegrated_kernel(
     struct coffe_parameters_t *par,
     struct coffe_background_t *bg,
     struct coffe_integrals_t integral[],
     double z_mean,
     double mu,
-    double sep
+    double sep,
+    const uint64_t terms,
+    double contributions[]
 )
 {
+    if (!(terms & COFFE_TERMS_NONINTEGRATED)) return 0;
+
     double chi_mean = interp_spline(&bg->comoving_distance, z_mean);
     double chi1 = chi_mean - sep*mu/2.;
     double chi2 = chi_mean + sep*mu/2.;
@@ -46,490 +78,510 @@ double functions_nonintegrated(
        /(2.*chi_mean*chi_mean - mu*mu*sep*sep/2.);
 
     double result = 0;
-    int len = par->correlation_sources_len*(par->correlation_sources_len + 1)/2;
     double z1 = interp_spline(&bg->z_as_chi, chi1);
     double z2 = interp_spline(&bg->z_as_chi, chi2);
-    double f1 = interp_spline(&bg->f, z1);
-    double f2 = interp_spline(&bg->f, z2);
-    double curlyH1 = interp_spline(&bg->conformal_Hz, z1); // dimensionless
-    double curlyH2 = interp_spline(&bg->conformal_Hz, z2); // dimensionless
-    double b1 = interp_spline(&par->matter_bias1, z1);
-    double b2 = interp_spline(&par->matter_bias2, z2);
-    double G1 = interp_spline(&bg->G1, z1);
-    double G2 = interp_spline(&bg->G2, z2);
-    double s1 = interp_spline(&par->magnification_bias1, z1);
-    double s2 = interp_spline(&par->magnification_bias2, z2);
-    double fevo1 = interp_spline(&par->evolution_bias1, z1);
-    double fevo2 = interp_spline(&par->evolution_bias2, z2);
-    double a1 = interp_spline(&bg->a, z1);
-    double a2 = interp_spline(&bg->a, z2);
-    for (int i = 0; i<len; ++i){
-        /* den-den term */
-        if (strcmp(par->corr_terms[i], "00") == 0){
-            result += b1*b2
-               *interp_spline(&integral[0].result, sep);
-        }
-        /* rsd-rsd term */
-        else if (strcmp(par->corr_terms[i], "11") == 0){
-            result +=
-                f1*f2*(1 + 2*pow(costheta, 2))/15
-               *interp_spline(&integral[0].result, sep)
-                -
-                f1*f2/21.*(
-                    (1 + 11.*pow(costheta, 2)) + 18*costheta*(pow(costheta, 2) - 1)*chi1*chi2/sep/sep
-                )
-               *interp_spline(&integral[1].result, sep)
+
+    /* only looking up the quantities that the terms actually need */
+    double f1 = 0, f2 = 0;
+    if (terms & (COFFE_TERMS_WITH(1) | COFFE_TERMS_WITH(2) | COFFE_TERMS_WITH(3) | COFFE_TERMS_WITH(6))){
+        f1 = interp_spline(&bg->f, z1);
+        f2 = interp_spline(&bg->f, z2);
+    }
+    double curlyH1 = 0, curlyH2 = 0; // dimensionless
+    if (terms & (COFFE_TERMS_WITH(2) | COFFE_TERMS_WITH(3))){
+        curlyH1 = interp_spline(&bg->conformal_Hz, z1);
+        curlyH2 = interp_spline(&bg->conformal_Hz, z2);
+    }
+    double b1 = 0, b2 = 0;
+    if (terms & COFFE_TERMS_WITH(0)){
+        b1 = interp_spline(&par->matter_bias1, z1);
+        b2 = interp_spline(&par->matter_bias2, z2);
+    }
+    double G1 = 0, G2 = 0;
+    if (terms & (COFFE_TERMS_WITH(2) | COFFE_TERMS_WITH(4))){
+        G1 = interp_spline(&bg->G1, z1);
+        G2 = interp_spline(&bg->G2, z2);
+    }
+    double s1 = 0, s2 = 0;
+    if (terms & COFFE_TERMS_WITH(5)){
+        s1 = interp_spline(&par->magnification_bias1, z1);
+        s2 = interp_spline(&par->magnification_bias2, z2);
+    }
+    double fevo1 = 0, fevo2 = 0;
+    if (terms & COFFE_TERMS_WITH(3)){
+        fevo1 = interp_spline(&par->evolution_bias1, z1);
+        fevo2 = interp_spline(&par->evolution_bias2, z2);
+    }
+    double a1 = 1, a2 = 1;
+    if (terms & (COFFE_TERMS_WITH(4) | COFFE_TERMS_WITH(5) | COFFE_TERMS_WITH(6))){
+        a1 = interp_spline(&bg->a, z1);
+        a2 = interp_spline(&bg->a, z2);
+    }
+
+    /* den-den term */
+    if (terms & COFFE_TERM(0, 0)){
+        double term = 0;
+        term += b1*b2
+           *interp_spline(&integral[0].result, sep);
+        FUNCTIONS_ADD_TERM(0, 0, term);
+    }
+    /* rsd-rsd term */
+    if (terms & COFFE_TERM(1, 1)){
+        double term = 0;
+        term +=
+            f1*f2*(1 + 2*pow(costheta, 2))/15
+           *interp_spline(&integral[0].result, sep)
+            -
+            f1*f2/21.*(
+                (1 + 11.*pow(costheta, 2)) + 18*costheta*(pow(costheta, 2) - 1)*chi1*chi2/sep/sep
+            )
+           *interp_spline(&integral[1].result, sep)
+            +
+            f1*f2*(
+                4*(3*pow(costheta, 2) - 1)*(pow(chi1, 4) + pow(chi2, 4))/35./pow(sep, 4)
                 +
-                f1*f2*(
-                    4*(3*pow(costheta, 2) - 1)*(pow(chi1, 4) + pow(chi2, 4))/35./pow(sep, 4)
-                    +
-                    chi1*chi2*(3 + pow(costheta, 2))*(
-                        3*(3 + pow(costheta, 2))*chi1*chi2 - 8*(pow(chi1, 2) + pow(chi2, 2))*costheta
-                    )/35./pow(sep, 4)
-                )
-               *interp_spline(&integral[2].result, sep);
-        }
-        /* d1-d1 term */
-        else if (strcmp(par->corr_terms[i], "22") == 0){
-            result +=
-                (
-                    curlyH1*curlyH2*f1*f2*G1*G2
-                   *costheta/3.
-                   *interp_spline(&integral[5].result, sep)
-                    +
-                    curlyH1*curlyH2*f1*f2*G1*G2
-                   *(
-                        (chi2 - chi1*costheta)*(chi1 - chi2*costheta)
-                        +
-                        pow(sep, 2)*costheta/3.
-                    )
-                   *interp_spline(&integral[6].result, sep)
-                );
-        }
-        /* d2-d2 term */
-        else if (strcmp(par->corr_terms[i], "33") == 0){
-            result +=
-                (3 - fevo1)*(3 - fevo2)*pow(curlyH1, 2)*pow(curlyH2, 2)*f1*f2
-               *(
-                    interp_spline(&integral[8].result, sep)
-                    /* renormalization term */
-                   -gsl_spline2d_eval(
-                        integral[8].renormalization.spline,
-                        chi1, chi2,
-                        integral[8].renormalization.xaccel,
-                        integral[8].renormalization.yaccel
-                    )
-                );
-        }
-        /* g1-g1 term */
-        else if (strcmp(par->corr_terms[i], "44") == 0){
-            result += 9*pow(par->Omega0_m, 2)
-               *(1 + G1)*(1 + G2)/4/a1/a2
-               *(
-                    interp_spline(&integral[8].result, sep)
-                    /* renormalization term */
-                   -gsl_spline2d_eval(
-                        integral[8].renormalization.spline,
-                        chi1, chi2,
-                        integral[8].renormalization.xaccel,
-                        integral[8].renormalization.yaccel
-                    )
-                );
-        }
-        /* g2-g2 term */
-        else if (strcmp(par->corr_terms[i], "55") == 0){
-            result += 9*pow(par->Omega0_m, 2)
-               *(5*s1 - 2)*(5*s2 - 2)/4/a1/a2
-               *(
-                    interp_spline(&integral[8].result, sep)
-                    /* renormalization term */
-                   -gsl_spline2d_eval(
-                        integral[8].renormalization.spline,
-                        chi1, chi2,
-                        integral[8].renormalization.xaccel,
-                        integral[8].renormalization.yaccel
-                    )
-                );
-        }
-        /* g3-g3 term */
-        else if (strcmp(par->corr_terms[i], "66") == 0){
-            result += 9*pow(par->Omega0_m, 2)
-               *(f1 - 1)*(f2 - 1)/4/a1/a2
+                chi1*chi2*(3 + pow(costheta, 2))*(
+                    3*(3 + pow(costheta, 2))*chi1*chi2 - 8*(pow(chi1, 2) + pow(chi2, 2))*costheta
+                )/35./pow(sep, 4)
+            )
+           *interp_spline(&integral[2].result, sep);
+        FUNCTIONS_ADD_TERM(1, 1, term);
+    }
+    /* d1-d1 term */
+    if (terms & COFFE_TERM(2, 2)){
+        double term = 0;
+        term +=
+            (
+                curlyH1*curlyH2*f1*f2*G1*G2
+               *costheta/3.
+               *interp_spline(&integral[5].result, sep)
+                +
+                curlyH1*curlyH2*f1*f2*G1*G2
                *(
-                    interp_spline(&integral[8].result, sep)
-                    /* renormalization term */
-                   -gsl_spline2d_eval(
-                        integral[8].renormalization.spline,
-                        chi1, chi2,
-                        integral[8].renormalization.xaccel,
-                        integral[8].renormalization.yaccel
-                    )
-                );
-        }
-        /* den-rsd + rsd-den term */
-        else if (
-            strcmp(par->corr_terms[i], "01") == 0 ||
-            strcmp(par->corr_terms[i], "10") == 0
-        ){
-            result += (b1*f2/3. + b2*f1/3.)
-               *interp_spline(&integral[0].result, sep)
-               -
-                (
-                    b1*f2*(2./3. - (1. - pow(costheta, 2))*pow(chi1/sep, 2))
-                    +
-                    b2*f1*(2./3. - (1. - pow(costheta, 2))*pow(chi2/sep, 2))
-                )
-               *interp_spline(&integral[1].result, sep);
-        }
-        /* den-d1 + d1-den term */
-        else if (
-            strcmp(par->corr_terms[i], "02") == 0 ||
-            strcmp(par->corr_terms[i], "20") == 0
-        ){
-            result += -(
-                    b1*f2*curlyH2*G2*(chi1*costheta - chi2)
-                    +
-                    b2*f1*curlyH1*G1*(chi2*costheta - chi1)
-                )
-               *interp_spline(&integral[3].result, sep);
-        }
-        /* den-d2 + d2-den term */
-        else if (
-            strcmp(par->corr_terms[i], "03") == 0 ||
-            strcmp(par->corr_terms[i], "30") == 0
-        ){
-            result += (
-                    (3 - fevo2)*b1*f2*pow(curlyH2, 2)
-                    +
-                    (3 - fevo1)*b2*f1*pow(curlyH1, 2)
-                )
-               *interp_spline(&integral[5].result, sep);
-        }
-        /* den-g1 + g1-den term */
-        else if (
-            strcmp(par->corr_terms[i], "04") == 0 ||
-            strcmp(par->corr_terms[i], "40") == 0
-        ){
-            result += -(
-                    b1*3*par->Omega0_m/2/a2*(1 + G2)
-                    +
-                    b2*3*par->Omega0_m/2/a1*(1 + G1)
-                )
-               *interp_spline(&integral[5].result, sep);
-        }
-        /* den-g2 + g2-den term */
-        else if (
-            strcmp(par->corr_terms[i], "05") == 0 ||
-            strcmp(par->corr_terms[i], "50") == 0
-        ){
-            result += -(
-                    b1*3*par->Omega0_m/2/a2*(5*s2 - 2)
-                    +
-                    b2*3*par->Omega0_m/2/a1*(5*s1 - 2)
-                )
-               *interp_spline(&integral[5].result, sep);
-        }
-        /* den-g3 + g3-den term */
-        else if (
-            strcmp(par->corr_terms[i], "06") == 0 ||
-            strcmp(par->corr_terms[i], "60") == 0
-        ){
-            result += -(
-                    b1*3*par->Omega0_m/2/a2*(f2 - 1)
-                    +
-                    b2*3*par->Omega0_m/2/a1*(f1 - 1)
-                )
-               *interp_spline(&integral[5].result, sep);
-        }
-        /* rsd-d1 + d1-rsd term */
-        else if (
-            strcmp(par->corr_terms[i], "12") == 0 ||
-            strcmp(par->corr_terms[i], "21") == 0
-        ){
-            result += (
-                (
-                    f1*f2*curlyH2*G2*((1. + 2*pow(costheta, 2))*chi2 - 3*chi1*costheta)/5.
+                    (chi2 - chi1*costheta)*(chi1 - chi2*costheta)
                     +
-                    f2*f1*curlyH1*G1*((1. + 2*pow(costheta, 2))*chi1 - 3*chi2*costheta)/5.
+                    pow(sep, 2)*costheta/3.
                 )
-               *interp_spline(&integral[3].result, sep)
-                + (
-                    f1*f2*curlyH2*G2*(
-                        (1. - 3*costheta*costheta)*pow(chi2, 3)
-                        +
-                        costheta*(5. + pow(costheta, 2))*pow(chi2, 2)*chi1
-                        -
-                        2*(2. + pow(costheta, 2))*chi2*pow(chi1, 2)
-                        +
-                        2*pow(chi1, 3)*costheta
-                    )/5
-                    +
-                    f2*f1*curlyH1*G1*(
-                        (1. - 3*costheta*costheta)*pow(chi1, 3)
-                        +
-                        costheta*(5. + pow(costheta, 2))*pow(chi1, 2)*chi2
-                        -
-                        2*(2. + pow(costheta, 2))*chi1*pow(chi2, 2)
-                        +
-                        2*pow(chi2, 3)*costheta
-                    )/5
-                )
-               *interp_spline(&integral[4].result, sep)/pow(sep, 2)
+               *interp_spline(&integral[6].result, sep)
             );
-        }
-        /* rsd-d2 + d2-rsd term */
-        else if (
-            strcmp(par->corr_terms[i], "13") == 0 ||
-            strcmp(par->corr_terms[i], "31") == 0
-        ){
-            result += (
-                (
-                    (3 - fevo2)/3*f1*f2*pow(curlyH2, 2)
-                    +
-                    (3 - fevo1)/3*f2*f1*pow(curlyH1, 2)
+        FUNCTIONS_ADD_TERM(2, 2, term);
+    }
+    /* d2-d2 term */
+    if (terms & COFFE_TERM(3, 3)){
+        double term = 0;
+        term +=
+            (3 - fevo1)*(3 - fevo2)*pow(curlyH1, 2)*pow(curlyH2, 2)*f1*f2
+           *(
+                interp_spline(&integral[8].result, sep)
+                /* renormalization term */
+               -gsl_spline2d_eval(
+                    integral[8].renormalization.spline,
+                    chi1, chi2,
+                    integral[8].renormalization.xaccel,
+                    integral[8].renormalization.yaccel
                 )
-               *interp_spline(&integral[5].result, sep)
-                - (
-                    (3 - fevo2)*f1*f2*pow(curlyH2, 2)*(2./3*pow(sep, 2) - (1 - pow(costheta, 2))*pow(chi2, 2))
-                    +
-                    (3 - fevo1)*f2*f1*pow(curlyH1, 2)*(2./3*pow(sep, 2) - (1 - pow(costheta, 2))*pow(chi1, 2))
+            );
+        FUNCTIONS_ADD_TERM(3, 3, term);
+    }
+    /* g1-g1 term */
+    if (terms & COFFE_TERM(4, 4)){
+        double term = 0;
+        term += 9*pow(par->Omega0_m, 2)
+           *(1 + G1)*(1 + G2)/4/a1/a2
+           *(
+                interp_spline(&integral[8].result, sep)
+                /* renormalization term */
+               -gsl_spline2d_eval(
+                    integral[8].renormalization.spline,
+                    chi1, chi2,
+                    integral[8].renormalization.xaccel,
+                    integral[8].renormalization.yaccel
                 )
-               *interp_spline(&integral[6].result, sep)
             );
-        }
-        /* rsd-g1 + g1-rsd term */
-        else if (
-            strcmp(par->corr_terms[i], "14") == 0 ||
-            strcmp(par->corr_terms[i], "41") == 0
-        ){
-            result += -(
-                    par->Omega0_m/2./a2*f1*(1 + G2)
-                    +
-                    par->Omega0_m/2./a1*f2*(1 + G1)
+        FUNCTIONS_ADD_TERM(4, 4, term);
+    }
+    /* g2-g2 term */
+    if (terms & COFFE_TERM(5, 5)){
+        double term = 0;
+        term += 9*pow(par->Omega0_m, 2)
+           *(5*s1 - 2)*(5*s2 - 2)/4/a1/a2
+           *(
+                interp_spline(&integral[8].result, sep)
+                /* renormalization term */
+               -gsl_spline2d_eval(
+                    integral[8].renormalization.spline,
+                    chi1, chi2,
+                    integral[8].renormalization.xaccel,
+                    integral[8].renormalization.yaccel
                 )
-               *interp_spline(&integral[5].result, sep)
-                + (
-                    3*par->Omega0_m/2./a2*f1*(1 + G2)*(2./3*pow(sep, 2) - (1 - pow(costheta, 2))*pow(chi2, 2))
-                    +
-                    3*par->Omega0_m/2./a1*f2*(1 + G1)*(2./3*pow(sep, 2) - (1 - pow(costheta, 2))*pow(chi1, 2))
+            );
+        FUNCTIONS_ADD_TERM(5, 5, term);
+    }
+    /* g3-g3 term */
+    if (terms & COFFE_TERM(6, 6)){
+        double term = 0;
+        term += 9*pow(par->Omega0_m, 2)
+           *(f1 - 1)*(f2 - 1)/4/a1/a2
+           *(
+                interp_spline(&integral[8].result, sep)
+                /* renormalization term */
+               -gsl_spline2d_eval(
+                    integral[8].renormalization.spline,
+                    chi1, chi2,
+                    integral[8].renormalization.xaccel,
+                    integral[8].renormalization.yaccel
                 )
-               *interp_spline(&integral[6].result, sep);
-        }
-        /* rsd-g2 + g2-rsd term */
-        else if (
-            strcmp(par->corr_terms[i], "15") == 0 ||
-            strcmp(par->corr_terms[i], "51") == 0
-        ){
-            result += -(
-                    par->Omega0_m/2./a2*f1*(5*s2 - 2)
+            );
+        FUNCTIONS_ADD_TERM(6, 6, term);
+    }
+    /* den-rsd + rsd-den term */
+    if (terms & COFFE_TERM(0, 1)){
+        double term = 0;
+        term += (b1*f2/3. + b2*f1/3.)
+           *interp_spline(&integral[0].result, sep)
+           -
+            (
+                b1*f2*(2./3. - (1. - pow(costheta, 2))*pow(chi1/sep, 2))
+                +
+                b2*f1*(2./3. - (1. - pow(costheta, 2))*pow(chi2/sep, 2))
+            )
+           *interp_spline(&integral[1].result, sep);
+        FUNCTIONS_ADD_TERM(0, 1, term);
+    }
+    /* den-d1 + d1-den term */
+    if (terms & COFFE_TERM(0, 2)){
+        double term = 0;
+        term += -(
+                b1*f2*curlyH2*G2*(chi1*costheta - chi2)
+                +
+                b2*f1*curlyH1*G1*(chi2*costheta - chi1)
+            )
+           *interp_spline(&integral[3].result, sep);
+        FUNCTIONS_ADD_TERM(0, 2, term);
+    }
+    /* den-d2 + d2-den term */
+    if (terms & COFFE_TERM(0, 3)){
+        double term = 0;
+        term += (
+                (3 - fevo2)*b1*f2*pow(curlyH2, 2)
+                +
+                (3 - fevo1)*b2*f1*pow(curlyH1, 2)
+            )
+           *interp_spline(&integral[5].result, sep);
+        FUNCTIONS_ADD_TERM(0, 3, term);
+    }
+    /* den-g1 + g1-den term */
+    if (terms & COFFE_TERM(0, 4)){
+        double term = 0;
+        term += -(
+                b1*3*par->Omega0_m/2/a2*(1 + G2)
+                +
+                b2*3*par->Omega0_m/2/a1*(1 + G1)
+            )
+           *interp_spline(&integral[5].result, sep);
+        FUNCTIONS_ADD_TERM(0, 4, term);
+    }
+    /* den-g2 + g2-den term */
+    if (terms & COFFE_TERM(0, 5)){
+        double term = 0;
+        term += -(
+                b1*3*par->Omega0_m/2/a2*(5*s2 - 2)
+                +
+                b2*3*par->Omega0_m/2/a1*(5*s1 - 2)
+            )
+           *interp_spline(&integral[5].result, sep);
+        FUNCTIONS_ADD_TERM(0, 5, term);
+    }
+    /* den-g3 + g3-den term */
+    if (terms & COFFE_TERM(0, 6)){
+        double term = 0;
+        term += -(
+                b1*3*par->Omega0_m/2/a2*(f2 - 1)
+                +
+                b2*3*par->Omega0_m/2/a1*(f1 - 1)
+            )
+           *interp_spline(&integral[5].result, sep);
+        FUNCTIONS_ADD_TERM(0, 6, term);
+    }
+    /* rsd-d1 + d1-rsd term */
+    if (terms & COFFE_TERM(1, 2)){
+        double term = 0;
+        term += (
+            (
+                f1*f2*curlyH2*G2*((1. + 2*pow(costheta, 2))*chi2 - 3*chi1*costheta)/5.
+                +
+                f2*f1*curlyH1*G1*((1. + 2*pow(costheta, 2))*chi1 - 3*chi2*costheta)/5.
+            )
+           *interp_spline(&integral[3].result, sep)
+            + (
+                f1*f2*curlyH2*G2*(
+                    (1. - 3*costheta*costheta)*pow(chi2, 3)
                     +
-                    par->Omega0_m/2./a1*f2*(5*s1 - 2)
-                )
-               *interp_spline(&integral[5].result, sep)
-                + (
-                    3*par->Omega0_m/2./a2*f1*(5*s2 - 2)*(2./3*pow(sep, 2) - (1 - pow(costheta, 2))*pow(chi2, 2))
+                    costheta*(5. + pow(costheta, 2))*pow(chi2, 2)*chi1
+                    -
+                    2*(2. + pow(costheta, 2))*chi2*pow(chi1, 2)
                     +
-                    3*par->Omega0_m/2./a1*f2*(5*s1 - 2)*(2./3*pow(sep, 2) - (1 - pow(costheta, 2))*pow(chi1, 2))
-                )
-               *interp_spline(&integral[6].result, sep);
-        }
-        /* rsd-g3 + g3-rsd term */
-        else if (
-            strcmp(par->corr_terms[i], "16") == 0 ||
-            strcmp(par->corr_terms[i], "61") == 0
-        ){
-            result += -(
-                    par->Omega0_m/2./a2*f1*(f2 - 1)
+                    2*pow(chi1, 3)*costheta
+                )/5
+                +
+                f2*f1*curlyH1*G1*(
+                    (1. - 3*costheta*costheta)*pow(chi1, 3)
                     +
-                    par->Omega0_m/2./a1*f2*(f1 - 1)
-                )
-               *interp_spline(&integral[5].result, sep)
-                + (
-                    3*par->Omega0_m/2./a2*f1*(f2 - 1)*(2./3*pow(sep, 2) - (1 - pow(costheta, 2))*pow(chi2, 2))
+                    costheta*(5. + pow(costheta, 2))*pow(chi1, 2)*chi2
+                    -
+                    2*(2. + pow(costheta, 2))*chi1*pow(chi2, 2)
                     +
-                    3*par->Omega0_m/2./a1*f2*(f1 - 1)*(2./3*pow(sep, 2) - (1 - pow(costheta, 2))*pow(chi1, 2))
-                )
-               *interp_spline(&integral[6].result, sep);
+                    2*pow(chi2, 3)*costheta
+                )/5
+            )
+           *interp_spline(&integral[4].result, sep)/pow(sep, 2)
+        );
+        FUNCTIONS_ADD_TERM(1, 2, term);
+    }
+    /* rsd-d2 + d2-rsd term */
+    if (terms & COFFE_TERM(1, 3)){
+        double term = 0;
+        term += (
+            (
+                (3 - fevo2)/3*f1*f2*pow(curlyH2, 2)
+                +
+                (3 - fevo1)/3*f2*f1*pow(curlyH1, 2)
+            )
+           *interp_spline(&integral[5].result, sep)
+            - (
+                (3 - fevo2)*f1*f2*pow(curlyH2, 2)*(2./3*pow(sep, 2) - (1 - pow(costheta, 2))*pow(chi2, 2))
+                +
+                (3 - fevo1)*f2*f1*pow(curlyH1, 2)*(2./3*pow(sep, 2) - (1 - pow(costheta, 2))*pow(chi1, 2))
+            )
+           *interp_spline(&integral[6].result, sep)
+        );
+        FUNCTIONS_ADD_TERM(1, 3, term);
+    }
+    /* rsd-g1 + g1-rsd term */
+    if (terms & COFFE_TERM(1, 4)){
+        double term = 0;
+        term += -(
+                par->Omega0_m/2./a2*f1*(1 + G2)
+                +
+                par->Omega0_m/2./a1*f2*(1 + G1)
+            )
+           *interp_spline(&integral[5].result, sep)
+            + (
+                3*par->Omega0_m/2./a2*f1*(1 + G2)*(2./3*pow(sep, 2) - (1 - pow(costheta, 2))*pow(chi2, 2))
+                +
+                3*par->Omega0_m/2./a1*f2*(1 + G1)*(2./3*pow(sep, 2) - (1 - pow(costheta, 2))*pow(chi1, 2))
+            )
+           *interp_spline(&integral[6].result, sep);
+        FUNCTIONS_ADD_TERM(1, 4, term);
+    }
+    /* rsd-g2 + g2-rsd term */
+    if (terms & COFFE_TERM(1, 5)){
+        double term = 0;
+        term += -(
+                par->Omega0_m/2./a2*f1*(5*s2 - 2)
+                +
+                par->Omega0_m/2./a1*f2*(5*s1 - 2)
+            )
+           *interp_spline(&integral[5].result, sep)
+            + (
+                3*par->Omega0_m/2./a2*f1*(5*s2 - 2)*(2./3*pow(sep, 2) - (1 - pow(costheta, 2))*pow(chi2, 2))
+                +
+                3*par->Omega0_m/2./a1*f2*(5*s1 - 2)*(2./3*pow(sep, 2) - (1 - pow(costheta, 2))*pow(chi1, 2))
+            )
+           *interp_spline(&integral[6].result, sep);
+        FUNCTIONS_ADD_TERM(1, 5, term);
+    }
+    /* rsd-g3 + g3-rsd term */
+    if (terms & COFFE_TERM(1, 6)){
+        double term = 0;
+        term += -(
+                par->Omega0_m/2./a2*f1*(f2 - 1)
+                +
+                par->Omega0_m/2./a1*f2*(f1 - 1)
+            )
+           *interp_spline(&integral[5].result, sep)
+            + (
+                3*par->Omega0_m/2./a2*f1*(f2 - 1)*(2./3*pow(sep, 2) - (1 - pow(costheta, 2))*pow(chi2, 2))
+                +
+                3*par->Omega0_m/2./a1*f2*(f1 - 1)*(2./3*pow(sep, 2) - (1 - pow(costheta, 2))*pow(chi1, 2))
+            )
+           *interp_spline(&integral[6].result, sep);
 
-        }
-        /* d1-d2 + d2-d1 term */
-        else if (
-            strcmp(par->corr_terms[i], "23") == 0 ||
-            strcmp(par->corr_terms[i], "32") == 0
-        ){
-            result += -(
-                    (3 - fevo2)*curlyH1*pow(curlyH2, 2)*f1*f2*(chi2*costheta - chi1)
-                    +
-                    (3 - fevo1)*curlyH2*pow(curlyH1, 2)*f2*f1*(chi1*costheta - chi2)
-                )
-               *interp_spline(&integral[7].result, sep);
-        }
-        /* d1-g1 + g1-d1 term */
-        else if (
-            strcmp(par->corr_terms[i], "24") == 0 ||
-            strcmp(par->corr_terms[i], "42") == 0
-        ){
-            result += (
-                    3*par->Omega0_m/2./a2*curlyH1*f1*(1 + G2)*(chi2*costheta - chi1)
-                    +
-                    3*par->Omega0_m/2./a1*curlyH2*f2*(1 + G1)*(chi1*costheta - chi2)
-                )
-               *interp_spline(&integral[7].result, sep);
-        }
-        /* d1-g2 + g2-d1 term */
-        else if (
-            strcmp(par->corr_terms[i], "25") == 0 ||
-            strcmp(par->corr_terms[i], "52") == 0
-        ){
-            result += (
-                    3*par->Omega0_m/2./a2*curlyH1*f1*(5*s2 - 2)*(chi2*costheta - chi1)
-                    +
-                    3*par->Omega0_m/2./a1*curlyH2*f2*(5*s1 - 2)*(chi1*costheta - chi2)
-                )
-               *interp_spline(&integral[7].result, sep);
-        }
-        /* d1-g3 + g3-d1 term */
-        else if (
-            strcmp(par->corr_terms[i], "26") == 0 ||
-            strcmp(par->corr_terms[i], "62") == 0
-        ){
-            result += (
-                    3*par->Omega0_m/2./a2*curlyH1*f1*(f2 - 1.)*(chi2*costheta - chi1)
-                    +
-                    3*par->Omega0_m/2./a1*curlyH2*f2*(f1 - 1.)*(chi1*costheta - chi2)
-                )
-               *interp_spline(&integral[7].result, sep);
-        }
-        /* d2-g1 + g1-d2 term */
-        else if (
-            strcmp(par->corr_terms[i], "34") == 0 ||
-            strcmp(par->corr_terms[i], "43") == 0
-        ){
-            result += -(
-                    3*(3 - fevo1)*par->Omega0_m/2./a2*pow(curlyH1, 2)*f1*(1 + G2)
-                    +
-                    3*(3 - fevo2)*par->Omega0_m/2./a1*pow(curlyH2, 2)*f2*(1 + G1)
+        FUNCTIONS_ADD_TERM(1, 6, term);
+    }
+    /* d1-d2 + d2-d1 term */
+    if (terms & COFFE_TERM(2, 3)){
+        double term = 0;
+        term += -(
+                (3 - fevo2)*curlyH1*pow(curlyH2, 2)*f1*f2*(chi2*costheta - chi1)
+                +
+                (3 - fevo1)*curlyH2*pow(curlyH1, 2)*f2*f1*(chi1*costheta - chi2)
+            )
+           *interp_spline(&integral[7].result, sep);
+        FUNCTIONS_ADD_TERM(2, 3, term);
+    }
+    /* d1-g1 + g1-d1 term */
+    if (terms & COFFE_TERM(2, 4)){
+        double term = 0;
+        term += (
+                3*par->Omega0_m/2./a2*curlyH1*f1*(1 + G2)*(chi2*costheta - chi1)
+                +
+                3*par->Omega0_m/2./a1*curlyH2*f2*(1 + G1)*(chi1*costheta - chi2)
+            )
+           *interp_spline(&integral[7].result, sep);
+        FUNCTIONS_ADD_TERM(2, 4, term);
+    }
+    /* d1-g2 + g2-d1 term */
+    if (terms & COFFE_TERM(2, 5)){
+        double term = 0;
+        term += (
+                3*par->Omega0_m/2./a2*curlyH1*f1*(5*s2 - 2)*(chi2*costheta - chi1)
+                +
+                3*par->Omega0_m/2./a1*curlyH2*f2*(5*s1 - 2)*(chi1*costheta - chi2)
+            )
+           *interp_spline(&integral[7].result, sep);
+        FUNCTIONS_ADD_TERM(2, 5, term);
+    }
+    /* d1-g3 + g3-d1 term */
+    if (terms & COFFE_TERM(2, 6)){
+        double term = 0;
+        term += (
+                3*par->Omega0_m/2./a2*curlyH1*f1*(f2 - 1.)*(chi2*costheta - chi1)
+                +
+                3*par->Omega0_m/2./a1*curlyH2*f2*(f1 - 1.)*(chi1*costheta - chi2)
+            )
+           *interp_spline(&integral[7].result, sep);
+        FUNCTIONS_ADD_TERM(2, 6, term);
+    }
+    /* d2-g1 + g1-d2 term */
+    if (terms & COFFE_TERM(3, 4)){
+        double term = 0;
+        term += -(
+                3*(3 - fevo1)*par->Omega0_m/2./a2*pow(curlyH1, 2)*f1*(1 + G2)
+                +
+                3*(3 - fevo2)*par->Omega0_m/2./a1*pow(curlyH2, 2)*f2*(1 + G1)
+            )
+           *(
+                interp_spline(&integral[8].result, sep)
+                /* renormalization term */
+               -gsl_spline2d_eval(
+                    integral[8].renormalization.spline,
+                    chi1, chi2,
+                    integral[8].renormalization.xaccel,
+                    integral[8].renormalization.yaccel
                 )
-               *(
-                    interp_spline(&integral[8].result, sep)
-                    /* renormalization term */
-                   -gsl_spline2d_eval(
-                        integral[8].renormalization.spline,
-                        chi1, chi2,
-                        integral[8].renormalization.xaccel,
-                        integral[8].renormalization.yaccel
-                    )
-                );
-        }
-        /* d2-g2 + g2-d2 term */
-        else if (
-            strcmp(par->corr_terms[i], "35") == 0 ||
-            strcmp(par->corr_terms[i], "53") == 0
-        ){
-            result += -(
-                    3*(3 - fevo1)*par->Omega0_m/2./a2*pow(curlyH1, 2)*f1*(5*s2 - 2)
-                    +
-                    3*(3 - fevo2)*par->Omega0_m/2./a1*pow(curlyH2, 2)*f2*(5*s1 - 2)
+            );
+        FUNCTIONS_ADD_TERM(3, 4, term);
+    }
+    /* d2-g2 + g2-d2 term */
+    if (terms & COFFE_TERM(3, 5)){
+        double term = 0;
+        term += -(
+                3*(3 - fevo1)*par->Omega0_m/2./a2*pow(curlyH1, 2)*f1*(5*s2 - 2)
+                +
+                3*(3 - fevo2)*par->Omega0_m/2./a1*pow(curlyH2, 2)*f2*(5*s1 - 2)
+            )
+           *(
+                interp_spline(&integral[8].result, sep)
+                /* renormalization term */
+               -gsl_spline2d_eval(
+                    integral[8].renormalization.spline,
+                    chi1, chi2,
+                    integral[8].renormalization.xaccel,
+                    integral[8].renormalization.yaccel
                 )
-               *(
-                    interp_spline(&integral[8].result, sep)
-                    /* renormalization term */
-                   -gsl_spline2d_eval(
-                        integral[8].renormalization.spline,
-                        chi1, chi2,
-                        integral[8].renormalization.xaccel,
-                        integral[8].renormalization.yaccel
-                    )
-                );
-        }
-        /* d2-g3 + g3-d2 term */
-        else if (
-            strcmp(par->corr_terms[i], "36") == 0 ||
-            strcmp(par->corr_terms[i], "63") == 0
-        ){
-            result += -(
-                    3*(3 - fevo1)*par->Omega0_m/2./a2*pow(curlyH1, 2)*f1*(f2 - 1)
-                    +
-                    3*(3 - fevo2)*par->Omega0_m/2./a1*pow(curlyH2, 2)*f2*(f1 - 1)
+            );
+        FUNCTIONS_ADD_TERM(3, 5, term);
+    }
+    /* d2-g3 + g3-d2 term */
+    if (terms & COFFE_TERM(3, 6)){
+        double term = 0;
+        term += -(
+                3*(3 - fevo1)*par->Omega0_m/2./a2*pow(curlyH1, 2)*f1*(f2 - 1)
+                +
+                3*(3 - fevo2)*par->Omega0_m/2./a1*pow(curlyH2, 2)*f2*(f1 - 1)
+            )
+           *(
+                interp_spline(&integral[8].result, sep)
+                /* renormalization term */
+               -gsl_spline2d_eval(
+                    integral[8].renormalization.spline,
+                    chi1, chi2,
+                    integral[8].renormalization.xaccel,
+                    integral[8].renormalization.yaccel
                 )
-               *(
-                    interp_spline(&integral[8].result, sep)
-                    /* renormalization term */
-                   -gsl_spline2d_eval(
-                        integral[8].renormalization.spline,
-                        chi1, chi2,
-                        integral[8].renormalization.xaccel,
-                        integral[8].renormalization.yaccel
-                    )
-                );
-        }
-        /* g1-g2 + g2-g1 term */
-        else if (
-            strcmp(par->corr_terms[i], "45") == 0 ||
-            strcmp(par->corr_terms[i], "54") == 0
-        ){
-            result += (
-                    9*pow(par->Omega0_m, 2)/4./a1/a2*(1 + G1)*(5*s2 - 2)
-                    +
-                    9*pow(par->Omega0_m, 2)/4./a2/a1*(1 + G2)*(5*s1 - 2)
+            );
+        FUNCTIONS_ADD_TERM(3, 6, term);
+    }
+    /* g1-g2 + g2-g1 term */
+    if (terms & COFFE_TERM(4, 5)){
+        double term = 0;
+        term += (
+                9*pow(par->Omega0_m, 2)/4./a1/a2*(1 + G1)*(5*s2 - 2)
+                +
+                9*pow(par->Omega0_m, 2)/4./a2/a1*(1 + G2)*(5*s1 - 2)
+            )
+           *(
+                interp_spline(&integral[8].result, sep)
+                /* renormalization term */
+               -gsl_spline2d_eval(
+                    integral[8].renormalization.spline,
+                    chi1, chi2,
+                    integral[8].renormalization.xaccel,
+                    integral[8].renormalization.yaccel
                 )
-               *(
-                    interp_spline(&integral[8].result, sep)
-                    /* renormalization term */
-                   -gsl_spline2d_eval(
-                        integral[8].renormalization.spline,
-                        chi1, chi2,
-                        integral[8].renormalization.xaccel,
-                        integral[8].renormalization.yaccel
-                    )
-                );
-        }
-        /* g1-g3 + g3-g1 term */
-        else if (
-            strcmp(par->corr_terms[i], "46") == 0 ||
-            strcmp(par->corr_terms[i], "64") == 0
-        ){
-            result += (
-                    9*pow(par->Omega0_m, 2)/4./a1/a2*(1 + G1)*(f2 - 1)
-                    +
-                    9*pow(par->Omega0_m, 2)/4./a2/a1*(1 + G2)*(f1 - 1)
+            );
+        FUNCTIONS_ADD_TERM(4, 5, term);
+    }
+    /* g1-g3 + g3-g1 term */
+    if (terms & COFFE_TERM(4, 6)){
+        double term = 0;
+        term += (
+                9*pow(par->Omega0_m, 2)/4./a1/a2*(1 + G1)*(f2 - 1)
+                +
+                9*pow(par->Omega0_m, 2)/4./a2/a1*(1 + G2)*(f1 - 1)
+            )
+           *(
+                interp_spline(&integral[8].result, sep)
+                /* renormalization term */
+               -gsl_spline2d_eval(
+                    integral[8].renormalization.spline,
+                    chi1, chi2,
+                    integral[8].renormalization.xaccel,
+                    integral[8].renormalization.yaccel
                 )
-               *(
-                    interp_spline(&integral[8].result, sep)
-                    /* renormalization term */
-                   -gsl_spline2d_eval(
-                        integral[8].renormalization.spline,
-                        chi1, chi2,
-                        integral[8].renormalization.xaccel,
-                        integral[8].renormalization.yaccel
-                    )
-                );
-        }
-        /* g2-g3 + g3-g2 term */
-        else if (
-            strcmp(par->corr_terms[i], "56") == 0 ||
-            strcmp(par->corr_terms[i], "65") == 0
-        ){
-            result += 9*pow(par->Omega0_m, 2)/4.*(
-                    (5*s1 - 2)*(f2 - 1)/a1/a2
-                    +
-                    (5*s2 - 2)*(f1 - 1)/a2/a1
+            );
+        FUNCTIONS_ADD_TERM(4, 6, term);
+    }
+    /* g2-g3 + g3-g2 term */
+    if (terms & COFFE_TERM(5, 6)){
+        double term = 0;
+        term += 9*pow(par->Omega0_m, 2)/4.*(
+                (5*s1 - 2)*(f2 - 1)/a1/a2
+                +
+                (5*s2 - 2)*(f1 - 1)/a2/a1
+            )
+           *(
+                interp_spline(&integral[8].result, sep)
+            /* renormalization term */
+               -gsl_spline2d_eval(
+                    integral[8].renormalization.spline,
+                    chi1, chi2,
+                    integral[8].renormalization.xaccel,
+                    integral[8].renormalization.yaccel
                 )
-               *(
-                    interp_spline(&integral[8].result, sep)
-                /* renormalization term */
-                   -gsl_spline2d_eval(
-                        integral[8].renormalization.spline,
-                        chi1, chi2,
-                        integral[8].renormalization.xaccel,
-                        integral[8].renormalization.yaccel
-                    )
-                );
-        }
+            );
+        FUNCTIONS_ADD_TERM(5, 6, term);
     }
     if (gsl_finite(result)){
+    const double growth = interp_spline(&bg->D1, z1)*interp_spline(&bg->D1, z2);
+    if (contributions != NULL){
+        for (int t = 0; t<COFFE_TERMS_LEN; ++t)
+            if (terms & COFFE_TERMS_NONINTEGRATED & (UINT64_C(1) << t))
+                contributions[t] *= growth;
+    }
     return
-        result*interp_spline(&bg->D1, z1)*interp_spline(&bg->D1, z2);
+        result*growth;
     }
     else{
         fprintf(stderr,
@@ -547,929 +599,1262 @@ double functions_nonintegrated(
     }
 }
 
-double functions_single_integrated(
-    struct coffe_parameters_t *par,
-    struct coffe_background_t *bg,
+/**
+    fills the values of the single integrated terms which only
+    depend on the geometry, i.e. the mean redshift, the angle
+    and the separation
+**/
+
+FUNCTIONS_INLINE void functions_single_geometry_fill(
+    struct coffe_parameters_t *par,
+    struct coffe_background_t *bg,
     struct coffe_integrals_t integral[],
     double z_mean,
     double mu,
     double sep,
-    double x
+    struct functions_single_geometry *g,
+    const uint64_t terms
 )
 {
-    double result = 0;
-    int len =
-        par->correlation_sources_len
-       *(par->correlation_sources_len + 1)/2;
-
-    double chi_mean = interp_spline(&bg->comoving_distance, z_mean);
-    double chi1 = chi_mean - sep*mu/2.;
-    double chi2 = chi_mean + sep*mu/2.;
-    double costheta =
-        (2*chi_mean*chi_mean - sep*sep + mu*mu*sep*sep/2.)
-       /(2*chi_mean*chi_mean - mu*mu*sep*sep/2.);
-    double lambda1 = chi1*x, lambda2 = chi2*x;
+    g->z_mean = z_mean;
+    g->mu = mu;
+    g->sep = sep;
+    g->chi_mean = interp_spline(&bg->comoving_distance, z_mean);
+    g->chi1 = g->chi_mean - sep*mu/2.;
+    g->chi2 = g->chi_mean + sep*mu/2.;
+    g->costheta =
+        (2*g->chi_mean*g->chi_mean - sep*sep + mu*mu*sep*sep/2.)
+       /(2*g->chi_mean*g->chi_mean - mu*mu*sep*sep/2.);
 
-    double r21 = lambda2*lambda2 + chi1*chi1 - 2*chi1*lambda2*costheta;
-    double r22 = lambda1*lambda1 + chi2*chi2 - 2*chi2*lambda1*costheta;
-    if (r21 < 0) r21 = 0;
-    if (r22 < 0) r22 = 0;
-    double z1_const = interp_spline(&bg->z_as_chi, chi1);
-    double z2_const = interp_spline(&bg->z_as_chi, chi2);
-    double z1 = interp_spline(&bg->z_as_chi, lambda1);
-    double z2 = interp_spline(&bg->z_as_chi, lambda2);
+    g->z1_const = interp_spline(&bg->z_as_chi, g->chi1);
+    g->z2_const = interp_spline(&bg->z_as_chi, g->chi2);
 
-    double s1 = interp_spline(&par->magnification_bias1, z1_const);
-    double s2 = interp_spline(&par->magnification_bias2, z2_const);
-    double b1 = interp_spline(&par->matter_bias1, z1_const);
-    double b2 = interp_spline(&par->matter_bias2, z2_const);
+    g->s1 = interp_spline(&par->magnification_bias1, g->z1_const);
+    g->s2 = interp_spline(&par->magnification_bias2, g->z2_const);
+    g->D1_1 = interp_spline(&bg->D1, g->z1_const);
+    g->D1_2 = interp_spline(&bg->D1, g->z2_const);
 
-    double ren1 = 0, ren2 = 0;
-    if (par->divergent){
-        if (r21 == 0.0) ren1 = interp_spline(&integral[8].renormalization0, lambda2);
-        else ren1 = interp_spline(&integral[8].result, sqrt(r21))
-                    /* renormalization term */
-                   -gsl_spline2d_eval(
-                        integral[8].renormalization.spline,
-                        lambda2, chi1,
-                        integral[8].renormalization.xaccel,
-                        integral[8].renormalization.yaccel
-                );
-        if (r22 == 0.0) ren2 = interp_spline(&integral[8].renormalization0, lambda1);
-        else ren2 = interp_spline(&integral[8].result, sqrt(r22))
-                    /* renormalization term */
-                   -gsl_spline2d_eval(
-                        integral[8].renormalization.spline,
-                        lambda1, chi2,
-                        integral[8].renormalization.xaccel,
-                        integral[8].renormalization.yaccel
-                );
+    g->b1 = 0, g->b2 = 0;
+    if (terms & COFFE_TERMS_WITH(0)){
+        g->b1 = interp_spline(&par->matter_bias1, g->z1_const);
+        g->b2 = interp_spline(&par->matter_bias2, g->z2_const);
     }
+    g->f_1 = 0, g->f_2 = 0;
+    if (terms & (COFFE_TERMS_WITH(1) | COFFE_TERMS_WITH(2) | COFFE_TERMS_WITH(3) | COFFE_TERMS_WITH(6))){
+        g->f_1 = interp_spline(&bg->f, g->z1_const);
+        g->f_2 = interp_spline(&bg->f, g->z2_const);
+    }
+    g->curlyH_1 = 0, g->curlyH_2 = 0;
+    if (terms & (COFFE_TERMS_WITH(2) | COFFE_TERMS_WITH(3))){
+        g->curlyH_1 = interp_spline(&bg->conformal_Hz, g->z1_const);
+        g->curlyH_2 = interp_spline(&bg->conformal_Hz, g->z2_const);
+    }
+    g->G1_1 = 0, g->G2_2 = 0;
+    if (terms & (COFFE_TERMS_WITH(2) | COFFE_TERMS_WITH(4) | COFFE_TERMS_WITH(8))){
+        g->G1_1 = interp_spline(&bg->G1, g->z1_const);
+        g->G2_2 = interp_spline(&bg->G2, g->z2_const);
+    }
+    g->a_1 = 1, g->a_2 = 1;
+    if (terms & (COFFE_TERMS_WITH(4) | COFFE_TERMS_WITH(5) | COFFE_TERMS_WITH(6))){
+        g->a_1 = interp_spline(&bg->a, g->z1_const);
+        g->a_2 = interp_spline(&bg->a, g->z2_const);
+    }
+    g->fevo_1 = 0, g->fevo_2 = 0;
+    if (terms & COFFE_TERMS_WITH(3)){
+        g->fevo_1 = interp_spline(&par->evolution_bias1, g->z1_const);
+        g->fevo_2 = interp_spline(&par->evolution_bias2, g->z2_const);
+    }
+    for (int i = 0; i<8; ++i) g->I_zero[i] = 0;
+    if (terms & COFFE_TERM(1, 9))
+        g->I_zero[0] = interp_spline(&integral[0].result, 0.0);
+    if (terms & COFFE_TERM(0, 9))
+        g->I_zero[3] = interp_spline(&integral[3].result, 0.0);
+    if (terms & COFFE_TERM(2, 9))
+        g->I_zero[5] = interp_spline(&integral[5].result, 0.0);
+}
 
-    for (int i = 0; i<len; ++i){
-        /* den-len + len-den term */
-        if (
-            strcmp(par->corr_terms[i], "09") == 0 ||
-            strcmp(par->corr_terms[i], "90") == 0
-        ){
-            if (r21 != 0.0 && r22 != 0.0){
-                result +=
-                   -3*par->Omega0_m/2.
-                   *(
-                        b1*(2 - 5*s2)*interp_spline(&bg->D1, z1_const)*chi2
-                        /* integrand */
-                       *(1 - x)*interp_spline(&bg->D1, z2)/interp_spline(&bg->a, z2)
-                       *(
-                            2*chi1*costheta*interp_spline(&integral[3].result, sqrt(r21))
-                           -chi1*chi1*lambda2*(1 - costheta*costheta)
-                           *interp_spline(&integral[1].result, sqrt(r21))
-                           /r21
-                        )
-                        +
-                        b2*(2 - 5*s1)*interp_spline(&bg->D1, z2_const)*chi1
-                        /* integrand */
-                       *(1 - x)*interp_spline(&bg->D1, z1)/interp_spline(&bg->a, z1)
-                       *(
-                            2*chi2*costheta*interp_spline(&integral[3].result, sqrt(r22))
-                           -chi2*chi2*lambda1*(1 - costheta*costheta)
-                           *interp_spline(&integral[1].result, sqrt(r22))
-                           /r22
-                        )
-                    );
-            }
-            else if (r21 == 0.0 && r22 != 0){
-                result +=
-                   -3*par->Omega0_m/2.
-                   *(
-                        b1*(2 - 5*s2)*interp_spline(&bg->D1, z1_const)*chi2
-                        /* integrand */
-                       *(1 - x)*interp_spline(&bg->D1, z2)/interp_spline(&bg->a, z2)
-                       *(
-                            2*chi1*interp_spline(&integral[3].result, 0.0)
-                        )
-                        +
-                        b2*(2 - 5*s1)*interp_spline(&bg->D1, z2_const)*chi1
-                        /* integrand */
-                       *(1 - x)*interp_spline(&bg->D1, z1)/interp_spline(&bg->a, z1)
-                       *(
-                            2*chi2*costheta*interp_spline(&integral[3].result, sqrt(r22))
-                           -chi2*chi2*lambda1*(1 - costheta*costheta)
-                           *interp_spline(&integral[1].result, sqrt(r22))
-                           /r22
-                        )
-                    );
-            }
-            else if (r21 != 0 && r22 == 0.0){
-                result +=
-                   -3*par->Omega0_m/2.
-                   *(
-                        b1*(2 - 5*s2)*interp_spline(&bg->D1, z1_const)*chi2
-                        /* integrand */
-                       *(1 - x)*interp_spline(&bg->D1, z2)/interp_spline(&bg->a, z2)
-                       *(
-                            2*chi1*costheta*interp_spline(&integral[3].result, sqrt(r21))
-                           -chi1*chi1*lambda2*(1 - costheta*costheta)
-                           *interp_spline(&integral[1].result, sqrt(r21))
-                           /r21
-                        )
-                        +
-                        b2*(2 - 5*s1)*interp_spline(&bg->D1, z2_const)*chi1
-                        /* integrand */
-                       *(1 - x)*interp_spline(&bg->D1, z1)/interp_spline(&bg->a, z1)
-                       *(
-                            2*chi2*interp_spline(&integral[3].result, 0.0)
-                        )
-                    );
-            }
-            else{
-                result +=
-                   -3*par->Omega0_m/2.
-                   *(
-                        b1*(2 - 5*s2)*interp_spline(&bg->D1, z1_const)
-                        /* integrand */
-                       *(1 - x)*interp_spline(&bg->D1, z2)/interp_spline(&bg->a, z2)
-                       *(
-                            2*chi1*chi2*interp_spline(&integral[3].result, 0.0)
-                        )
-                        +
-                        b2*(2 - 5*s1)*interp_spline(&bg->D1, z2_const)
-                        /* integrand */
-                       *(1 - x)*interp_spline(&bg->D1, z1)/interp_spline(&bg->a, z1)
-                       *(
-                            2*chi2*chi1*interp_spline(&integral[3].result, 0.0)
-                        )
-                    );
-            }
+
+/**
+    fills the values of the single integrated terms at the
+    nodes along the line of sight; nodes->x must already be set
+**/
+
+FUNCTIONS_INLINE void functions_los_fill(
+    struct coffe_parameters_t *par,
+    struct coffe_background_t *bg,
+    struct coffe_integrals_t integral[],
+    const struct functions_single_geometry *g,
+    struct functions_los_nodes *n,
+    const uint64_t terms
+)
+{
+    /* which of the I^n_l are needed by which terms */
+    const uint64_t needs_integral[8] = {
+        COFFE_TERM(1, 9),
+        COFFE_TERM(0, 9) | COFFE_TERM(1, 9),
+        COFFE_TERM(1, 9),
+        COFFE_TERM(0, 9) | COFFE_TERM(2, 9),
+        COFFE_TERM(2, 9),
+        COFFE_TERM(2, 9) | COFFE_TERM(0, 7) | COFFE_TERM(0, 8) | COFFE_TERM(1, 7) | COFFE_TERM(1, 8),
+        COFFE_TERM(3, 9) | COFFE_TERM(4, 9) | COFFE_TERM(5, 9) | COFFE_TERM(6, 9) | COFFE_TERM(1, 7) | COFFE_TERM(1, 8),
+        COFFE_TERM(3, 9) | COFFE_TERM(4, 9) | COFFE_TERM(5, 9) | COFFE_TERM(6, 9) | COFFE_TERM(2, 7) | COFFE_TERM(2, 8)
+    };
+    const uint64_t needs_z =
+        COFFE_TERM(0, 8) | COFFE_TERM(1, 8) | COFFE_TERM(2, 8) | COFFE_TERM(3, 8);
+    const uint64_t needs_lambda =
+        COFFE_TERM(4, 8) | COFFE_TERM(5, 8) | COFFE_TERM(6, 8);
+    const int needs_ren =
+        par->divergent &&
+        (terms & (
+            COFFE_TERM(3, 7) | COFFE_TERM(3, 8) |
+            COFFE_TERM(4, 7) | COFFE_TERM(4, 8) |
+            COFFE_TERM(5, 7) | COFFE_TERM(5, 8) |
+            COFFE_TERM(6, 7) | COFFE_TERM(6, 8)
+        ));
+
+    for (size_t k = 0; k<n->len; ++k){
+        const double x = n->x[k];
+        const double lambda1 = g->chi1*x, lambda2 = g->chi2*x;
+        double r21 = lambda2*lambda2 + g->chi1*g->chi1 - 2*g->chi1*lambda2*g->costheta;
+        double r22 = lambda1*lambda1 + g->chi2*g->chi2 - 2*g->chi2*lambda1*g->costheta;
+        if (r21 < 0) r21 = 0;
+        if (r22 < 0) r22 = 0;
+        n->lambda1[k] = lambda1, n->lambda2[k] = lambda2;
+        n->r21[k] = r21, n->r22[k] = r22;
+
+        const double z1 = interp_spline(&bg->z_as_chi, lambda1);
+        const double z2 = interp_spline(&bg->z_as_chi, lambda2);
+        n->z1[k] = z1, n->z2[k] = z2;
+        n->D1_1[k] = interp_spline(&bg->D1, z1);
+        n->D1_2[k] = interp_spline(&bg->D1, z2);
+        n->a_1[k] = interp_spline(&bg->a, z1);
+        n->a_2[k] = interp_spline(&bg->a, z2);
+
+        if (terms & needs_z){
+            n->f_1[k] = interp_spline(&bg->f, z1);
+            n->f_2[k] = interp_spline(&bg->f, z2);
+            n->curlyH_1[k] = interp_spline(&bg->conformal_Hz, z1);
+            n->curlyH_2[k] = interp_spline(&bg->conformal_Hz, z2);
         }
-        /* rsd-len + len-rsd term */
-        else if (
-            strcmp(par->corr_terms[i], "19") == 0 ||
-            strcmp(par->corr_terms[i], "91") == 0
-        ){
-            if (r21 != 0 && r22 != 0){
-                result +=
-                    /* constant in front */
-                    3*par->Omega0_m/2.
-                   *(
-                        chi2*interp_spline(&bg->f, z1_const)*(2 - 5*s2)*interp_spline(&bg->D1, z1_const)
-                        /* integrand */
-                       *(1 - x)*interp_spline(&bg->D1, z2)/interp_spline(&bg->a, z2)
-                       *(
-                            (lambda2 - 6*chi1*costheta + 3*lambda2*(2*costheta*costheta - 1))
-                           *interp_spline(&integral[0].result, sqrt(r21))/15.
-                           -(
-                                6*chi1*chi1*chi1*costheta - chi1*chi1*lambda2*(9*costheta*costheta + 11)
-                               +chi1*lambda2*lambda2*costheta*(3*(2*costheta*costheta - 1) + 19)
-                               -2*lambda2*lambda2*lambda2*(3*(2*costheta*costheta - 1) + 1)
-                            )
-                           *interp_spline(&integral[1].result, sqrt(r21))/r21/21.
-                        )
-                        +
-                        chi1*interp_spline(&bg->f, z2_const)*(2 - 5*s1)*interp_spline(&bg->D1, z2_const)
-                        /* integrand */
-                       *(1 - x)*interp_spline(&bg->D1, z1)/interp_spline(&bg->a, z1)
-                       *(
-                            (lambda1 - 6*chi2*costheta + 3*lambda1*(2*costheta*costheta - 1))
-                           *interp_spline(&integral[0].result, sqrt(r22))/15.
-                           -(
-                                6*chi2*chi2*chi2*costheta - chi2*chi2*lambda1*(9*costheta*costheta + 11)
-                               +chi2*lambda1*lambda1*costheta*(3*(2*costheta*costheta - 1) + 19)
-                               -2*lambda1*lambda1*lambda1*(3*(2*costheta*costheta - 1) + 1)
-                            )
-                           *interp_spline(&integral[1].result, sqrt(r22))/r22/21.
-                        )
-                    );
-                if (fabs(mu) < 0.999){
-                    result +=
-                    3*par->Omega0_m/2.
-                   *(
-                        chi2*interp_spline(&bg->f, z1_const)*(2 - 5*s2)*interp_spline(&bg->D1, z1_const)
-                        /* integrand */
-                       *(1 - x)*interp_spline(&bg->D1, z2)/interp_spline(&bg->a, z2)
-                       *(
-                           -(
-                               -4*pow(chi1, 5)*costheta
-                               -pow(chi1, 3)*pow(lambda2, 2)*costheta*((2*costheta*costheta - 1) + 7)
-                               +pow(chi1, 2)*pow(lambda2, 3)*(pow(costheta, 4) + 12*costheta*costheta - 21)
-                               -3*chi1*pow(lambda2, 4)*costheta*((2*costheta*costheta - 1) - 5)
-                               -pow(lambda2, 5)*(3*(2*costheta*costheta - 1) + 1)
-                               +12*pow(chi1, 4)*lambda2
-                            )
-                           *interp_spline(&integral[2].result, sqrt(r21))/r21/r21/35.
-                        )
-                        +
-                        chi1*interp_spline(&bg->f, z2_const)*(2 - 5*s1)*interp_spline(&bg->D1, z2_const)
-                        /* integrand */
-                       *(1 - x)*interp_spline(&bg->D1, z1)/interp_spline(&bg->a, z1)
-                       *(
-                           -(
-                               -4*pow(chi2, 5)*costheta
-                               -pow(chi2, 3)*pow(lambda1, 2)*costheta*((2*costheta*costheta - 1) + 7)
-                               +pow(chi2, 2)*pow(lambda1, 3)*(pow(costheta, 4) + 12*costheta*costheta - 21)
-                               -3*chi2*pow(lambda1, 4)*costheta*((2*costheta*costheta - 1) - 5)
-                               -pow(lambda1, 5)*(3*(2*costheta*costheta - 1) + 1)
-                               +12*pow(chi2, 4)*lambda1
-                            )
-                           *interp_spline(&integral[2].result, sqrt(r22))/r22/r22/35.
-                        )
-                    );
-                }
-                else{
-                    result +=
-                    3*par->Omega0_m/2.
-                   *(
-                        chi2*interp_spline(&bg->f, z1_const)*(2 - 5*s2)*interp_spline(&bg->D1, z1_const)
-                        /* integrand */
-                       *(1 - x)*interp_spline(&bg->D1, z2)/interp_spline(&bg->a, z2)
-                       *4.*(lambda2 + chi1)*interp_spline(&integral[2].result, sqrt(r21))/35.
-                        +
-                        chi1*interp_spline(&bg->f, z2_const)*(2 - 5*s1)*interp_spline(&bg->D1, z2_const)
-                        /* integrand */
-                       *(1 - x)*interp_spline(&bg->D1, z1)/interp_spline(&bg->a, z1)
-                       *4.*(lambda1 + chi2)*interp_spline(&integral[2].result, sqrt(r22))/35.
-                    );
-                }
-            }
-            else if (r21 == 0 && r22 != 0){
-                result +=
-                    3*par->Omega0_m/2.
-                   *(
-                        chi2*interp_spline(&bg->f, z1_const)*(2 - 5*s2)*interp_spline(&bg->D1, z1_const)
-                        /* integrand */
-                       *(1 - chi1/chi2)*interp_spline(&bg->D1, z2)/interp_spline(&bg->a, z2)
-                       *(
-                           -2*chi1*interp_spline(&integral[0].result, 0.0)/15.
-                        )
-                        +
-                        chi1*interp_spline(&bg->f, z2_const)*(2 - 5*s1)*interp_spline(&bg->D1, z2_const)
-                        /* integrand */
-                       *(1 - x)*interp_spline(&bg->D1, z1)/interp_spline(&bg->a, z1)
-                       *(
-                            (lambda1 - 6*chi2*costheta + 3*lambda1*(2*costheta*costheta - 1))
-                           *interp_spline(&integral[0].result, sqrt(r22))/15.
-                           -(
-                                6*chi2*chi2*chi2*costheta - chi2*chi2*lambda1*(9*costheta*costheta + 11)
-                               +chi2*lambda1*lambda1*costheta*(3*(2*costheta*costheta - 1) + 19)
-                               -2*lambda1*lambda1*lambda1*(3*(2*costheta*costheta - 1) + 1)
-                            )
-                           *interp_spline(&integral[1].result, sqrt(r22))/r22/21.
-                           -(
-                               -4*pow(chi2, 5)*costheta
-                               -pow(chi2, 3)*pow(lambda1, 2)*costheta*((2*costheta*costheta - 1) + 7)
-                               +pow(chi2, 2)*pow(lambda1, 3)*(pow(costheta, 4) + 12*costheta*costheta - 21)
-                               -3*chi2*pow(lambda1, 4)*costheta*((2*costheta*costheta - 1) - 5)
-                               -pow(lambda1, 5)*(3*(2*costheta*costheta - 1) + 1)
-                               +12*pow(chi2, 4)*lambda1
-                            )
-                           *interp_spline(&integral[2].result, sqrt(r22))/r22/r22/35.
-                        )
-                    );
-            }
-            else if (r21 != 0 && r22 == 0){
-                result +=
-                    /* constant in front */
-                    3*par->Omega0_m/2.
-                   *(
-                        chi2*interp_spline(&bg->f, z1_const)*(2 - 5*s2)*interp_spline(&bg->D1, z1_const)
-                        /* integrand */
-                       *(1 - x)*interp_spline(&bg->D1, z2)/interp_spline(&bg->a, z2)
-                       *(
-                            (lambda2 - 6*chi1*costheta + 3*lambda2*(2*costheta*costheta - 1))
-                           *interp_spline(&integral[0].result, sqrt(r21))/15.
-                           -(
-                                6*chi1*chi1*chi1*costheta - chi1*chi1*lambda2*(9*costheta*costheta + 11)
-                               +chi1*lambda2*lambda2*costheta*(3*(2*costheta*costheta - 1) + 19)
-                               -2*lambda2*lambda2*lambda2*(3*(2*costheta*costheta - 1) + 1)
-                            )
-                           *interp_spline(&integral[1].result, sqrt(r21))/r21/21.
-                           -(
-                               -4*pow(chi1, 5)*costheta
-                               -pow(chi1, 3)*pow(lambda2, 2)*costheta*((2*costheta*costheta - 1) + 7)
-                               +pow(chi1, 2)*pow(lambda2, 3)*(pow(costheta, 4) + 12*costheta*costheta - 21)
-                               -3*chi1*pow(lambda2, 4)*costheta*((2*costheta*costheta - 1) - 5)
-                               -pow(lambda2, 5)*(3*(2*costheta*costheta - 1) + 1)
-                               +12*pow(chi1, 4)*lambda2
-                            )
-                           *interp_spline(&integral[2].result, sqrt(r21))/r21/r21/35.
-                        )
-                        +
-                        chi1*interp_spline(&bg->f, z2_const)*(2 - 5*s1)*interp_spline(&bg->D1, z2_const)
-                        /* integrand */
-                       *(1 - chi2/chi1)*interp_spline(&bg->D1, z1)/interp_spline(&bg->a, z1)
-                       *(
-                          -2*chi2*interp_spline(&integral[0].result, 0.0)/15.
-                        )
-                    );
-            }
-            else{
-                result +=
-                    3*par->Omega0_m/2.
-                   *(
-                        chi2*interp_spline(&bg->f, z1_const)*(2 - 5*s2)*interp_spline(&bg->D1, z1_const)
-                        /* integrand */
-                       *(1 - chi1/chi2)*interp_spline(&bg->D1, z2)/interp_spline(&bg->a, z2)
-                       *(
-                          -2*chi1*interp_spline(&integral[0].result, 0.0)/15.
-                        )
-                        +
-                        chi1*interp_spline(&bg->f, z2_const)*(2 - 5*s1)*interp_spline(&bg->D1, z2_const)
-                        /* integrand */
-                       *(1 - chi2/chi1)*interp_spline(&bg->D1, z1)/interp_spline(&bg->a, z1)
-                       *(
-                           -2*chi2*interp_spline(&integral[0].result, 0.0)/15.
-                        )
-                    );
+        /* these take the comoving distance instead of the redshift, as they always did */
+        if (terms & needs_lambda){
+            n->f_lambda1[k] = interp_spline(&bg->f, lambda1);
+            n->f_lambda2[k] = interp_spline(&bg->f, lambda2);
+            n->curlyH_lambda1[k] = interp_spline(&bg->conformal_Hz, lambda1);
+            n->curlyH_lambda2[k] = interp_spline(&bg->conformal_Hz, lambda2);
+        }
+        for (int i = 0; i<8; ++i){
+            if (terms & needs_integral[i]){
+                n->I1[i][k] = interp_spline(&integral[i].result, sqrt(r21));
+                n->I2[i][k] = interp_spline(&integral[i].result, sqrt(r22));
             }
         }
-        /* d1-len + len-d1 term */
-        else if (
-            strcmp(par->corr_terms[i], "29") == 0 ||
-            strcmp(par->corr_terms[i], "92") == 0
-        ){
-            if (r21 != 0 && r22 != 0){
-                result +=
-                    /* constant in front */
-                    3*par->Omega0_m/2.
-                   *(
-                        chi2*interp_spline(&bg->conformal_Hz, z1_const)*interp_spline(&bg->f, z1_const)
-                       *interp_spline(&bg->G1, z1_const)*(2 - 5*s2)*interp_spline(&bg->D1, z1_const)
-                        /* integrand */
-                       *(1 - x)*interp_spline(&bg->D1, z2)/interp_spline(&bg->a, z2)
-                       *(
-                            2*(costheta*(lambda2*lambda2 - 2*chi1*chi1) + chi1*lambda2*(2*(2*costheta*costheta - 1) - 1))
-                           *interp_spline(&integral[3].result, sqrt(r21))/15.
-                           +2*costheta*interp_spline(&integral[5].result, sqrt(r21))/3.
-                           -(
-                                4*pow(chi1, 4)*costheta
-                               -pow(chi1, 3)*lambda2*(costheta*costheta + 9)
-                               +chi1*chi1*lambda2*lambda2*costheta*(costheta*costheta + 5)
-                               -2*chi1*pow(lambda2, 3)*((2*costheta*costheta - 1) - 2)
-                               -2*pow(lambda2, 4)*costheta
-                            )*interp_spline(&integral[4].result, sqrt(r21))/r21/15.
-                        )
-                        +
-                        chi1*interp_spline(&bg->conformal_Hz, z2_const)*interp_spline(&bg->f, z2_const)
-                       *interp_spline(&bg->G1, z2_const)*(2 - 5*s2)*interp_spline(&bg->D1, z2_const)
-                        /* integrand */
-                       *(1 - x)*interp_spline(&bg->D1, z1)/interp_spline(&bg->a, z1)
-                       *(
-                            2*(costheta*(lambda1*lambda1 - 2*chi2*chi2) + chi2*lambda1*(2*(2*costheta*costheta - 1) - 1))
-                           *interp_spline(&integral[3].result, sqrt(r22))/15.
-                           +2*costheta*interp_spline(&integral[5].result, sqrt(r22))/3.
-                           -(
-                                4*pow(chi2, 4)*costheta
-                               -pow(chi2, 3)*lambda1*(costheta*costheta + 9)
-                               +chi2*chi2*lambda1*lambda1*costheta*(costheta*costheta + 5)
-                               -2*chi2*pow(lambda1, 3)*((2*costheta*costheta - 1) - 2)
-                               -2*pow(lambda1, 4)*costheta
-                            )*interp_spline(&integral[4].result, sqrt(r22))/r22/15.
-                        )
+
+        n->ren1[k] = 0, n->ren2[k] = 0;
+        if (needs_ren){
+            if (r21 == 0.0) n->ren1[k] = interp_spline(&integral[8].renormalization0, lambda2);
+            else n->ren1[k] = interp_spline(&integral[8].result, sqrt(r21))
+                        /* renormalization term */
+                       -gsl_spline2d_eval(
+                            integral[8].renormalization.spline,
+                            lambda2, g->chi1,
+                            integral[8].renormalization.xaccel,
+                            integral[8].renormalization.yaccel
                     );
-            }
-            else if (r21 == 0 && r22 != 0){
-                result +=
-                    /* constant in front */
-                    3*par->Omega0_m/2.
-                   *(
-                        chi2*interp_spline(&bg->conformal_Hz, z1_const)*interp_spline(&bg->f, z1_const)
-                       *interp_spline(&bg->G1, z1_const)*(2 - 5*s2)*interp_spline(&bg->D1, z1_const)
-                        /* integrand */
-                       *(1 - x)*interp_spline(&bg->D1, z2)/interp_spline(&bg->a, z2)
-                       *(
-                           2*interp_spline(&integral[5].result, 0.0)/3.
-                        )
-                        +
-                        chi1*interp_spline(&bg->conformal_Hz, z2_const)*interp_spline(&bg->f, z2_const)
-                       *interp_spline(&bg->G1, z2_const)*(2 - 5*s2)*interp_spline(&bg->D1, z2_const)
-                        /* integrand */
-                       *(1 - x)*interp_spline(&bg->D1, z1)/interp_spline(&bg->a, z1)
-                       *(
-                            2*(costheta*(lambda1*lambda1 - 2*chi2*chi2) + chi2*lambda1*(2*(2*costheta*costheta - 1) - 1))
-                           *interp_spline(&integral[3].result, sqrt(r22))/15.
-                           +2*costheta*interp_spline(&integral[5].result, sqrt(r22))/3.
-                           -(
-                                4*pow(chi2, 4)*costheta
-                               -pow(chi2, 3)*lambda1*(costheta*costheta + 9)
-                               +chi2*chi2*lambda1*lambda1*costheta*(costheta*costheta + 5)
-                               -2*chi2*pow(lambda1, 3)*((2*costheta*costheta - 1) - 2)
-                               -2*pow(lambda1, 4)*costheta
-                            )*interp_spline(&integral[4].result, sqrt(r22))/r22/15.
-                        )
+            if (r22 == 0.0) n->ren2[k] = interp_spline(&integral[8].renormalization0, lambda1);
+            else n->ren2[k] = interp_spline(&integral[8].result, sqrt(r22))
+                        /* renormalization term */
+                       -gsl_spline2d_eval(
+                            integral[8].renormalization.spline,
+                            lambda1, g->chi2,
+                            integral[8].renormalization.xaccel,
+                            integral[8].renormalization.yaccel
                     );
-            }
-            else if (r21 != 0 && r22 == 0){
-                result +=
-                    /* constant in front */
-                    3*par->Omega0_m/2.
+        }
+    }
+}
+
+
+/**
+    all the single integrated terms in one place, evaluated
+    at the k-th node along the line of sight; only arithmetic,
+    all of the lookups are done in the two functions above
+**/
+
+FUNCTIONS_INLINE double functions_single_integrated_eval(
+    struct coffe_parameters_t *par,
+    const struct functions_single_geometry *g,
+    const struct functions_los_nodes *n,
+    const size_t k,
+    const uint64_t terms,
+    double contributions[]
+)
+{
+    const double mu = g->mu;
+    const double chi1 = g->chi1, chi2 = g->chi2, costheta = g->costheta;
+    const double s1 = g->s1, s2 = g->s2, b1 = g->b1, b2 = g->b2;
+    const double x = n->x[k];
+    const double lambda1 = n->lambda1[k], lambda2 = n->lambda2[k];
+    const double r21 = n->r21[k], r22 = n->r22[k];
+    const double ren1 = n->ren1[k], ren2 = n->ren2[k];
+
+    double result = 0;
+
+    /* den-len + len-den term */
+    if (terms & COFFE_TERM(0, 9)){
+        double term = 0;
+        if (r21 != 0.0 && r22 != 0.0){
+            term +=
+               -3*par->Omega0_m/2.
+               *(
+                    b1*(2 - 5*s2)*g->D1_1*chi2
+                    /* integrand */
+                   *(1 - x)*n->D1_2[k]/n->a_2[k]
                    *(
-                        chi2*interp_spline(&bg->conformal_Hz, z1_const)*interp_spline(&bg->f, z1_const)
-                       *interp_spline(&bg->G1, z1_const)*(2 - 5*s2)*interp_spline(&bg->D1, z1_const)
-                        /* integrand */
-                       *(1 - x)*interp_spline(&bg->D1, z2)/interp_spline(&bg->a, z2)
-                       *(
-                            2*(costheta*(lambda2*lambda2 - 2*chi1*chi1) + chi1*lambda2*(2*(2*costheta*costheta - 1) - 1))
-                           *interp_spline(&integral[3].result, sqrt(r21))/15.
-                           +2*costheta*interp_spline(&integral[5].result, sqrt(r21))/3.
-                           -(
-                                4*pow(chi1, 4)*costheta
-                               -pow(chi1, 3)*lambda2*(costheta*costheta + 9)
-                               +chi1*chi1*lambda2*lambda2*costheta*(costheta*costheta + 5)
-                               -2*chi1*pow(lambda2, 3)*((2*costheta*costheta - 1) - 2)
-                               -2*pow(lambda2, 4)*costheta
-                            )*interp_spline(&integral[4].result, sqrt(r21))/r21/15.
-                        )
-                        +
-                        chi1*interp_spline(&bg->conformal_Hz, z2_const)*interp_spline(&bg->f, z2_const)
-                       *interp_spline(&bg->G1, z2_const)*(2 - 5*s2)*interp_spline(&bg->D1, z2_const)
-                        /* integrand */
-                       *(1 - x)*interp_spline(&bg->D1, z1)/interp_spline(&bg->a, z1)
-                       *(
-                           2*interp_spline(&integral[5].result, 0.0)/3.
-                        )
-                    );
-            }
-            else{
-                result +=
-                    /* constant in front */
-                    3*par->Omega0_m/2.
+                        2*chi1*costheta*n->I1[3][k]
+                       -chi1*chi1*lambda2*(1 - costheta*costheta)
+                       *n->I1[1][k]
+                       /r21
+                    )
+                    +
+                    b2*(2 - 5*s1)*g->D1_2*chi1
+                    /* integrand */
+                   *(1 - x)*n->D1_1[k]/n->a_1[k]
                    *(
-                        chi2*interp_spline(&bg->conformal_Hz, z1_const)*interp_spline(&bg->f, z1_const)
-                       *interp_spline(&bg->G1, z1_const)*(2 - 5*s2)*interp_spline(&bg->D1, z1_const)
-                        /* integrand */
-                       *(1 - x)*interp_spline(&bg->D1, z2)/interp_spline(&bg->a, z2)
-                       *(
-                           2*interp_spline(&integral[5].result, 0.0)/3.
-                        )
-                        +
-                        chi1*interp_spline(&bg->conformal_Hz, z2_const)*interp_spline(&bg->f, z2_const)
-                       *interp_spline(&bg->G1, z2_const)*(2 - 5*s2)*interp_spline(&bg->D1, z2_const)
-                        /* integrand */
-                       *(1 - x)*interp_spline(&bg->D1, z1)/interp_spline(&bg->a, z1)
-                       *(
-                           2*interp_spline(&integral[5].result, 0.0)/3.
-                        )
-                    );
-            }
+                        2*chi2*costheta*n->I2[3][k]
+                       -chi2*chi2*lambda1*(1 - costheta*costheta)
+                       *n->I2[1][k]
+                       /r22
+                    )
+                );
         }
-        /* d2-len + len-d2 term */
-        else if (
-            strcmp(par->corr_terms[i], "39") == 0 ||
-            strcmp(par->corr_terms[i], "93") == 0
-        ){
-            result +=
-                /* constant in front */
+        else if (r21 == 0.0 && r22 != 0){
+            term +=
                -3*par->Omega0_m/2.
                *(
-                    chi2*(3 - interp_spline(&par->evolution_bias1, z1_const))*interp_spline(&bg->f, z1_const)
-                   *pow(interp_spline(&bg->conformal_Hz, z1_const), 2)*(2 - 5*s2)*interp_spline(&bg->D1, z1_const)
+                    b1*(2 - 5*s2)*g->D1_1*chi2
+                    /* integrand */
+                   *(1 - x)*n->D1_2[k]/n->a_2[k]
                    *(
-                        /* integrand */
-                        (1 - x)*interp_spline(&bg->D1, z2)/interp_spline(&bg->a, z2)
-                       *(
-                            2*chi1*costheta*interp_spline(&integral[7].result, sqrt(r21))
-                           -chi1*chi1*lambda2*(1 - costheta*costheta)*interp_spline(&integral[6].result, sqrt(r21))
-                        )
+                        2*chi1*g->I_zero[3]
                     )
                     +
-                    chi1*(3 - interp_spline(&par->evolution_bias2, z2_const))*interp_spline(&bg->f, z2_const)
-                   *pow(interp_spline(&bg->conformal_Hz, z2_const), 2)*(2 - 5*s1)*interp_spline(&bg->D1, z2_const)
+                    b2*(2 - 5*s1)*g->D1_2*chi1
+                    /* integrand */
+                   *(1 - x)*n->D1_1[k]/n->a_1[k]
                    *(
-                        /* integrand */
-                        (1 - x)*interp_spline(&bg->D1, z1)/interp_spline(&bg->a, z1)
-                       *(
-                            2*chi2*costheta*interp_spline(&integral[7].result, sqrt(r22))
-                           -chi2*chi2*lambda1*(1 - costheta*costheta)*interp_spline(&integral[6].result, sqrt(r22))
-                        )
+                        2*chi2*costheta*n->I2[3][k]
+                       -chi2*chi2*lambda1*(1 - costheta*costheta)
+                       *n->I2[1][k]
+                       /r22
                     )
                 );
         }
-        /* g1-len + len-g1 term */
-        else if (
-            strcmp(par->corr_terms[i], "49") == 0 ||
-            strcmp(par->corr_terms[i], "94") == 0
-        ){
-            result +=
-                /* constant in front */
-                9*par->Omega0_m*par->Omega0_m/4.
+        else if (r21 != 0 && r22 == 0.0){
+            term +=
+               -3*par->Omega0_m/2.
                *(
-                    chi2*(1 + interp_spline(&bg->G1, z1_const))*(2 - 5*s2)*interp_spline(&bg->D1, z1_const)
+                    b1*(2 - 5*s2)*g->D1_1*chi2
+                    /* integrand */
+                   *(1 - x)*n->D1_2[k]/n->a_2[k]
                    *(
-                        /* integrand */
-                        (1 - x)*interp_spline(&bg->D1, z2)/interp_spline(&bg->a, z2)
-                       *(
-                            2*chi1*costheta*interp_spline(&integral[7].result, sqrt(r21))
-                           -chi1*chi1*lambda2*(1 - costheta*costheta)*interp_spline(&integral[6].result, sqrt(r21))
-                        )
+                        2*chi1*costheta*n->I1[3][k]
+                       -chi1*chi1*lambda2*(1 - costheta*costheta)
+                       *n->I1[1][k]
+                       /r21
                     )
                     +
-                    chi1*(1 + interp_spline(&bg->G2, z2_const))*(2 - 5*s1)*interp_spline(&bg->D1, z2_const)
+                    b2*(2 - 5*s1)*g->D1_2*chi1
+                    /* integrand */
+                   *(1 - x)*n->D1_1[k]/n->a_1[k]
                    *(
-                        /* integrand */
-                        (1 - x)*interp_spline(&bg->D1, z1)/interp_spline(&bg->a, z1)
-                       *(
-                            2*chi2*costheta*interp_spline(&integral[7].result, sqrt(r22))
-                           -chi2*chi2*lambda1*(1 - costheta*costheta)*interp_spline(&integral[6].result, sqrt(r22))
-                        )
+                        2*chi2*g->I_zero[3]
                     )
                 );
         }
-        /* g2-len + len-g2 term */
-        else if (
-            strcmp(par->corr_terms[i], "59") == 0 ||
-            strcmp(par->corr_terms[i], "95") == 0
-        ){
-            result +=
-                /* constant in front */
-                9*par->Omega0_m*par->Omega0_m/4.
+        else{
+            term +=
+               -3*par->Omega0_m/2.
                *(
-                    chi2*(5*s1 - 2)*(2 - 5*s2)*interp_spline(&bg->D1, z1_const)
+                    b1*(2 - 5*s2)*g->D1_1
+                    /* integrand */
+                   *(1 - x)*n->D1_2[k]/n->a_2[k]
                    *(
-                        /* integrand */
-                        (1 - x)*interp_spline(&bg->D1, z2)/interp_spline(&bg->a, z2)
-                       *(
-                            2*chi1*costheta*interp_spline(&integral[7].result, sqrt(r21))
-                           -chi1*chi1*lambda2*(1 - costheta*costheta)*interp_spline(&integral[6].result, sqrt(r21))
-                        )
+                        2*chi1*chi2*g->I_zero[3]
                     )
                     +
-                    chi1*(5*s2 - 2)*(2 - 5*s1)*interp_spline(&bg->D1, z2_const)
+                    b2*(2 - 5*s1)*g->D1_2
+                    /* integrand */
+                   *(1 - x)*n->D1_1[k]/n->a_1[k]
                    *(
-                        /* integrand */
-                        (1 - x)*interp_spline(&bg->D1, z1)/interp_spline(&bg->a, z1)
-                       *(
-                            2*chi2*costheta*interp_spline(&integral[7].result, sqrt(r22))
-                           -chi2*chi2*lambda1*(1 - costheta*costheta)*interp_spline(&integral[6].result, sqrt(r22))
-                        )
+                        2*chi2*chi1*g->I_zero[3]
                     )
                 );
         }
-        /* g3-len + len-g3 term */
-        else if (
-            strcmp(par->corr_terms[i], "69") == 0 ||
-            strcmp(par->corr_terms[i], "96") == 0
-        ){
-            result +=
+        FUNCTIONS_ADD_TERM(0, 9, term);
+    }
+    /* rsd-len + len-rsd term */
+    if (terms & COFFE_TERM(1, 9)){
+        double term = 0;
+        if (r21 != 0 && r22 != 0){
+            term +=
                 /* constant in front */
-                9*par->Omega0_m*par->Omega0_m/4.
+                3*par->Omega0_m/2.
                *(
-                    chi2*(interp_spline(&bg->f, z1_const) - 1)*(2 - 5*s2)*interp_spline(&bg->D1, z1_const)
+                    chi2*g->f_1*(2 - 5*s2)*g->D1_1
+                    /* integrand */
+                   *(1 - x)*n->D1_2[k]/n->a_2[k]
                    *(
-                        /* integrand */
-                        (1 - x)*interp_spline(&bg->D1, z2)/interp_spline(&bg->a, z2)
-                       *(
-                            2*chi1*costheta*interp_spline(&integral[7].result, sqrt(r21))
-                           -chi1*chi1*lambda2*(1 - costheta*costheta)*interp_spline(&integral[6].result, sqrt(r21))
+                        (lambda2 - 6*chi1*costheta + 3*lambda2*(2*costheta*costheta - 1))
+                       *n->I1[0][k]/15.
+                       -(
+                            6*chi1*chi1*chi1*costheta - chi1*chi1*lambda2*(9*costheta*costheta + 11)
+                           +chi1*lambda2*lambda2*costheta*(3*(2*costheta*costheta - 1) + 19)
+                           -2*lambda2*lambda2*lambda2*(3*(2*costheta*costheta - 1) + 1)
                         )
+                       *n->I1[1][k]/r21/21.
                     )
                     +
-                    chi1*(interp_spline(&bg->f, z2_const) - 1)*(2 - 5*s1)*interp_spline(&bg->D1, z2_const)
+                    chi1*g->f_2*(2 - 5*s1)*g->D1_2
+                    /* integrand */
+                   *(1 - x)*n->D1_1[k]/n->a_1[k]
                    *(
-                        /* integrand */
-                        (1 - x)*interp_spline(&bg->D1, z1)/interp_spline(&bg->a, z1)
-                       *(
-                            2*chi2*costheta*interp_spline(&integral[7].result, sqrt(r22))
-                           -chi2*chi2*lambda1*(1 - costheta*costheta)*interp_spline(&integral[6].result, sqrt(r22))
+                        (lambda1 - 6*chi2*costheta + 3*lambda1*(2*costheta*costheta - 1))
+                       *n->I2[0][k]/15.
+                       -(
+                            6*chi2*chi2*chi2*costheta - chi2*chi2*lambda1*(9*costheta*costheta + 11)
+                           +chi2*lambda1*lambda1*costheta*(3*(2*costheta*costheta - 1) + 19)
+                           -2*lambda1*lambda1*lambda1*(3*(2*costheta*costheta - 1) + 1)
                         )
+                       *n->I2[1][k]/r22/21.
                     )
                 );
-        }
-        /* den-g4 + g4-den term */
-        else if (
-            strcmp(par->corr_terms[i], "07") == 0 ||
-            strcmp(par->corr_terms[i], "70") == 0
-        ){
-            result +=
-                /* constant in front */
-               -3*par->Omega0_m
+            if (fabs(mu) < 0.999){
+                term +=
+                3*par->Omega0_m/2.
                *(
-                    b1*(2 - 5*s2)*interp_spline(&bg->D1, z1_const)
+                    chi2*g->f_1*(2 - 5*s2)*g->D1_1
                     /* integrand */
-                   *interp_spline(&bg->D1, z2)/interp_spline(&bg->a, z2)
-                   *interp_spline(&integral[5].result, sqrt(r21))
-                   +
-                    b2*(2 - 5*s1)*interp_spline(&bg->D1, z2_const)
+                   *(1 - x)*n->D1_2[k]/n->a_2[k]
+                   *(
+                       -(
+                           -4*pow(chi1, 5)*costheta
+                           -pow(chi1, 3)*pow(lambda2, 2)*costheta*((2*costheta*costheta - 1) + 7)
+                           +pow(chi1, 2)*pow(lambda2, 3)*(pow(costheta, 4) + 12*costheta*costheta - 21)
+                           -3*chi1*pow(lambda2, 4)*costheta*((2*costheta*costheta - 1) - 5)
+                           -pow(lambda2, 5)*(3*(2*costheta*costheta - 1) + 1)
+                           +12*pow(chi1, 4)*lambda2
+                        )
+                       *n->I1[2][k]/r21/r21/35.
+                    )
+                    +
+                    chi1*g->f_2*(2 - 5*s1)*g->D1_2
                     /* integrand */
-                   *interp_spline(&bg->D1, z1)/interp_spline(&bg->a, z1)
-                   *interp_spline(&integral[5].result, sqrt(r22))
+                   *(1 - x)*n->D1_1[k]/n->a_1[k]
+                   *(
+                       -(
+                           -4*pow(chi2, 5)*costheta
+                           -pow(chi2, 3)*pow(lambda1, 2)*costheta*((2*costheta*costheta - 1) + 7)
+                           +pow(chi2, 2)*pow(lambda1, 3)*(pow(costheta, 4) + 12*costheta*costheta - 21)
+                           -3*chi2*pow(lambda1, 4)*costheta*((2*costheta*costheta - 1) - 5)
+                           -pow(lambda1, 5)*(3*(2*costheta*costheta - 1) + 1)
+                           +12*pow(chi2, 4)*lambda1
+                        )
+                       *n->I2[2][k]/r22/r22/35.
+                    )
                 );
-        }
-        /* den-g5 + g5-den term */
-        else if (
-            strcmp(par->corr_terms[i], "08") == 0 ||
-            strcmp(par->corr_terms[i], "80") == 0
-        ){
-            result +=
-                /* constant in front */
-               -3*par->Omega0_m
+            }
+            else{
+                term +=
+                3*par->Omega0_m/2.
                *(
-                    chi2*b1*interp_spline(&bg->G2, z2_const)*interp_spline(&bg->D1, z1_const)
+                    chi2*g->f_1*(2 - 5*s2)*g->D1_1
                     /* integrand */
-                   *interp_spline(&bg->conformal_Hz, z2)*(interp_spline(&bg->f, z2) - 1)
-                   *interp_spline(&bg->D1, z2)*interp_spline(&bg->a, z2)
-                   *interp_spline(&integral[5].result, sqrt(r21))
-                   +
-                    chi1*b2*interp_spline(&bg->G1, z1_const)*interp_spline(&bg->D1, z2_const)
+                   *(1 - x)*n->D1_2[k]/n->a_2[k]
+                   *4.*(lambda2 + chi1)*n->I1[2][k]/35.
+                    +
+                    chi1*g->f_2*(2 - 5*s1)*g->D1_2
                     /* integrand */
-                   *interp_spline(&bg->conformal_Hz, z1)*(interp_spline(&bg->f, z1) - 1)
-                   *interp_spline(&bg->D1, z1)*interp_spline(&bg->a, z1)
-                   *interp_spline(&integral[5].result, sqrt(r22))
+                   *(1 - x)*n->D1_1[k]/n->a_1[k]
+                   *4.*(lambda1 + chi2)*n->I2[2][k]/35.
                 );
+            }
         }
-        /* rsd-g4 + g4-rsd term */
-        else if (
-            strcmp(par->corr_terms[i], "17") == 0 ||
-            strcmp(par->corr_terms[i], "71") == 0
-        ){
-            result +=
-                3*par->Omega0_m
+        else if (r21 == 0 && r22 != 0){
+            term +=
+                3*par->Omega0_m/2.
                *(
-                    interp_spline(&bg->f, z1_const)*(2 - 5*s2)*interp_spline(&bg->D1, z1_const)
+                    chi2*g->f_1*(2 - 5*s2)*g->D1_1
                     /* integrand */
-                   *interp_spline(&bg->D1, z2)/interp_spline(&bg->a, z2)
+                   *(1 - chi1/chi2)*n->D1_2[k]/n->a_2[k]
                    *(
-                        (2*r21/3. + (costheta*costheta - 1)*lambda2*lambda2)
-                       *interp_spline(&integral[6].result, sqrt(r21))
-                       -interp_spline(&integral[5].result, sqrt(r21))/3.
+                       -2*chi1*g->I_zero[0]/15.
                     )
-                   +
-                    interp_spline(&bg->f, z2_const)*(2 - 5*s1)*interp_spline(&bg->D1, z2_const)
+                    +
+                    chi1*g->f_2*(2 - 5*s1)*g->D1_2
                     /* integrand */
-                   *interp_spline(&bg->D1, z1)/interp_spline(&bg->a, z1)
+                   *(1 - x)*n->D1_1[k]/n->a_1[k]
                    *(
-                        (2*r22/3. + (costheta*costheta - 1)*lambda1*lambda1)
-                       *interp_spline(&integral[6].result, sqrt(r22))
-                       -interp_spline(&integral[5].result, sqrt(r22))/3.
+                        (lambda1 - 6*chi2*costheta + 3*lambda1*(2*costheta*costheta - 1))
+                       *n->I2[0][k]/15.
+                       -(
+                            6*chi2*chi2*chi2*costheta - chi2*chi2*lambda1*(9*costheta*costheta + 11)
+                           +chi2*lambda1*lambda1*costheta*(3*(2*costheta*costheta - 1) + 19)
+                           -2*lambda1*lambda1*lambda1*(3*(2*costheta*costheta - 1) + 1)
+                        )
+                       *n->I2[1][k]/r22/21.
+                       -(
+                           -4*pow(chi2, 5)*costheta
+                           -pow(chi2, 3)*pow(lambda1, 2)*costheta*((2*costheta*costheta - 1) + 7)
+                           +pow(chi2, 2)*pow(lambda1, 3)*(pow(costheta, 4) + 12*costheta*costheta - 21)
+                           -3*chi2*pow(lambda1, 4)*costheta*((2*costheta*costheta - 1) - 5)
+                           -pow(lambda1, 5)*(3*(2*costheta*costheta - 1) + 1)
+                           +12*pow(chi2, 4)*lambda1
+                        )
+                       *n->I2[2][k]/r22/r22/35.
                     )
                 );
         }
-        /* rsd-g5 + g5-rsd term */
-        else if (
-            strcmp(par->corr_terms[i], "18") == 0 ||
-            strcmp(par->corr_terms[i], "81") == 0
-        ){
-            result +=
-                3*par->Omega0_m
+        else if (r21 != 0 && r22 == 0){
+            term +=
+                /* constant in front */
+                3*par->Omega0_m/2.
                *(
-                    chi2*interp_spline(&bg->f, z1_const)*interp_spline(&bg->G2, z2_const)*interp_spline(&bg->D1, z1_const)
+                    chi2*g->f_1*(2 - 5*s2)*g->D1_1
                     /* integrand */
-                   *interp_spline(&bg->conformal_Hz, z2)*(interp_spline(&bg->f, z2) - 1)
-                   *interp_spline(&bg->D1, z2)/interp_spline(&bg->a, z2)
+                   *(1 - x)*n->D1_2[k]/n->a_2[k]
                    *(
-                        (2*r21/3. + (costheta*costheta - 1)*lambda2*lambda2)
-                       *interp_spline(&integral[6].result, sqrt(r21))
-                       -interp_spline(&integral[5].result, sqrt(r21))/3.
+                        (lambda2 - 6*chi1*costheta + 3*lambda2*(2*costheta*costheta - 1))
+                       *n->I1[0][k]/15.
+                       -(
+                            6*chi1*chi1*chi1*costheta - chi1*chi1*lambda2*(9*costheta*costheta + 11)
+                           +chi1*lambda2*lambda2*costheta*(3*(2*costheta*costheta - 1) + 19)
+                           -2*lambda2*lambda2*lambda2*(3*(2*costheta*costheta - 1) + 1)
+                        )
+                       *n->I1[1][k]/r21/21.
+                       -(
+                           -4*pow(chi1, 5)*costheta
+                           -pow(chi1, 3)*pow(lambda2, 2)*costheta*((2*costheta*costheta - 1) + 7)
+                           +pow(chi1, 2)*pow(lambda2, 3)*(pow(costheta, 4) + 12*costheta*costheta - 21)
+                           -3*chi1*pow(lambda2, 4)*costheta*((2*costheta*costheta - 1) - 5)
+                           -pow(lambda2, 5)*(3*(2*costheta*costheta - 1) + 1)
+                           +12*pow(chi1, 4)*lambda2
+                        )
+                       *n->I1[2][k]/r21/r21/35.
                     )
-                   +
-                    chi1*interp_spline(&bg->f, z2_const)*interp_spline(&bg->G1, z1_const)*interp_spline(&bg->D1, z2_const)
+                    +
+                    chi1*g->f_2*(2 - 5*s1)*g->D1_2
                     /* integrand */
-                   *interp_spline(&bg->conformal_Hz, z1)*(interp_spline(&bg->f, z1) - 1)
-                   *interp_spline(&bg->D1, z1)/interp_spline(&bg->a, z1)
+                   *(1 - chi2/chi1)*n->D1_1[k]/n->a_1[k]
                    *(
-                        (2*r22/3. + (costheta*costheta - 1)*lambda1*lambda1)
-                       *interp_spline(&integral[6].result, sqrt(r22))
-                       -interp_spline(&integral[5].result, sqrt(r22))/3.
+                      -2*chi2*g->I_zero[0]/15.
                     )
                 );
         }
-        /* d1-g4 + d1-g4 term */
-        else if (
-            strcmp(par->corr_terms[i], "27") == 0 ||
-            strcmp(par->corr_terms[i], "72") == 0
-        ){
-            result +=
-                3*par->Omega0_m
-               *(
-                    interp_spline(&bg->conformal_Hz, z1_const)*interp_spline(&bg->f, z1_const)*(2 - 5*s2)*interp_spline(&bg->D1, z1_const)
-                   *interp_spline(&bg->D1, z2)/interp_spline(&bg->a, z2)*(lambda2*costheta - chi1)
-                   *interp_spline(&integral[7].result, sqrt(r21))
-                   +
-                    interp_spline(&bg->conformal_Hz, z2_const)*interp_spline(&bg->f, z2_const)*(2 - 5*s1)*interp_spline(&bg->D1, z2_const)
-                   *interp_spline(&bg->D1, z1)/interp_spline(&bg->a, z1)*(lambda1*costheta - chi2)
-                   *interp_spline(&integral[7].result, sqrt(r22))
-                );
-        }
-        /* d1-g5 + d1-g5 term */
-        else if (
-            strcmp(par->corr_terms[i], "28") == 0 ||
-            strcmp(par->corr_terms[i], "82") == 0
-        ){
-            result +=
-                3*par->Omega0_m
-               *(
-                    chi2*interp_spline(&bg->conformal_Hz, z1_const)*interp_spline(&bg->f, z1_const)
-                   *interp_spline(&bg->G2, z2_const)*interp_spline(&bg->D1, z1_const)
-                   *interp_spline(&bg->conformal_Hz, z2)*(interp_spline(&bg->f, z2) - 1)
-                   *interp_spline(&bg->D1, z2)/interp_spline(&bg->a, z2)*(lambda2*costheta - chi1)
-                   *interp_spline(&integral[7].result, sqrt(r21))
-                   +
-                    chi1*interp_spline(&bg->conformal_Hz, z2_const)*interp_spline(&bg->f, z2_const)
-                   *interp_spline(&bg->G1, z1_const)*interp_spline(&bg->D1, z2_const)
-                   *interp_spline(&bg->conformal_Hz, z1)*(interp_spline(&bg->f, z1) - 1)
-                   *interp_spline(&bg->D1, z1)/interp_spline(&bg->a, z1)*(lambda1*costheta - chi2)
-                   *interp_spline(&integral[7].result, sqrt(r22))
-                );
-        }
-        /* d2-g4 + g4-d2 term */
-        else if (
-            strcmp(par->corr_terms[i], "37") == 0 ||
-            strcmp(par->corr_terms[i], "73") == 0
-        ){
-            result +=
-               -3*par->Omega0_m
-               *(
-                    (3 - interp_spline(&par->evolution_bias1, z1_const))*interp_spline(&bg->f, z1_const)
-                   *pow(interp_spline(&bg->conformal_Hz, z1_const), 2)*(2 - 5*s2)*interp_spline(&bg->D1, z1_const)
-                   *interp_spline(&bg->D1, z2)/interp_spline(&bg->a, z2)
-                   *ren1
-                   +
-                    (3 - interp_spline(&par->evolution_bias2, z2_const))*interp_spline(&bg->f, z2_const)
-                   *pow(interp_spline(&bg->conformal_Hz, z2_const), 2)*(2 - 5*s1)*interp_spline(&bg->D1, z2_const)
-                   *interp_spline(&bg->D1, z1)/interp_spline(&bg->a, z1)
-                   *ren2
-                );
-        }
-        /* d2-g5 + g5-d2 term */
-        else if (
-            strcmp(par->corr_terms[i], "38") == 0 ||
-            strcmp(par->corr_terms[i], "83") == 0
-        ){
-            result +=
-               -3*par->Omega0_m
-               *(
-                    chi2*(3 - interp_spline(&par->evolution_bias1, z1_const))*interp_spline(&bg->f, z1_const)
-                   *pow(interp_spline(&bg->conformal_Hz, z1_const), 2)*interp_spline(&bg->G2, z2_const)*interp_spline(&bg->D1, z1_const)
-                   *interp_spline(&bg->conformal_Hz, z2)*(interp_spline(&bg->f, z2) - 1)
-                   *interp_spline(&bg->D1, z2)/interp_spline(&bg->a, z2)
-                   *ren1
-                   +
-                    chi1*(3 - interp_spline(&par->evolution_bias2, z2_const))*interp_spline(&bg->f, z2_const)
-                   *pow(interp_spline(&bg->conformal_Hz, z2_const), 2)*interp_spline(&bg->G1, z1_const)*interp_spline(&bg->D1, z2_const)
-                   *interp_spline(&bg->conformal_Hz, z1)*(interp_spline(&bg->f, z1) - 1)
-                   *interp_spline(&bg->D1, z1)/interp_spline(&bg->a, z1)
-                   *ren2
-                );
-        }
-        /* g1-g4 + g4-g1 term */
-        else if (
-            strcmp(par->corr_terms[i], "47") == 0 ||
-            strcmp(par->corr_terms[i], "74") == 0
-        ){
-            result +=
-                9*par->Omega0_m*par->Omega0_m/2.
+        else{
+            term +=
+                3*par->Omega0_m/2.
                *(
-                    (1 + interp_spline(&bg->G1, z1_const))*(2 - 5*s2)
-                   *interp_spline(&bg->D1, z1_const)/interp_spline(&bg->a, z1_const)
+                    chi2*g->f_1*(2 - 5*s2)*g->D1_1
                     /* integrand */
-                   *interp_spline(&bg->D1, z2)/interp_spline(&bg->a, z2)*ren1
+                   *(1 - chi1/chi2)*n->D1_2[k]/n->a_2[k]
+                   *(
+                      -2*chi1*g->I_zero[0]/15.
+                    )
                     +
-                    (1 + interp_spline(&bg->G2, z2_const))*(2 - 5*s1)
-                   *interp_spline(&bg->D1, z2_const)/interp_spline(&bg->a, z2_const)
+                    chi1*g->f_2*(2 - 5*s1)*g->D1_2
                     /* integrand */
-                   *interp_spline(&bg->D1, z1)/interp_spline(&bg->a, z1)*ren2
+                   *(1 - chi2/chi1)*n->D1_1[k]/n->a_1[k]
+                   *(
+                       -2*chi2*g->I_zero[0]/15.
+                    )
                 );
         }
-        /* g1-g5 + g5-g1 term */
-        else if (
-            strcmp(par->corr_terms[i], "48") == 0 ||
-            strcmp(par->corr_terms[i], "84") == 0
-        ){
-            result +=
-                9*par->Omega0_m*par->Omega0_m/2.
+        FUNCTIONS_ADD_TERM(1, 9, term);
+    }
+    /* d1-len + len-d1 term */
+    if (terms & COFFE_TERM(2, 9)){
+        double term = 0;
+        if (r21 != 0 && r22 != 0){
+            term +=
+                /* constant in front */
+                3*par->Omega0_m/2.
                *(
-                    chi2*(1 + interp_spline(&bg->G1, z1_const))*interp_spline(&bg->G2, z2_const)
-                   *interp_spline(&bg->D1, z1_const)/interp_spline(&bg->a, z1_const)
+                    chi2*g->curlyH_1*g->f_1
+                   *g->G1_1*(2 - 5*s2)*g->D1_1
                     /* integrand */
-                   *interp_spline(&bg->conformal_Hz, lambda2)
-                   *(interp_spline(&bg->f, lambda2) - 1)
-                   *interp_spline(&bg->D1, z2)/interp_spline(&bg->a, z2)*ren1
+                   *(1 - x)*n->D1_2[k]/n->a_2[k]
+                   *(
+                        2*(costheta*(lambda2*lambda2 - 2*chi1*chi1) + chi1*lambda2*(2*(2*costheta*costheta - 1) - 1))
+                       *n->I1[3][k]/15.
+                       +2*costheta*n->I1[5][k]/3.
+                       -(
+                            4*pow(chi1, 4)*costheta
+                           -pow(chi1, 3)*lambda2*(costheta*costheta + 9)
+                           +chi1*chi1*lambda2*lambda2*costheta*(costheta*costheta + 5)
+                           -2*chi1*pow(lambda2, 3)*((2*costheta*costheta - 1) - 2)
+                           -2*pow(lambda2, 4)*costheta
+                        )*n->I1[4][k]/r21/15.
+                    )
                     +
-                    chi1*(1 + interp_spline(&bg->G2, z2_const))*interp_spline(&bg->G1, z1_const)
-                   *interp_spline(&bg->D1, z2_const)/interp_spline(&bg->a, z2_const)
+                    chi1*g->curlyH_2*g->f_2
+                   *g->G2_2*(2 - 5*s1)*g->D1_2
                     /* integrand */
-                    *interp_spline(&bg->conformal_Hz, lambda1)
-                   *(interp_spline(&bg->f, lambda1) - 1)
-                   *interp_spline(&bg->D1, z1)/interp_spline(&bg->a, z1)*ren2
+                   *(1 - x)*n->D1_1[k]/n->a_1[k]
+                   *(
+                        2*(costheta*(lambda1*lambda1 - 2*chi2*chi2) + chi2*lambda1*(2*(2*costheta*costheta - 1) - 1))
+                       *n->I2[3][k]/15.
+                       +2*costheta*n->I2[5][k]/3.
+                       -(
+                            4*pow(chi2, 4)*costheta
+                           -pow(chi2, 3)*lambda1*(costheta*costheta + 9)
+                           +chi2*chi2*lambda1*lambda1*costheta*(costheta*costheta + 5)
+                           -2*chi2*pow(lambda1, 3)*((2*costheta*costheta - 1) - 2)
+                           -2*pow(lambda1, 4)*costheta
+                        )*n->I2[4][k]/r22/15.
+                    )
                 );
         }
-        /* g2-g4 + g4-g2 term */
-        else if (
-            strcmp(par->corr_terms[i], "57") == 0 ||
-            strcmp(par->corr_terms[i], "75") == 0
-        ){
-            result +=
-                9*par->Omega0_m*par->Omega0_m/2.
+        else if (r21 == 0 && r22 != 0){
+            term +=
+                /* constant in front */
+                3*par->Omega0_m/2.
                *(
-                    (5*s1 - 2)*(2 - 5*s2)
-                   *interp_spline(&bg->D1, z1_const)/interp_spline(&bg->a, z1_const)
+                    chi2*g->curlyH_1*g->f_1
+                   *g->G1_1*(2 - 5*s2)*g->D1_1
                     /* integrand */
-                   *interp_spline(&bg->D1, z2)/interp_spline(&bg->a, z2)*ren1
+                   *(1 - x)*n->D1_2[k]/n->a_2[k]
+                   *(
+                       2*g->I_zero[5]/3.
+                    )
                     +
-                    (5*s2 - 2)*(2 - 5*s1)
-                   *interp_spline(&bg->D1, z2_const)/interp_spline(&bg->a, z2_const)
+                    chi1*g->curlyH_2*g->f_2
+                   *g->G2_2*(2 - 5*s1)*g->D1_2
                     /* integrand */
-                   *interp_spline(&bg->D1, z1)/interp_spline(&bg->a, z1)*ren2
+                   *(1 - x)*n->D1_1[k]/n->a_1[k]
+                   *(
+                        2*(costheta*(lambda1*lambda1 - 2*chi2*chi2) + chi2*lambda1*(2*(2*costheta*costheta - 1) - 1))
+                       *n->I2[3][k]/15.
+                       +2*costheta*n->I2[5][k]/3.
+                       -(
+                            4*pow(chi2, 4)*costheta
+                           -pow(chi2, 3)*lambda1*(costheta*costheta + 9)
+                           +chi2*chi2*lambda1*lambda1*costheta*(costheta*costheta + 5)
+                           -2*chi2*pow(lambda1, 3)*((2*costheta*costheta - 1) - 2)
+                           -2*pow(lambda1, 4)*costheta
+                        )*n->I2[4][k]/r22/15.
+                    )
                 );
         }
-        /* g2-g5 + g5-g2 term */
-        else if (
-            strcmp(par->corr_terms[i], "58") == 0 ||
-            strcmp(par->corr_terms[i], "85") == 0
-        ){
-            result +=
-                9*par->Omega0_m*par->Omega0_m/2.
+        else if (r21 != 0 && r22 == 0){
+            term +=
+                /* constant in front */
+                3*par->Omega0_m/2.
                *(
-                    chi2*(5*s1 - 2)*interp_spline(&bg->G2, z2_const)
-                   *interp_spline(&bg->D1, z1_const)/interp_spline(&bg->a, z1_const)
+                    chi2*g->curlyH_1*g->f_1
+                   *g->G1_1*(2 - 5*s2)*g->D1_1
                     /* integrand */
-                   *interp_spline(&bg->conformal_Hz, lambda2)
-                   *(interp_spline(&bg->f, lambda2) - 1)
-                   *interp_spline(&bg->D1, z2)/interp_spline(&bg->a, z2)*ren1
+                   *(1 - x)*n->D1_2[k]/n->a_2[k]
+                   *(
+                        2*(costheta*(lambda2*lambda2 - 2*chi1*chi1) + chi1*lambda2*(2*(2*costheta*costheta - 1) - 1))
+                       *n->I1[3][k]/15.
+                       +2*costheta*n->I1[5][k]/3.
+                       -(
+                            4*pow(chi1, 4)*costheta
+                           -pow(chi1, 3)*lambda2*(costheta*costheta + 9)
+                           +chi1*chi1*lambda2*lambda2*costheta*(costheta*costheta + 5)
+                           -2*chi1*pow(lambda2, 3)*((2*costheta*costheta - 1) - 2)
+                           -2*pow(lambda2, 4)*costheta
+                        )*n->I1[4][k]/r21/15.
+                    )
                     +
-                    chi1*(5*s2 - 2)*interp_spline(&bg->G1, z1_const)
-                   *interp_spline(&bg->D1, z2_const)/interp_spline(&bg->a, z2_const)
+                    chi1*g->curlyH_2*g->f_2
+                   *g->G2_2*(2 - 5*s1)*g->D1_2
                     /* integrand */
-                    *interp_spline(&bg->conformal_Hz, lambda1)
-                   *(interp_spline(&bg->f, lambda1) - 1)
-                   *interp_spline(&bg->D1, z1)/interp_spline(&bg->a, z1)*ren2
+                   *(1 - x)*n->D1_1[k]/n->a_1[k]
+                   *(
+                       2*g->I_zero[5]/3.
+                    )
                 );
         }
-        /* g3-g4 + g4-g3 term */
-        else if (
-            strcmp(par->corr_terms[i], "67") == 0 ||
-            strcmp(par->corr_terms[i], "76") == 0
-        ){
-            result +=
-                9*par->Omega0_m*par->Omega0_m/2.
+        else{
+            term +=
+                /* constant in front */
+                3*par->Omega0_m/2.
                *(
-                    (interp_spline(&bg->f, z1_const) - 1)*(2 - 5*s2)
-                   *interp_spline(&bg->D1, z1_const)/interp_spline(&bg->a, z1_const)
+                    chi2*g->curlyH_1*g->f_1
+                   *g->G1_1*(2 - 5*s2)*g->D1_1
                     /* integrand */
-                   *interp_spline(&bg->D1, z2)/interp_spline(&bg->a, z2)*ren1
+                   *(1 - x)*n->D1_2[k]/n->a_2[k]
+                   *(
+                       2*g->I_zero[5]/3.
+                    )
                     +
-                    (interp_spline(&bg->f, z2_const) - 1)*(2 - 5*s1)
-                   *interp_spline(&bg->D1, z2_const)/interp_spline(&bg->a, z2_const)
+                    chi1*g->curlyH_2*g->f_2
+                   *g->G2_2*(2 - 5*s1)*g->D1_2
                     /* integrand */
-                   *interp_spline(&bg->D1, z1)/interp_spline(&bg->a, z1)*ren2
+                   *(1 - x)*n->D1_1[k]/n->a_1[k]
+                   *(
+                       2*g->I_zero[5]/3.
+                    )
                 );
         }
-        /* g3-g5 + g5-g3 term */
-        else if (
-            strcmp(par->corr_terms[i], "68") == 0 ||
-            strcmp(par->corr_terms[i], "86") == 0
-        ){
-            result +=
-                9*par->Omega0_m*par->Omega0_m/2.
+        FUNCTIONS_ADD_TERM(2, 9, term);
+    }
+    /* d2-len + len-d2 term */
+    if (terms & COFFE_TERM(3, 9)){
+        double term = 0;
+        term +=
+            /* constant in front */
+           -3*par->Omega0_m/2.
+           *(
+                chi2*(3 - g->fevo_1)*g->f_1
+               *pow(g->curlyH_1, 2)*(2 - 5*s2)*g->D1_1
                *(
-                    chi2*(interp_spline(&bg->f, z1_const) - 1)*interp_spline(&bg->G2, z2_const)
-                   *interp_spline(&bg->D1, z1_const)/interp_spline(&bg->a, z1_const)
                     /* integrand */
-                   *interp_spline(&bg->conformal_Hz, lambda2)
-                   *(interp_spline(&bg->f, lambda2) - 1)
-                   *interp_spline(&bg->D1, z2)/interp_spline(&bg->a, z2)*ren1
-                    +
-                    chi1*(interp_spline(&bg->f, z2_const) - 1)*interp_spline(&bg->G1, z1_const)
-                   *interp_spline(&bg->D1, z2_const)/interp_spline(&bg->a, z2_const)
+                    (1 - x)*n->D1_2[k]/n->a_2[k]
+                   *(
+                        2*chi1*costheta*n->I1[7][k]
+                       -chi1*chi1*lambda2*(1 - costheta*costheta)*n->I1[6][k]
+                    )
+                )
+                +
+                chi1*(3 - g->fevo_2)*g->f_2
+               *pow(g->curlyH_2, 2)*(2 - 5*s1)*g->D1_2
+               *(
                     /* integrand */
-                    *interp_spline(&bg->conformal_Hz, lambda1)
-                   *(interp_spline(&bg->f, lambda1) - 1)
-                   *interp_spline(&bg->D1, z1)/interp_spline(&bg->a, z1)*ren2
-                );
-        }
+                    (1 - x)*n->D1_1[k]/n->a_1[k]
+                   *(
+                        2*chi2*costheta*n->I2[7][k]
+                       -chi2*chi2*lambda1*(1 - costheta*costheta)*n->I2[6][k]
+                    )
+                )
+            );
+        FUNCTIONS_ADD_TERM(3, 9, term);
     }
-    if (gsl_finite(result)){
-        return result;
+    /* g1-len + len-g1 term */
+    if (terms & COFFE_TERM(4, 9)){
+        double term = 0;
+        term +=
+            /* constant in front */
+            9*par->Omega0_m*par->Omega0_m/4.
+           *(
+                chi2*(1 + g->G1_1)*(2 - 5*s2)*g->D1_1
+               *(
+                    /* integrand */
+                    (1 - x)*n->D1_2[k]/n->a_2[k]
+                   *(
+                        2*chi1*costheta*n->I1[7][k]
+                       -chi1*chi1*lambda2*(1 - costheta*costheta)*n->I1[6][k]
+                    )
+                )
+                +
+                chi1*(1 + g->G2_2)*(2 - 5*s1)*g->D1_2
+               *(
+                    /* integrand */
+                    (1 - x)*n->D1_1[k]/n->a_1[k]
+                   *(
+                        2*chi2*costheta*n->I2[7][k]
+                       -chi2*chi2*lambda1*(1 - costheta*costheta)*n->I2[6][k]
+                    )
+                )
+            );
+        FUNCTIONS_ADD_TERM(4, 9, term);
     }
-    else{
-        fprintf(stderr,
-            "ERROR: in function %s, values:\n"
-            "mu = %e\n"
-            "z_mean = %e\n"
-            "chi_mean = %e\n"
-            "sep = %e\n"
-            "z1 = %e\n"
-            "z2 = %e\n"
-            "chi1 = %e\n"
-            "chi2 = %e\n"
-            "costheta = %e\n"
-            "r21 = %e\n"
-            "r22 = %e\n"
-            "z1_const = %e\n"
-            "z2_const = %e\n"
-            "s1, s2 = %e, %e\n"
-            "b1, b2 = %e, %e\n"
-            "x = %e\n",
-            __func__,
-            mu, z_mean, chi_mean, sep,
-            z1, z2, chi1, chi2, costheta,
-            r21, r22, z1_const, z2_const,
-            s1, s2, b1, b2, x
-        );
-        exit(EXIT_FAILURE);
+    /* g2-len + len-g2 term */
+    if (terms & COFFE_TERM(5, 9)){
+        double term = 0;
+        term +=
+            /* constant in front */
+            9*par->Omega0_m*par->Omega0_m/4.
+           *(
+                chi2*(5*s1 - 2)*(2 - 5*s2)*g->D1_1
+               *(
+                    /* integrand */
+                    (1 - x)*n->D1_2[k]/n->a_2[k]
+                   *(
+                        2*chi1*costheta*n->I1[7][k]
+                       -chi1*chi1*lambda2*(1 - costheta*costheta)*n->I1[6][k]
+                    )
+                )
+                +
+                chi1*(5*s2 - 2)*(2 - 5*s1)*g->D1_2
+               *(
+                    /* integrand */
+                    (1 - x)*n->D1_1[k]/n->a_1[k]
+                   *(
+                        2*chi2*costheta*n->I2[7][k]
+                       -chi2*chi2*lambda1*(1 - costheta*costheta)*n->I2[6][k]
+                    )
+                )
+            );
+        FUNCTIONS_ADD_TERM(5, 9, term);
+    }
+    /* g3-len + len-g3 term */
+    if (terms & COFFE_TERM(6, 9)){
+        double term = 0;
+        term +=
+            /* constant in front */
+            9*par->Omega0_m*par->Omega0_m/4.
+           *(
+                chi2*(g->f_1 - 1)*(2 - 5*s2)*g->D1_1
+               *(
+                    /* integrand */
+                    (1 - x)*n->D1_2[k]/n->a_2[k]
+                   *(
+                        2*chi1*costheta*n->I1[7][k]
+                       -chi1*chi1*lambda2*(1 - costheta*costheta)*n->I1[6][k]
+                    )
+                )
+                +
+                chi1*(g->f_2 - 1)*(2 - 5*s1)*g->D1_2
+               *(
+                    /* integrand */
+                    (1 - x)*n->D1_1[k]/n->a_1[k]
+                   *(
+                        2*chi2*costheta*n->I2[7][k]
+                       -chi2*chi2*lambda1*(1 - costheta*costheta)*n->I2[6][k]
+                    )
+                )
+            );
+        FUNCTIONS_ADD_TERM(6, 9, term);
+    }
+    /* den-g4 + g4-den term */
+    if (terms & COFFE_TERM(0, 7)){
+        double term = 0;
+        term +=
+            /* constant in front */
+           -3*par->Omega0_m
+           *(
+                b1*(2 - 5*s2)*g->D1_1
+                /* integrand */
+               *n->D1_2[k]/n->a_2[k]
+               *n->I1[5][k]
+               +
+                b2*(2 - 5*s1)*g->D1_2
+                /* integrand */
+               *n->D1_1[k]/n->a_1[k]
+               *n->I2[5][k]
+            );
+        FUNCTIONS_ADD_TERM(0, 7, term);
+    }
+    /* den-g5 + g5-den term */
+    if (terms & COFFE_TERM(0, 8)){
+        double term = 0;
+        term +=
+            /* constant in front */
+           -3*par->Omega0_m
+           *(
+                chi2*b1*g->G2_2*g->D1_1
+                /* integrand */
+               *n->curlyH_2[k]*(n->f_2[k] - 1)
+               *n->D1_2[k]*n->a_2[k]
+               *n->I1[5][k]
+               +
+                chi1*b2*g->G1_1*g->D1_2
+                /* integrand */
+               *n->curlyH_1[k]*(n->f_1[k] - 1)
+               *n->D1_1[k]*n->a_1[k]
+               *n->I2[5][k]
+            );
+        FUNCTIONS_ADD_TERM(0, 8, term);
+    }
+    /* rsd-g4 + g4-rsd term */
+    if (terms & COFFE_TERM(1, 7)){
+        double term = 0;
+        term +=
+            3*par->Omega0_m
+           *(
+                g->f_1*(2 - 5*s2)*g->D1_1
+                /* integrand */
+               *n->D1_2[k]/n->a_2[k]
+               *(
+                    (2*r21/3. + (costheta*costheta - 1)*lambda2*lambda2)
+                   *n->I1[6][k]
+                   -n->I1[5][k]/3.
+                )
+               +
+                g->f_2*(2 - 5*s1)*g->D1_2
+                /* integrand */
+               *n->D1_1[k]/n->a_1[k]
+               *(
+                    (2*r22/3. + (costheta*costheta - 1)*lambda1*lambda1)
+                   *n->I2[6][k]
+                   -n->I2[5][k]/3.
+                )
+            );
+        FUNCTIONS_ADD_TERM(1, 7, term);
+    }
+    /* rsd-g5 + g5-rsd term */
+    if (terms & COFFE_TERM(1, 8)){
+        double term = 0;
+        term +=
+            3*par->Omega0_m
+           *(
+                chi2*g->f_1*g->G2_2*g->D1_1
+                /* integrand */
+               *n->curlyH_2[k]*(n->f_2[k] - 1)
+               *n->D1_2[k]/n->a_2[k]
+               *(
+                    (2*r21/3. + (costheta*costheta - 1)*lambda2*lambda2)
+                   *n->I1[6][k]
+                   -n->I1[5][k]/3.
+                )
+               +
+                chi1*g->f_2*g->G1_1*g->D1_2
+                /* integrand */
+               *n->curlyH_1[k]*(n->f_1[k] - 1)
+               *n->D1_1[k]/n->a_1[k]
+               *(
+                    (2*r22/3. + (costheta*costheta - 1)*lambda1*lambda1)
+                   *n->I2[6][k]
+                   -n->I2[5][k]/3.
+                )
+            );
+        FUNCTIONS_ADD_TERM(1, 8, term);
+    }
+    /* d1-g4 + d1-g4 term */
+    if (terms & COFFE_TERM(2, 7)){
+        double term = 0;
+        term +=
+            3*par->Omega0_m
+           *(
+                g->curlyH_1*g->f_1*(2 - 5*s2)*g->D1_1
+               *n->D1_2[k]/n->a_2[k]*(lambda2*costheta - chi1)
+               *n->I1[7][k]
+               +
+                g->curlyH_2*g->f_2*(2 - 5*s1)*g->D1_2
+               *n->D1_1[k]/n->a_1[k]*(lambda1*costheta - chi2)
+               *n->I2[7][k]
+            );
+        FUNCTIONS_ADD_TERM(2, 7, term);
+    }
+    /* d1-g5 + d1-g5 term */
+    if (terms & COFFE_TERM(2, 8)){
+        double term = 0;
+        term +=
+            3*par->Omega0_m
+           *(
+                chi2*g->curlyH_1*g->f_1
+               *g->G2_2*g->D1_1
+               *n->curlyH_2[k]*(n->f_2[k] - 1)
+               *n->D1_2[k]/n->a_2[k]*(lambda2*costheta - chi1)
+               *n->I1[7][k]
+               +
+                chi1*g->curlyH_2*g->f_2
+               *g->G1_1*g->D1_2
+               *n->curlyH_1[k]*(n->f_1[k] - 1)
+               *n->D1_1[k]/n->a_1[k]*(lambda1*costheta - chi2)
+               *n->I2[7][k]
+            );
+        FUNCTIONS_ADD_TERM(2, 8, term);
+    }
+    /* d2-g4 + g4-d2 term */
+    if (terms & COFFE_TERM(3, 7)){
+        double term = 0;
+        term +=
+           -3*par->Omega0_m
+           *(
+                (3 - g->fevo_1)*g->f_1
+               *pow(g->curlyH_1, 2)*(2 - 5*s2)*g->D1_1
+               *n->D1_2[k]/n->a_2[k]
+               *ren1
+               +
+                (3 - g->fevo_2)*g->f_2
+               *pow(g->curlyH_2, 2)*(2 - 5*s1)*g->D1_2
+               *n->D1_1[k]/n->a_1[k]
+               *ren2
+            );
+        FUNCTIONS_ADD_TERM(3, 7, term);
+    }
+    /* d2-g5 + g5-d2 term */
+    if (terms & COFFE_TERM(3, 8)){
+        double term = 0;
+        term +=
+           -3*par->Omega0_m
+           *(
+                chi2*(3 - g->fevo_1)*g->f_1
+               *pow(g->curlyH_1, 2)*g->G2_2*g->D1_1
+               *n->curlyH_2[k]*(n->f_2[k] - 1)
+               *n->D1_2[k]/n->a_2[k]
+               *ren1
+               +
+                chi1*(3 - g->fevo_2)*g->f_2
+               *pow(g->curlyH_2, 2)*g->G1_1*g->D1_2
+               *n->curlyH_1[k]*(n->f_1[k] - 1)
+               *n->D1_1[k]/n->a_1[k]
+               *ren2
+            );
+        FUNCTIONS_ADD_TERM(3, 8, term);
+    }
+    /* g1-g4 + g4-g1 term */
+    if (terms & COFFE_TERM(4, 7)){
+        double term = 0;
+        term +=
+            9*par->Omega0_m*par->Omega0_m/2.
+           *(
+                (1 + g->G1_1)*(2 - 5*s2)
+               *g->D1_1/g->a_1
+                /* integrand */
+               *n->D1_2[k]/n->a_2[k]*ren1
+                +
+                (1 + g->G2_2)*(2 - 5*s1)
+               *g->D1_2/g->a_2
+                /* integrand */
+               *n->D1_1[k]/n->a_1[k]*ren2
+            );
+        FUNCTIONS_ADD_TERM(4, 7, term);
+    }
+    /* g1-g5 + g5-g1 term */
+    if (terms & COFFE_TERM(4, 8)){
+        double term = 0;
+        term +=
+            9*par->Omega0_m*par->Omega0_m/2.
+           *(
+                chi2*(1 + g->G1_1)*g->G2_2
+               *g->D1_1/g->a_1
+                /* integrand */
+               *n->curlyH_lambda2[k]
+               *(n->f_lambda2[k] - 1)
+               *n->D1_2[k]/n->a_2[k]*ren1
+                +
+                chi1*(1 + g->G2_2)*g->G1_1
+               *g->D1_2/g->a_2
+                /* integrand */
+                *n->curlyH_lambda1[k]
+               *(n->f_lambda1[k] - 1)
+               *n->D1_1[k]/n->a_1[k]*ren2
+            );
+        FUNCTIONS_ADD_TERM(4, 8, term);
+    }
+    /* g2-g4 + g4-g2 term */
+    if (terms & COFFE_TERM(5, 7)){
+        double term = 0;
+        term +=
+            9*par->Omega0_m*par->Omega0_m/2.
+           *(
+                (5*s1 - 2)*(2 - 5*s2)
+               *g->D1_1/g->a_1
+                /* integrand */
+               *n->D1_2[k]/n->a_2[k]*ren1
+                +
+                (5*s2 - 2)*(2 - 5*s1)
+               *g->D1_2/g->a_2
+                /* integrand */
+               *n->D1_1[k]/n->a_1[k]*ren2
+            );
+        FUNCTIONS_ADD_TERM(5, 7, term);
+    }
+    /* g2-g5 + g5-g2 term */
+    if (terms & COFFE_TERM(5, 8)){
+        double term = 0;
+        term +=
+            9*par->Omega0_m*par->Omega0_m/2.
+           *(
+                chi2*(5*s1 - 2)*g->G2_2
+               *g->D1_1/g->a_1
+                /* integrand */
+               *n->curlyH_lambda2[k]
+               *(n->f_lambda2[k] - 1)
+               *n->D1_2[k]/n->a_2[k]*ren1
+                +
+                chi1*(5*s2 - 2)*g->G1_1
+               *g->D1_2/g->a_2
+                /* integrand */
+                *n->curlyH_lambda1[k]
+               *(n->f_lambda1[k] - 1)
+               *n->D1_1[k]/n->a_1[k]*ren2
+            );
+        FUNCTIONS_ADD_TERM(5, 8, term);
+    }
+    /* g3-g4 + g4-g3 term */
+    if (terms & COFFE_TERM(6, 7)){
+        double term = 0;
+        term +=
+            9*par->Omega0_m*par->Omega0_m/2.
+           *(
+                (g->f_1 - 1)*(2 - 5*s2)
+               *g->D1_1/g->a_1
+                /* integrand */
+               *n->D1_2[k]/n->a_2[k]*ren1
+                +
+                (g->f_2 - 1)*(2 - 5*s1)
+               *g->D1_2/g->a_2
+                /* integrand */
+               *n->D1_1[k]/n->a_1[k]*ren2
+            );
+        FUNCTIONS_ADD_TERM(6, 7, term);
+    }
+    /* g3-g5 + g5-g3 term */
+    if (terms & COFFE_TERM(6, 8)){
+        double term = 0;
+        term +=
+            9*par->Omega0_m*par->Omega0_m/2.
+           *(
+                chi2*(g->f_1 - 1)*g->G2_2
+               *g->D1_1/g->a_1
+                /* integrand */
+               *n->curlyH_lambda2[k]
+               *(n->f_lambda2[k] - 1)
+               *n->D1_2[k]/n->a_2[k]*ren1
+                +
+                chi1*(g->f_2 - 1)*g->G1_1
+               *g->D1_2/g->a_2
+                /* integrand */
+                *n->curlyH_lambda1[k]
+               *(n->f_lambda1[k] - 1)
+               *n->D1_1[k]/n->a_1[k]*ren2
+            );
+        FUNCTIONS_ADD_TERM(6, 8, term);
     }
+    return result;
 }
 
 
-double functions_double_integrated(
+/**
+    reports the values of the single integrated terms
+    for which the result is not finite, and exits
+**/
+
+static void functions_single_integrated_error(
+    const char *func,
+    const struct functions_single_geometry *g,
+    const struct functions_los_nodes *n,
+    const size_t k
+)
+{
+    fprintf(stderr,
+        "ERROR: in function %s, values:\n"
+        "mu = %e\n"
+        "z_mean = %e\n"
+        "chi_mean = %e\n"
+        "sep = %e\n"
+        "z1 = %e\n"
+        "z2 = %e\n"
+        "chi1 = %e\n"
+        "chi2 = %e\n"
+        "costheta = %e\n"
+        "r21 = %e\n"
+        "r22 = %e\n"
+        "z1_const = %e\n"
+        "z2_const = %e\n"
+        "s1, s2 = %e, %e\n"
+        "b1, b2 = %e, %e\n"
+        "x = %e\n",
+        func,
+        g->mu, g->z_mean, g->chi_mean, g->sep,
+        n->z1[k], n->z2[k], g->chi1, g->chi2, g->costheta,
+        n->r21[k], n->r22[k], g->z1_const, g->z2_const,
+        g->s1, g->s2, g->b1, g->b2, n->x[k]
+    );
+    exit(EXIT_FAILURE);
+}
+
+
+/**
+    the single integrated terms at one point x along the line of sight
+**/
+
+FUNCTIONS_INLINE double functions_single_integrated_kernel(
+    struct coffe_parameters_t *par,
+    struct coffe_background_t *bg,
+    struct coffe_integrals_t integral[],
+    double z_mean,
+    double mu,
+    double sep,
+    double x,
+    const uint64_t terms,
+    double contributions[]
+)
+{
+    if (!(terms & COFFE_TERMS_SINGLE_INTEGRATED)) return 0;
+
+    struct functions_single_geometry g;
+    struct functions_los_nodes n;
+    double buffer[FUNCTIONS_LOS_VALUES];
+
+    functions_los_assign(&n, buffer, 1);
+    n.x[0] = x, n.weight[0] = 1;
+
+    functions_single_geometry_fill(par, bg, integral, z_mean, mu, sep, &g, terms);
+    functions_los_fill(par, bg, integral, &g, &n, terms);
+
+    double result = functions_single_integrated_eval(par, &g, &n, 0, terms, contributions);
+
+    if (!gsl_finite(result))
+        functions_single_integrated_error(__func__, &g, &n, 0);
+
+    return result;
+}
+
+
+/**
+    the single integrated terms integrated over the whole line
+    of sight with the fixed quadrature in nodes; the geometry
+    and all of the lookups at the nodes are done only once
+**/
+
+FUNCTIONS_INLINE double functions_single_integrated_los_kernel(
+    struct coffe_parameters_t *par,
+    struct coffe_background_t *bg,
+    struct coffe_integrals_t integral[],
+    double z_mean,
+    double mu,
+    double sep,
+    struct functions_los_nodes *nodes,
+    const uint64_t terms,
+    double contributions[]
+)
+{
+    if (!(terms & COFFE_TERMS_SINGLE_INTEGRATED)) return 0;
+
+    struct functions_single_geometry g;
+
+    functions_single_geometry_fill(par, bg, integral, z_mean, mu, sep, &g, terms);
+    functions_los_fill(par, bg, integral, &g, nodes, terms);
+
+    double result = 0;
+    if (contributions == NULL){
+        #pragma omp simd reduction(+:result)
+        for (size_t k = 0; k<nodes->len; ++k){
+            result += nodes->weight[k]
+               *functions_single_integrated_eval(par, &g, nodes, k, terms, NULL);
+        }
+    }
+    else{
+        const uint64_t present = terms & COFFE_TERMS_SINGLE_INTEGRATED;
+        double node[COFFE_TERMS_LEN];
+        for (int t = 0; t<COFFE_TERMS_LEN; ++t)
+            if (present & (UINT64_C(1) << t)) contributions[t] = 0;
+        for (size_t k = 0; k<nodes->len; ++k){
+            result += nodes->weight[k]
+               *functions_single_integrated_eval(par, &g, nodes, k, terms, node);
+            for (int t = 0; t<COFFE_TERMS_LEN; ++t)
+                if (present & (UINT64_C(1) << t))
+                    contributions[t] += nodes->weight[k]*node[t];
+        }
+    }
+
+    if (!gsl_finite(result)){
+        for (size_t k = 0; k<nodes->len; ++k){
+            if (!gsl_finite(functions_single_integrated_eval(par, &g, nodes, k, terms, NULL)))
+                functions_single_integrated_error(__func__, &g, nodes, k);
+        }
+    }
+
+    return result;
+}
+
+
+/**
+    assigns the arrays of nodes to consecutive chunks
+    of buffer, which must hold FUNCTIONS_LOS_VALUES*len values
+**/
+
+void functions_los_assign(
+    struct functions_los_nodes *nodes,
+    double *buffer,
+    size_t len
+)
+{
+    double **values[] = {
+        &nodes->x, &nodes->weight,
+        &nodes->lambda1, &nodes->lambda2, &nodes->r21, &nodes->r22,
+        &nodes->z1, &nodes->z2,
+        &nodes->D1_1, &nodes->D1_2, &nodes->a_1, &nodes->a_2,
+        &nodes->f_1, &nodes->f_2, &nodes->curlyH_1, &nodes->curlyH_2,
+        &nodes->f_lambda1, &nodes->f_lambda2,
+        &nodes->curlyH_lambda1, &nodes->curlyH_lambda2,
+        &nodes->I1[0], &nodes->I1[1], &nodes->I1[2], &nodes->I1[3],
+        &nodes->I1[4], &nodes->I1[5], &nodes->I1[6], &nodes->I1[7],
+        &nodes->I2[0], &nodes->I2[1], &nodes->I2[2], &nodes->I2[3],
+        &nodes->I2[4], &nodes->I2[5], &nodes->I2[6], &nodes->I2[7],
+        &nodes->ren1, &nodes->ren2
+    };
+    for (size_t i = 0; i<FUNCTIONS_LOS_VALUES; ++i){
+        *values[i] = buffer + i*len;
+    }
+    nodes->len = len;
+}
+
+
+/**
+    maps u in [0, 1] to the line of sight variable x in [0, 1] with
+    the substitution transform, and returns the jacobian dx/du; the
+    integrands only have integrable (at most logarithmic or inverse
+    square root) features at the endpoints, which the jacobian flattens
+**/
+
+double functions_los_transform(
+    int transform,
+    double u,
+    double *x
+)
+{
+    switch (transform){
+        case 1:
+            *x = u*u*(3 - 2*u);
+            return 6*u*(1 - u);
+        case 2:{
+            const double t = FUNCTIONS_TANH_SINH_RANGE*(2*u - 1);
+            const double s = M_PI*sinh(t);
+            /* x and 1 - x computed separately, so the jacobian stays accurate near x = 1 */
+            const double low = 1./(1 + exp(-s)), high = 1./(1 + exp(s));
+            *x = low;
+            return 2*FUNCTIONS_TANH_SINH_RANGE*M_PI*cosh(t)*low*high;
+        }
+        default:
+            *x = u;
+            return 1;
+    }
+}
+
+
+/**
+    allocates the nodes for a Gauss-Legendre quadrature of order
+    <order> on x in [0, 1], with the substitution transform
+    (see functions_los_transform)
+**/
+
+int functions_los_init(
+    struct functions_los_nodes *nodes,
+    size_t order,
+    int transform
+)
+{
+    nodes->buffer =
+        (double *)coffe_malloc(sizeof(double)*FUNCTIONS_LOS_VALUES*order);
+    functions_los_assign(nodes, nodes->buffer, order);
+
+    gsl_integration_glfixed_table *table =
+        gsl_integration_glfixed_table_alloc(order);
+    for (size_t k = 0; k<order; ++k){
+        double u, weight;
+        gsl_integration_glfixed_point(0., 1., k, &u, &weight, table);
+        nodes->weight[k] =
+            weight*functions_los_transform(transform, u, &nodes->x[k]);
+    }
+    gsl_integration_glfixed_table_free(table);
+
+    return EXIT_SUCCESS;
+}
+
+int functions_los_free(
+    struct functions_los_nodes *nodes
+)
+{
+    free(nodes->buffer);
+    nodes->buffer = NULL;
+    nodes->len = 0;
+    return EXIT_SUCCESS;
+}
+
+
+/**
+    all the double integrated terms in one place
+**/
+
+FUNCTIONS_INLINE double functions_double_integrated_kernel(
     struct coffe_parameters_t *par,
     struct coffe_background_t *bg,
     struct coffe_integrals_t integral[],
@@ -1477,13 +1862,14 @@ double functions_double_integrated(
     double mu,
     double sep,
     double x1,
-    double x2
+    double x2,
+    const uint64_t terms,
+    double contributions[]
 )
 {
+    if (!(terms & COFFE_TERMS_DOUBLE_INTEGRATED)) return 0;
+
     double result = 0;
-    int len =
-        par->correlation_sources_len
-       *(par->correlation_sources_len + 1)/2;
 
     double chi_mean = interp_spline(&bg->comoving_distance, z_mean);
     double chi1 = chi_mean - sep*mu/2.;
@@ -1504,7 +1890,10 @@ double functions_double_integrated(
     double s2 = interp_spline(&par->magnification_bias2, z2_const);
 
     double ren = 0;
-    if (par->divergent){
+    if (
+        par->divergent &&
+        (terms & (COFFE_TERM(7, 7) | COFFE_TERM(8, 8) | COFFE_TERM(7, 8)))
+    ){
         if (r2 <= pow(0.000001*COFFE_H0, 2)){
             ren = interp_spline(&integral[8].renormalization0, lambda1);
         }
@@ -1520,211 +1909,212 @@ double functions_double_integrated(
         }
     }
 
-    for (int i = 0; i<len; ++i){
-        /* len-len term */
-        if (strcmp(par->corr_terms[i], "99") == 0){
-            if (r2 > 1e-20){
-                result +=
-                /* constant in front */
-                9.*par->Omega0_m*par->Omega0_m*(2 - 5*s1)*(2 - 5*s2)/4.*chi1*chi2
-               *
-                /* integrand */
-                interp_spline(&bg->D1, z1)
-               *interp_spline(&bg->D1, z2)
-               /interp_spline(&bg->a, z1)
-               /interp_spline(&bg->a, z2)
-               *(1 - x1)*(1 - x2)
-               *(
-                    2*(costheta*costheta - 1)*lambda1*lambda2
-                   *interp_spline(&integral[0].result, sqrt(r2))/5.
-                   +
-                    4*costheta
-                   *interp_spline(&integral[5].result, sqrt(r2))/3.
-                   +
-                    4*costheta*(r2 + 6*costheta*lambda1*lambda2)
-                   *interp_spline(&integral[3].result, sqrt(r2))/15.
-                   +
-                    2*(costheta*costheta - 1)*lambda1*lambda2
-                   *(2*r2 + 3*costheta*lambda1*lambda2)
-                   *interp_spline(&integral[1].result, sqrt(r2))/7./r2
-                   +
-                    2*costheta
-                   *(2*r2*r2 + 12*costheta*r2*lambda1*lambda2 + 15*(costheta*costheta - 1)*lambda1*lambda1*lambda2*lambda2)
-                   *interp_spline(&integral[4].result, sqrt(r2))/15./r2
-                   +
-                    (costheta*costheta - 1)*lambda1*lambda2
-                   *(6*r2*r2 + 30*costheta*r2*lambda1*lambda2 + 35*(costheta*costheta - 1)*lambda1*lambda1*lambda2*lambda2)
-                   *interp_spline(&integral[2].result, sqrt(r2))/35./r2/r2
-                );
-            }
-            else{
-                result +=
-                /* constant in front */
-                9./4*pow(par->Omega0_m, 2)*(2 - 5*s1)*(2 - 5*s2)*chi1*chi2
-               *
-                /* integrand */
-                interp_spline(&bg->D1, z1)
-               *interp_spline(&bg->D1, z2)
-               /interp_spline(&bg->a, z1)
-               /interp_spline(&bg->a, z2)
-               *(1 - x1)*(1 - x2)
-               *(
-                   4*interp_spline(&integral[5].result, 0.0)/3.
-                   +
-                    24.*lambda1*lambda2
-                   *interp_spline(&integral[3].result, 0.0)/15.
-                );
-            }
-        }
-        /* g4-g4 term */
-        else if (strcmp(par->corr_terms[i], "77") == 0){
-            result +=
+    /* len-len term */
+    if (terms & COFFE_TERM(9, 9)){
+        double term = 0;
+        if (r2 > 1e-20){
+            term +=
             /* constant in front */
-            9*par->Omega0_m*par->Omega0_m*(2 - 5*s1)*(2 - 5*s2)
+            9.*par->Omega0_m*par->Omega0_m*(2 - 5*s1)*(2 - 5*s2)/4.*chi1*chi2
            *
-                /* integrand */
-                interp_spline(&bg->D1, z1)
-               *interp_spline(&bg->D1, z2)
-               /interp_spline(&bg->a, z1)
-               /interp_spline(&bg->a, z2)
-               *ren;
+            /* integrand */
+            interp_spline(&bg->D1, z1)
+           *interp_spline(&bg->D1, z2)
+           /interp_spline(&bg->a, z1)
+           /interp_spline(&bg->a, z2)
+           *(1 - x1)*(1 - x2)
+           *(
+                2*(costheta*costheta - 1)*lambda1*lambda2
+               *interp_spline(&integral[0].result, sqrt(r2))/5.
+               +
+                4*costheta
+               *interp_spline(&integral[5].result, sqrt(r2))/3.
+               +
+                4*costheta*(r2 + 6*costheta*lambda1*lambda2)
+               *interp_spline(&integral[3].result, sqrt(r2))/15.
+               +
+                2*(costheta*costheta - 1)*lambda1*lambda2
+               *(2*r2 + 3*costheta*lambda1*lambda2)
+               *interp_spline(&integral[1].result, sqrt(r2))/7./r2
+               +
+                2*costheta
+               *(2*r2*r2 + 12*costheta*r2*lambda1*lambda2 + 15*(costheta*costheta - 1)*lambda1*lambda1*lambda2*lambda2)
+               *interp_spline(&integral[4].result, sqrt(r2))/15./r2
+               +
+                (costheta*costheta - 1)*lambda1*lambda2
+               *(6*r2*r2 + 30*costheta*r2*lambda1*lambda2 + 35*(costheta*costheta - 1)*lambda1*lambda1*lambda2*lambda2)
+               *interp_spline(&integral[2].result, sqrt(r2))/35./r2/r2
+            );
         }
-        /* g5-g5 term */
-        else if (strcmp(par->corr_terms[i], "88") == 0){
-            result +=
+        else{
+            term +=
             /* constant in front */
-            9*par->Omega0_m*par->Omega0_m
-           *interp_spline(&bg->G1, z1_const)
-           *interp_spline(&bg->G2, z2_const)
-           *chi1*chi2
+            9./4*pow(par->Omega0_m, 2)*(2 - 5*s1)*(2 - 5*s2)*chi1*chi2
            *
             /* integrand */
-                interp_spline(&bg->D1, z1)
-               *interp_spline(&bg->D1, z2)
-               /interp_spline(&bg->a, z1)
-               /interp_spline(&bg->a, z2)
-               *interp_spline(&bg->conformal_Hz, z1)
-               *interp_spline(&bg->conformal_Hz, z2)
-               *(interp_spline(&bg->f, z1) - 1)
-               *(interp_spline(&bg->f, z2) - 1)
-               *ren;
-        }
-        /* g4-len + len-g4 term */
-        else if (
-            strcmp(par->corr_terms[i], "79") == 0 ||
-            strcmp(par->corr_terms[i], "97") == 0
-        ){
-            if (r2 != 0){
-                result +=
-                    /* constant in front */
-                    9*par->Omega0_m*par->Omega0_m/2.
-                   *(
-                        (2 - 5*s1)*(2 - 5*s2)
-                       *(1 - x2)/x2*interp_spline(&bg->D1, z1)*interp_spline(&bg->D1, z2)
-                       /interp_spline(&bg->a, z1)/interp_spline(&bg->a, z2)
-                       *(
-                            2*lambda1*lambda2*costheta*interp_spline(&integral[7].result, sqrt(r2))
-                           -lambda1*lambda1*lambda2*lambda2*(1 - costheta*costheta)*interp_spline(&integral[6].result, sqrt(r2))
-                        )
-                        +
-                        (2 - 5*s1)*(2 - 5*s2)
-                       *(1 - x1)/x1*interp_spline(&bg->D1, z1)*interp_spline(&bg->D1, z2)
-                       /interp_spline(&bg->a, z1)/interp_spline(&bg->a, z2)
-                       *(
-                            2*lambda1*lambda2*costheta*interp_spline(&integral[7].result, sqrt(r2))
-                           -lambda1*lambda1*lambda2*lambda2*(1 - costheta*costheta)*interp_spline(&integral[6].result, sqrt(r2))
-                        )
-                    );
-            }
-            else{
-                result +=
-                    9*par->Omega0_m*par->Omega0_m/2.
-                   *(
-                        (2 - 5*s1)*(2 - 5*s2)
-                       *(1 - x2)/x2*interp_spline(&bg->D1, z1)*interp_spline(&bg->D1, z2)
-                       /interp_spline(&bg->a, z1)/interp_spline(&bg->a, z2)
-                       *2*lambda1*lambda2*interp_spline(&integral[7].result, 0.0)
-                        +
-                        (2 - 5*s1)*(2 - 5*s2)
-                       *(1 - x1)/x1*interp_spline(&bg->D1, z2)*interp_spline(&bg->D1, z1)
-                       /interp_spline(&bg->a, z2)/interp_spline(&bg->a, z1)
-                       *2*lambda1*lambda2*interp_spline(&integral[7].result, 0.0)
-                    );
-            }
+            interp_spline(&bg->D1, z1)
+           *interp_spline(&bg->D1, z2)
+           /interp_spline(&bg->a, z1)
+           /interp_spline(&bg->a, z2)
+           *(1 - x1)*(1 - x2)
+           *(
+               4*interp_spline(&integral[5].result, 0.0)/3.
+               +
+                24.*lambda1*lambda2
+               *interp_spline(&integral[3].result, 0.0)/15.
+            );
         }
-        /* g5-len + len-g5 term */
-        else if (
-            strcmp(par->corr_terms[i], "89") == 0 ||
-            strcmp(par->corr_terms[i], "98") == 0
-        ){
-            if (r2 != 0){
-                result +=
-                    /* constant in front */
-                    9*par->Omega0_m*par->Omega0_m/2.
+        FUNCTIONS_ADD_TERM(9, 9, term);
+    }
+    /* g4-g4 term */
+    if (terms & COFFE_TERM(7, 7)){
+        double term = 0;
+        term +=
+        /* constant in front */
+        9*par->Omega0_m*par->Omega0_m*(2 - 5*s1)*(2 - 5*s2)
+       *
+            /* integrand */
+            interp_spline(&bg->D1, z1)
+           *interp_spline(&bg->D1, z2)
+           /interp_spline(&bg->a, z1)
+           /interp_spline(&bg->a, z2)
+           *ren;
+        FUNCTIONS_ADD_TERM(7, 7, term);
+    }
+    /* g5-g5 term */
+    if (terms & COFFE_TERM(8, 8)){
+        double term = 0;
+        term +=
+        /* constant in front */
+        9*par->Omega0_m*par->Omega0_m
+       *interp_spline(&bg->G1, z1_const)
+       *interp_spline(&bg->G2, z2_const)
+       *chi1*chi2
+       *
+        /* integrand */
+            interp_spline(&bg->D1, z1)
+           *interp_spline(&bg->D1, z2)
+           /interp_spline(&bg->a, z1)
+           /interp_spline(&bg->a, z2)
+           *interp_spline(&bg->conformal_Hz, z1)
+           *interp_spline(&bg->conformal_Hz, z2)
+           *(interp_spline(&bg->f, z1) - 1)
+           *(interp_spline(&bg->f, z2) - 1)
+           *ren;
+        FUNCTIONS_ADD_TERM(8, 8, term);
+    }
+    /* g4-len + len-g4 term */
+    if (terms & COFFE_TERM(7, 9)){
+        double term = 0;
+        if (r2 != 0){
+            term +=
+                /* constant in front */
+                9*par->Omega0_m*par->Omega0_m/2.
+               *(
+                    (2 - 5*s1)*(2 - 5*s2)
+                   *(1 - x2)/x2*interp_spline(&bg->D1, z1)*interp_spline(&bg->D1, z2)
+                   /interp_spline(&bg->a, z1)/interp_spline(&bg->a, z2)
                    *(
-                        (2 - 5*s2)*interp_spline(&bg->G1, z1_const)*chi1
-                       *interp_spline(&bg->conformal_Hz, z1)*(interp_spline(&bg->conformal_Hz, z1) - 1)
-                       *(1 - x2)/x2*interp_spline(&bg->D1, z1)*interp_spline(&bg->D1, z2)
-                       /interp_spline(&bg->a, z1)/interp_spline(&bg->a, z2)
-                       *(
-                            2*lambda1*lambda2*costheta*interp_spline(&integral[7].result, sqrt(r2))
-                           -lambda1*lambda1*lambda2*lambda2*(1 - costheta*costheta)*interp_spline(&integral[6].result, sqrt(r2))
-                        )
-                        +
-                        (2 - 5*s1)*interp_spline(&bg->G2, z2_const)*chi2
-                       *interp_spline(&bg->conformal_Hz, z2)*(interp_spline(&bg->conformal_Hz, z2) - 1)
-                       *(1 - x1)/x1*interp_spline(&bg->D1, z1)*interp_spline(&bg->D1, z2)
-                       /interp_spline(&bg->a, z1)/interp_spline(&bg->a, z2)
-                       *(
-                            2*lambda1*lambda2*costheta*interp_spline(&integral[7].result, sqrt(r2))
-                           -lambda1*lambda1*lambda2*lambda2*(1 - costheta*costheta)*interp_spline(&integral[6].result, sqrt(r2))
-                        )
-                    );
-            }
-            else{
-                result +=
-                    9*par->Omega0_m*par->Omega0_m/2.
+                        2*lambda1*lambda2*costheta*interp_spline(&integral[7].result, sqrt(r2))
+                       -lambda1*lambda1*lambda2*lambda2*(1 - costheta*costheta)*interp_spline(&integral[6].result, sqrt(r2))
+                    )
+                    +
+                    (2 - 5*s1)*(2 - 5*s2)
+                   *(1 - x1)/x1*interp_spline(&bg->D1, z1)*interp_spline(&bg->D1, z2)
+                   /interp_spline(&bg->a, z1)/interp_spline(&bg->a, z2)
                    *(
-                        (2 - 5*s2)*interp_spline(&bg->G1, z1_const)*chi1
-                       *interp_spline(&bg->conformal_Hz, z1)*(interp_spline(&bg->conformal_Hz, z1) - 1)
-                       *(1 - x2)/x2*interp_spline(&bg->D1, z1)*interp_spline(&bg->D1, z2)
-                       /interp_spline(&bg->a, z1)/interp_spline(&bg->a, z2)
-                       *2*lambda1*lambda2*interp_spline(&integral[7].result, 0.0)
-                        +
-                        (2 - 5*s1)*interp_spline(&bg->G2, z2_const)*chi2
-                       *interp_spline(&bg->conformal_Hz, z2)*(interp_spline(&bg->conformal_Hz, z2) - 1)
-                       *(1 - x1)/x1*interp_spline(&bg->D1, z1)*interp_spline(&bg->D1, z2)
-                       /interp_spline(&bg->a, z1)/interp_spline(&bg->a, z2)
-                       *2*lambda1*lambda2*interp_spline(&integral[7].result, 0.0)
-                    );
-            }
+                        2*lambda1*lambda2*costheta*interp_spline(&integral[7].result, sqrt(r2))
+                       -lambda1*lambda1*lambda2*lambda2*(1 - costheta*costheta)*interp_spline(&integral[6].result, sqrt(r2))
+                    )
+                );
         }
-        /* g4-g5 + g5-g4 term */
-        else if (
-            strcmp(par->corr_terms[i], "78") == 0 ||
-            strcmp(par->corr_terms[i], "87") == 0
-        ){
-            result +=
-                /* constant in front */
-                9*par->Omega0_m*par->Omega0_m
+        else{
+            term +=
+                9*par->Omega0_m*par->Omega0_m/2.
                *(
-                    interp_spline(&bg->G2, z2_const)*(2 - 5*s1)*chi2
-                   *interp_spline(&bg->conformal_Hz, z2)*(interp_spline(&bg->f, z2) - 1)
-                   *interp_spline(&bg->D1, z1)*interp_spline(&bg->D1, z2)
-                   /interp_spline(&bg->a, z1)/interp_spline(&bg->a, z2)
-                   *ren
-                   +
-                    interp_spline(&bg->G1, z1_const)*(2 - 5*s2)*chi1
-                   *interp_spline(&bg->conformal_Hz, z1)*(interp_spline(&bg->f, z1) - 1)
-                   *interp_spline(&bg->D1, z1)*interp_spline(&bg->D1, z2)
+                    (2 - 5*s1)*(2 - 5*s2)
+                   *(1 - x2)/x2*interp_spline(&bg->D1, z1)*interp_spline(&bg->D1, z2)
                    /interp_spline(&bg->a, z1)/interp_spline(&bg->a, z2)
-                   *ren
+                   *2*lambda1*lambda2*interp_spline(&integral[7].result, 0.0)
+                    +
+                    (2 - 5*s1)*(2 - 5*s2)
+                   *(1 - x1)/x1*interp_spline(&bg->D1, z2)*interp_spline(&bg->D1, z1)
+                   /interp_spline(&bg->a, z2)/interp_spline(&bg->a, z1)
+                   *2*lambda1*lambda2*interp_spline(&integral[7].result, 0.0)
                 );
         }
+        FUNCTIONS_ADD_TERM(7, 9, term);
     }
-    if (gsl_finite(result)){
-    return
-        result;
+    /* g5-len + len-g5 term */
+    if (terms & COFFE_TERM(8, 9)){
+        double term = 0;
+        if (r2 != 0){
+            term +=
+                /* constant in front */
+                9*par->Omega0_m*par->Omega0_m/2.
+               *(
+                    (2 - 5*s2)*interp_spline(&bg->G1, z1_const)*chi1
+                   *interp_spline(&bg->conformal_Hz, z1)*(interp_spline(&bg->conformal_Hz, z1) - 1)
+                   *(1 - x2)/x2*interp_spline(&bg->D1, z1)*interp_spline(&bg->D1, z2)
+                   /interp_spline(&bg->a, z1)/interp_spline(&bg->a, z2)
+                   *(
+                        2*lambda1*lambda2*costheta*interp_spline(&integral[7].result, sqrt(r2))
+                       -lambda1*lambda1*lambda2*lambda2*(1 - costheta*costheta)*interp_spline(&integral[6].result, sqrt(r2))
+                    )
+                    +
+                    (2 - 5*s1)*interp_spline(&bg->G2, z2_const)*chi2
+                   *interp_spline(&bg->conformal_Hz, z2)*(interp_spline(&bg->conformal_Hz, z2) - 1)
+                   *(1 - x1)/x1*interp_spline(&bg->D1, z1)*interp_spline(&bg->D1, z2)
+                   /interp_spline(&bg->a, z1)/interp_spline(&bg->a, z2)
+                   *(
+                        2*lambda1*lambda2*costheta*interp_spline(&integral[7].result, sqrt(r2))
+                       -lambda1*lambda1*lambda2*lambda2*(1 - costheta*costheta)*interp_spline(&integral[6].result, sqrt(r2))
+                    )
+                );
+        }
+        else{
+            term +=
+                9*par->Omega0_m*par->Omega0_m/2.
+               *(
+                    (2 - 5*s2)*interp_spline(&bg->G1, z1_const)*chi1
+                   *interp_spline(&bg->conformal_Hz, z1)*(interp_spline(&bg->conformal_Hz, z1) - 1)
+                   *(1 - x2)/x2*interp_spline(&bg->D1, z1)*interp_spline(&bg->D1, z2)
+                   /interp_spline(&bg->a, z1)/interp_spline(&bg->a, z2)
+                   *2*lambda1*lambda2*interp_spline(&integral[7].result, 0.0)
+                    +
+                    (2 - 5*s1)*interp_spline(&bg->G2, z2_const)*chi2
+                   *interp_spline(&bg->conformal_Hz, z2)*(interp_spline(&bg->conformal_Hz, z2) - 1)
+                   *(1 - x1)/x1*interp_spline(&bg->D1, z1)*interp_spline(&bg->D1, z2)
+                   /interp_spline(&bg->a, z1)/interp_spline(&bg->a, z2)
+                   *2*lambda1*lambda2*interp_spline(&integral[7].result, 0.0)
+                );
+        }
+        FUNCTIONS_ADD_TERM(8, 9, term);
+    }
+    /* g4-g5 + g5-g4 term */
+    if (terms & COFFE_TERM(7, 8)){
+        double term = 0;
+        term +=
+            /* constant in front */
+            9*par->Omega0_m*par->Omega0_m
+           *(
+                interp_spline(&bg->G2, z2_const)*(2 - 5*s1)*chi2
+               *interp_spline(&bg->conformal_Hz, z2)*(interp_spline(&bg->f, z2) - 1)
+               *interp_spline(&bg->D1, z1)*interp_spline(&bg->D1, z2)
+               /interp_spline(&bg->a, z1)/interp_spline(&bg->a, z2)
+               *ren
+               +
+                interp_spline(&bg->G1, z1_const)*(2 - 5*s2)*chi1
+               *interp_spline(&bg->conformal_Hz, z1)*(interp_spline(&bg->f, z1) - 1)
+               *interp_spline(&bg->D1, z1)*interp_spline(&bg->D1, z2)
+               /interp_spline(&bg->a, z1)/interp_spline(&bg->a, z2)
+               *ren
+            );
+        FUNCTIONS_ADD_TERM(7, 8, term);
+    }
+    if (gsl_finite(result)){
+    return
+        result;
     }
     else{
         fprintf(stderr,
@@ -1749,3 +2139,976 @@ double functions_double_integrated(
         exit(EXIT_FAILURE);
     }
 }
+
+
+/**
+    the single precision tables for the double integrated terms
+**/
+
+static double functions_interp_clamped(
+    struct coffe_interpolation *interp,
+    double value
+)
+{
+    const double x_min = interp->spline->x[0];
+    const double x_max = interp->spline->x[interp->spline->size - 1];
+    if (value < x_min) value = x_min;
+    if (value > x_max) value = x_max;
+    return interp_spline(interp, value);
+}
+
+static void functions_float_table_alloc(
+    struct functions_float_table *table,
+    double x_min,
+    double x_max,
+    size_t len
+)
+{
+    table->x_min = x_min;
+    table->inv_dx = (len - 1)/(x_max - x_min);
+    table->len = len;
+    table->y = (float *)coffe_malloc(sizeof(float)*len);
+}
+
+static inline double functions_float_table_x(
+    const struct functions_float_table *table,
+    size_t i
+)
+{
+    return table->x_min + i/table->inv_dx;
+}
+
+static inline float functions_float_table_eval(
+    const struct functions_float_table *table,
+    double x
+)
+{
+    const double u = (x - table->x_min)*table->inv_dx;
+    if (u <= 0) return table->y[0];
+    if (u >= table->len - 1) return table->y[table->len - 1];
+    const size_t i = (size_t)u;
+    const float t = (float)(u - i);
+    return table->y[i] + t*(table->y[i + 1] - table->y[i]);
+}
+
+static inline float functions_float_table2d_eval(
+    const struct functions_float_table2d *table,
+    double x,
+    double y
+)
+{
+    double u = (x - table->x_min)*table->inv_dx;
+    double v = (y - table->y_min)*table->inv_dy;
+    if (u < 0) u = 0;
+    if (v < 0) v = 0;
+    if (u > table->xlen - 1) u = table->xlen - 1;
+    if (v > table->ylen - 1) v = table->ylen - 1;
+    size_t i = (size_t)u, j = (size_t)v;
+    if (i == table->xlen - 1) --i;
+    if (j == table->ylen - 1) --j;
+    const float t = (float)(u - i), w = (float)(v - j);
+    const float *z0 = table->z + j*table->xlen + i;
+    const float *z1 = z0 + table->xlen;
+    return
+        (1 - w)*(z0[0] + t*(z0[1] - z0[0]))
+       +w*(z1[0] + t*(z1[1] - z1[0]));
+}
+
+int functions_float_tables_init(
+    struct coffe_parameters_t *par,
+    struct coffe_background_t *bg,
+    struct coffe_integrals_t integral[],
+    struct functions_float_tables *tables
+)
+{
+    memset(tables, 0, sizeof(struct functions_float_tables));
+
+    tables->z_mean = par->z_mean;
+    tables->chi_mean = interp_spline(&bg->comoving_distance, par->z_mean);
+
+    const size_t len = FUNCTIONS_FLOAT_TABLE_LEN;
+
+    /* the background, as a function of the comoving distance */
+    {
+        const double chi_min = bg->z_as_chi.spline->x[0];
+        const double chi_max =
+            bg->z_as_chi.spline->x[bg->z_as_chi.spline->size - 1];
+
+        struct functions_float_table *all[] = {
+            &tables->D1_over_a, &tables->conformal_Hz, &tables->f,
+            &tables->G1, &tables->G2,
+            &tables->magnification_bias1, &tables->magnification_bias2
+        };
+        for (size_t k = 0; k<sizeof(all)/sizeof(all[0]); ++k)
+            functions_float_table_alloc(all[k], chi_min, chi_max, len);
+
+        for (size_t i = 0; i<len; ++i){
+            const double z = functions_interp_clamped(
+                &bg->z_as_chi,
+                functions_float_table_x(&tables->D1_over_a, i)
+            );
+            tables->D1_over_a.y[i] = (float)(
+                functions_interp_clamped(&bg->D1, z)
+               /functions_interp_clamped(&bg->a, z)
+            );
+            tables->conformal_Hz.y[i] =
+                (float)functions_interp_clamped(&bg->conformal_Hz, z);
+            tables->f.y[i] = (float)functions_interp_clamped(&bg->f, z);
+            tables->G1.y[i] = (float)functions_interp_clamped(&bg->G1, z);
+            tables->G2.y[i] = (float)functions_interp_clamped(&bg->G2, z);
+            tables->magnification_bias1.y[i] =
+                (float)functions_interp_clamped(&par->magnification_bias1, z);
+            tables->magnification_bias2.y[i] =
+                (float)functions_interp_clamped(&par->magnification_bias2, z);
+        }
+    }
+
+    /* the integrals, as a function of the separation */
+    for (int j = 0; j<9; ++j){
+        if (par->nonzero_terms[j].n == -1 || par->nonzero_terms[j].l == -1)
+            continue;
+        const gsl_spline *spline = integral[j].result.spline;
+        functions_float_table_alloc(
+            &tables->integral[j],
+            spline->x[0], spline->x[spline->size - 1], len
+        );
+        for (size_t i = 0; i<len; ++i){
+            tables->integral[j].y[i] = (float)functions_interp_clamped(
+                &integral[j].result,
+                functions_float_table_x(&tables->integral[j], i)
+            );
+        }
+    }
+
+    /* the renormalization, only present for the divergent integral */
+    if (integral[8].n == 4 && integral[8].l == 0){
+        const gsl_spline *spline = integral[8].renormalization0.spline;
+        functions_float_table_alloc(
+            &tables->renormalization0,
+            spline->x[0], spline->x[spline->size - 1], len
+        );
+        for (size_t i = 0; i<len; ++i){
+            tables->renormalization0.y[i] = (float)functions_interp_clamped(
+                &integral[8].renormalization0,
+                functions_float_table_x(&tables->renormalization0, i)
+            );
+        }
+
+        const gsl_spline2d *spline2d = integral[8].renormalization.spline;
+        struct functions_float_table2d *ren = &tables->renormalization;
+        const size_t len2d = FUNCTIONS_FLOAT_TABLE2D_LEN;
+        ren->x_min = spline2d->interp_object.xmin;
+        ren->y_min = spline2d->interp_object.ymin;
+        ren->inv_dx = (len2d - 1)/(spline2d->interp_object.xmax - ren->x_min);
+        ren->inv_dy = (len2d - 1)/(spline2d->interp_object.ymax - ren->y_min);
+        ren->xlen = len2d;
+        ren->ylen = len2d;
+        ren->z = (float *)coffe_malloc(sizeof(float)*len2d*len2d);
+        for (size_t j = 0; j<len2d; ++j){
+            const double y = ren->y_min + j/ren->inv_dy;
+            for (size_t i = 0; i<len2d; ++i){
+                const double x = ren->x_min + i/ren->inv_dx;
+                ren->z[j*len2d + i] = (float)gsl_spline2d_eval(
+                    spline2d,
+                    GSL_MIN(x, spline2d->interp_object.xmax),
+                    GSL_MIN(y, spline2d->interp_object.ymax),
+                    integral[8].renormalization.xaccel,
+                    integral[8].renormalization.yaccel
+                );
+            }
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
+
+int functions_float_tables_free(
+    struct functions_float_tables *tables
+)
+{
+    free(tables->D1_over_a.y);
+    free(tables->conformal_Hz.y);
+    free(tables->f.y);
+    free(tables->G1.y);
+    free(tables->G2.y);
+    free(tables->magnification_bias1.y);
+    free(tables->magnification_bias2.y);
+    for (int j = 0; j<9; ++j){
+        free(tables->integral[j].y);
+    }
+    free(tables->renormalization0.y);
+    free(tables->renormalization.z);
+    memset(tables, 0, sizeof(struct functions_float_tables));
+    return EXIT_SUCCESS;
+}
+
+
+/**
+    the double integrated terms with all of the lookups done in the
+    single precision tables; the geometry (and therefore r2, which
+    suffers from cancellations) and the sum stay in double precision
+**/
+
+FUNCTIONS_INLINE double functions_double_integrated_float_kernel(
+    struct coffe_parameters_t *par,
+    struct coffe_background_t *bg,
+    const struct functions_float_tables *tables,
+    double z_mean,
+    double mu,
+    double sep,
+    double x1,
+    double x2,
+    const uint64_t terms,
+    double contributions[]
+)
+{
+    if (!(terms & COFFE_TERMS_DOUBLE_INTEGRATED)) return 0;
+
+    double result = 0;
+
+    const double chi_mean =
+        z_mean == tables->z_mean ?
+        tables->chi_mean :
+        interp_spline(&bg->comoving_distance, z_mean);
+    const double chi1 = chi_mean - sep*mu/2.;
+    const double chi2 = chi_mean + sep*mu/2.;
+    const double costheta =
+        (2*chi_mean*chi_mean - sep*sep + mu*mu*sep*sep/2.)
+       /(2*chi_mean*chi_mean - mu*mu*sep*sep/2.);
+    const double lambda1 = chi1*x1, lambda2 = chi2*x2;
+    double r2 = lambda1*lambda1 + lambda2*lambda2 - 2*lambda1*lambda2*costheta;
+    if (r2 < 0) r2 = 0;
+    const double r = sqrt(r2);
+
+    const float s1 = functions_float_table_eval(&tables->magnification_bias1, chi1);
+    const float s2 = functions_float_table_eval(&tables->magnification_bias2, chi2);
+
+    /* D1/a at both points, common to all of the terms */
+    const double growth =
+        (double)functions_float_table_eval(&tables->D1_over_a, lambda1)
+       *(double)functions_float_table_eval(&tables->D1_over_a, lambda2);
+
+    double ren = 0;
+    if (
+        par->divergent &&
+        (terms & (COFFE_TERM(7, 7) | COFFE_TERM(8, 8) | COFFE_TERM(7, 8)))
+    ){
+        if (r2 <= pow(0.000001*COFFE_H0, 2)){
+            ren = functions_float_table_eval(&tables->renormalization0, lambda1);
+        }
+        else{
+            ren = (double)functions_float_table_eval(&tables->integral[8], r)
+                    /* renormalization term */
+                   -(double)functions_float_table2d_eval(
+                        &tables->renormalization, lambda1, lambda2
+                    );
+        }
+    }
+
+    float curlyH_1 = 0, curlyH_2 = 0, f_1 = 0, f_2 = 0, G1 = 0, G2 = 0;
+    if (terms & (COFFE_TERM(8, 8) | COFFE_TERM(8, 9) | COFFE_TERM(7, 8))){
+        curlyH_1 = functions_float_table_eval(&tables->conformal_Hz, lambda1);
+        curlyH_2 = functions_float_table_eval(&tables->conformal_Hz, lambda2);
+        G1 = functions_float_table_eval(&tables->G1, chi1);
+        G2 = functions_float_table_eval(&tables->G2, chi2);
+    }
+    if (terms & (COFFE_TERM(8, 8) | COFFE_TERM(7, 8))){
+        f_1 = functions_float_table_eval(&tables->f, lambda1);
+        f_2 = functions_float_table_eval(&tables->f, lambda2);
+    }
+
+    /* the lensing-like bracket of the g4-len and g5-len terms */
+    double bracket = 0;
+    if (terms & (COFFE_TERM(7, 9) | COFFE_TERM(8, 9))){
+        if (r2 != 0){
+            bracket =
+                2*lambda1*lambda2*costheta
+               *functions_float_table_eval(&tables->integral[7], r)
+               -lambda1*lambda1*lambda2*lambda2*(1 - costheta*costheta)
+               *functions_float_table_eval(&tables->integral[6], r);
+        }
+        else{
+            bracket =
+                2*lambda1*lambda2
+               *functions_float_table_eval(&tables->integral[7], 0.0);
+        }
+    }
+
+    /* len-len term */
+    if (terms & COFFE_TERM(9, 9)){
+        double term = 0;
+        if (r2 > 1e-20){
+            term +=
+            /* constant in front */
+            9.*par->Omega0_m*par->Omega0_m*(2 - 5*s1)*(2 - 5*s2)/4.*chi1*chi2
+           *
+            /* integrand */
+            growth
+           *(1 - x1)*(1 - x2)
+           *(
+                2*(costheta*costheta - 1)*lambda1*lambda2
+               *functions_float_table_eval(&tables->integral[0], r)/5.
+               +
+                4*costheta
+               *functions_float_table_eval(&tables->integral[5], r)/3.
+               +
+                4*costheta*(r2 + 6*costheta*lambda1*lambda2)
+               *functions_float_table_eval(&tables->integral[3], r)/15.
+               +
+                2*(costheta*costheta - 1)*lambda1*lambda2
+               *(2*r2 + 3*costheta*lambda1*lambda2)
+               *functions_float_table_eval(&tables->integral[1], r)/7./r2
+               +
+                2*costheta
+               *(2*r2*r2 + 12*costheta*r2*lambda1*lambda2 + 15*(costheta*costheta - 1)*lambda1*lambda1*lambda2*lambda2)
+               *functions_float_table_eval(&tables->integral[4], r)/15./r2
+               +
+                (costheta*costheta - 1)*lambda1*lambda2
+               *(6*r2*r2 + 30*costheta*r2*lambda1*lambda2 + 35*(costheta*costheta - 1)*lambda1*lambda1*lambda2*lambda2)
+               *functions_float_table_eval(&tables->integral[2], r)/35./r2/r2
+            );
+        }
+        else{
+            term +=
+            /* constant in front */
+            9./4*pow(par->Omega0_m, 2)*(2 - 5*s1)*(2 - 5*s2)*chi1*chi2
+           *
+            /* integrand */
+            growth
+           *(1 - x1)*(1 - x2)
+           *(
+               4*functions_float_table_eval(&tables->integral[5], 0.0)/3.
+               +
+                24.*lambda1*lambda2
+               *functions_float_table_eval(&tables->integral[3], 0.0)/15.
+            );
+        }
+        FUNCTIONS_ADD_TERM(9, 9, term);
+    }
+    /* g4-g4 term */
+    if (terms & COFFE_TERM(7, 7)){
+        double term = 0;
+        term +=
+            9*par->Omega0_m*par->Omega0_m*(2 - 5*s1)*(2 - 5*s2)
+           *growth*ren;
+        FUNCTIONS_ADD_TERM(7, 7, term);
+    }
+    /* g5-g5 term */
+    if (terms & COFFE_TERM(8, 8)){
+        double term = 0;
+        term +=
+            9*par->Omega0_m*par->Omega0_m*G1*G2*chi1*chi2
+           *growth*curlyH_1*curlyH_2*(f_1 - 1)*(f_2 - 1)*ren;
+        FUNCTIONS_ADD_TERM(8, 8, term);
+    }
+    /* g4-len + len-g4 term */
+    if (terms & COFFE_TERM(7, 9)){
+        double term = 0;
+        term +=
+            9*par->Omega0_m*par->Omega0_m/2.
+           *(2 - 5*s1)*(2 - 5*s2)*growth
+           *((1 - x2)/x2 + (1 - x1)/x1)*bracket;
+        FUNCTIONS_ADD_TERM(7, 9, term);
+    }
+    /* g5-len + len-g5 term */
+    if (terms & COFFE_TERM(8, 9)){
+        double term = 0;
+        term +=
+            9*par->Omega0_m*par->Omega0_m/2.
+           *growth
+           *(
+                (2 - 5*s2)*G1*chi1*curlyH_1*(curlyH_1 - 1)*(1 - x2)/x2
+               +(2 - 5*s1)*G2*chi2*curlyH_2*(curlyH_2 - 1)*(1 - x1)/x1
+            )*bracket;
+        FUNCTIONS_ADD_TERM(8, 9, term);
+    }
+    /* g4-g5 + g5-g4 term */
+    if (terms & COFFE_TERM(7, 8)){
+        double term = 0;
+        term +=
+            9*par->Omega0_m*par->Omega0_m
+           *growth
+           *(
+                G2*(2 - 5*s1)*chi2*curlyH_2*(f_2 - 1)
+               +G1*(2 - 5*s2)*chi1*curlyH_1*(f_1 - 1)
+            )*ren;
+        FUNCTIONS_ADD_TERM(7, 8, term);
+    }
+    if (gsl_finite(result)){
+        return result;
+    }
+    else{
+        fprintf(stderr,
+            "ERROR: in function %s, values:\n"
+            "x1 = %e, x2 = %e\n"
+            "r2 = %e\n"
+            "mu = %e\n"
+            "z_mean = %e\n"
+            "chi_mean = %e\n"
+            "sep = %e\n"
+            "chi1 = %e\n"
+            "chi2 = %e\n"
+            "lambda1 = %e\n"
+            "lambda2 = %e\n"
+            "ren(sqrt(r2)) = %e\n",
+            __func__, x1, x2, r2,
+            mu, z_mean, chi_mean, sep,
+            chi1, chi2, lambda1, lambda2, ren
+        );
+        exit(EXIT_FAILURE);
+    }
+}
+
+
+/**
+    the specialized kernels, one set for each of the COFFE_KERNEL_SETS
+**/
+
+#define FUNCTIONS_SPECIALIZE(ID, NAME, TERMS) \
+static double functions_nonintegrated_##NAME( \
+    struct coffe_parameters_t *par, \
+    struct coffe_background_t *bg, \
+    struct coffe_integrals_t integral[], \
+    double z_mean, double mu, double sep) \
+{ \
+    return functions_nonintegrated_kernel( \
+        par, bg, integral, z_mean, mu, sep, (TERMS), NULL); \
+} \
+static double functions_single_integrated_##NAME( \
+    struct coffe_parameters_t *par, \
+    struct coffe_background_t *bg, \
+    struct coffe_integrals_t integral[], \
+    double z_mean, double mu, double sep, double x) \
+{ \
+    return functions_single_integrated_kernel( \
+        par, bg, integral, z_mean, mu, sep, x, (TERMS), NULL); \
+} \
+static double functions_single_integrated_los_##NAME( \
+    struct coffe_parameters_t *par, \
+    struct coffe_background_t *bg, \
+    struct coffe_integrals_t integral[], \
+    double z_mean, double mu, double sep, \
+    struct functions_los_nodes *nodes) \
+{ \
+    return functions_single_integrated_los_kernel( \
+        par, bg, integral, z_mean, mu, sep, nodes, (TERMS), NULL); \
+} \
+static double functions_double_integrated_##NAME( \
+    struct coffe_parameters_t *par, \
+    struct coffe_background_t *bg, \
+    struct coffe_integrals_t integral[], \
+    double z_mean, double mu, double sep, double x1, double x2) \
+{ \
+    return functions_double_integrated_kernel( \
+        par, bg, integral, z_mean, mu, sep, x1, x2, (TERMS), NULL); \
+} \
+static double functions_double_integrated_float_##NAME( \
+    struct coffe_parameters_t *par, \
+    struct coffe_background_t *bg, \
+    const struct functions_float_tables *tables, \
+    double z_mean, double mu, double sep, double x1, double x2) \
+{ \
+    return functions_double_integrated_float_kernel( \
+        par, bg, tables, z_mean, mu, sep, x1, x2, (TERMS), NULL); \
+}
+
+COFFE_KERNEL_SETS(FUNCTIONS_SPECIALIZE)
+
+#undef FUNCTIONS_SPECIALIZE
+
+
+/**
+    the public interface; picks the specialized kernel if the
+    parser found one matching the terms, otherwise the generic one
+**/
+
+double functions_nonintegrated(
+    struct coffe_parameters_t *par,
+    struct coffe_background_t *bg,
+    struct coffe_integrals_t integral[],
+    double z_mean,
+    double mu,
+    double sep
+)
+{
+    switch (par->terms_kernel){
+#define FUNCTIONS_DISPATCH(ID, NAME, TERMS) \
+        case ID: \
+            return functions_nonintegrated_##NAME( \
+                par, bg, integral, z_mean, mu, sep);
+        COFFE_KERNEL_SETS(FUNCTIONS_DISPATCH)
+#undef FUNCTIONS_DISPATCH
+        default:
+            return functions_nonintegrated_kernel(
+                par, bg, integral, z_mean, mu, sep, par->terms, NULL
+            );
+    }
+}
+
+double functions_single_integrated(
+    struct coffe_parameters_t *par,
+    struct coffe_background_t *bg,
+    struct coffe_integrals_t integral[],
+    double z_mean,
+    double mu,
+    double sep,
+    double x
+)
+{
+    switch (par->terms_kernel){
+#define FUNCTIONS_DISPATCH(ID, NAME, TERMS) \
+        case ID: \
+            return functions_single_integrated_##NAME( \
+                par, bg, integral, z_mean, mu, sep, x);
+        COFFE_KERNEL_SETS(FUNCTIONS_DISPATCH)
+#undef FUNCTIONS_DISPATCH
+        default:
+            return functions_single_integrated_kernel(
+                par, bg, integral, z_mean, mu, sep, x, par->terms, NULL
+            );
+    }
+}
+
+double functions_single_integrated_los(
+    struct coffe_parameters_t *par,
+    struct coffe_background_t *bg,
+    struct coffe_integrals_t integral[],
+    double z_mean,
+    double mu,
+    double sep,
+    struct functions_los_nodes *nodes
+)
+{
+    switch (par->terms_kernel){
+#define FUNCTIONS_DISPATCH(ID, NAME, TERMS) \
+        case ID: \
+            return functions_single_integrated_los_##NAME( \
+                par, bg, integral, z_mean, mu, sep, nodes);
+        COFFE_KERNEL_SETS(FUNCTIONS_DISPATCH)
+#undef FUNCTIONS_DISPATCH
+        default:
+            return functions_single_integrated_los_kernel(
+                par, bg, integral, z_mean, mu, sep, nodes, par->terms, NULL
+            );
+    }
+}
+
+double functions_double_integrated(
+    struct coffe_parameters_t *par,
+    struct coffe_background_t *bg,
+    struct coffe_integrals_t integral[],
+    double z_mean,
+    double mu,
+    double sep,
+    double x1,
+    double x2
+)
+{
+    switch (par->terms_kernel){
+#define FUNCTIONS_DISPATCH(ID, NAME, TERMS) \
+        case ID: \
+            return functions_double_integrated_##NAME( \
+                par, bg, integral, z_mean, mu, sep, x1, x2);
+        COFFE_KERNEL_SETS(FUNCTIONS_DISPATCH)
+#undef FUNCTIONS_DISPATCH
+        default:
+            return functions_double_integrated_kernel(
+                par, bg, integral, z_mean, mu, sep, x1, x2, par->terms, NULL
+            );
+    }
+}
+
+double functions_double_integrated_float(
+    struct coffe_parameters_t *par,
+    struct coffe_background_t *bg,
+    const struct functions_float_tables *tables,
+    double z_mean,
+    double mu,
+    double sep,
+    double x1,
+    double x2
+)
+{
+    switch (par->terms_kernel){
+#define FUNCTIONS_DISPATCH(ID, NAME, TERMS) \
+        case ID: \
+            return functions_double_integrated_float_##NAME( \
+                par, bg, tables, z_mean, mu, sep, x1, x2);
+        COFFE_KERNEL_SETS(FUNCTIONS_DISPATCH)
+#undef FUNCTIONS_DISPATCH
+        default:
+            return functions_double_integrated_float_kernel(
+                par, bg, tables, z_mean, mu, sep, x1, x2, par->terms, NULL
+            );
+    }
+}
+
+
+/**
+    estimates how much the single precision path changes the integral
+    of the double integrated terms (times P_l(mu)) over the unit cube
+    in (mu, x1, x2), with mu uniform in [mu_min, mu_max]; returns the
+    absolute value of the mean difference plus three standard errors
+**/
+
+double functions_double_integrated_float_loss(
+    struct coffe_parameters_t *par,
+    struct coffe_background_t *bg,
+    struct coffe_integrals_t integral[],
+    const struct functions_float_tables *tables,
+    double z_mean,
+    double mu_min,
+    double mu_max,
+    double sep,
+    int l
+)
+{
+    const size_t samples = FUNCTIONS_FLOAT_CHECK_SAMPLES;
+    double sum = 0, sum2 = 0;
+
+    /* fixed seed, so the check is reproducible */
+    gsl_rng *random = gsl_rng_alloc(gsl_rng_mt19937);
+    gsl_rng_set(random, 0);
+
+    for (size_t i = 0; i<samples; ++i){
+        const double mu = mu_min + (mu_max - mu_min)*gsl_rng_uniform(random);
+        const double x1 = gsl_rng_uniform_pos(random);
+        const double x2 = gsl_rng_uniform_pos(random);
+        double diff =
+            functions_double_integrated_float(
+                par, bg, tables, z_mean, mu, sep, x1, x2
+            )
+           -functions_double_integrated(
+                par, bg, integral, z_mean, mu, sep, x1, x2
+            );
+        if (l != 0) diff *= gsl_sf_legendre_Pl(l, mu);
+        sum += diff;
+        sum2 += diff*diff;
+    }
+    gsl_rng_free(random);
+
+    const double mean = sum/samples;
+    const double variance = GSL_MAX(sum2/samples - mean*mean, 0);
+
+    return fabs(mean) + 3*sqrt(variance/samples);
+}
+
+
+/**
+    the same as the functions above, but with an arbitrary set of terms,
+    and (if contributions is not NULL) also storing each of the terms
+    separately, indexed by COFFE_TERM_INDEX
+**/
+
+double functions_nonintegrated_terms(
+    struct coffe_parameters_t *par,
+    struct coffe_background_t *bg,
+    struct coffe_integrals_t integral[],
+    double z_mean,
+    double mu,
+    double sep,
+    const uint64_t terms,
+    double contributions[]
+)
+{
+    return functions_nonintegrated_kernel(
+        par, bg, integral, z_mean, mu, sep, terms, contributions
+    );
+}
+
+double functions_single_integrated_terms(
+    struct coffe_parameters_t *par,
+    struct coffe_background_t *bg,
+    struct coffe_integrals_t integral[],
+    double z_mean,
+    double mu,
+    double sep,
+    double x,
+    const uint64_t terms,
+    double contributions[]
+)
+{
+    return functions_single_integrated_kernel(
+        par, bg, integral, z_mean, mu, sep, x, terms, contributions
+    );
+}
+
+double functions_single_integrated_los_terms(
+    struct coffe_parameters_t *par,
+    struct coffe_background_t *bg,
+    struct coffe_integrals_t integral[],
+    double z_mean,
+    double mu,
+    double sep,
+    struct functions_los_nodes *nodes,
+    const uint64_t terms,
+    double contributions[]
+)
+{
+    return functions_single_integrated_los_kernel(
+        par, bg, integral, z_mean, mu, sep, nodes, terms, contributions
+    );
+}
+
+double functions_double_integrated_terms(
+    struct coffe_parameters_t *par,
+    struct coffe_background_t *bg,
+    struct coffe_integrals_t integral[],
+    double z_mean,
+    double mu,
+    double sep,
+    double x1,
+    double x2,
+    const uint64_t terms,
+    double contributions[]
+)
+{
+    return functions_double_integrated_kernel(
+        par, bg, integral, z_mean, mu, sep, x1, x2, terms, contributions
+    );
+}
+
+
+/**
+    lists the terms in the bitmask terms, so they can be
+    integrated as the components of one vector
+**/
+
+int functions_contributions_init(
+    const uint64_t terms,
+    struct functions_contributions *c
+)
+{
+    c->len = 0;
+    for (int t = 0; t<COFFE_TERMS_LEN; ++t){
+        if (terms & (UINT64_C(1) << t)){
+            c->index[c->len] = t;
+            ++c->len;
+        }
+    }
+    return EXIT_SUCCESS;
+}
+
+
+/**
+    copies the terms in the bitmask terms from all (indexed by
+    COFFE_TERM_INDEX) to values (indexed as corr_terms), times factor
+**/
+
+int functions_contributions_scatter(
+    struct coffe_parameters_t *par,
+    const uint64_t terms,
+    const double all[],
+    double factor,
+    double values[]
+)
+{
+    for (int k = 0; k<par->corr_terms_len; ++k){
+        const int t = COFFE_TERM_INDEX(
+            par->corr_terms[k][0] - '0',
+            par->corr_terms[k][1] - '0'
+        );
+        if (terms & (UINT64_C(1) << t))
+            values[k] = factor*all[t];
+    }
+    return EXIT_SUCCESS;
+}
+
+
+const int functions_flatsky_terms[3] = {
+    COFFE_TERM_INDEX(0, 0), COFFE_TERM_INDEX(0, 1), COFFE_TERM_INDEX(1, 1)
+};
+
+int functions_flatsky_coefficients(
+    struct coffe_parameters_t *par,
+    struct coffe_background_t *bg,
+    struct coffe_integrals_t integral[],
+    double z,
+    double sep,
+    double coefficient[3][3]
+)
+{
+    const double growth = pow(interp_spline(&bg->D1, z), 2);
+    const double b1 = interp_spline(&par->matter_bias1, z);
+    const double b2 = interp_spline(&par->matter_bias2, z);
+    const double f = interp_spline(&bg->f, z);
+    const double i0 = growth*interp_spline(&integral[0].result, sep);
+    const double i2 = growth*interp_spline(&integral[1].result, sep);
+    const double i4 = growth*interp_spline(&integral[2].result, sep);
+
+    memset(coefficient, 0, sizeof(double)*3*3);
+    if (par->terms & COFFE_TERM(0, 0)){
+        coefficient[0][0] = b1*b2*i0;
+    }
+    if (par->terms & COFFE_TERM(0, 1)){
+        coefficient[1][0] = (b1 + b2)*f/3.*i0;
+        coefficient[1][1] = -2*(b1 + b2)*f/3.*i2;
+    }
+    if (par->terms & COFFE_TERM(1, 1)){
+        coefficient[2][0] = f*f/5.*i0;
+        coefficient[2][1] = -4*f*f/7.*i2;
+        coefficient[2][2] = 8*f*f/35.*i4;
+    }
+    return EXIT_SUCCESS;
+}
+
+
+struct functions_limber_params
+{
+    struct coffe_parameters_t *par;
+    struct coffe_background_t *bg;
+    struct coffe_integrals_t *integral;
+    struct functions_limber *limber;
+    double R, chi1, chi2, theta;
+};
+
+static double functions_limber_projected_integrand(
+    double delta,
+    void *p
+)
+{
+    struct functions_limber_params *params = (struct functions_limber_params *) p;
+    return functions_interp_clamped(
+        &params->integral[0].result,
+        sqrt(params->R*params->R + delta*delta)
+    );
+}
+
+int functions_limber_init(
+    struct coffe_parameters_t *par,
+    struct coffe_integrals_t integral[],
+    struct functions_limber *limber
+)
+{
+    const gsl_spline *spline = integral[0].result.spline;
+    const double r_max = spline->x[spline->size - 1];
+    const double R_min = 1e-6*COFFE_H0, R_max = r_max/2.;
+    const size_t len = FUNCTIONS_LIMBER_LEN;
+    double *R = (double *)coffe_malloc(sizeof(double)*len);
+    double *w = (double *)coffe_malloc(sizeof(double)*len);
+
+    #pragma omp parallel num_threads(par->nthreads)
+    {
+        struct functions_limber_params params;
+        params.integral = integral;
+        gsl_function integrand;
+        integrand.function = &functions_limber_projected_integrand;
+        integrand.params = &params;
+        gsl_integration_workspace *wspace =
+            gsl_integration_workspace_alloc(COFFE_MAX_INTSPACE);
+
+        #pragma omp for
+        for (size_t i = 0; i<len; ++i){
+            double error;
+            R[i] = R_min*pow(R_max/R_min, (double)i/(len - 1));
+            params.R = R[i];
+            /* only as far as the integrals are known */
+            gsl_integration_qag(
+                &integrand, 0, sqrt(r_max*r_max - R[i]*R[i]), 0,
+                1e-6, COFFE_MAX_INTSPACE,
+                GSL_INTEG_GAUSS61, wspace,
+                &w[i], &error
+            );
+            w[i] *= 2;
+        }
+        gsl_integration_workspace_free(wspace);
+    }
+
+    init_spline(&limber->projected, R, w, len, par->interp_method);
+    free(R);
+    free(w);
+    return EXIT_SUCCESS;
+}
+
+int functions_limber_free(
+    struct functions_limber *limber
+)
+{
+    free_spline(&limber->projected);
+    return EXIT_SUCCESS;
+}
+
+
+/**
+    the angle between the two lines of sight of the point (mu, sep)
+**/
+
+double functions_limber_angle(
+    struct coffe_background_t *bg,
+    double z_mean,
+    double mu,
+    double sep
+)
+{
+    const double chi_mean = interp_spline(&bg->comoving_distance, z_mean);
+    const double costheta =
+        (2*chi_mean*chi_mean - sep*sep + mu*mu*sep*sep/2.)
+       /(2*chi_mean*chi_mean - mu*mu*sep*sep/2.);
+    return acos(GSL_MAX(GSL_MIN(costheta, 1), -1));
+}
+
+static double functions_limber_lensing_integrand(
+    double lambda,
+    void *p
+)
+{
+    struct functions_limber_params *params = (struct functions_limber_params *) p;
+    struct coffe_background_t *bg = params->bg;
+    const double z = interp_spline(&bg->z_as_chi, lambda);
+    const double growth = interp_spline(&bg->D1, z)/interp_spline(&bg->a, z);
+    return
+        (params->chi1 - lambda)*(params->chi2 - lambda)*lambda*lambda
+       /params->chi1/params->chi2
+       *growth*growth
+       *functions_interp_clamped(&params->limber->projected, lambda*params->theta);
+}
+
+/**
+    the len-len term at the point (mu, sep) in the Limber approximation,
+    9/4 Omega_m^2 (2 - 5 s1) (2 - 5 s2) int_0^min(chi1, chi2) dlambda
+    (chi1 - lambda) (chi2 - lambda) lambda^2/(chi1 chi2) (D1/a)^2 w(lambda theta)
+**/
+
+double functions_limber_lensing(
+    struct coffe_parameters_t *par,
+    struct coffe_background_t *bg,
+    struct functions_limber *limber,
+    double z_mean,
+    double mu,
+    double sep
+)
+{
+    const double chi_mean = interp_spline(&bg->comoving_distance, z_mean);
+    struct functions_limber_params params;
+    params.par = par;
+    params.bg = bg;
+    params.limber = limber;
+    params.chi1 = chi_mean - sep*mu/2.;
+    params.chi2 = chi_mean + sep*mu/2.;
+    params.theta = functions_limber_angle(bg, z_mean, mu, sep);
+
+    const double s1 = interp_spline(
+        &par->magnification_bias1, interp_spline(&bg->z_as_chi, params.chi1)
+    );
+    const double s2 = interp_spline(
+        &par->magnification_bias2, interp_spline(&bg->z_as_chi, params.chi2)
+    );
+
+    gsl_function integrand;
+    integrand.function = &functions_limber_lensing_integrand;
+    integrand.params = &params;
+
+    double result, error;
+    gsl_integration_workspace *wspace =
+        gsl_integration_workspace_alloc(COFFE_MAX_INTSPACE);
+    gsl_integration_qag(
+        &integrand, 0, GSL_MIN(params.chi1, params.chi2), 0,
+        1e-5, COFFE_MAX_INTSPACE,
+        GSL_INTEG_GAUSS61, wspace,
+        &result, &error
+    );
+    gsl_integration_workspace_free(wspace);
+
+    return 9./4*pow(par->Omega0_m, 2)*(2 - 5*s1)*(2 - 5*s2)*result;
+}
+
@@ -31,6 +31,162 @@ struct functions_params
     int l;
 };
 
+/**
+    values of the single integrated terms which do not depend
+    on the position along the line of sight
+**/
+struct functions_single_geometry
+{
+    double z_mean, mu, sep;
+    double chi_mean, chi1, chi2, costheta;
+    double z1_const, z2_const;
+    double s1, s2, b1, b2;
+    double D1_1, D1_2, f_1, f_2, curlyH_1, curlyH_2;
+    double G1_1, G2_2, a_1, a_2, fevo_1, fevo_2;
+    double I_zero[8]; /* I^n_l at zero separation */
+};
+
+/**
+    nodes along the line of sight (x in [0, 1]) and all of the values
+    the single integrated terms need at them, as a structure of arrays
+    so the sum over the nodes can be vectorized
+**/
+
+#ifndef FUNCTIONS_LOS_VALUES
+#define FUNCTIONS_LOS_VALUES 38 /* number of arrays below */
+#endif
+
+struct functions_los_nodes
+{
+    size_t len;
+    double *buffer; /* where all the arrays live */
+    double *x, *weight;
+    double *lambda1, *lambda2, *r21, *r22;
+    double *z1, *z2;
+    double *D1_1, *D1_2, *a_1, *a_2;
+    double *f_1, *f_2, *curlyH_1, *curlyH_2;
+    double *f_lambda1, *f_lambda2, *curlyH_lambda1, *curlyH_lambda2;
+    double *I1[8], *I2[8]; /* I^n_l at sqrt(r21) and sqrt(r22) */
+    double *ren1, *ren2;
+};
+
+void functions_los_assign(
+    struct functions_los_nodes *nodes,
+    double *buffer,
+    size_t len
+);
+
+int functions_los_init(
+    struct functions_los_nodes *nodes,
+    size_t order,
+    int transform
+);
+
+/**
+    substitutions of the line of sight variables, which put more
+    of the points near the observer (x = 0) and the source (x = 1):
+    0 - none
+    1 - polynomial, x = u^2 (3 - 2u)
+    2 - tanh-sinh (double exponential), cut at |t| = FUNCTIONS_TANH_SINH_RANGE
+**/
+
+#ifndef FUNCTIONS_TANH_SINH_RANGE
+#define FUNCTIONS_TANH_SINH_RANGE 3.
+#endif
+
+double functions_los_transform(
+    int transform,
+    double u,
+    double *x
+);
+
+int functions_los_free(
+    struct functions_los_nodes *nodes
+);
+
+/**
+    single precision tables on uniform grids, used by the mixed
+    precision path of the double integrated terms; the lookup
+    is linear interpolation without any search
+**/
+
+#ifndef FUNCTIONS_FLOAT_TABLE_LEN
+#define FUNCTIONS_FLOAT_TABLE_LEN 32768
+#endif
+
+#ifndef FUNCTIONS_FLOAT_TABLE2D_LEN
+#define FUNCTIONS_FLOAT_TABLE2D_LEN 512
+#endif
+
+#ifndef FUNCTIONS_FLOAT_CHECK_SAMPLES
+#define FUNCTIONS_FLOAT_CHECK_SAMPLES 2000 /* points used to estimate the precision loss */
+#endif
+
+#ifndef FUNCTIONS_FLOAT_LOSS_FRACTION
+#define FUNCTIONS_FLOAT_LOSS_FRACTION 0.1 /* max allowed loss relative to the integration error */
+#endif
+
+struct functions_float_table
+{
+    double x_min, inv_dx;
+    size_t len;
+    float *y;
+};
+
+struct functions_float_table2d
+{
+    double x_min, y_min, inv_dx, inv_dy;
+    size_t xlen, ylen;
+    float *z;
+};
+
+struct functions_float_tables
+{
+    double z_mean, chi_mean;
+    /* as functions of the comoving distance */
+    struct functions_float_table D1_over_a, conformal_Hz, f, G1, G2;
+    struct functions_float_table magnification_bias1, magnification_bias2;
+    /* as functions of the separation */
+    struct functions_float_table integral[9];
+    struct functions_float_table renormalization0;
+    struct functions_float_table2d renormalization;
+};
+
+int functions_float_tables_init(
+    struct coffe_parameters_t *par,
+    struct coffe_background_t *bg,
+    struct coffe_integrals_t integral[],
+    struct functions_float_tables *tables
+);
+
+int functions_float_tables_free(
+    struct functions_float_tables *tables
+);
+
+/**
+    the terms of one class (nonintegrated, single or double integrated)
+    which are integrated together as the components of a vector
+**/
+
+struct functions_contributions
+{
+    int len; /* number of terms */
+    int index[COFFE_TERMS_LEN]; /* COFFE_TERM_INDEX of each of them */
+};
+
+int functions_contributions_init(
+    const uint64_t terms,
+    struct functions_contributions *c
+);
+
+int functions_contributions_scatter(
+    struct coffe_parameters_t *par,
+    const uint64_t terms,
+    const double all[],
+    double factor,
+    double values[]
+);
+
 double functions_nonintegrated(
     struct coffe_parameters_t *par,
     struct coffe_background_t *bg,
@@ -50,6 +206,16 @@ double functions_single_integrated(
     double x
 );
 
+double functions_single_integrated_los(
+    struct coffe_parameters_t *par,
+    struct coffe_background_t *bg,
+    struct coffe_integrals_t integral[],
+    double z_mean,
+    double mu,
+    double r,
+    struct functions_los_nodes *nodes
+);
+
 double functions_double_integrated(
     struct coffe_parameters_t *par,
     struct coffe_background_t *bg,
@@ -61,5 +227,137 @@ double functions_double_integrated(
     double x2
 );
 
+double functions_nonintegrated_terms(
+    struct coffe_parameters_t *par,
+    struct coffe_background_t *bg,
+    struct coffe_integrals_t integral[],
+    double z_mean,
+    double mu,
+    double r,
+    const uint64_t terms,
+    double contributions[]
+);
+
+double functions_single_integrated_terms(
+    struct coffe_parameters_t *par,
+    struct coffe_background_t *bg,
+    struct coffe_integrals_t integral[],
+    double z_mean,
+    double mu,
+    double r,
+    double x,
+    const uint64_t terms,
+    double contributions[]
+);
+
+double functions_single_integrated_los_terms(
+    struct coffe_parameters_t *par,
+    struct coffe_background_t *bg,
+    struct coffe_integrals_t integral[],
+    double z_mean,
+    double mu,
+    double r,
+    struct functions_los_nodes *nodes,
+    const uint64_t terms,
+    double contributions[]
+);
+
+double functions_double_integrated_terms(
+    struct coffe_parameters_t *par,
+    struct coffe_background_t *bg,
+    struct coffe_integrals_t integral[],
+    double z_mean,
+    double mu,
+    double r,
+    double x1,
+    double x2,
+    const uint64_t terms,
+    double contributions[]
+);
+
+double functions_double_integrated_float(
+    struct coffe_parameters_t *par,
+    struct coffe_background_t *bg,
+    const struct functions_float_tables *tables,
+    double z_mean,
+    double mu,
+    double r,
+    double x1,
+    double x2
+);
+
+double functions_double_integrated_float_loss(
+    struct coffe_parameters_t *par,
+    struct coffe_background_t *bg,
+    struct coffe_integrals_t integral[],
+    const struct functions_float_tables *tables,
+    double z_mean,
+    double mu_min,
+    double mu_max,
+    double r,
+    int l
+);
+
+/**
+    the flat-sky (Kaiser) limit of the den-den, den-rsd and rsd-rsd
+    terms at redshift z and separation sep: coefficient[k][j] is the one
+    of the term with index functions_flatsky_terms[k] in front of P_2j(mu)
+    (zero if that term is not computed), including the growth D1(z)^2
+**/
+
+extern const int functions_flatsky_terms[3];
+
+int functions_flatsky_coefficients(
+    struct coffe_parameters_t *par,
+    struct coffe_background_t *bg,
+    struct coffe_integrals_t integral[],
+    double z,
+    double sep,
+    double coefficient[3][3]
+);
+
+/**
+    the len-len term in the Limber approximation, where the double
+    integral along the two lines of sight becomes a single one over
+    the projected correlation function w(R), the integral of I^0_0 along
+    the line of sight, 2 int_0^infinity dDelta I^0_0(sqrt(R^2 + Delta^2)),
+    which is tabulated once
+**/
+
+#ifndef FUNCTIONS_LIMBER_LEN
+#define FUNCTIONS_LIMBER_LEN 512 /* number of points of the table of w(R) */
+#endif
+
+struct functions_limber
+{
+    struct coffe_interpolation projected; /* w(R), logarithmically spaced in R */
+};
+
+int functions_limber_init(
+    struct coffe_parameters_t *par,
+    struct coffe_integrals_t integral[],
+    struct functions_limber *limber
+);
+
+int functions_limber_free(
+    struct functions_limber *limber
+);
+
+double functions_limber_angle(
+    struct coffe_background_t *bg,
+    double z_mean,
+    double mu,
+    double sep
+);
+
+double functions_limber_lensing(
+    struct coffe_parameters_t *par,
+    struct coffe_background_t *bg,
+    struct functions_limber *limber,
+    double z_mean,
+    double mu,
+    double sep
+);
+
 #endif
 
@@ -383,21 +383,37 @@ int coffe_integrals_init(
                 double *result2d = (double *)coffe_malloc(sizeof(double)*(nbins + 1)*(nbins + 1));
 
                 double chi_min = 0.;
-                double chi_max;
-                if (par->output_type == 0){
-                    chi_max = interp_spline(&bg->comoving_distance, par->z_mean);
-                }
-                else if (par->output_type == 1 || par->output_type == 2){
-                    chi_max = interp_spline(&bg->comoving_distance, par->z_mean + par->deltaz); // dimensionless
-                }
-                else if (par->output_type == 3){
-                    chi_max = interp_spline(&bg->comoving_distance, par->z_max); // dimensionless
-                }
-                else if (par->output_type == 6){
-                    chi_max = interp_spline(&bg->comoving_distance, par->z_mean) + 300.*COFFE_H0;
-                }
-                else{
-                    chi_max = 0.;
+                /* the union of the ranges of all of the redshift bins */
+                double chi_max = 0.;
+                for (int bin = 0; bin<par->z_bins_len; ++bin){
+                    double chi_bin = 0.;
+                    if (par->output_type == 0){
+                        chi_bin = interp_spline(&bg->comoving_distance, par->z_mean_bins[bin]);
+                    }
+                    else if (par->output_type == 1 || par->output_type == 2){
+                        chi_bin = interp_spline(&bg->comoving_distance, par->z_mean_bins[bin] + par->deltaz_bins[bin]); // dimensionless
+                    }
+                    else if (par->output_type == 3){
+                        chi_bin = interp_spline(&bg->comoving_distance, par->z_max_bins[bin]); // dimensionless
+                    }
+                    else if (par->output_type == 6){
+                        /* covering the largest of the separations parallel to the line of sight */
+                        double sep_parallel_max = 300.;
+                        for (int i = 0; i<par->sep_parallel_len; ++i)
+                            sep_parallel_max = fmax(sep_parallel_max, par->sep_parallel[i]);
+                        /* the polar grid reaches half of the largest separation along the line of sight */
+                        if (par->corrfunc2d_multipole_max > 0){
+                            double sep_perpendicular_max = par->sep_perpendicular != NULL ? 0. : 300.;
+                            for (int i = 0; i<par->sep_perpendicular_len; ++i)
+                                sep_perpendicular_max = fmax(sep_perpendicular_max, par->sep_perpendicular[i]);
+                            sep_parallel_max = fmax(
+                                sep_parallel_max,
+                                hypot(sep_parallel_max, sep_perpendicular_max)/2.
+                            );
+                        }
+                        chi_bin = interp_spline(&bg->comoving_distance, par->z_mean_bins[bin]) + sep_parallel_max*COFFE_H0;
+                    }
+                    chi_max = fmax(chi_max, chi_bin);
                 }
                 double *chi_array = (double *)coffe_malloc(sizeof(double)*(nbins + 1));
                 for (size_t i = 0; i<=nbins; ++i){
@@ -0,0 +1,1355 @@
+/*
+ * This file is part of COFFE
+ * Copyright (C) 2018 Goran Jelic-Cizmek
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <gsl/gsl_math.h>
+#include <gsl/gsl_integration.h>
+#include <gsl/gsl_rng.h>
+#include <gsl/gsl_qrng.h>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include <gsl/gsl_monte_plain.h>
+#include <gsl/gsl_monte.h>
+#include <gsl/gsl_monte_miser.h>
+#include <gsl/gsl_monte_vegas.h>
+
+#ifdef HAVE_CUBA
+#include "cuba.h"
+#endif
+
+#include "common.h"
+#include "integrators.h"
+
+struct integrators_params
+{
+    integrators_function integrand;
+    integrators_batch batch; /* NULL if the integrand takes one point at a time */
+    void *params;
+    int dims;
+    int ncomp;
+    int component;
+    int threads; /* how many threads evaluate the points of a batch */
+};
+
+
+/**
+    evaluates the integrand at the n points x[i*dims + d], into
+    value[i*ncomp + c] (value[i] if only one component is requested);
+    the points are split evenly among the threads, and a batched
+    integrand gets all of the points of a thread at once, otherwise
+    they are passed one by one
+**/
+
+static int integrators_eval(
+    struct integrators_params *all,
+    size_t n,
+    const double x[],
+    double value[]
+)
+{
+    const int stride = all->component >= 0 ? 1 : all->ncomp;
+    const int threads = (size_t)all->threads < n ? all->threads : (int)n;
+
+    #pragma omp parallel for num_threads(threads) if(threads > 1)
+    for (int t = 0; t<threads; ++t){
+        const size_t first = n*t/threads, last = n*(t + 1)/threads;
+        if (all->batch != NULL){
+            all->batch(
+                &x[first*all->dims], last - first, all->component,
+                &value[first*stride], all->params
+            );
+        }
+        else{
+            for (size_t i = first; i<last; ++i)
+                all->integrand(
+                    &x[i*all->dims], all->component, &value[i*stride], all->params
+                );
+        }
+    }
+    return EXIT_SUCCESS;
+}
+
+#ifdef HAVE_CUBA
+static int integrators_cuba_integrand(
+    const int *ndim, const cubareal var[],
+    const int *ncomp, cubareal value[],
+    void *p, const int *nvec
+)
+{
+    return integrators_eval((struct integrators_params *) p, (size_t)*nvec, var, value);
+}
+#endif
+
+static double integrators_monte_integrand(
+    double *var, size_t dim, void *p
+)
+{
+    double value;
+    integrators_eval((struct integrators_params *) p, 1, var, &value);
+    return value;
+}
+
+
+/**
+    whether every component has an error below epsrel relative to
+    its own value, or below epsabs
+**/
+
+static int integrators_converged(
+    int ncomp,
+    double epsrel,
+    double epsabs,
+    const double result[],
+    const double error[]
+)
+{
+    for (int c = 0; c<ncomp; ++c)
+        if (error[c] > epsrel*fabs(result[c]) && error[c] > epsabs)
+            return 0;
+    return 1;
+}
+
+
+/**
+    independent estimates of one value, combined with their inverse
+    variances as weights; the ones with no variance (e.g. all of the
+    samples equal) would swamp the weights, so they are left out,
+    unless none of the estimates have a variance, in which case they
+    are just averaged
+**/
+
+struct integrators_estimates
+{
+    double weighted, total_weight; /* of the ones with a variance */
+    double sum; /* of the ones without one */
+    size_t exact_len;
+};
+
+static void integrators_estimates_init(
+    struct integrators_estimates *estimates
+)
+{
+    estimates->weighted = 0, estimates->total_weight = 0;
+    estimates->sum = 0;
+    estimates->exact_len = 0;
+}
+
+static void integrators_estimates_add(
+    struct integrators_estimates *estimates,
+    double value,
+    double variance
+)
+{
+    if (variance > 0 && gsl_finite(1./variance)){
+        estimates->weighted += value/variance;
+        estimates->total_weight += 1./variance;
+    }
+    else{
+        estimates->sum += value;
+        ++estimates->exact_len;
+    }
+}
+
+static void integrators_estimates_result(
+    const struct integrators_estimates *estimates,
+    double *result,
+    double *error
+)
+{
+    if (estimates->total_weight > 0){
+        *result = estimates->weighted/estimates->total_weight;
+        *error = 1./sqrt(estimates->total_weight);
+    }
+    else{
+        *result = estimates->exact_len > 0 ? estimates->sum/estimates->exact_len : 0;
+        *error = 0;
+    }
+}
+
+
+/**
+    plain Monte Carlo integration of all of the components
+    at once, with the same samples for each of them
+**/
+
+static int integrators_plain(
+    struct integrators_params *all,
+    int dims,
+    int ncomp,
+    size_t calls,
+    gsl_rng *random,
+    double result[],
+    double error[]
+)
+{
+    const size_t nvec = INTEGRATORS_NVEC;
+    double *x = (double *)coffe_malloc(sizeof(double)*nvec*dims);
+    double *value = (double *)coffe_malloc(sizeof(double)*nvec*ncomp);
+    double *sum = (double *)coffe_malloc(sizeof(double)*2*ncomp);
+    double *sum2 = sum + ncomp;
+    for (int c = 0; c<ncomp; ++c) sum[c] = 0, sum2[c] = 0;
+
+    for (size_t n = 0; n<calls; n += nvec){
+        const size_t len = calls - n < nvec ? calls - n : nvec;
+        for (size_t i = 0; i<len*dims; ++i)
+            x[i] = gsl_rng_uniform_pos(random);
+        integrators_eval(all, len, x, value);
+        for (size_t i = 0; i<len; ++i){
+            for (int c = 0; c<ncomp; ++c){
+                sum[c] += value[i*ncomp + c];
+                sum2[c] += value[i*ncomp + c]*value[i*ncomp + c];
+            }
+        }
+    }
+    for (int c = 0; c<ncomp; ++c){
+        const double mean = sum[c]/calls;
+        const double variance = (sum2[c]/calls - mean*mean)/(calls > 1 ? calls - 1 : 1);
+        result[c] = mean;
+        error[c] = variance > 0 ? sqrt(variance) : 0;
+    }
+
+    free(x);
+    free(value);
+    free(sum);
+    return EXIT_SUCCESS;
+}
+
+
+/**
+    VEGAS (importance sampling on a separable grid, see Lepage 1978)
+    of all of the components at once, with the same samples for each;
+    the grid is adapted to the sum of the squares of the components,
+    each relative to its total (so that all of them count the same),
+    and the estimates of the iterations after the first one are
+    combined with their inverse variances as weights; if warm already
+    contains an adapted grid, it is used as the starting point and all
+    of the iterations count, and the final grid is stored in warm
+**/
+
+static int integrators_vegas(
+    struct integrators_params *all,
+    int dims,
+    int ncomp,
+    size_t calls,
+    gsl_rng *random,
+    struct integrators_grid *warm,
+    double result[],
+    double error[]
+)
+{
+    const int bins = INTEGRATORS_VEGAS_BINS;
+    const int iterations = INTEGRATORS_VEGAS_ITERATIONS;
+    const double alpha = INTEGRATORS_VEGAS_ALPHA;
+    const size_t calls_per_iteration =
+        calls/iterations > 1 ? calls/iterations : 2;
+
+    /* the edges of the bins and the histogram of the integrand */
+    double *grid = (double *)coffe_malloc(sizeof(double)*dims*(bins + 1));
+    double *histogram = (double *)coffe_malloc(sizeof(double)*dims*bins*(ncomp + 1));
+    double *combined = histogram + dims*bins*ncomp;
+    double *weight = (double *)coffe_malloc(sizeof(double)*bins);
+    double *new_grid = (double *)coffe_malloc(sizeof(double)*(bins + 1));
+    const size_t nvec = INTEGRATORS_NVEC;
+    double *x = (double *)coffe_malloc(sizeof(double)*nvec*dims);
+    double *jacobian = (double *)coffe_malloc(sizeof(double)*nvec);
+    int *bin = (int *)coffe_malloc(sizeof(int)*nvec*dims);
+    double *value = (double *)coffe_malloc(sizeof(double)*nvec*ncomp);
+    double *sum = (double *)coffe_malloc(sizeof(double)*2*ncomp);
+    double *sum2 = sum + ncomp;
+    struct integrators_estimates *estimates = (struct integrators_estimates *)coffe_malloc(
+        sizeof(struct integrators_estimates)*ncomp
+    );
+
+    const int warm_start = warm != NULL && warm->adapted;
+    for (int d = 0; d<dims; ++d)
+        for (int k = 0; k<=bins; ++k)
+            grid[d*(bins + 1) + k] =
+                warm_start ? warm->edges[d*(bins + 1) + k] : (double)k/bins;
+    for (int c = 0; c<ncomp; ++c){
+        integrators_estimates_init(&estimates[c]);
+        result[c] = 0, error[c] = 0;
+    }
+
+    for (int it = 0; it<iterations; ++it){
+        for (int i = 0; i<dims*bins*ncomp; ++i) histogram[i] = 0;
+        for (int c = 0; c<ncomp; ++c) sum[c] = 0, sum2[c] = 0;
+
+        for (size_t n = 0; n<calls_per_iteration; n += nvec){
+            const size_t len =
+                calls_per_iteration - n < nvec ? calls_per_iteration - n : nvec;
+            for (size_t i = 0; i<len; ++i){
+                jacobian[i] = 1;
+                for (int d = 0; d<dims; ++d){
+                    const double *edges = &grid[d*(bins + 1)];
+                    const double u = gsl_rng_uniform_pos(random)*bins;
+                    int k = (int)u;
+                    if (k >= bins) k = bins - 1;
+                    const double width = edges[k + 1] - edges[k];
+                    x[i*dims + d] = edges[k] + (u - k)*width;
+                    jacobian[i] *= bins*width;
+                    bin[i*dims + d] = k;
+                }
+            }
+            integrators_eval(all, len, x, value);
+            for (size_t i = 0; i<len; ++i){
+                for (int c = 0; c<ncomp; ++c){
+                    const double f = jacobian[i]*value[i*ncomp + c];
+                    sum[c] += f;
+                    sum2[c] += f*f;
+                    for (int d = 0; d<dims; ++d)
+                        histogram[(c*dims + d)*bins + bin[i*dims + d]] += f*f;
+                }
+            }
+        }
+
+        for (int c = 0; c<ncomp; ++c){
+            const double mean = sum[c]/calls_per_iteration;
+            const double variance =
+                (sum2[c]/calls_per_iteration - mean*mean)/(calls_per_iteration - 1);
+            /* the first iteration only adapts the grid, unless it's the only one */
+            if (it > 0 || iterations == 1 || warm_start)
+                integrators_estimates_add(&estimates[c], mean, variance);
+        }
+
+        /* refining the grid so that each bin has the same weight */
+        for (int i = 0; i<dims*bins; ++i) combined[i] = 0;
+        for (int c = 0; c<ncomp; ++c){
+            if (sum2[c] <= 0) continue;
+            for (int i = 0; i<dims*bins; ++i)
+                combined[i] += histogram[c*dims*bins + i]/sum2[c];
+        }
+        for (int d = 0; d<dims; ++d){
+            double *h = &combined[d*bins];
+            double *edges = &grid[d*(bins + 1)];
+            double total = 0;
+
+            /* smoothing */
+            double previous = h[0], current = h[1];
+            h[0] = (previous + current)/2.;
+            for (int k = 1; k<bins - 1; ++k){
+                const double next = h[k + 1];
+                h[k] = (previous + current + next)/3.;
+                previous = current, current = next;
+            }
+            h[bins - 1] = (previous + current)/2.;
+            for (int k = 0; k<bins; ++k) total += h[k];
+            if (total <= 0) continue;
+
+            double total_w = 0;
+            for (int k = 0; k<bins; ++k){
+                const double r = h[k]/total;
+                weight[k] = r > 0 && r < 1 ? pow((r - 1)/log(r), alpha) : (r >= 1 ? 1 : 0);
+                total_w += weight[k];
+            }
+            if (total_w <= 0) continue;
+
+            const double per_bin = total_w/bins;
+            double accumulated = 0;
+            int k = 0;
+            new_grid[0] = 0;
+            for (int j = 1; j<bins; ++j){
+                while (accumulated + weight[k] < j*per_bin && k < bins - 1){
+                    accumulated += weight[k];
+                    ++k;
+                }
+                const double fraction = weight[k] > 0 ?
+                    (j*per_bin - accumulated)/weight[k] : 0;
+                new_grid[j] = edges[k] + fraction*(edges[k + 1] - edges[k]);
+            }
+            new_grid[bins] = 1;
+            for (int j = 0; j<=bins; ++j) edges[j] = new_grid[j];
+        }
+    }
+
+    for (int c = 0; c<ncomp; ++c)
+        integrators_estimates_result(&estimates[c], &result[c], &error[c]);
+    if (warm != NULL){
+        for (int i = 0; i<dims*(bins + 1); ++i) warm->edges[i] = grid[i];
+        warm->adapted = 1;
+    }
+
+    free(grid);
+    free(histogram);
+    free(weight);
+    free(new_grid);
+    free(x);
+    free(jacobian);
+    free(bin);
+    free(value);
+    free(sum);
+    free(estimates);
+    return EXIT_SUCCESS;
+}
+
+
+/**
+    the error-targeted mode of plain Monte Carlo (method 0), MISER
+    (method 1) and VEGAS (method 2): the integration is repeated in
+    increments, each with as many calls as all of the previous ones,
+    until every component has an error below epsrel relative to its
+    value (or below epsabs), or until calls have been used up; the
+    increments are combined with their inverse variances as weights
+    (see integrators_estimates),
+    VEGAS carries its grid over from one increment to the next, and
+    MISER only repeats the components which haven't converged yet
+**/
+
+static int integrators_increments(
+    struct integrators_params *all,
+    int method,
+    int dims,
+    int ncomp,
+    double epsrel,
+    double epsabs,
+    size_t calls,
+    gsl_rng *random,
+    struct integrators_grid *grid,
+    double result[],
+    double error[]
+)
+{
+    double *value = (double *)coffe_malloc(sizeof(double)*2*ncomp);
+    double *err = value + ncomp;
+    struct integrators_estimates *estimates = (struct integrators_estimates *)coffe_malloc(
+        sizeof(struct integrators_estimates)*ncomp
+    );
+    for (int c = 0; c<ncomp; ++c){
+        integrators_estimates_init(&estimates[c]);
+        result[c] = 0, error[c] = 0;
+    }
+
+    /* VEGAS needs a grid to carry over */
+    struct integrators_grid local;
+    const int own_grid = method == 2 && grid == NULL;
+    if (own_grid){
+        integrators_grid_init(&local, dims);
+        grid = &local;
+    }
+
+    gsl_monte_function function;
+    function.dim = dims;
+    function.params = all;
+    function.f = &integrators_monte_integrand;
+
+    double lower[dims];
+    double upper[dims];
+    for (int i = 0; i<dims; ++i){
+        lower[i] = 0.0;
+        upper[i] = 1.0;
+    }
+
+    size_t used = 0;
+    size_t increment = INTEGRATORS_TARGET_START < calls ? INTEGRATORS_TARGET_START : calls;
+
+    while (1){
+        switch (method){
+            case 0:
+                integrators_plain(all, dims, ncomp, increment, random, value, err);
+                break;
+            case 1:
+                for (int c = 0; c<ncomp; ++c){
+                    if (used > 0 && integrators_converged(1, epsrel, epsabs, &result[c], &error[c]))
+                        continue;
+                    all->component = ncomp == 1 ? -1 : c;
+                    gsl_monte_miser_state *state =
+                        gsl_monte_miser_alloc(dims);
+                    gsl_monte_miser_integrate(
+                        &function, lower, upper,
+                        dims, increment, random,
+                        state,
+                        &value[c], &err[c]
+                    );
+                    gsl_monte_miser_free(state);
+                }
+                all->component = -1;
+                break;
+            default:
+                integrators_vegas(all, dims, ncomp, increment, random, grid, value, err);
+                break;
+        }
+
+        for (int c = 0; c<ncomp; ++c){
+            if (
+                method == 1 && used > 0 &&
+                integrators_converged(1, epsrel, epsabs, &result[c], &error[c])
+            ) continue;
+            integrators_estimates_add(&estimates[c], value[c], err[c]*err[c]);
+            integrators_estimates_result(&estimates[c], &result[c], &error[c]);
+        }
+        used += increment;
+
+        if (
+            integrators_converged(ncomp, epsrel, epsabs, result, error) ||
+            used >= calls
+        ) break;
+        increment = used < calls - used ? used : calls - used;
+    }
+
+    if (own_grid) integrators_grid_free(&local);
+    free(value);
+    free(estimates);
+    return EXIT_SUCCESS;
+}
+
+
+
+/**
+    the 7 point Gauss-Kronrod rule on [-1, 1], and the weights
+    of the 3 point Gauss-Legendre rule embedded in it
+**/
+
+static const double integrators_kronrod_x[7] = {
+    -0.9604912687080202834235071, -0.7745966692414833770358531,
+    -0.4342437493468025580020715, 0,
+    0.4342437493468025580020715, 0.7745966692414833770358531,
+    0.9604912687080202834235071
+};
+
+static const double integrators_kronrod_w[7] = {
+    0.1046562260264672651938238, 0.2684880898683334407285693,
+    0.4013974147759622229050518, 0.4509165386584741423451382,
+    0.4013974147759622229050518, 0.2684880898683334407285693,
+    0.1046562260264672651938238
+};
+
+static const double integrators_gauss_w[7] = {
+    0, 5./9., 0, 8./9., 0, 5./9., 0
+};
+
+
+/**
+    the tensor product of the Gauss-Kronrod rule on the box
+    [lower, upper]; err is the difference from the embedded
+    Gauss-Legendre rule, and axis the direction in which the
+    integrand is the least resolved (where the difference between
+    the two rules along just that direction is the largest)
+**/
+
+static int integrators_cubature_rule(
+    struct integrators_params *all,
+    int dims,
+    int ncomp,
+    const double lower[],
+    const double upper[],
+    const double scale[],
+    double value[],
+    double err[],
+    int *axis
+)
+{
+    const size_t nvec = INTEGRATORS_NVEC;
+    int index[dims];
+    double gauss[ncomp], along[dims*ncomp];
+    double volume = 1;
+    for (int d = 0; d<dims; ++d){
+        index[d] = 0;
+        volume *= (upper[d] - lower[d])/2.;
+    }
+    for (int c = 0; c<ncomp; ++c) value[c] = 0, gauss[c] = 0;
+    for (int i = 0; i<dims*ncomp; ++i) along[i] = 0;
+
+    int *indices = (int *)coffe_malloc(sizeof(int)*nvec*dims);
+    double *x = (double *)coffe_malloc(sizeof(double)*nvec*dims);
+    double *f = (double *)coffe_malloc(sizeof(double)*nvec*ncomp);
+
+    int done = 0;
+    while (!done){
+        /* the next batch of points of the tensor product */
+        size_t len = 0;
+        while (len < nvec && !done){
+            for (int d = 0; d<dims; ++d){
+                const double center = (upper[d] + lower[d])/2.;
+                const double half = (upper[d] - lower[d])/2.;
+                x[len*dims + d] = center + half*integrators_kronrod_x[index[d]];
+                indices[len*dims + d] = index[d];
+            }
+            ++len;
+            int d = 0;
+            while (d<dims && ++index[d] == 7) index[d++] = 0;
+            if (d == dims) done = 1;
+        }
+        integrators_eval(all, len, x, f);
+
+        for (size_t i = 0; i<len; ++i){
+            const int *point = &indices[i*dims];
+            const double *fi = &f[i*ncomp];
+            double weight = 1, weight_gauss = 1;
+            for (int d = 0; d<dims; ++d){
+                weight *= integrators_kronrod_w[point[d]];
+                weight_gauss *= integrators_gauss_w[point[d]];
+            }
+            for (int c = 0; c<ncomp; ++c){
+                value[c] += weight*fi[c];
+                gauss[c] += weight_gauss*fi[c];
+            }
+            for (int d = 0; d<dims; ++d){
+                const double ratio =
+                    integrators_gauss_w[point[d]]/integrators_kronrod_w[point[d]];
+                if (ratio == 0) continue;
+                for (int c = 0; c<ncomp; ++c)
+                    along[d*ncomp + c] += ratio*weight*fi[c];
+            }
+        }
+    }
+    free(indices);
+    free(x);
+    free(f);
+
+    double largest = -1;
+    *axis = 0;
+    for (int d = 0; d<dims; ++d){
+        double difference = 0;
+        for (int c = 0; c<ncomp; ++c)
+            difference += fabs(value[c] - along[d*ncomp + c])/scale[c];
+        if (difference > largest) largest = difference, *axis = d;
+    }
+    for (int c = 0; c<ncomp; ++c){
+        err[c] = fabs(value[c] - gauss[c])*volume;
+        value[c] *= volume;
+    }
+    return EXIT_SUCCESS;
+}
+
+
+/**
+    restores the order of the max-heap of regions (by priority)
+    after the priority of the region at position i has changed
+**/
+
+static void integrators_heap_update(
+    size_t heap[],
+    size_t len,
+    const double priority[],
+    size_t i
+)
+{
+    while (i > 0 && priority[heap[(i - 1)/2]] < priority[heap[i]]){
+        const size_t temp = heap[i];
+        heap[i] = heap[(i - 1)/2], heap[(i - 1)/2] = temp;
+        i = (i - 1)/2;
+    }
+    while (1){
+        size_t largest = i;
+        const size_t left = 2*i + 1, right = 2*i + 2;
+        if (left < len && priority[heap[left]] > priority[heap[largest]])
+            largest = left;
+        if (right < len && priority[heap[right]] > priority[heap[largest]])
+            largest = right;
+        if (largest == i) break;
+        const size_t temp = heap[i];
+        heap[i] = heap[largest], heap[largest] = temp;
+        i = largest;
+    }
+}
+
+
+/**
+    deterministic adaptive cubature of all of the components at once:
+    the region with the largest error (relative to the integral of
+    the same component) is bisected along its least resolved direction
+    until every component has a relative error below epsrel (or an
+    absolute one below epsabs), or until maxeval evaluations of the integrand
+**/
+
+static int integrators_cubature(
+    struct integrators_params *all,
+    int dims,
+    int ncomp,
+    double epsrel,
+    double epsabs,
+    size_t maxeval,
+    double result[],
+    double error[]
+)
+{
+    size_t points = 1;
+    for (int d = 0; d<dims; ++d) points *= 7;
+    /* each bisection costs two evaluations of the rule */
+    const size_t limit = maxeval > points ? (maxeval/points - 1)/2 + 1 : 1;
+
+    double *lower = (double *)coffe_malloc(sizeof(double)*limit*dims);
+    double *upper = (double *)coffe_malloc(sizeof(double)*limit*dims);
+    double *value = (double *)coffe_malloc(sizeof(double)*limit*ncomp);
+    double *err = (double *)coffe_malloc(sizeof(double)*limit*ncomp);
+    double *priority = (double *)coffe_malloc(sizeof(double)*limit);
+    int *axis = (int *)coffe_malloc(sizeof(int)*limit);
+    size_t *heap = (size_t *)coffe_malloc(sizeof(size_t)*limit);
+    double *scale = (double *)coffe_malloc(sizeof(double)*ncomp);
+
+    for (int d = 0; d<dims; ++d) lower[d] = 0, upper[d] = 1;
+    for (int c = 0; c<ncomp; ++c) scale[c] = 1;
+    integrators_cubature_rule(
+        all, dims, ncomp, lower, upper, scale, value, err, &axis[0]
+    );
+    /* the priorities are relative to the first estimate of each component */
+    for (int c = 0; c<ncomp; ++c){
+        scale[c] = fabs(value[c]) > 0 ? fabs(value[c]) : (err[c] > 0 ? err[c] : 1);
+        result[c] = value[c], error[c] = err[c];
+    }
+    size_t len = 1;
+    heap[0] = 0, priority[0] = 0;
+
+    while (1){
+        if (integrators_converged(ncomp, epsrel, epsabs, result, error) || len == limit)
+            break;
+
+        /* replacing the worst region by its two halves */
+        const size_t worst = heap[0], other = len;
+        double *lower1 = &lower[worst*dims], *upper1 = &upper[worst*dims];
+        double *lower2 = &lower[other*dims], *upper2 = &upper[other*dims];
+        const int a = axis[worst];
+        for (int d = 0; d<dims; ++d)
+            lower2[d] = lower1[d], upper2[d] = upper1[d];
+        upper1[a] = lower2[a] = (lower1[a] + upper1[a])/2.;
+
+        for (int c = 0; c<ncomp; ++c){
+            result[c] -= value[worst*ncomp + c];
+            error[c] -= err[worst*ncomp + c];
+        }
+        const size_t regions[2] = {worst, other};
+        for (int n = 0; n<2; ++n){
+            const size_t r = regions[n];
+            integrators_cubature_rule(
+                all, dims, ncomp, &lower[r*dims], &upper[r*dims], scale,
+                &value[r*ncomp], &err[r*ncomp], &axis[r]
+            );
+            priority[r] = 0;
+            for (int c = 0; c<ncomp; ++c){
+                result[c] += value[r*ncomp + c];
+                error[c] += err[r*ncomp + c];
+                if (err[r*ncomp + c]/scale[c] > priority[r])
+                    priority[r] = err[r*ncomp + c]/scale[c];
+            }
+        }
+        integrators_heap_update(heap, len, priority, 0);
+        heap[len] = other;
+        ++len;
+        integrators_heap_update(heap, len, priority, len - 1);
+    }
+
+    /* summing again, without the rounding errors of the updates */
+    for (int c = 0; c<ncomp; ++c){
+        result[c] = 0, error[c] = 0;
+        for (size_t i = 0; i<len; ++i){
+            result[c] += value[i*ncomp + c];
+            error[c] += err[i*ncomp + c];
+        }
+    }
+
+    free(lower);
+    free(upper);
+    free(value);
+    free(err);
+    free(priority);
+    free(axis);
+    free(heap);
+    free(scale);
+    return EXIT_SUCCESS;
+}
+
+
+/**
+    randomized quasi-Monte Carlo integration of all of the components
+    at once: the same Sobol points are used for every randomization,
+    each with its own random digital shift (XOR of the binary digits
+    of the coordinates); the error is estimated from the spread of
+    the independent randomizations, and the number of points is doubled
+    until every component has a relative error below epsrel (or an
+    absolute one below epsabs), or until the next doubling would exceed
+    calls evaluations
+**/
+
+static int integrators_qmc(
+    struct integrators_params *all,
+    int dims,
+    int ncomp,
+    double epsrel,
+    double epsabs,
+    size_t calls,
+    gsl_rng *random,
+    double result[],
+    double error[]
+)
+{
+    const int scramblings = INTEGRATORS_QMC_SCRAMBLINGS;
+    /* GSL's Sobol points are multiples of 2^-30 */
+    const double resolution = 1073741824.;
+
+    gsl_qrng *sobol = gsl_qrng_alloc(gsl_qrng_sobol, dims);
+    unsigned long *shift =
+        (unsigned long *)coffe_malloc(sizeof(unsigned long)*scramblings*dims);
+    /* each batch has all of the randomizations of some of the points */
+    const size_t per_batch =
+        INTEGRATORS_NVEC > scramblings ? INTEGRATORS_NVEC/scramblings : 1;
+    double *u = (double *)coffe_malloc(sizeof(double)*dims);
+    double *x = (double *)coffe_malloc(sizeof(double)*per_batch*scramblings*dims);
+    double *value = (double *)coffe_malloc(sizeof(double)*per_batch*scramblings*ncomp);
+    double *sum = (double *)coffe_malloc(sizeof(double)*scramblings*ncomp);
+
+    for (int i = 0; i<scramblings*dims; ++i)
+        shift[i] = gsl_rng_uniform_int(random, (unsigned long)resolution);
+    for (int i = 0; i<scramblings*ncomp; ++i) sum[i] = 0;
+
+    size_t points = 0, target = INTEGRATORS_QMC_START;
+    if (target*scramblings > calls) target = calls/scramblings > 2 ? calls/scramblings : 2;
+
+    while (1){
+        while (points < target){
+            const size_t len = target - points < per_batch ? target - points : per_batch;
+            for (size_t j = 0; j<len; ++j, ++points){
+                /* GSL starts after the first point of the sequence (the origin),
+                without which the first 2^m points are not a net */
+                if (points == 0)
+                    for (int d = 0; d<dims; ++d) u[d] = 0;
+                else
+                    gsl_qrng_get(sobol, u);
+                for (int r = 0; r<scramblings; ++r){
+                    for (int d = 0; d<dims; ++d){
+                        const unsigned long digits = (unsigned long)(u[d]*resolution);
+                        /* the middle of the cell, so never exactly on the boundary */
+                        x[(j*scramblings + r)*dims + d] =
+                            ((digits ^ shift[r*dims + d]) + 0.5)/resolution;
+                    }
+                }
+            }
+            integrators_eval(all, len*scramblings, x, value);
+            for (size_t j = 0; j<len; ++j)
+                for (int r = 0; r<scramblings; ++r)
+                    for (int c = 0; c<ncomp; ++c)
+                        sum[r*ncomp + c] += value[(j*scramblings + r)*ncomp + c];
+        }
+
+        for (int c = 0; c<ncomp; ++c){
+            double mean = 0, variance = 0;
+            for (int r = 0; r<scramblings; ++r)
+                mean += sum[r*ncomp + c]/points/scramblings;
+            for (int r = 0; r<scramblings; ++r)
+                variance += pow(sum[r*ncomp + c]/points - mean, 2);
+            result[c] = mean;
+            error[c] = sqrt(variance/scramblings/(scramblings - 1));
+        }
+        if (
+            integrators_converged(ncomp, epsrel, epsabs, result, error) ||
+            2*target*scramblings > calls
+        ) break;
+        target *= 2;
+    }
+
+    gsl_qrng_free(sobol);
+    free(shift);
+    free(u);
+    free(x);
+    free(value);
+    free(sum);
+    return EXIT_SUCCESS;
+}
+
+int integrators_grid_init(
+    struct integrators_grid *grid,
+    int dims
+)
+{
+    grid->dims = dims;
+    grid->adapted = 0;
+    grid->edges = (double *)coffe_malloc(
+        sizeof(double)*dims*(INTEGRATORS_VEGAS_BINS + 1)
+    );
+    return EXIT_SUCCESS;
+}
+
+int integrators_grid_free(
+    struct integrators_grid *grid
+)
+{
+    free(grid->edges);
+    grid->edges = NULL;
+    grid->adapted = 0;
+    return EXIT_SUCCESS;
+}
+
+
+#ifdef HAVE_CUBA
+/**
+    the algorithms of CUBA (Cuhre, Vegas, Suave and Divonne, as
+    methods 5-8), with all of the components at once and nvec points
+    per call of the integrand; maxeval is the maximum number of
+    evaluations of the integrand
+**/
+
+static int integrators_cuba(
+    struct integrators_params *all,
+    int method,
+    int dims,
+    int ncomp,
+    double epsrel,
+    double epsabs,
+    int maxeval,
+    double result[],
+    double error[]
+)
+{
+    const int nvec = INTEGRATORS_NVEC;
+    int nregions, neval, fail;
+    double *prob = (double *)coffe_malloc(sizeof(double)*ncomp);
+
+    switch (method){
+        case 5:
+            Cuhre(dims, ncomp,
+                (integrand_t)integrators_cuba_integrand,
+                (void *)all, nvec,
+                epsrel, epsabs, 0,
+                1, maxeval, 7,
+                NULL, NULL,
+                &nregions, &neval, &fail, result, error, prob
+            );
+            break;
+        case 6:
+            Vegas(dims, ncomp,
+                (integrand_t)integrators_cuba_integrand,
+                (void *)all, nvec,
+                epsrel, epsabs, 0, 0,
+                1, maxeval, 1000, 500, 1000, 0,
+                NULL, NULL,
+                &neval, &fail, result, error, prob
+            );
+            break;
+        case 7:
+            Suave(dims, ncomp,
+                (integrand_t)integrators_cuba_integrand,
+                (void *)all, nvec,
+                epsrel, epsabs, 0, 0,
+                1, maxeval, 1000, 2, 25.,
+                NULL, NULL,
+                &nregions, &neval, &fail, result, error, prob
+            );
+            break;
+        default:
+            Divonne(dims, ncomp,
+                (integrand_t)integrators_cuba_integrand,
+                (void *)all, nvec,
+                epsrel, epsabs, 0, 0,
+                1, maxeval, 47, 1, 1, 5, 0., 10., 0.25,
+                0, dims, NULL, 0, NULL,
+                NULL, NULL,
+                &nregions, &neval, &fail, result, error, prob
+            );
+            break;
+    }
+    free(prob);
+    return EXIT_SUCCESS;
+}
+#endif
+
+
+/**
+    the integration method for the integrals of the terms in the
+    bitmask terms (all of the same kind)
+**/
+
+static int integrators_method(
+    const struct coffe_parameters_t *par,
+    uint64_t terms
+)
+{
+    if (terms & COFFE_TERMS_DOUBLE_INTEGRATED)
+        return par->integration_methods[2];
+    if (terms & COFFE_TERMS_SINGLE_INTEGRATED)
+        return par->integration_methods[1];
+    return par->integration_methods[0];
+}
+
+
+/**
+    the common part of integrators_monte and integrators_monte_batch
+**/
+
+static int integrators_monte_all(
+    struct coffe_parameters_t *par,
+    uint64_t terms,
+    struct integrators_params *all,
+    int dims,
+    int ncomp,
+    double epsrel,
+    double scale,
+    struct integrators_grid *grid,
+    double result[],
+    double error[]
+)
+{
+    const int method = integrators_method(par, terms);
+    if (grid != NULL && grid->dims != dims) grid = NULL;
+
+    const int targeted =
+        par->integration_target_relative > 0 ||
+        par->integration_target_absolute > 0;
+    double epsabs = 0;
+    if (targeted){
+        epsrel = par->integration_target_relative;
+        if (scale > 0) epsabs = par->integration_target_absolute/scale;
+    }
+
+    if (method == 3)
+        return integrators_cubature(
+            all, dims, ncomp, epsrel, epsabs, par->integration_bins, result, error
+        );
+
+#ifdef HAVE_CUBA
+    if (method >= 5)
+        return integrators_cuba(
+            all, method, dims, ncomp, epsrel, epsabs,
+            par->integration_bins, result, error
+        );
+#endif
+
+    gsl_rng_env_setup();
+    gsl_rng *random = gsl_rng_alloc(gsl_rng_default);
+
+    if (method == 4){
+        integrators_qmc(
+            all, dims, ncomp, epsrel, epsabs, par->integration_bins, random, result, error
+        );
+    }
+    else if (targeted){
+        integrators_increments(
+            all, method, dims, ncomp, epsrel, epsabs,
+            par->integration_bins, random, grid, result, error
+        );
+    }
+    /* all of the components with the same samples */
+    else if (
+        ((ncomp > 1 || all->batch != NULL) && method == 0) ||
+        ((ncomp > 1 || all->batch != NULL || grid != NULL) && method == 2)
+    ){
+        if (method == 0)
+            integrators_plain(
+                all, dims, ncomp, par->integration_bins, random, result, error
+            );
+        else
+            integrators_vegas(
+                all, dims, ncomp, par->integration_bins, random, grid, result, error
+            );
+    }
+    else{
+        gsl_monte_function function;
+        function.dim = dims;
+        function.params = all;
+        function.f = &integrators_monte_integrand;
+
+        double lower[dims];
+        double upper[dims];
+        for (int i = 0; i<dims; ++i){
+            lower[i] = 0.0;
+            upper[i] = 1.0;
+        }
+
+        for (int c = 0; c<ncomp; ++c){
+            all->component = ncomp == 1 ? -1 : c;
+
+            switch (method){
+                case 0:{
+                    gsl_monte_plain_state *state =
+                        gsl_monte_plain_alloc(dims);
+                    gsl_monte_plain_integrate(
+                        &function, lower, upper,
+                        dims, par->integration_bins, random,
+                        state,
+                        &result[c], &error[c]
+                    );
+                    gsl_monte_plain_free(state);
+                    break;
+                }
+                case 1:{
+                    gsl_monte_miser_state *state =
+                        gsl_monte_miser_alloc(dims);
+                    gsl_monte_miser_integrate(
+                        &function, lower, upper,
+                        dims, par->integration_bins, random,
+                        state,
+                        &result[c], &error[c]
+                    );
+                    gsl_monte_miser_free(state);
+                    break;
+                }
+                case 2:{
+                    gsl_monte_vegas_state *state =
+                        gsl_monte_vegas_alloc(dims);
+                    gsl_monte_vegas_integrate(
+                        &function, lower, upper,
+                        dims, par->integration_bins, random,
+                        state,
+                        &result[c], &error[c]
+                    );
+                    gsl_monte_vegas_free(state);
+                    break;
+                }
+                default:
+                    result[c] = 0, error[c] = 0;
+                    break;
+            }
+        }
+        all->component = -1;
+    }
+
+    gsl_rng_free(random);
+    return EXIT_SUCCESS;
+}
+
+
+/**
+    integrates integrand over the unit hypercube in dims dimensions,
+    with the method chosen for the terms in the bitmask terms:
+    the deterministic cubature (method 3), quasi-Monte Carlo
+    (method 4) and the algorithms of CUBA (methods 5-8) integrate all
+    of the components at once, and so do plain Monte Carlo and VEGAS
+    (with COFFE's own implementation, and the same samples for all of
+    the components), while MISER integrates one component at a time;
+    VEGAS starts from the grid in grid (if not NULL and already adapted),
+    and stores its grid there; in the error-targeted mode
+    (integration_target_relative or integration_target_absolute set),
+    epsrel is replaced by the relative target, the absolute target is
+    divided by scale (the factor with which the result enters the
+    output), and integration_sampling only caps the number of calls
+**/
+
+int integrators_monte(
+    struct coffe_parameters_t *par,
+    uint64_t terms,
+    integrators_function integrand,
+    void *params,
+    int dims,
+    int ncomp,
+    double epsrel,
+    double scale,
+    struct integrators_grid *grid,
+    double result[],
+    double error[]
+)
+{
+    struct integrators_params all;
+    all.integrand = integrand;
+    all.batch = NULL;
+    all.params = params;
+    all.dims = dims;
+    all.ncomp = ncomp;
+    all.component = -1;
+    all.threads = par->nthreads_inner > 1 ? par->nthreads_inner : 1;
+    return integrators_monte_all(
+        par, terms, &all, dims, ncomp, epsrel, scale, grid, result, error
+    );
+}
+
+
+/**
+    same as integrators_monte, but the integrand is evaluated on
+    batches of up to INTEGRATORS_NVEC points at once; only MISER
+    (which comes from GSL) passes the points one at a time
+**/
+
+int integrators_monte_batch(
+    struct coffe_parameters_t *par,
+    uint64_t terms,
+    integrators_batch integrand,
+    void *params,
+    int dims,
+    int ncomp,
+    double epsrel,
+    double scale,
+    struct integrators_grid *grid,
+    double result[],
+    double error[]
+)
+{
+    struct integrators_params all;
+    all.integrand = NULL;
+    all.batch = integrand;
+    all.params = params;
+    all.dims = dims;
+    all.ncomp = ncomp;
+    all.component = -1;
+    all.threads = par->nthreads_inner > 1 ? par->nthreads_inner : 1;
+    return integrators_monte_all(
+        par, terms, &all, dims, ncomp, epsrel, scale, grid, result, error
+    );
+}
+
+
+/**
+    sets up the integrators before a calculation; CUBA is run without
+    worker processes, since they can't be shared between the threads
+    calling it at the same time, and the batches of points it passes
+    to the integrand are instead evaluated by par->nthreads_inner threads
+    (nested inside the parallel loop over the points)
+**/
+
+int integrators_init(
+    struct coffe_parameters_t *par
+)
+{
+#ifdef HAVE_CUBA
+    cubacores(0, 10000);
+#endif
+#ifdef _OPENMP
+    omp_set_max_active_levels(2);
+#endif
+    return EXIT_SUCCESS;
+}
+
+
+/**
+    Gauss-Legendre estimate of the integral over [a, b]
+**/
+
+static void integrators_gauss(
+    integrators_function1d integrand,
+    void *params,
+    const gsl_integration_glfixed_table *table,
+    double a,
+    double b,
+    int ncomp,
+    double result[],
+    double temp[]
+)
+{
+    for (int c = 0; c<ncomp; ++c) result[c] = 0;
+    for (size_t i = 0; i<table->n; ++i){
+        double x, w;
+        gsl_integration_glfixed_point(a, b, i, &x, &w, table);
+        integrand(x, temp, params);
+        for (int c = 0; c<ncomp; ++c) result[c] += w*temp[c];
+    }
+}
+
+
+/**
+    adaptive integration of all the components of integrand at once,
+    bisecting the interval with the largest error (relative to the first
+    estimate of the integral of the same component) until every component
+    has a relative error below epsrel, or an absolute one below
+    INTEGRATORS_QAG_ABSOLUTE*epsrel times the largest component, so that
+    components which are close to zero can converge too; the error of an
+    interval is estimated from the difference between the rule on it and
+    on its two halves
+**/
+
+int integrators_qag(
+    integrators_function1d integrand,
+    void *params,
+    double a,
+    double b,
+    int ncomp,
+    double epsrel,
+    double result[],
+    double error[]
+)
+{
+    const size_t limit = INTEGRATORS_QAG_LIMIT;
+    gsl_integration_glfixed_table *table =
+        gsl_integration_glfixed_table_alloc(INTEGRATORS_QAG_ORDER);
+
+    double *lower = (double *)coffe_malloc(sizeof(double)*limit);
+    double *upper = (double *)coffe_malloc(sizeof(double)*limit);
+    double *value = (double *)coffe_malloc(sizeof(double)*limit*ncomp);
+    double *err = (double *)coffe_malloc(sizeof(double)*limit*ncomp);
+    double *priority = (double *)coffe_malloc(sizeof(double)*limit);
+    size_t *heap = (size_t *)coffe_malloc(sizeof(size_t)*limit);
+    double *whole = (double *)coffe_malloc(sizeof(double)*3*ncomp);
+    double *temp = whole + ncomp, *scale = whole + 2*ncomp;
+
+    integrators_gauss(integrand, params, table, a, b, ncomp, value, temp);
+    lower[0] = a, upper[0] = b;
+    /* the priorities are relative to the first estimate of each component */
+    double largest = 0;
+    for (int c = 0; c<ncomp; ++c){
+        largest = fmax(largest, fabs(value[c]));
+        result[c] = value[c], error[c] = 0;
+        err[c] = 0;
+    }
+    for (int c = 0; c<ncomp; ++c){
+        scale[c] = fmax(fabs(value[c]), INTEGRATORS_QAG_ABSOLUTE*largest);
+        if (scale[c] == 0) scale[c] = 1;
+    }
+    size_t len = 1;
+    heap[0] = 0, priority[0] = 0;
+
+    while (1){
+        /* replacing the worst interval by its two halves */
+        const size_t worst = heap[0], other = len;
+        const double left = lower[worst], right = upper[worst];
+        const double middle = (left + right)/2.;
+        double *value1 = &value[worst*ncomp], *value2 = &value[other*ncomp];
+        for (int c = 0; c<ncomp; ++c){
+            whole[c] = value1[c];
+            result[c] -= value1[c];
+            error[c] -= err[worst*ncomp + c];
+        }
+        integrators_gauss(integrand, params, table, left, middle, ncomp, value1, temp);
+        integrators_gauss(integrand, params, table, middle, right, ncomp, value2, temp);
+        priority[worst] = 0;
+        for (int c = 0; c<ncomp; ++c){
+            const double difference = fabs(whole[c] - value1[c] - value2[c])/2.;
+            err[worst*ncomp + c] = difference;
+            err[other*ncomp + c] = difference;
+            result[c] += value1[c] + value2[c];
+            error[c] += 2*difference;
+            if (difference/scale[c] > priority[worst])
+                priority[worst] = difference/scale[c];
+        }
+        priority[other] = priority[worst];
+        upper[worst] = middle;
+        lower[other] = middle, upper[other] = right;
+        integrators_heap_update(heap, len, priority, 0);
+        heap[len] = other;
+        ++len;
+        integrators_heap_update(heap, len, priority, len - 1);
+
+        largest = 0;
+        for (int c = 0; c<ncomp; ++c)
+            largest = fmax(largest, fabs(result[c]));
+        if (
+            integrators_converged(
+                ncomp, epsrel, INTEGRATORS_QAG_ABSOLUTE*epsrel*largest, result, error
+            ) || len == limit
+        )
+            break;
+    }
+
+    /* summing again, without the rounding errors of the updates */
+    for (int c = 0; c<ncomp; ++c){
+        result[c] = 0, error[c] = 0;
+        for (size_t i = 0; i<len; ++i){
+            result[c] += value[i*ncomp + c];
+            error[c] += err[i*ncomp + c];
+        }
+    }
+
+    free(lower);
+    free(upper);
+    free(value);
+    free(err);
+    free(priority);
+    free(heap);
+    free(whole);
+    gsl_integration_glfixed_table_free(table);
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,165 @@
+/*
+ * This file is part of COFFE
+ * Copyright (C) 2018 Goran Jelic-Cizmek
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef COFFE_INTEGRATORS_H
+#define COFFE_INTEGRATORS_H
+
+#ifndef INTEGRATORS_QAG_ORDER
+#define INTEGRATORS_QAG_ORDER 15 /* Gauss-Legendre points per interval */
+#endif
+
+#ifndef INTEGRATORS_QAG_LIMIT
+#define INTEGRATORS_QAG_LIMIT 1000 /* max number of intervals */
+#endif
+
+#ifndef INTEGRATORS_QAG_ABSOLUTE
+#define INTEGRATORS_QAG_ABSOLUTE 1E-3 /* absolute tolerance, in units of epsrel times the largest component */
+#endif
+
+#ifndef INTEGRATORS_VEGAS_BINS
+#define INTEGRATORS_VEGAS_BINS 50 /* bins of the grid per dimension */
+#endif
+
+#ifndef INTEGRATORS_VEGAS_ITERATIONS
+#define INTEGRATORS_VEGAS_ITERATIONS 5 /* the calls are split among these */
+#endif
+
+#ifndef INTEGRATORS_VEGAS_ALPHA
+#define INTEGRATORS_VEGAS_ALPHA 1.5 /* stiffness of the grid refinement */
+#endif
+
+#ifndef INTEGRATORS_QMC_SCRAMBLINGS
+#define INTEGRATORS_QMC_SCRAMBLINGS 8 /* independent randomizations of the Sobol sequence */
+#endif
+
+#ifndef INTEGRATORS_QMC_START
+#define INTEGRATORS_QMC_START 1024 /* initial number of points of each randomization */
+#endif
+
+#ifndef INTEGRATORS_NVEC
+#define INTEGRATORS_NVEC 256 /* max number of points evaluated at once (split among the inner threads) */
+#endif
+
+#ifndef INTEGRATORS_TARGET_START
+#define INTEGRATORS_TARGET_START 8192 /* calls of the first increment in the error-targeted mode */
+#endif
+
+/**
+    integrand over the unit hypercube with ncomp components;
+    if component is negative, all of them go into value,
+    otherwise only the given one, into value[0]
+**/
+
+typedef int (*integrators_function)(
+    const double var[],
+    int component,
+    double value[],
+    void *params
+);
+
+/**
+    integrand over the unit hypercube with ncomp components,
+    evaluated on n points at once, var[i*dims + d] for the i-th;
+    if component is negative, all of them go into value[i*ncomp + c],
+    otherwise only the given one, into value[i]
+**/
+
+typedef int (*integrators_batch)(
+    const double var[],
+    size_t n,
+    int component,
+    double value[],
+    void *params
+);
+
+/**
+    integrand over an interval with ncomp components
+**/
+
+typedef int (*integrators_function1d)(
+    double x,
+    double value[],
+    void *params
+);
+
+/**
+    the grid of VEGAS, kept between integrations of similar
+    integrands (such as at neighbouring separations) so that
+    it only needs to be adapted once
+**/
+
+struct integrators_grid
+{
+    int dims;
+    int adapted; /* whether edges already contains an adapted grid */
+    double *edges; /* dims*(INTEGRATORS_VEGAS_BINS + 1) edges of the bins */
+};
+
+int integrators_grid_init(
+    struct integrators_grid *grid,
+    int dims
+);
+
+int integrators_grid_free(
+    struct integrators_grid *grid
+);
+
+int integrators_init(
+    struct coffe_parameters_t *par
+);
+
+int integrators_monte(
+    struct coffe_parameters_t *par,
+    uint64_t terms,
+    integrators_function integrand,
+    void *params,
+    int dims,
+    int ncomp,
+    double epsrel,
+    double scale,
+    struct integrators_grid *grid,
+    double result[],
+    double error[]
+);
+
+int integrators_monte_batch(
+    struct coffe_parameters_t *par,
+    uint64_t terms,
+    integrators_batch integrand,
+    void *params,
+    int dims,
+    int ncomp,
+    double epsrel,
+    double scale,
+    struct integrators_grid *grid,
+    double result[],
+    double error[]
+);
+
+int integrators_qag(
+    integrators_function1d integrand,
+    void *params,
+    double a,
+    double b,
+    int ncomp,
+    double epsrel,
+    double result[],
+    double error[]
+);
+
+#endif
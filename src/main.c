@@ -34,6 +34,7 @@
 #include "corrfunc.h"
 #include "multipoles.h"
 #include "average_multipoles.h"
+#include "tracers.h"
 #include "output.h"
 
 
@@ -45,10 +46,11 @@ int main(int argc, char *argv[])
     struct coffe_corrfunc_ang_t cf_ang;
     struct coffe_corrfunc_t cf;
     struct coffe_multipoles_t mp;
-    struct coffe_average_multipoles_t ramp;
+    struct coffe_average_multipoles_t *ramp;
     struct coffe_covariance_t cov_mp;
     struct coffe_covariance_t cov_ramp;
     struct coffe_corrfunc2d_t cf2d;
+    struct coffe_tracers_t tracers;
 
     char settings_file[COFFE_MAX_STRLEN];
 
@@ -114,6 +116,7 @@ int main(int argc, char *argv[])
         exit(EXIT_FAILURE);
     }
     par.nthreads = n;
+    par.nthreads_inner = 1;
     printf("Number of threads in use: %d\n", par.nthreads);
 
     /* the main sequence */
@@ -124,44 +127,171 @@ int main(int argc, char *argv[])
 
     coffe_integrals_init(&par, &bg, integral);
 
-    coffe_corrfunc_init(&par, &bg, integral, &cf_ang, &cf, &cf2d);
+    /* the redshift averaged multipoles of each of the redshift bins */
+    ramp = (struct coffe_average_multipoles_t *)coffe_malloc(
+        sizeof(struct coffe_average_multipoles_t)*par.z_bins_len
+    );
+
+    coffe_tracers_init(&par, &tracers);
+
+    if (tracers.flag){
+        /* the outputs of each of the redshift bins, kept between the pairs of probe populations */
+        struct coffe_corrfunc_ang_t *bin_cf_ang = (struct coffe_corrfunc_ang_t *)coffe_malloc(
+            sizeof(struct coffe_corrfunc_ang_t)*par.z_bins_len
+        );
+        struct coffe_corrfunc_t *bin_cf = (struct coffe_corrfunc_t *)coffe_malloc(
+            sizeof(struct coffe_corrfunc_t)*par.z_bins_len
+        );
+        struct coffe_corrfunc2d_t *bin_cf2d = (struct coffe_corrfunc2d_t *)coffe_malloc(
+            sizeof(struct coffe_corrfunc2d_t)*par.z_bins_len
+        );
+        struct coffe_multipoles_t *bin_mp = (struct coffe_multipoles_t *)coffe_malloc(
+            sizeof(struct coffe_multipoles_t)*par.z_bins_len
+        );
+        memset(bin_cf_ang, 0, sizeof(struct coffe_corrfunc_ang_t)*par.z_bins_len);
+        memset(bin_cf, 0, sizeof(struct coffe_corrfunc_t)*par.z_bins_len);
+        memset(bin_cf2d, 0, sizeof(struct coffe_corrfunc2d_t)*par.z_bins_len);
+        memset(bin_mp, 0, sizeof(struct coffe_multipoles_t)*par.z_bins_len);
+        memset(ramp, 0, sizeof(struct coffe_average_multipoles_t)*par.z_bins_len);
+
+        /* the only runs, one for each pair of probe populations */
+        const int probe_pairs_len = tracers.probes_len*tracers.probes_len;
+        for (int pair = 0; pair<probe_pairs_len; ++pair){
+            coffe_tracers_probe(&par, &bg, &tracers, pair);
+            printf("Probe populations %d and %d\n",
+                pair / tracers.probes_len + 1, pair % tracers.probes_len + 1);
+
+            for (int bin = 0; bin<par.z_bins_len; ++bin)
+                coffe_average_multipoles_free(&ramp[bin]);
+            coffe_average_multipoles_init(&par, &bg, integral, ramp);
 
-    coffe_multipoles_init(&par, &bg, integral, &mp);
+            for (int bin = 0; bin<par.z_bins_len; ++bin){
+                coffe_redshift_bin(&par, bin);
+                if (par.z_bins_len > 1)
+                    printf("Redshift bin %d of %d\n", bin + 1, par.z_bins_len);
+
+                coffe_corrfunc_ang_free(&bin_cf_ang[bin]);
+                coffe_corrfunc_free(&bin_cf[bin]);
+                coffe_corrfunc2d_free(&bin_cf2d[bin]);
+                coffe_multipoles_free(&bin_mp[bin]);
+
+                coffe_corrfunc_init(&par, &bg, integral, &bin_cf_ang[bin], &bin_cf[bin], &bin_cf2d[bin]);
+
+                coffe_multipoles_init(&par, &bg, integral, &bin_mp[bin]);
+
+                coffe_tracers_store(
+                    &par, &tracers, pair,
+                    &bin_cf_ang[bin], &bin_cf[bin], &bin_cf2d[bin],
+                    &bin_mp[bin], &ramp[bin]
+                );
+            }
+        }
 
-    coffe_average_multipoles_init(&par, &bg, integral, &ramp);
+        /* the outputs of the last pair of probe populations are overwritten with the ones of each pair */
+        for (int pair = 0; pair<par.tracer_pairs_len; ++pair){
+            coffe_tracer_pair(&par, pair);
+            coffe_background_tracers(&par, &bg);
+            printf("Populations %d and %d\n", par.tracer_pairs[2*pair] + 1, par.tracer_pairs[2*pair + 1] + 1);
 
-    coffe_covariance_init(&par, &bg, &cov_mp, &cov_ramp);
+            for (int bin = 0; bin<par.z_bins_len; ++bin){
+                coffe_redshift_bin(&par, bin);
 
-    coffe_output_init(
-        &par, &bg,
+                coffe_tracers_combine(
+                    &par, &tracers,
+                    &bin_cf_ang[bin], &bin_cf[bin], &bin_cf2d[bin],
+                    &bin_mp[bin], &ramp[bin]
+                );
+
+                coffe_covariance_init(&par, &bg, &cov_mp, &cov_ramp);
+
+                coffe_output_init(
+                    &par, &bg,
 #ifdef HAVE_INTEGRALS
-        integral,
+                    integral,
 #endif
-        &cf_ang, &cf,
-        &mp, &ramp,
-        &cov_mp, &cov_ramp,
-        &cf2d
-    );
+                    &bin_cf_ang[bin], &bin_cf[bin],
+                    &bin_mp[bin], &ramp[bin],
+                    &cov_mp, &cov_ramp,
+                    &bin_cf2d[bin]
+                );
 
-    /* freeing the memory */
+                coffe_covariance_free(&cov_mp);
 
-    coffe_background_free(&bg);
+                coffe_covariance_free(&cov_ramp);
+            }
+        }
 
-    coffe_integrals_free(integral);
+        for (int bin = 0; bin<par.z_bins_len; ++bin){
+            coffe_corrfunc_ang_free(&bin_cf_ang[bin]);
+            coffe_corrfunc_free(&bin_cf[bin]);
+            coffe_corrfunc2d_free(&bin_cf2d[bin]);
+            coffe_multipoles_free(&bin_mp[bin]);
+            coffe_average_multipoles_free(&ramp[bin]);
+        }
+        free(bin_cf_ang);
+        free(bin_cf);
+        free(bin_cf2d);
+        free(bin_mp);
+    }
+    else{
+        /* the background and the integrals are shared by all of the redshift bins and pairs of populations */
+        for (int pair = 0; pair<par.tracer_pairs_len; ++pair){
+            coffe_tracer_pair(&par, pair);
+            coffe_background_tracers(&par, &bg);
+            if (par.tracer_pairs_len > 1)
+                printf("Populations %d and %d\n", par.tracer_pairs[2*pair] + 1, par.tracer_pairs[2*pair + 1] + 1);
+
+            /* all of the windows at once */
+            coffe_average_multipoles_init(&par, &bg, integral, ramp);
+
+            for (int bin = 0; bin<par.z_bins_len; ++bin){
+                coffe_redshift_bin(&par, bin);
+                if (par.z_bins_len > 1)
+                    printf("Redshift bin %d of %d\n", bin + 1, par.z_bins_len);
+
+                coffe_corrfunc_init(&par, &bg, integral, &cf_ang, &cf, &cf2d);
+
+                coffe_multipoles_init(&par, &bg, integral, &mp);
+
+                coffe_covariance_init(&par, &bg, &cov_mp, &cov_ramp);
+
+                coffe_output_init(
+                    &par, &bg,
+#ifdef HAVE_INTEGRALS
+                    integral,
+#endif
+                    &cf_ang, &cf,
+                    &mp, &ramp[bin],
+                    &cov_mp, &cov_ramp,
+                    &cf2d
+                );
+
+                coffe_corrfunc_ang_free(&cf_ang);
 
-    coffe_corrfunc_ang_free(&cf_ang);
+                coffe_corrfunc_free(&cf);
 
-    coffe_corrfunc_free(&cf);
+                coffe_corrfunc2d_free(&cf2d);
 
-    coffe_corrfunc2d_free(&cf2d);
+                coffe_multipoles_free(&mp);
 
-    coffe_multipoles_free(&mp);
+                coffe_average_multipoles_free(&ramp[bin]);
 
-    coffe_average_multipoles_free(&ramp);
+                coffe_covariance_free(&cov_mp);
+
+                coffe_covariance_free(&cov_ramp);
+            }
+        }
+    }
+
+    /* freeing the memory */
+
+    coffe_background_free(&bg);
+
+    coffe_integrals_free(integral);
 
-    coffe_covariance_free(&cov_mp);
+    coffe_tracers_free(&tracers);
 
-    coffe_covariance_free(&cov_ramp);
+    free(ramp);
 
     end = clock();
     printf("Total program runtime is: %.2f s\n",
@@ -17,21 +17,13 @@
 */
 
 #include <stdio.h>
+#include <math.h>
 #include <string.h>
 #include <time.h>
 #include <gsl/gsl_integration.h>
 #include <gsl/gsl_sf_legendre.h>
 #include <gsl/gsl_errno.h>
 
-#ifdef HAVE_CUBA
-#include "cuba.h"
-#else
-#include <gsl/gsl_monte_plain.h>
-#include <gsl/gsl_monte.h>
-#include <gsl/gsl_monte_miser.h>
-#include <gsl/gsl_monte_vegas.h>
-#endif
-
 #ifdef _OPENMP
 #include <omp.h>
 #endif
@@ -41,7 +33,12 @@
 #include "integrals.h"
 #include "multipoles.h"
 #include "functions.h"
+#include "integrators.h"
+
 
+#ifndef MULTIPOLES_MU_ORDER_MAX
+#define MULTIPOLES_MU_ORDER_MAX 1024 /* max number of nodes of the quadrature in mu */
+#endif
 
 struct multipoles_params
 {
@@ -49,7 +46,12 @@ struct multipoles_params
     struct coffe_parameters_t *par;
     struct coffe_integrals_t *integral;
     double sep;
-    int l;
+    const int *l; /* all of the multipoles are integrated at once */
+    size_t l_len;
+    int l_max;
+    struct functions_los_nodes *los;
+    const struct functions_float_tables *tables; /* NULL for double precision */
+    const struct functions_contributions *contributions; /* NULL for just the sum */
 };
 
 static int multipoles_check_range(
@@ -112,84 +114,365 @@ static int multipoles_check_range(
 }
 
 
+/**
+    the component of the integrands belonging to the multipole
+    with index i and (if computing the separate terms) the term
+    with index t is i*(number of terms) + t
+**/
+
+static int multipoles_ncomp(
+    const struct multipoles_params *params
+)
+{
+    const struct functions_contributions *c = params->contributions;
+    return (int)params->l_len*(c != NULL ? c->len : 1);
+}
+
+/**
+    the largest factor with which the integrals enter the
+    multipoles, (2l + 1)/D1(0)^2, for the absolute error target
+**/
+
+static double multipoles_scale(
+    const struct multipoles_params *params
+)
+{
+    int l_max = 0;
+    for (size_t i = 0; i<params->l_len; ++i)
+        if (params->l[i] > l_max) l_max = params->l[i];
+    const double D1_0 = interp_spline(&params->bg->D1, 0);
+    return (2*l_max + 1)/D1_0/D1_0;
+}
+
+/**
+    the integrals are over mu in [mu_min, 1], mapped to x in [0, 1];
+    for auto-correlations the integrands are even in mu, so only
+    half of the interval is needed
+**/
+
+static double multipoles_mu_min(
+    const struct coffe_parameters_t *par
+)
+{
+    return par->autocorrelation ? 0. : -1.;
+}
+
+static double multipoles_mu(
+    const struct coffe_parameters_t *par,
+    double x
+)
+{
+    const double mu_min = multipoles_mu_min(par);
+    return mu_min + (1 - mu_min)*x;
+}
+
+/**
+    the index of the multipole of the component, and the terms
+    to evaluate for it
+**/
+
+static size_t multipoles_component(
+    const struct multipoles_params *params,
+    int component,
+    uint64_t *terms
+)
+{
+    const struct functions_contributions *c = params->contributions;
+    if (c == NULL){
+        *terms = params->par->terms;
+        return (size_t)component;
+    }
+    *terms = UINT64_C(1) << c->index[component % c->len];
+    return (size_t)(component/c->len);
+}
+
+/**
+    fills all of the components of value from the sum of the
+    terms (total), or from the separate terms (all), with all
+    of the Legendre polynomials from a single recurrence
+**/
+
+static int multipoles_fill(
+    const struct multipoles_params *params,
+    double mu,
+    double total,
+    const double all[],
+    double value[]
+)
+{
+    const struct functions_contributions *c = params->contributions;
+    double legendre[params->l_max + 1];
+    gsl_sf_legendre_Pl_array(params->l_max, mu, legendre);
+
+    for (size_t i = 0; i<params->l_len; ++i){
+        const double p = legendre[params->l[i]];
+        if (c == NULL){
+            value[i] = total*p;
+        }
+        else{
+            for (int t = 0; t<c->len; ++t)
+                value[i*c->len + t] = all[c->index[t]]*p;
+        }
+    }
+    return EXIT_SUCCESS;
+}
+
+/**
+    from the integrals of the components (over mu in [mu_min, 1]
+    mapped to [0, 1]) and their errors to the multipoles, their errors,
+    and (optionally) the separate terms; the terms share the samples,
+    so their errors are added linearly
+**/
+
+static int multipoles_store(
+    const struct multipoles_params *params,
+    const uint64_t terms,
+    const double integral[],
+    const double error[],
+    double result[],
+    double errors[],
+    double values[]
+)
+{
+    struct coffe_parameters_t *par = params->par;
+    struct coffe_background_t *bg = params->bg;
+    const struct functions_contributions *c = params->contributions;
+    const double D1_0 = interp_spline(&bg->D1, 0);
+
+    for (size_t i = 0; i<params->l_len; ++i){
+        const double factor = (2*params->l[i] + 1)/D1_0/D1_0;
+        if (c == NULL){
+            result[i] = factor*integral[i];
+            errors[i] = factor*error[i];
+        }
+        else{
+            double all[COFFE_TERMS_LEN];
+            result[i] = 0;
+            errors[i] = 0;
+            for (int t = 0; t<c->len; ++t){
+                all[c->index[t]] = integral[i*c->len + t];
+                result[i] += factor*all[c->index[t]];
+                errors[i] += factor*error[i*c->len + t];
+            }
+            functions_contributions_scatter(
+                par, terms, all, factor,
+                values + i*par->corr_terms_len
+            );
+        }
+    }
+    return EXIT_SUCCESS;
+}
+
+
 /**
     calculates all the nonintegrated terms
 **/
 
-static double multipoles_nonintegrated_integrand(
+static int multipoles_nonintegrated_integrand(
     double x,
+    double value[],
     void *p
 )
 {
-    struct multipoles_params *all_params =
-        (struct multipoles_params *) p;
-    struct coffe_parameters_t *par = all_params->par;
-    struct coffe_background_t *bg = all_params->bg;
-    struct coffe_integrals_t *integral = all_params->integral;
-    double sep = all_params->sep;
-    int l = all_params->l;
-
-    double mu = 2*x - 1;
-    if (l == 0){
-        return functions_nonintegrated(
-            par, bg, integral,
-            par->z_mean, mu, sep
+    struct multipoles_params *params = (struct multipoles_params *) p;
+    struct coffe_parameters_t *par = params->par;
+    double mu = multipoles_mu(par, x);
+
+    if (params->contributions == NULL){
+        multipoles_fill(
+            params, mu,
+            functions_nonintegrated(
+                par, params->bg, params->integral,
+                par->z_mean, mu, params->sep
+            ),
+            NULL, value
         );
     }
     else{
-        return functions_nonintegrated(
-            par, bg, integral,
-            par->z_mean, mu, sep
-            )
-           *gsl_sf_legendre_Pl(l, mu);
+        double all[COFFE_TERMS_LEN];
+        functions_nonintegrated_terms(
+            par, params->bg, params->integral,
+            par->z_mean, mu, params->sep, par->terms, all
+        );
+        multipoles_fill(params, mu, 0, all, value);
+    }
+    return EXIT_SUCCESS;
+}
+
+/**
+    sets up the integration of all of the multipoles
+    (and all of the terms of the class terms if values is not NULL)
+**/
+
+static int multipoles_params_init(
+    struct multipoles_params *params,
+    struct coffe_parameters_t *par,
+    struct coffe_background_t *bg,
+    struct coffe_integrals_t *integral,
+    double sep,
+    size_t l_len,
+    const int l[],
+    const uint64_t terms,
+    struct functions_contributions *c,
+    double values[]
+)
+{
+    params->par = par;
+    params->bg = bg;
+    params->integral = integral;
+    params->sep = sep;
+    params->l = l;
+    params->l_len = l_len;
+    params->l_max = 0;
+    for (size_t i = 0; i<l_len; ++i)
+        if (l[i] > params->l_max) params->l_max = l[i];
+    params->los = NULL;
+    params->tables = NULL;
+    params->contributions = NULL;
+    if (values != NULL){
+        functions_contributions_init(par->terms & terms, c);
+        params->contributions = c;
     }
+    return EXIT_SUCCESS;
+}
+
+/**
+    fixed Gauss-Legendre quadrature in mu for the nonintegrated
+    terms: the terms are evaluated once per separation on the
+    nodes, and projected onto all of the multipoles with the
+    (nodes x multipoles) matrix of weights times P_l(mu)
+**/
+
+struct multipoles_projection
+{
+    size_t order;
+    double *mu; /* the nodes in [mu_min, 1] */
+    double *matrix; /* index = node*l_len + multipole */
+};
+
+static int multipoles_projection_init(
+    struct multipoles_projection *projection,
+    double mu_min,
+    size_t order,
+    size_t l_len,
+    const int l[]
+)
+{
+    int l_max = 0;
+    for (size_t i = 0; i<l_len; ++i)
+        if (l[i] > l_max) l_max = l[i];
+    double legendre[l_max + 1];
+
+    gsl_integration_glfixed_table *table =
+        gsl_integration_glfixed_table_alloc(order);
+    projection->order = order;
+    projection->mu = (double *)coffe_malloc(sizeof(double)*order);
+    projection->matrix = (double *)coffe_malloc(sizeof(double)*order*l_len);
+    for (size_t k = 0; k<order; ++k){
+        double weight;
+        gsl_integration_glfixed_point(mu_min, 1, k, &projection->mu[k], &weight, table);
+        gsl_sf_legendre_Pl_array(l_max, projection->mu[k], legendre);
+        /* the integrals are over x = (mu - mu_min)/(1 - mu_min) */
+        for (size_t i = 0; i<l_len; ++i)
+            projection->matrix[k*l_len + i] = weight/(1 - mu_min)*legendre[l[i]];
+    }
+    gsl_integration_glfixed_table_free(table);
+    return EXIT_SUCCESS;
+}
+
+static int multipoles_projection_free(
+    struct multipoles_projection *projection
+)
+{
+    free(projection->mu);
+    free(projection->matrix);
+    return EXIT_SUCCESS;
 }
 
-static double multipoles_nonintegrated(
+static int multipoles_projection_apply(
+    const struct multipoles_projection *projection,
+    struct multipoles_params *params,
+    double integral_value[]
+)
+{
+    struct coffe_parameters_t *par = params->par;
+    const struct functions_contributions *c = params->contributions;
+    const size_t l_len = params->l_len;
+    const int ncomp = multipoles_ncomp(params);
+    for (int i = 0; i<ncomp; ++i) integral_value[i] = 0;
+
+    for (size_t k = 0; k<projection->order; ++k){
+        const double mu = projection->mu[k];
+        const double *row = &projection->matrix[k*l_len];
+        if (c == NULL){
+            const double value = functions_nonintegrated(
+                par, params->bg, params->integral,
+                par->z_mean, mu, params->sep
+            );
+            for (size_t i = 0; i<l_len; ++i)
+                integral_value[i] += row[i]*value;
+        }
+        else{
+            double all[COFFE_TERMS_LEN];
+            functions_nonintegrated_terms(
+                par, params->bg, params->integral,
+                par->z_mean, mu, params->sep, par->terms, all
+            );
+            for (size_t i = 0; i<l_len; ++i)
+                for (int t = 0; t<c->len; ++t)
+                    integral_value[i*c->len + t] += row[i]*all[c->index[t]];
+        }
+    }
+    return EXIT_SUCCESS;
+}
+
+static int multipoles_nonintegrated(
     struct coffe_parameters_t *par,
     struct coffe_background_t *bg,
     struct coffe_integrals_t *integral,
+    const struct multipoles_projection *projection,
     double sep,
-    int l
+    size_t l_len,
+    const int l[],
+    double result[],
+    double errors[],
+    double values[]
 )
 {
+    for (size_t i = 0; i<l_len; ++i) result[i] = 0, errors[i] = 0;
+    if (!(par->terms & COFFE_TERMS_NONINTEGRATED)) return EXIT_SUCCESS;
+
     struct multipoles_params test;
-    test.par = par;
-    test.bg = bg;
-    test.integral = integral;
-    test.l = l;
-    test.sep = sep;
-
-    double result, error, prec = 1E-5;
-
-    gsl_function integrand;
-    integrand.function = &multipoles_nonintegrated_integrand;
-    integrand.params = &test;
-
-    gsl_integration_workspace *wspace =
-        gsl_integration_workspace_alloc(COFFE_MAX_INTSPACE);
-    gsl_integration_qag(
-        &integrand, 0., 1., 0,
-        prec, COFFE_MAX_INTSPACE,
-        GSL_INTEG_GAUSS61, wspace,
-        &result, &error
+    struct functions_contributions c;
+    multipoles_params_init(
+        &test, par, bg, integral, sep, l_len, l,
+        COFFE_TERMS_NONINTEGRATED, &c, values
+    );
+
+    const int ncomp = multipoles_ncomp(&test);
+    double integral_value[ncomp], error[ncomp], prec = 1E-5;
+    if (projection != NULL){
+        multipoles_projection_apply(projection, &test, integral_value);
+        for (int i = 0; i<ncomp; ++i) error[i] = 0;
+    }
+    else
+        integrators_qag(
+            &multipoles_nonintegrated_integrand, &test,
+            0., 1., ncomp, prec, integral_value, error
+        );
+    multipoles_store(
+        &test, par->terms & COFFE_TERMS_NONINTEGRATED,
+        integral_value, error, result, errors, values
     );
-    gsl_integration_workspace_free(wspace);
-    return (2*l + 1)*result
-        /interp_spline(&bg->D1, 0)/interp_spline(&bg->D1, 0);
+    return EXIT_SUCCESS;
 }
 
-#ifdef HAVE_CUBA
 static int multipoles_single_integrated_integrand(
-    const int *ndim, const cubareal var[],
-    const int *ncomp, cubareal value[],
+    const double var[],
+    int component,
+    double value[],
     void *p
 )
-#else
-static double multipoles_single_integrated_integrand(
-    double *var, size_t dim, void *p
-)
-#endif
 {
     struct multipoles_params *params = (struct multipoles_params *) p;
     struct coffe_parameters_t *par = params->par;
@@ -197,193 +480,140 @@ static double multipoles_single_integrated_integrand(
     struct coffe_integrals_t *integral = params->integral;
     double sep = params->sep;
 
-    double mu = 2*var[0] - 1, x = var[1];
-#ifdef HAVE_CUBA
-    if (params->l == 0){
-        value[0] = functions_single_integrated(
-            par, bg, integral, par->z_mean, mu, sep, x
+    double mu = multipoles_mu(par, var[0]), x;
+    const double jacobian =
+        functions_los_transform(par->integration_transforms[0], var[1], &x);
+
+    if (component >= 0){
+        uint64_t terms;
+        const size_t i = multipoles_component(params, component, &terms);
+        value[0] = (
+            params->contributions == NULL ?
+            functions_single_integrated(
+                par, bg, integral, par->z_mean, mu, sep, x
+            ) :
+            functions_single_integrated_terms(
+                par, bg, integral, par->z_mean, mu, sep, x, terms, NULL
+            )
+        )*gsl_sf_legendre_Pl(params->l[i], mu);
+    }
+    else if (params->contributions == NULL){
+        multipoles_fill(
+            params, mu,
+            functions_single_integrated(
+                par, bg, integral, par->z_mean, mu, sep, x
+            ),
+            NULL, value
         );
-        return EXIT_SUCCESS;
     }
     else{
-        value[0] = functions_single_integrated(
-            par, bg, integral, par->z_mean, mu, sep, x
-        )
-       *gsl_sf_legendre_Pl(params->l, mu);
-        return EXIT_SUCCESS;
-    }
-#else
-    if (params->l == 0){
-        return functions_single_integrated(
-            par, bg, integral, par->z_mean, mu, sep, x
+        double all[COFFE_TERMS_LEN];
+        functions_single_integrated_terms(
+            par, bg, integral, par->z_mean, mu, sep, x, par->terms, all
+        );
+        multipoles_fill(params, mu, 0, all, value);
+    }
+    for (int n = 0; n<(component >= 0 ? 1 : multipoles_ncomp(params)); ++n)
+        value[n] *= jacobian;
+    return EXIT_SUCCESS;
+}
+
+static int multipoles_single_integrated_los_integrand(
+    double x,
+    double value[],
+    void *p
+)
+{
+    struct multipoles_params *params = (struct multipoles_params *) p;
+    struct coffe_parameters_t *par = params->par;
+    double mu = multipoles_mu(par, x);
+
+    if (params->contributions == NULL){
+        multipoles_fill(
+            params, mu,
+            functions_single_integrated_los(
+                par, params->bg, params->integral,
+                par->z_mean, mu, params->sep, params->los
+            ),
+            NULL, value
         );
     }
     else{
-        return functions_single_integrated(
-            par, bg, integral, par->z_mean, mu, sep, x
-        )
-       *gsl_sf_legendre_Pl(params->l, mu);
+        double all[COFFE_TERMS_LEN];
+        functions_single_integrated_los_terms(
+            par, params->bg, params->integral,
+            par->z_mean, mu, params->sep, params->los,
+            par->terms, all
+        );
+        multipoles_fill(params, mu, 0, all, value);
     }
-#endif
+    return EXIT_SUCCESS;
 }
 
-static double multipoles_single_integrated(
+static int multipoles_single_integrated(
     struct coffe_parameters_t *par,
     struct coffe_background_t *bg,
     struct coffe_integrals_t integral[],
+    struct integrators_grid *grid,
     double sep,
-    double l
+    size_t l_len,
+    const int l[],
+    double result[],
+    double errors[],
+    double values[]
 )
 {
     const int dims = 2;
 
+    for (size_t i = 0; i<l_len; ++i) result[i] = 0, errors[i] = 0;
+    if (!(par->terms & COFFE_TERMS_SINGLE_INTEGRATED)) return EXIT_SUCCESS;
+
     struct multipoles_params test;
-    test.par = par;
-    test.bg = bg;
-    test.integral = integral;
-    test.sep = sep;
-    test.l = l;
-
-    int flag = 0;
-    int len = par->correlation_sources_len*(par->correlation_sources_len + 1)/2;
-    for (int i = 0; i<len; ++i){
-        if (
-            strcmp(par->corr_terms[i], "07") == 0 ||
-            strcmp(par->corr_terms[i], "70") == 0 ||
-            strcmp(par->corr_terms[i], "08") == 0 ||
-            strcmp(par->corr_terms[i], "80") == 0 ||
-            strcmp(par->corr_terms[i], "09") == 0 ||
-            strcmp(par->corr_terms[i], "90") == 0 ||
-            strcmp(par->corr_terms[i], "17") == 0 ||
-            strcmp(par->corr_terms[i], "71") == 0 ||
-            strcmp(par->corr_terms[i], "18") == 0 ||
-            strcmp(par->corr_terms[i], "81") == 0 ||
-            strcmp(par->corr_terms[i], "19") == 0 ||
-            strcmp(par->corr_terms[i], "91") == 0 ||
-            strcmp(par->corr_terms[i], "27") == 0 ||
-            strcmp(par->corr_terms[i], "72") == 0 ||
-            strcmp(par->corr_terms[i], "28") == 0 ||
-            strcmp(par->corr_terms[i], "82") == 0 ||
-            strcmp(par->corr_terms[i], "29") == 0 ||
-            strcmp(par->corr_terms[i], "92") == 0 ||
-            strcmp(par->corr_terms[i], "37") == 0 ||
-            strcmp(par->corr_terms[i], "73") == 0 ||
-            strcmp(par->corr_terms[i], "38") == 0 ||
-            strcmp(par->corr_terms[i], "83") == 0 ||
-            strcmp(par->corr_terms[i], "39") == 0 ||
-            strcmp(par->corr_terms[i], "93") == 0 ||
-            strcmp(par->corr_terms[i], "47") == 0 ||
-            strcmp(par->corr_terms[i], "74") == 0 ||
-            strcmp(par->corr_terms[i], "48") == 0 ||
-            strcmp(par->corr_terms[i], "84") == 0 ||
-            strcmp(par->corr_terms[i], "49") == 0 ||
-            strcmp(par->corr_terms[i], "94") == 0 ||
-            strcmp(par->corr_terms[i], "57") == 0 ||
-            strcmp(par->corr_terms[i], "75") == 0 ||
-            strcmp(par->corr_terms[i], "58") == 0 ||
-            strcmp(par->corr_terms[i], "85") == 0 ||
-            strcmp(par->corr_terms[i], "59") == 0 ||
-            strcmp(par->corr_terms[i], "95") == 0 ||
-            strcmp(par->corr_terms[i], "67") == 0 ||
-            strcmp(par->corr_terms[i], "76") == 0 ||
-            strcmp(par->corr_terms[i], "68") == 0 ||
-            strcmp(par->corr_terms[i], "86") == 0 ||
-            strcmp(par->corr_terms[i], "69") == 0 ||
-            strcmp(par->corr_terms[i], "96") == 0
-        ) ++flag;
-    }
-    if (flag == 0) return 0;
-
-#ifdef HAVE_CUBA
-    int nregions, neval, fail;
-    double result[1], error[1], prob[1];
-
-    Cuhre(dims, 1,
-        multipoles_single_integrated_integrand,
-        (void *)&test, 1,
-        5e-4, 0, 0,
-        1, par->integration_bins, 7,
-        NULL, NULL,
-        &nregions, &neval, &fail, result, error, prob
+    struct functions_contributions c;
+    multipoles_params_init(
+        &test, par, bg, integral, sep, l_len, l,
+        COFFE_TERMS_SINGLE_INTEGRATED, &c, values
     );
-    return (2*l + 1)*result[0]/interp_spline(&bg->D1, 0)/interp_spline(&bg->D1, 0);
-#else
-    gsl_monte_function integrand;
-    integrand.dim = dims;
-    integrand.params = &test;
-    integrand.f = &multipoles_single_integrated_integrand;
-
-    gsl_rng *random;
-    gsl_rng_env_setup();
-    const gsl_rng_type *T = gsl_rng_default;
-    random = gsl_rng_alloc(T);
-    double result, error;
-    double lower[dims];
-    double upper[dims];
-    for (int i = 0; i<dims; ++i){
-        lower[i] = 0.0;
-        upper[i] = 1.0;
-    }
-
-    switch (par->integration_method){
-        case 0:{
-            gsl_monte_plain_state *state =
-                gsl_monte_plain_alloc(dims);
-            gsl_monte_plain_integrate(
-                &integrand, lower, upper,
-                dims, par->integration_bins, random,
-                state,
-                &result, &error
-            );
-            gsl_monte_plain_free(state);
-            break;
-        }
-        case 1:{
-            gsl_monte_miser_state *state =
-                gsl_monte_miser_alloc(dims);
-            gsl_monte_miser_integrate(
-                &integrand, lower, upper,
-                dims, par->integration_bins, random,
-                state,
-                &result, &error
-            );
-            gsl_monte_miser_free(state);
-            break;
-        }
-        case 2:{
-            gsl_monte_vegas_state *state =
-                gsl_monte_vegas_alloc(dims);
-            gsl_monte_vegas_integrate(
-                &integrand, lower, upper,
-                dims, par->integration_bins, random,
-                state,
-                &result, &error
-            );
-            gsl_monte_vegas_free(state);
-            break;
-        }
-        default:
-            result = 0;
-            break;
+
+    const int ncomp = multipoles_ncomp(&test);
+    double integral_value[ncomp], error[ncomp];
+
+    /* the line of sight is done with a fixed quadrature, only mu is adaptive */
+    if (par->integration_los_order > 0){
+        struct functions_los_nodes nodes;
+        functions_los_init(
+            &nodes, par->integration_los_order, par->integration_transforms[0]
+        );
+        test.los = &nodes;
+        integrators_qag(
+            &multipoles_single_integrated_los_integrand, &test,
+            0., 1., ncomp, 1E-5, integral_value, error
+        );
+        functions_los_free(&nodes);
+        test.los = NULL;
     }
-    gsl_rng_free(random);
-    return (2*l + 1)*result
-        /interp_spline(&bg->D1, 0)/interp_spline(&bg->D1, 0);
-#endif
+    else{
+        integrators_monte(
+            par, COFFE_TERMS_SINGLE_INTEGRATED,
+            &multipoles_single_integrated_integrand, &test,
+            dims, ncomp, 5e-4, multipoles_scale(&test), grid, integral_value, error
+        );
+    }
+
+    multipoles_store(
+        &test, par->terms & COFFE_TERMS_SINGLE_INTEGRATED,
+        integral_value, error, result, errors, values
+    );
+    return EXIT_SUCCESS;
 }
 
 
-#ifdef HAVE_CUBA
 static int multipoles_double_integrated_integrand(
-    const int *ndim, const cubareal var[],
-    const int *ncomp, cubareal value[],
+    const double var[],
+    int component,
+    double value[],
     void *p
 )
-#else
-static double multipoles_double_integrated_integrand(
-    double *var, size_t dim, void *p
-)
-#endif
 {
     struct multipoles_params *params = (struct multipoles_params *) p;
     struct coffe_parameters_t *par = params->par;
@@ -391,147 +621,346 @@ static double multipoles_double_integrated_integrand(
     struct coffe_integrals_t *integral = params->integral;
     double sep = params->sep;
 
-    double mu = 2*var[0] - 1, x1 = var[1], x2 = var[2];
-#ifdef HAVE_CUBA
-    if (params->l == 0){
-        value[0] = functions_double_integrated(
-            par, bg, integral, par->z_mean, mu, sep, x1, x2
-        );
-        return EXIT_SUCCESS;
+    double mu = multipoles_mu(par, var[0]), x1, x2;
+    const double jacobian =
+        functions_los_transform(par->integration_transforms[1], var[1], &x1)
+       *functions_los_transform(par->integration_transforms[1], var[2], &x2);
+
+    if (params->contributions == NULL){
+        const double total =
+            params->tables != NULL ?
+            functions_double_integrated_float(
+                par, bg, params->tables, par->z_mean, mu, sep, x1, x2
+            ) :
+            functions_double_integrated(
+                par, bg, integral, par->z_mean, mu, sep, x1, x2
+            );
+        if (component >= 0)
+            value[0] = total*gsl_sf_legendre_Pl(params->l[component], mu);
+        else
+            multipoles_fill(params, mu, total, NULL, value);
     }
-    else{
-        value[0] = functions_double_integrated(
-            par, bg, integral, par->z_mean, mu, sep, x1, x2
-        )
-       *gsl_sf_legendre_Pl(params->l, mu);
-        return EXIT_SUCCESS;
-    }
-#else
-    if (params->l == 0){
-        return functions_double_integrated(
-            par, bg, integral, par->z_mean, mu, sep, x1, x2
-        );
+    else if (component >= 0){
+        uint64_t terms;
+        const size_t i = multipoles_component(params, component, &terms);
+        value[0] = functions_double_integrated_terms(
+            par, bg, integral, par->z_mean, mu, sep, x1, x2, terms, NULL
+        )*gsl_sf_legendre_Pl(params->l[i], mu);
     }
     else{
-        return functions_double_integrated(
-            par, bg, integral, par->z_mean, mu, sep, x1, x2
-        )
-       *gsl_sf_legendre_Pl(params->l, mu);
+        double all[COFFE_TERMS_LEN];
+        functions_double_integrated_terms(
+            par, bg, integral, par->z_mean, mu, sep, x1, x2, par->terms, all
+        );
+        multipoles_fill(params, mu, 0, all, value);
     }
-#endif
+    for (int n = 0; n<(component >= 0 ? 1 : multipoles_ncomp(params)); ++n)
+        value[n] *= jacobian;
+    return EXIT_SUCCESS;
 }
 
-static double multipoles_double_integrated(
+static int multipoles_double_integrated(
     struct coffe_parameters_t *par,
     struct coffe_background_t *bg,
     struct coffe_integrals_t integral[],
+    const struct functions_float_tables *tables,
+    struct integrators_grid *grid,
     double sep,
-    double l
+    size_t l_len,
+    const int l[],
+    double result[],
+    double errors[],
+    double values[]
 )
 {
     const int dims = 3;
+
+    for (size_t i = 0; i<l_len; ++i) result[i] = 0, errors[i] = 0;
+    if (!(par->terms & COFFE_TERMS_DOUBLE_INTEGRATED)) return EXIT_SUCCESS;
+
     struct multipoles_params test;
-    test.par = par;
-    test.bg = bg;
-    test.integral = integral;
-    test.sep = sep;
-    test.l = l;
-
-    int flag = 0;
-    int len = par->correlation_sources_len*(par->correlation_sources_len + 1)/2;
-    for (int i = 0; i<len; ++i){
-        if (
-            strcmp(par->corr_terms[i], "77") == 0 || // g4-g4
-            strcmp(par->corr_terms[i], "88") == 0 || // g5-g5
-            strcmp(par->corr_terms[i], "99") == 0 || // len-len
-            strcmp(par->corr_terms[i], "78") == 0 || // g4-g5
-            strcmp(par->corr_terms[i], "87") == 0 || // g5-g4
-            strcmp(par->corr_terms[i], "79") == 0 || // g4-len
-            strcmp(par->corr_terms[i], "97") == 0 || // len-g4
-            strcmp(par->corr_terms[i], "89") == 0 || // g5-len
-            strcmp(par->corr_terms[i], "98") == 0    // len-g5
-        ) ++flag;
-    }
-    if (flag == 0) return 0;
-
-#ifdef HAVE_CUBA
-    int nregions, neval, fail;
-    double result[1], error[1], prob[1];
-
-    Cuhre(dims, 1,
-        multipoles_double_integrated_integrand,
-        (void *)&test, 1,
-        5e-4, 0, 0,
-        1, par->integration_bins, 7,
-        NULL, NULL,
-        &nregions, &neval, &fail, result, error, prob
+    struct functions_contributions c;
+    multipoles_params_init(
+        &test, par, bg, integral, sep, l_len, l,
+        COFFE_TERMS_DOUBLE_INTEGRATED, &c, values
+    );
+    /* the separate terms are always in double precision */
+    if (values == NULL) test.tables = tables;
+
+    const int ncomp = multipoles_ncomp(&test);
+    double integral_value[ncomp], error[ncomp];
+    integrators_monte(
+        par, COFFE_TERMS_DOUBLE_INTEGRATED,
+        &multipoles_double_integrated_integrand, &test,
+        dims, ncomp, 5e-4, multipoles_scale(&test), grid, integral_value, error
     );
-    return (2*l + 1)*result[0]/interp_spline(&bg->D1, 0)/interp_spline(&bg->D1, 0);
-#else
-    gsl_monte_function integrand;
-    integrand.dim = dims;
-    integrand.params = &test;
-    integrand.f = &multipoles_double_integrated_integrand;
-
-    gsl_rng *random;
-    gsl_rng_env_setup();
-    const gsl_rng_type *T = gsl_rng_default;
-    random = gsl_rng_alloc(T);
-    double result, error;
-    double lower[dims];
-    double upper[dims];
-    for (int i = 0; i<dims; ++i){
-        lower[i] = 0.0;
-        upper[i] = 1.0;
-    }
-
-    switch (par->integration_method){
-        case 0:{
-            gsl_monte_plain_state *state =
-                gsl_monte_plain_alloc(dims);
-            gsl_monte_plain_integrate(
-                &integrand, lower, upper,
-                dims, par->integration_bins, random,
-                state,
-                &result, &error
+
+    /* the single precision result is only kept if the loss is well below the error */
+    if (test.tables != NULL){
+        for (size_t i = 0; i<l_len; ++i){
+            if (
+                functions_double_integrated_float_loss(
+                    par, bg, integral, tables,
+                    par->z_mean, multipoles_mu_min(par), 1, sep, l[i]
+                ) > FUNCTIONS_FLOAT_LOSS_FRACTION*error[i]
+            ){
+                fprintf(
+                    stderr,
+                    "WARNING: single precision not accurate enough "
+                    "at l = %d, separation = %.2f Mpc/h; "
+                    "recomputing in double precision\n",
+                    l[i], sep/COFFE_H0
+                );
+                test.tables = NULL;
+                integrators_monte(
+                    par, COFFE_TERMS_DOUBLE_INTEGRATED,
+                    &multipoles_double_integrated_integrand, &test,
+                    dims, ncomp, 5e-4, multipoles_scale(&test), grid, integral_value, error
+                );
+                break;
+            }
+        }
+    }
+
+    multipoles_store(
+        &test, par->terms & COFFE_TERMS_DOUBLE_INTEGRATED,
+        integral_value, error, result, errors, values
+    );
+    return EXIT_SUCCESS;
+}
+
+
+/**
+    the VEGAS grids of the single and double integrated terms,
+    kept between separations
+**/
+
+struct multipoles_grids
+{
+    struct integrators_grid single, twice;
+};
+
+
+/**
+    the multipoles of the den-den, den-rsd and rsd-rsd terms in the
+    flat-sky (Kaiser) limit, which are just the coefficients of P_l(mu),
+    so nothing needs to be integrated
+**/
+
+static int multipoles_flatsky(
+    struct coffe_parameters_t *par,
+    struct coffe_background_t *bg,
+    struct coffe_integrals_t integral[],
+    double sep,
+    size_t l_len,
+    const int l[],
+    double result[],
+    double error[],
+    double values[]
+)
+{
+    const double D1_0 = interp_spline(&bg->D1, 0);
+    double coefficient[3][3];
+    functions_flatsky_coefficients(par, bg, integral, par->z_mean, sep, coefficient);
+
+    for (size_t i = 0; i<l_len; ++i){
+        double all[COFFE_TERMS_LEN];
+        result[i] = 0, error[i] = 0;
+        for (int k = 0; k<3; ++k){
+            all[functions_flatsky_terms[k]] =
+                l[i] % 2 == 0 && l[i] <= 4 ? coefficient[k][l[i]/2] : 0;
+            result[i] += all[functions_flatsky_terms[k]]/D1_0/D1_0;
+        }
+        if (values != NULL)
+            functions_contributions_scatter(
+                par, par->terms, all, 1./D1_0/D1_0,
+                values + i*par->corr_terms_len
             );
-            gsl_monte_plain_free(state);
-            break;
+    }
+    return EXIT_SUCCESS;
+}
+
+
+/**
+    estimates the wide-angle error of the flat-sky multipoles, by
+    comparing them with the full-sky ones at the smallest, middle and
+    largest separation; the difference is relative to the largest multipole
+**/
+
+static int multipoles_flatsky_check(
+    struct coffe_parameters_t *par,
+    struct coffe_background_t *bg,
+    struct coffe_integrals_t integral[],
+    const double sep[],
+    size_t sep_len,
+    size_t l_len,
+    const int l[]
+)
+{
+    const size_t checkpoints[] = {0, sep_len/2, sep_len - 1};
+    double flat[l_len], full[l_len], error[l_len];
+
+    for (size_t n = 0; n<3 && l_len > 0 && sep_len > 0; ++n){
+        if (n > 0 && checkpoints[n] == checkpoints[n - 1]) continue;
+        const double r = sep[checkpoints[n]]*COFFE_H0;
+        multipoles_flatsky(par, bg, integral, r, l_len, l, flat, error, NULL);
+        multipoles_nonintegrated(
+            par, bg, integral, NULL, r, l_len, l, full, error, NULL
+        );
+        double scale = 0, difference = 0;
+        for (size_t i = 0; i<l_len; ++i){
+            if (fabs(full[i]) > scale) scale = fabs(full[i]);
+            if (fabs(flat[i] - full[i]) > difference) difference = fabs(flat[i] - full[i]);
         }
-        case 1:{
-            gsl_monte_miser_state *state =
-                gsl_monte_miser_alloc(dims);
-            gsl_monte_miser_integrate(
-                &integrand, lower, upper,
-                dims, par->integration_bins, random,
-                state,
-                &result, &error
+        printf(
+            "Flat-sky multipoles at %.2f Mpc/h differ from the full-sky ones by %.2e\n",
+            sep[checkpoints[n]], scale > 0 ? difference/scale : difference
+        );
+    }
+    return EXIT_SUCCESS;
+}
+
+
+/**
+    all of the multipoles (all of the terms) at a single
+    separation, their estimated errors, and optionally the separate
+    terms (as values[i*corr_terms_len + k] for the multipole l[i])
+**/
+
+static int multipoles_point(
+    struct coffe_parameters_t *par,
+    struct coffe_background_t *bg,
+    struct coffe_integrals_t integral[],
+    const struct functions_float_tables *tables,
+    const struct multipoles_projection *projection,
+    struct multipoles_grids *grids,
+    double sep,
+    size_t l_len,
+    const int l[],
+    double result[],
+    double error[],
+    double values[]
+)
+{
+    if (par->flatsky)
+        return multipoles_flatsky(
+            par, bg, integral, sep, l_len, l, result, error, values
+        );
+
+    double temp[l_len], temp_error[l_len];
+    multipoles_nonintegrated(
+        par, bg, integral, projection, sep, l_len, l, result, error, values
+    );
+    for (size_t i = 0; i<l_len; ++i) error[i] *= error[i];
+    multipoles_single_integrated(
+        par, bg, integral, grids != NULL ? &grids->single : NULL,
+        sep, l_len, l, temp, temp_error, values
+    );
+    for (size_t i = 0; i<l_len; ++i)
+        result[i] += temp[i], error[i] += temp_error[i]*temp_error[i];
+    multipoles_double_integrated(
+        par, bg, integral, tables, grids != NULL ? &grids->twice : NULL,
+        sep, l_len, l, temp, temp_error, values
+    );
+    for (size_t i = 0; i<l_len; ++i)
+        result[i] += temp[i], error[i] += temp_error[i]*temp_error[i];
+    for (size_t i = 0; i<l_len; ++i) error[i] = sqrt(error[i]);
+    return EXIT_SUCCESS;
+}
+
+
+/**
+    rough estimate of the cost of multipoles_point, in units of
+    integrand evaluations; the adaptive integrations need more
+    of them at larger separations and multipoles
+**/
+
+static double multipoles_cost(
+    struct coffe_parameters_t *par,
+    double sep,
+    double sep_max,
+    int l_max
+)
+{
+    double cost = 100;
+    if (par->terms & COFFE_TERMS_SINGLE_INTEGRATED)
+        cost += par->integration_los_order > 0 ?
+            100*par->integration_los_order : par->integration_bins;
+    if (par->terms & COFFE_TERMS_DOUBLE_INTEGRATED)
+        cost += par->integration_bins;
+    return cost*(1 + sep/sep_max)*(1 + l_max/10.);
+}
+
+/**
+    picks the order of the projection in mu by doubling it (starting
+    from integration_mu_order) until the nonintegrated multipoles at
+    the smallest and largest separation agree with the ones at twice
+    the order; returns EXIT_FAILURE if it doesn't converge
+**/
+
+static int multipoles_projection_choose(
+    struct coffe_parameters_t *par,
+    struct coffe_background_t *bg,
+    struct coffe_integrals_t *integral,
+    const double sep[],
+    size_t sep_len,
+    size_t l_len,
+    const int l[],
+    struct multipoles_projection *projection
+)
+{
+    const double prec = 1E-5;
+    double coarse[l_len], fine[l_len], error[l_len];
+
+    for (
+        size_t order = (size_t)par->integration_mu_order;
+        order <= MULTIPOLES_MU_ORDER_MAX/2;
+        order *= 2
+    ){
+        struct multipoles_projection twice;
+        multipoles_projection_init(
+            projection, multipoles_mu_min(par), order, l_len, l
+        );
+        multipoles_projection_init(
+            &twice, multipoles_mu_min(par), 2*order, l_len, l
+        );
+
+        int converged = 1;
+        for (size_t n = 0; n<2 && n<sep_len; ++n){
+            const double r = (n == 0 ? sep[0] : sep[sep_len - 1])*COFFE_H0;
+            multipoles_nonintegrated(
+                par, bg, integral, projection, r, l_len, l, coarse, error, NULL
+            );
+            multipoles_nonintegrated(
+                par, bg, integral, &twice, r, l_len, l, fine, error, NULL
             );
-            gsl_monte_miser_free(state);
-            break;
+            /* the smaller multipoles only need to be accurate compared to the largest */
+            double scale = 0;
+            for (size_t i = 0; i<l_len; ++i)
+                if (fabs(fine[i]) > scale) scale = fabs(fine[i]);
+            for (size_t i = 0; i<l_len; ++i)
+                if (fabs(coarse[i] - fine[i]) > prec*fmax(fabs(fine[i]), 1e-3*scale))
+                    converged = 0;
         }
-        case 2:{
-            gsl_monte_vegas_state *state =
-                gsl_monte_vegas_alloc(dims);
-            gsl_monte_vegas_integrate(
-                &integrand, lower, upper,
-                dims, par->integration_bins, random,
-                state,
-                &result, &error
+        multipoles_projection_free(&twice);
+
+        if (converged){
+            printf(
+                "Using %zu nodes in mu for the nonintegrated multipoles\n",
+                order
             );
-            gsl_monte_vegas_free(state);
-            break;
+            return EXIT_SUCCESS;
         }
-        default:
-            result = 0;
-            break;
+        multipoles_projection_free(projection);
     }
-    gsl_rng_free(random);
-    return (2*l + 1)*result
-        /interp_spline(&bg->D1, 0)/interp_spline(&bg->D1, 0);
-#endif
-}
 
+    fprintf(
+        stderr,
+        "WARNING: the quadrature in mu for the nonintegrated multipoles "
+        "didn't converge; using the adaptive integration instead\n"
+    );
+    return EXIT_FAILURE;
+}
 
 int coffe_multipoles_init(
     struct coffe_parameters_t *par,
@@ -540,9 +969,7 @@ int coffe_multipoles_init(
     struct coffe_multipoles_t *mp
 )
 {
-#ifdef HAVE_CUBA
-    cubacores(0, 10000);
-#endif
+    integrators_init(par);
     if (par->output_type == 2){
         mp->flag = 1;
         clock_t start, end;
@@ -576,36 +1003,139 @@ int coffe_multipoles_init(
             bg
         );
 
-        #pragma omp parallel for num_threads(par->nthreads) collapse(2)
-        for (size_t i = 0; i<mp->l_len; ++i){
-            for (size_t j = 0; j<mp->sep_len; ++j){
-                mp->result[i][j] =
-                    multipoles_nonintegrated(
-                        par, bg, integral,
-                        mp->sep[j]*COFFE_H0, mp->l[i]
-                    );
-            }
+        mp->contributions = NULL;
+        mp->contributions_len = 0;
+        if (par->output_contributions){
+            mp->contributions_len = (size_t)par->corr_terms_len;
+            mp->contributions = (double *)coffe_malloc(
+                sizeof(double)*mp->l_len*mp->sep_len*mp->contributions_len
+            );
         }
-        #pragma omp parallel for num_threads(par->nthreads) collapse(2)
-        for (size_t i = 0; i<mp->l_len; ++i){
-            for (size_t j = 0; j<mp->sep_len; ++j){
-                mp->result[i][j] +=
-                    multipoles_single_integrated(
-                        par, bg, integral,
-                        mp->sep[j]*COFFE_H0, mp->l[i]
-                    );
-            }
+
+        mp->error = NULL;
+        if (par->output_errors)
+            mp->error = (double *)coffe_malloc(
+                sizeof(double)*mp->l_len*mp->sep_len
+            );
+
+        /* single precision tables for the double integrated terms */
+        struct functions_float_tables tables, *tables_ptr = NULL;
+        if (
+            par->integration_single_precision &&
+            (par->terms & COFFE_TERMS_DOUBLE_INTEGRATED)
+        ){
+            functions_float_tables_init(par, bg, integral, &tables);
+            tables_ptr = &tables;
         }
-        #pragma omp parallel for num_threads(par->nthreads) collapse(2)
-        for (size_t i = 0; i<mp->l_len; ++i){
-            for (size_t j = 0; j<mp->sep_len; ++j){
-                mp->result[i][j] +=
-                    multipoles_double_integrated(
-                        par, bg, integral,
-                        mp->sep[j]*COFFE_H0, mp->l[i]
+
+        /* only the multipoles which don't vanish by symmetry are integrated */
+        int *l = (int *)coffe_malloc(sizeof(int)*mp->l_len);
+        size_t l_len = 0;
+        for (size_t i = 0; i<mp->l_len; ++i)
+            if (!coffe_multipole_vanishes(par, mp->l[i]))
+                l[l_len++] = mp->l[i];
+
+        /* fixed quadrature in mu for the nonintegrated terms */
+        struct multipoles_projection projection, *projection_ptr = NULL;
+        if (
+            par->integration_mu_order > 0 &&
+            !par->flatsky &&
+            l_len > 0 &&
+            (par->terms & COFFE_TERMS_NONINTEGRATED) &&
+            multipoles_projection_choose(
+                par, bg, integral, mp->sep, mp->sep_len,
+                l_len, l, &projection
+            ) == EXIT_SUCCESS
+        ){
+            projection_ptr = &projection;
+        }
+
+        /* all of the multipoles at once for each separation, most expensive first */
+        int l_max = 0;
+        for (size_t i = 0; i<l_len; ++i)
+            if (l[i] > l_max) l_max = l[i];
+        double *cost = (double *)coffe_malloc(sizeof(double)*mp->sep_len);
+        size_t *order = (size_t *)coffe_malloc(sizeof(size_t)*mp->sep_len);
+        for (size_t j = 0; j<mp->sep_len; ++j){
+            cost[j] = multipoles_cost(
+                par, mp->sep[j], mp->sep[mp->sep_len - 1], l_max
+            );
+        }
+        coffe_order_by_cost(cost, mp->sep_len, order);
+        const int nthreads = coffe_threads_split(par, cost, mp->sep_len);
+
+        #pragma omp parallel num_threads(nthreads)
+        {
+            /* each thread keeps its own VEGAS grids between the separations */
+            struct multipoles_grids grids, *grids_ptr = NULL;
+            if (par->integration_warm_start){
+                integrators_grid_init(&grids.single, 2);
+                integrators_grid_init(&grids.twice, 3);
+                grids_ptr = &grids;
+            }
+
+            #pragma omp for schedule(dynamic, 1)
+            for (size_t k = 0; k<mp->sep_len; ++k){
+                const size_t j = order[k];
+                double *result = (double *)coffe_malloc(sizeof(double)*2*mp->l_len);
+                double *error = result + mp->l_len;
+                double *values = NULL;
+                if (mp->contributions != NULL)
+                    values = (double *)coffe_malloc(
+                        sizeof(double)*mp->l_len*mp->contributions_len
                     );
+
+                if (l_len > 0)
+                    multipoles_point(
+                        par, bg, integral, tables_ptr, projection_ptr, grids_ptr,
+                        mp->sep[j]*COFFE_H0, l_len, l,
+                        result, error, values
+                    );
+
+                for (size_t i = 0, n = 0; i<mp->l_len; ++i){
+                    double *contributions = mp->contributions == NULL ? NULL :
+                        mp->contributions + (i*mp->sep_len + j)*mp->contributions_len;
+                    if (coffe_multipole_vanishes(par, mp->l[i])){
+                        mp->result[i][j] = 0;
+                        if (mp->error != NULL) mp->error[i*mp->sep_len + j] = 0;
+                        if (contributions != NULL)
+                            for (size_t t = 0; t<mp->contributions_len; ++t)
+                                contributions[t] = 0;
+                        continue;
+                    }
+                    mp->result[i][j] = result[n];
+                    if (mp->error != NULL) mp->error[i*mp->sep_len + j] = error[n];
+                    if (contributions != NULL)
+                        memcpy(
+                            contributions,
+                            values + n*mp->contributions_len,
+                            sizeof(double)*mp->contributions_len
+                        );
+                    ++n;
+                }
+                free(result);
+                free(values);
+            }
+
+            if (grids_ptr != NULL){
+                integrators_grid_free(&grids.single);
+                integrators_grid_free(&grids.twice);
             }
         }
+        par->nthreads_inner = 1;
+        free(cost);
+        free(order);
+
+        if (par->flatsky)
+            multipoles_flatsky_check(
+                par, bg, integral, mp->sep, mp->sep_len, l_len, l
+            );
+        free(l);
+
+        if (tables_ptr != NULL)
+            functions_float_tables_free(&tables);
+        if (projection_ptr != NULL)
+            multipoles_projection_free(&projection);
 
         end = clock();
         printf("Multipoles calculated in %.2f s\n",
@@ -617,6 +1147,115 @@ int coffe_multipoles_init(
     return EXIT_SUCCESS;
 }
 
+/**
+    the multipoles l[0], ..., l[l_len - 1] (none of which vanish by
+    symmetry) at each of the len points with redshift z[n] (in place of
+    z_mean) and separation sep[n] (in Mpc/h), as result[n*l_len + i], with
+    the estimated errors in error[n*l_len + i], and the separate terms
+    in values[(n*l_len + i)*corr_terms_len + k] if values is not NULL;
+    all of the points are computed in parallel
+**/
+
+int coffe_multipoles_points(
+    struct coffe_parameters_t *par,
+    struct coffe_background_t *bg,
+    struct coffe_integrals_t *integral,
+    size_t len,
+    const double z[],
+    const double sep[],
+    size_t l_len,
+    const int l[],
+    double result[],
+    double error[],
+    double values[]
+)
+{
+    if (len == 0 || l_len == 0) return EXIT_SUCCESS;
+    const double z_mean = par->z_mean;
+    par->z_mean = z[0];
+
+    /* single precision tables for the double integrated terms */
+    struct functions_float_tables tables, *tables_ptr = NULL;
+    if (
+        par->integration_single_precision &&
+        (par->terms & COFFE_TERMS_DOUBLE_INTEGRATED)
+    ){
+        functions_float_tables_init(par, bg, integral, &tables);
+        tables_ptr = &tables;
+    }
+
+    /* fixed quadrature in mu for the nonintegrated terms, checked at the smallest and largest separation */
+    double sep_range[2] = {sep[0], sep[0]};
+    for (size_t n = 0; n<len; ++n){
+        sep_range[0] = fmin(sep_range[0], sep[n]);
+        sep_range[1] = fmax(sep_range[1], sep[n]);
+    }
+    struct multipoles_projection projection, *projection_ptr = NULL;
+    if (
+        par->integration_mu_order > 0 &&
+        !par->flatsky &&
+        (par->terms & COFFE_TERMS_NONINTEGRATED) &&
+        multipoles_projection_choose(
+            par, bg, integral, sep_range, 2, l_len, l, &projection
+        ) == EXIT_SUCCESS
+    ){
+        projection_ptr = &projection;
+    }
+
+    int l_max = 0;
+    for (size_t i = 0; i<l_len; ++i)
+        if (l[i] > l_max) l_max = l[i];
+    double *cost = (double *)coffe_malloc(sizeof(double)*len);
+    size_t *order = (size_t *)coffe_malloc(sizeof(size_t)*len);
+    for (size_t n = 0; n<len; ++n)
+        cost[n] = multipoles_cost(par, sep[n], sep_range[1], l_max);
+    coffe_order_by_cost(cost, len, order);
+    const int nthreads = coffe_threads_split(par, cost, len);
+
+    #pragma omp parallel num_threads(nthreads)
+    {
+        /* each thread has its own copy of the parameters, with its own redshift */
+        struct coffe_parameters_t *local =
+            (struct coffe_parameters_t *)coffe_malloc(sizeof(struct coffe_parameters_t));
+        *local = *par;
+
+        struct multipoles_grids grids, *grids_ptr = NULL;
+        if (par->integration_warm_start){
+            integrators_grid_init(&grids.single, 2);
+            integrators_grid_init(&grids.twice, 3);
+            grids_ptr = &grids;
+        }
+
+        #pragma omp for schedule(dynamic, 1)
+        for (size_t k = 0; k<len; ++k){
+            const size_t n = order[k];
+            local->z_mean = z[n];
+            multipoles_point(
+                local, bg, integral, tables_ptr, projection_ptr, grids_ptr,
+                sep[n]*COFFE_H0, l_len, l,
+                result + n*l_len, error + n*l_len,
+                values != NULL ? values + n*l_len*par->corr_terms_len : NULL
+            );
+        }
+
+        if (grids_ptr != NULL){
+            integrators_grid_free(&grids.single);
+            integrators_grid_free(&grids.twice);
+        }
+        free(local);
+    }
+    par->nthreads_inner = 1;
+    par->z_mean = z_mean;
+    free(cost);
+    free(order);
+
+    if (tables_ptr != NULL)
+        functions_float_tables_free(&tables);
+    if (projection_ptr != NULL)
+        multipoles_projection_free(&projection);
+    return EXIT_SUCCESS;
+}
+
 int coffe_multipoles_free(
     struct coffe_multipoles_t *mp
 )
@@ -628,6 +1267,8 @@ int coffe_multipoles_free(
         free(mp->result);
         free(mp->l);
         free(mp->sep);
+        free(mp->contributions);
+        free(mp->error);
         mp->flag = 0;
     }
     return EXIT_SUCCESS;
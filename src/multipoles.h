@@ -25,6 +25,11 @@ struct coffe_multipoles_t
     int *l;
     double *sep;
     size_t l_len, sep_len;
+    /* the separate terms (as in corr_terms) if output_contributions is set, otherwise NULL */
+    double *contributions; /* index = (i*sep_len + j)*contributions_len + term */
+    size_t contributions_len;
+    /* the estimated integration error if output_errors is set, otherwise NULL */
+    double *error; /* index = i*sep_len + j */
     int flag;
 };
 
@@ -35,6 +40,20 @@ int coffe_multipoles_init(
     struct coffe_multipoles_t *mp
 );
 
+int coffe_multipoles_points(
+    struct coffe_parameters_t *par,
+    struct coffe_background_t *bg,
+    struct coffe_integrals_t *integral,
+    size_t len,
+    const double z[],
+    const double sep[],
+    size_t l_len,
+    const int l[],
+    double result[],
+    double error[],
+    double values[]
+);
+
 int coffe_multipoles_free(
     struct coffe_multipoles_t *mp
 );
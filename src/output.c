@@ -33,6 +33,10 @@
 #include "output.h"
 #include "errors.h"
 
+/* the names of the columns of the main output files, with the error if there is one */
+#define OUTPUT_COLUMNS(error) \
+    ((error) != NULL ? "# sep[Mpc/h]\tresult\terror\n" : "# sep[Mpc/h]\tresult\n")
+
 
 /**
     makes the output directory if it doesn't exist;
@@ -197,6 +201,65 @@ static int output_background(
     return EXIT_SUCCESS;
 }
 
+/**
+    writes the names of the terms in corr_terms (as "den-rsd" etc.),
+    tab separated, as the column names of the separate contributions
+**/
+
+static int output_term_names(
+    FILE *output,
+    struct coffe_parameters_t *par
+)
+{
+    const char names[10][10]
+        = {"den", "rsd", "d1", "d2", "g1", "g2", "g3", "g4", "g5", "len"};
+    for (int k = 0; k<par->corr_terms_len; ++k){
+        fprintf(
+            output, "\t%s-%s",
+            names[par->corr_terms[k][0] - '0'],
+            names[par->corr_terms[k][1] - '0']
+        );
+    }
+    fprintf(output, "\n");
+    return EXIT_SUCCESS;
+}
+
+
+/**
+    writes the sum and the separate contributions (contributions_len
+    per point, in the order of corr_terms) as a function of x
+**/
+
+static int output_contributions(
+    char *filepath,
+    const char *header,
+    const char *xname,
+    struct coffe_parameters_t *par,
+    size_t len,
+    const double *x,
+    const double *total,
+    const double *contributions,
+    size_t contributions_len
+)
+{
+    FILE *output = fopen(filepath, "w");
+    if (output == NULL){
+        print_error_verbose(PROG_OPEN_ERROR, filepath);
+        exit(EXIT_FAILURE);
+    }
+    fprintf(output, "%s", header);
+    fprintf(output, "# %s\tresult", xname);
+    output_term_names(output, par);
+    for (size_t n = 0; n<len; ++n){
+        fprintf(output, "%e %e", x[n], total[n]);
+        for (size_t k = 0; k<contributions_len; ++k)
+            fprintf(output, " %e", contributions[n*contributions_len + k]);
+        fprintf(output, "\n");
+    }
+    fclose(output);
+    return EXIT_SUCCESS;
+}
+
 int coffe_output_init(
     struct coffe_parameters_t *par,
     struct coffe_background_t *bg,
@@ -227,15 +290,32 @@ int coffe_output_init(
         snprintf(prefix, COFFE_MAX_STRLEN, "%s%s", par->output_path, par->output_prefix);
     }
 
-    /* settings file copy */
-    snprintf(filepath, COFFE_MAX_STRLEN, "%ssettings.cfg", prefix);
-    config_write_file(par->conf, filepath);
-    config_destroy(par->conf);
-    par->conf = NULL;
+    /* the settings and the background are the same for all of the redshift bins and pairs */
+    if (par->z_bin == 0 && par->tracer_pair == 0){
+        /* settings file copy */
+        snprintf(filepath, COFFE_MAX_STRLEN, "%ssettings.cfg", prefix);
+        config_write_file(par->conf, filepath);
+        config_destroy(par->conf);
+        par->conf = NULL;
 
-    /* background */
-    snprintf(filepath, COFFE_MAX_STRLEN, "%sbackground.dat", prefix);
-    output_background(filepath, "\t", par, bg);
+        /* background */
+        snprintf(filepath, COFFE_MAX_STRLEN, "%sbackground.dat", prefix);
+        output_background(filepath, "\t", par, bg);
+    }
+
+    /* the rest of the files of each redshift bin and pair of populations get their indices */
+    if (par->z_bins_len > 1){
+        const size_t prefix_len = strlen(prefix);
+        snprintf(prefix + prefix_len, COFFE_MAX_STRLEN - prefix_len, "zbin%d_", par->z_bin);
+    }
+    if (par->tracer_pairs_len > 1){
+        const size_t prefix_len = strlen(prefix);
+        snprintf(
+            prefix + prefix_len, COFFE_MAX_STRLEN - prefix_len, "tracers%d_%d_",
+            par->tracer_pairs[2*par->tracer_pair] + 1,
+            par->tracer_pairs[2*par->tracer_pair + 1] + 1
+        );
+    }
 
     /* correlation function (angular) */
     if (par->output_type == 0){
@@ -245,13 +325,22 @@ int coffe_output_init(
             strncat(header, " ", COFFE_MAX_STRLEN);
         }
         strncat(header, "\n", COFFE_MAX_STRLEN);
-        strncat(header, "# sep[Mpc/h]\tresult\n", COFFE_MAX_STRLEN);
+        strncat(header, OUTPUT_COLUMNS(cf_ang->error), COFFE_MAX_STRLEN);
         snprintf(filepath, COFFE_MAX_STRLEN, "%sang_corrfunc.dat", prefix);
         write_ncol_null(
             filepath,
             cf_ang->theta_len, header, " ",
-            cf_ang->theta, cf_ang->result, NULL
+            cf_ang->theta, cf_ang->result, cf_ang->error, NULL
         );
+        if (cf_ang->contributions != NULL){
+            *strstr(header, "# sep[Mpc/h]") = '\0';
+            snprintf(filepath, COFFE_MAX_STRLEN, "%sang_corrfunc_contributions.dat", prefix);
+            output_contributions(
+                filepath, header, "sep[Mpc/h]", par,
+                cf_ang->theta_len, cf_ang->theta, cf_ang->result,
+                cf_ang->contributions, cf_ang->contributions_len
+            );
+        }
     }
 
     /* correlation function (full) */
@@ -267,13 +356,24 @@ int coffe_output_init(
                 strncat(header, " ", COFFE_MAX_STRLEN);
             }
             strncat(header, "\n", COFFE_MAX_STRLEN);
-            strncat(header, "# sep[Mpc/h]\tresult\n", COFFE_MAX_STRLEN);
+            strncat(header, OUTPUT_COLUMNS(cf->error), COFFE_MAX_STRLEN);
             snprintf(filepath, COFFE_MAX_STRLEN, "%scorrfunc%d.dat", prefix, i);
             write_ncol_null(
                 filepath,
                 cf->sep_len, header, " ",
-                cf->sep, cf->result[i], NULL
+                cf->sep, cf->result[i],
+                cf->error != NULL ? cf->error + i*cf->sep_len : NULL, NULL
             );
+            if (cf->contributions != NULL){
+                *strstr(header, "# sep[Mpc/h]") = '\0';
+                snprintf(filepath, COFFE_MAX_STRLEN, "%scorrfunc%d_contributions.dat", prefix, i);
+                output_contributions(
+                    filepath, header, "sep[Mpc/h]", par,
+                    cf->sep_len, cf->sep, cf->result[i],
+                    cf->contributions + i*cf->sep_len*cf->contributions_len,
+                    cf->contributions_len
+                );
+            }
         }
     }
 
@@ -290,13 +390,24 @@ int coffe_output_init(
                 strncat(header, " ", COFFE_MAX_STRLEN);
             }
             strncat(header, "\n", COFFE_MAX_STRLEN);
-            strncat(header, "# sep[Mpc/h]\tresult\n", COFFE_MAX_STRLEN);
+            strncat(header, OUTPUT_COLUMNS(mp->error), COFFE_MAX_STRLEN);
             snprintf(filepath, COFFE_MAX_STRLEN, "%smultipoles%d.dat", prefix, par->multipole_values[i]);
             write_ncol_null(
                 filepath,
                 mp->sep_len, header, " ",
-                mp->sep, mp->result[i], NULL
+                mp->sep, mp->result[i],
+                mp->error != NULL ? mp->error + i*mp->sep_len : NULL, NULL
             );
+            if (mp->contributions != NULL){
+                *strstr(header, "# sep[Mpc/h]") = '\0';
+                snprintf(filepath, COFFE_MAX_STRLEN, "%smultipoles%d_contributions.dat", prefix, par->multipole_values[i]);
+                output_contributions(
+                    filepath, header, "sep[Mpc/h]", par,
+                    mp->sep_len, mp->sep, mp->result[i],
+                    mp->contributions + i*mp->sep_len*mp->contributions_len,
+                    mp->contributions_len
+                );
+            }
         }
     }
 
@@ -313,13 +424,24 @@ int coffe_output_init(
                 strncat(header, " ", COFFE_MAX_STRLEN);
             }
             strncat(header, "\n", COFFE_MAX_STRLEN);
-            strncat(header, "# sep[Mpc/h]\tresult\n", COFFE_MAX_STRLEN);
+            strncat(header, OUTPUT_COLUMNS(ramp->error), COFFE_MAX_STRLEN);
             snprintf(filepath, COFFE_MAX_STRLEN,"%savg_multipoles%d.dat", prefix, par->multipole_values[i]);
             write_ncol_null(
                 filepath,
                 ramp->sep_len, header, " ",
-                ramp->sep, ramp->result[i], NULL
+                ramp->sep, ramp->result[i],
+                ramp->error != NULL ? ramp->error + i*ramp->sep_len : NULL, NULL
             );
+            if (ramp->contributions != NULL){
+                *strstr(header, "# sep[Mpc/h]") = '\0';
+                snprintf(filepath, COFFE_MAX_STRLEN, "%savg_multipoles%d_contributions.dat", prefix, par->multipole_values[i]);
+                output_contributions(
+                    filepath, header, "sep[Mpc/h]", par,
+                    ramp->sep_len, ramp->sep, ramp->result[i],
+                    ramp->contributions + i*ramp->sep_len*ramp->contributions_len,
+                    ramp->contributions_len
+                );
+            }
         }
     }
 
@@ -385,18 +507,50 @@ int coffe_output_init(
         );
         FILE *output = fopen(filepath, "w");
         fprintf(output, "# z_mean = %f\n", par->z_mean);
-        fprintf(output, "# sep_par[Mpc/h]\tsep_perp[Mpc/h]\tresult\n");
+        fprintf(
+            output, "# sep_par[Mpc/h]\tsep_perp[Mpc/h]\tresult%s\n",
+            cf2d->error != NULL ? "\terror" : ""
+        );
 
-        for (size_t i = 0; i<cf2d->sep_len; ++i){
-            for (size_t j = 0; j<cf2d->sep_len; ++j){
+        for (size_t i = 0; i<cf2d->sep_parallel_len; ++i){
+            for (size_t j = 0; j<cf2d->sep_perpendicular_len; ++j){
                 fprintf(
-                    output, "%e %e %e\n",
+                    output, "%e %e %e",
                     cf2d->sep_parallel[i], cf2d->sep_perpendicular[j],
                     cf2d->result[i][j]
                 );
+                if (cf2d->error != NULL)
+                    fprintf(output, " %e", cf2d->error[i*cf2d->sep_perpendicular_len + j]);
+                fprintf(output, "\n");
             }
         }
         fclose(output);
+
+        if (cf2d->contributions != NULL){
+            snprintf(
+                filepath, COFFE_MAX_STRLEN,
+                "%scorrfunc2d_contributions.dat", prefix
+            );
+            output = fopen(filepath, "w");
+            fprintf(output, "# z_mean = %f\n", par->z_mean);
+            fprintf(output, "# sep_par[Mpc/h]\tsep_perp[Mpc/h]\tresult");
+            output_term_names(output, par);
+            for (size_t i = 0; i<cf2d->sep_parallel_len; ++i){
+                for (size_t j = 0; j<cf2d->sep_perpendicular_len; ++j){
+                    const double *values = cf2d->contributions
+                        + (i*cf2d->sep_perpendicular_len + j)*cf2d->contributions_len;
+                    fprintf(
+                        output, "%e %e %e",
+                        cf2d->sep_parallel[i], cf2d->sep_perpendicular[j],
+                        cf2d->result[i][j]
+                    );
+                    for (size_t k = 0; k<cf2d->contributions_len; ++k)
+                        fprintf(output, " %e", values[k]);
+                    fprintf(output, "\n");
+                }
+            }
+            fclose(output);
+        }
     }
 
 
@@ -211,6 +211,112 @@ static int parse_double_array(
 }
 
 
+/**
+    parses setting <setting> in config file <conf>, either a single
+    number or an array of them (one for each redshift bin), into
+    <values> with length <values_len>
+**/
+
+static int parse_double_bins(
+    config_t *conf,
+    const char *setting,
+    double **values,
+    int *values_len
+)
+{
+    config_setting_t *type = config_lookup(conf, setting);
+    if (type != NULL && config_setting_is_array(type) == CONFIG_TRUE){
+        parse_double_array(conf, setting, values, values_len);
+        if (*values_len <= 0){
+            print_error_verbose(PROG_VALUE_ERROR, setting);
+            exit(EXIT_FAILURE);
+        }
+        return EXIT_SUCCESS;
+    }
+    *values_len = 1;
+    *values = (double *)coffe_malloc(sizeof(double));
+    parse_double(conf, setting, *values, COFFE_TRUE);
+    return EXIT_SUCCESS;
+}
+
+
+/**
+    repeats the single value of <values> for all of the <bins> redshift
+    bins; the arrays which are given must all have the same length
+**/
+
+static int parse_broadcast_bins(
+    const char *setting,
+    double **values,
+    int values_len,
+    int bins
+)
+{
+    if (*values == NULL || values_len == bins) return EXIT_SUCCESS;
+    if (values_len != 1){
+        fprintf(
+            stderr,
+            "ERROR: setting %s has %d redshift bins instead of %d!\n",
+            setting, values_len, bins
+        );
+        exit(EXIT_FAILURE);
+    }
+    const double value = (*values)[0];
+    free(*values);
+    *values = (double *)coffe_malloc(sizeof(double)*bins);
+    for (int i = 0; i<bins; ++i)
+        (*values)[i] = value;
+    return EXIT_SUCCESS;
+}
+
+
+/**
+    parses the bias <name><index> of population <index> into <bias>,
+    either a constant (up to redshift z_max), or read from the file
+    input_<name><index> if read_<name><index> is set
+**/
+
+static int parse_bias(
+    config_t *conf,
+    const char *name,
+    int index,
+    double z_max,
+    int interp_method,
+    struct coffe_interpolation *bias
+)
+{
+    char setting[COFFE_MAX_STRLEN], file[COFFE_MAX_STRLEN];
+    int read = 0;
+    snprintf(setting, COFFE_MAX_STRLEN, "read_%s%d", name, index);
+    parse_int(conf, setting, &read, COFFE_FALSE);
+    if (read == COFFE_TRUE){
+        double *bias_z, *bias_value;
+        size_t bias_len;
+        snprintf(setting, COFFE_MAX_STRLEN, "input_%s%d", name, index);
+        parse_string(conf, setting, file, COFFE_TRUE);
+        read_2col(
+            file,
+            &bias_z,
+            &bias_value,
+            &bias_len
+        );
+        init_spline(bias, bias_z, bias_value, bias_len, interp_method);
+        free(bias_z);
+        free(bias_value);
+    }
+    else{
+        double value;
+        snprintf(setting, COFFE_MAX_STRLEN, "%s%d", name, index);
+        parse_double(conf, setting, &value, COFFE_TRUE);
+        /* a hacky way to init; if you need more range, increase redshift */
+        double bias_redshift[] = {0, 25, 50, 75, z_max};
+        double bias_value[] = {value, value, value, value, value};
+        init_spline(bias, bias_redshift, bias_value, sizeof(bias_redshift)/sizeof(bias_redshift[0]), interp_method);
+    }
+    return EXIT_SUCCESS;
+}
+
+
 /**
     parses all the settings from the input file
     (given by argv[1]) into the structure <par>
@@ -241,6 +347,14 @@ int coffe_parser_init(
 
     parse_int(conf, "output_type", &par->output_type, COFFE_TRUE);
     parse_string_array(conf, "output_background", &par->type_bg, &par->type_bg_len);
+
+    /* each term of the correlation function separately */
+    par->output_contributions = 0;
+    parse_int(conf, "output_contributions", &par->output_contributions, COFFE_FALSE);
+
+    /* the estimated integration error */
+    par->output_errors = 0;
+    parse_int(conf, "output_errors", &par->output_errors, COFFE_FALSE);
     parse_int(conf, "background_sampling", &par->background_bins, COFFE_TRUE);
 
     /* cosmological parameters */
@@ -257,6 +371,11 @@ int coffe_parser_init(
 
     par->Omega0_de = 1. - par->Omega0_m - par->Omega0_gamma;
 
+    /* the redshift bins; each of the settings is either a number or an array */
+    par->z_mean_bins = NULL, par->deltaz_bins = NULL;
+    par->z_min_bins = NULL, par->z_max_bins = NULL;
+    int z_mean_len = 0, deltaz_len = 0, z_min_len = 0, z_max_len = 0;
+
     /* mean redshift */
     if (
         par->output_type == 0 ||
@@ -264,34 +383,59 @@ int coffe_parser_init(
         par->output_type == 2 ||
         par->output_type == 6
     ){
-        parse_double(conf, "z_mean", &par->z_mean, COFFE_TRUE);
-        if (par->z_mean <= 0){
-            print_error_verbose(PROG_VALUE_ERROR, "z_mean");
-            exit(EXIT_FAILURE);
-        }
+        parse_double_bins(conf, "z_mean", &par->z_mean_bins, &z_mean_len);
     }
 
     /* width of redshift bin */
     if (par->output_type == 1 || par->output_type == 2){
-        parse_double(conf, "deltaz", &par->deltaz, COFFE_TRUE);
-        if (par->deltaz <= 0){
-            print_error_verbose(PROG_VALUE_ERROR, "deltaz");
+        parse_double_bins(conf, "deltaz", &par->deltaz_bins, &deltaz_len);
+    }
+
+    /* range of integration for redshift averaged multipoles */
+    if (par->output_type == 3){
+        parse_double_bins(conf, "z_min", &par->z_min_bins, &z_min_len);
+        parse_double_bins(conf, "z_max", &par->z_max_bins, &z_max_len);
+    }
+
+    par->z_bins_len = 1;
+    const int z_bins_lens[] = {z_mean_len, deltaz_len, z_min_len, z_max_len};
+    for (int i = 0; i<4; ++i)
+        if (z_bins_lens[i] > par->z_bins_len) par->z_bins_len = z_bins_lens[i];
+    parse_broadcast_bins("z_mean", &par->z_mean_bins, z_mean_len, par->z_bins_len);
+    parse_broadcast_bins("deltaz", &par->deltaz_bins, deltaz_len, par->z_bins_len);
+    parse_broadcast_bins("z_min", &par->z_min_bins, z_min_len, par->z_bins_len);
+    parse_broadcast_bins("z_max", &par->z_max_bins, z_max_len, par->z_bins_len);
+
+    for (int i = 0; i<par->z_bins_len; ++i){
+        if (par->z_mean_bins != NULL && par->z_mean_bins[i] <= 0){
+            print_error_verbose(PROG_VALUE_ERROR, "z_mean");
             exit(EXIT_FAILURE);
         }
-        /* safety check for the range of deltaz */
-        if (par->deltaz > par->z_mean){
-            fprintf(
-                stderr,
-                "ERROR: z_mean cannot be smaller than deltaz!\n"
-            );
-            exit(EXIT_FAILURE);
+        if (par->deltaz_bins != NULL){
+            if (par->deltaz_bins[i] <= 0){
+                print_error_verbose(PROG_VALUE_ERROR, "deltaz");
+                exit(EXIT_FAILURE);
+            }
+            /* safety check for the range of deltaz */
+            if (par->deltaz_bins[i] > par->z_mean_bins[i]){
+                fprintf(
+                    stderr,
+                    "ERROR: z_mean cannot be smaller than deltaz!\n"
+                );
+                exit(EXIT_FAILURE);
+            }
         }
     }
+    coffe_redshift_bin(par, 0);
 
-    /* range of integration for redshift averaged multipoles */
+    /* the redshift averaged multipoles from the multipoles at fixed redshift */
+    par->average_multipoles_z_order = 0;
     if (par->output_type == 3){
-        parse_double(conf, "z_min", &par->z_min, COFFE_TRUE);
-        parse_double(conf, "z_max", &par->z_max, COFFE_TRUE);
+        parse_int(conf, "average_multipoles_z_order", &par->average_multipoles_z_order, COFFE_FALSE);
+        if (par->average_multipoles_z_order < 0){
+            print_error_verbose(PROG_VALUE_ERROR, "average_multipoles_z_order");
+            exit(EXIT_FAILURE);
+        }
     }
 
     /* the interpolation method for GSL */
@@ -322,181 +466,220 @@ int coffe_parser_init(
         );
     }
 
+    /* the custom separations for the 2D correlation function */
+    par->sep_parallel = NULL, par->sep_parallel_len = 0;
+    par->sep_perpendicular = NULL, par->sep_perpendicular_len = 0;
+    par->corrfunc2d_multipole_max = 0;
+    par->corrfunc2d_sep_sampling = 300;
+    if (par->output_type == 6){
+        const char *names[] = {"sep_parallel", "sep_perpendicular"};
+        double **values[] = {&par->sep_parallel, &par->sep_perpendicular};
+        int *values_len[] = {&par->sep_parallel_len, &par->sep_perpendicular_len};
+        for (int n = 0; n<2; ++n){
+            if (config_lookup(conf, names[n]) == NULL) continue;
+            parse_double_array(conf, names[n], values[n], values_len[n]);
+            if (*values_len[n] <= 0){
+                print_error_verbose(PROG_VALUE_ERROR, names[n]);
+                exit(EXIT_FAILURE);
+            }
+            for (int i = 0; i<*values_len[n]; ++i){
+                if ((*values[n])[i] <= 0){
+                    print_error_verbose(PROG_VALUE_ERROR, names[n]);
+                    exit(EXIT_FAILURE);
+                }
+            }
+        }
+
+        /* optionally resampled from the polar grid */
+        parse_int(conf, "corrfunc2d_multipole_max", &par->corrfunc2d_multipole_max, COFFE_FALSE);
+        if (par->corrfunc2d_multipole_max < 0){
+            print_error_verbose(PROG_VALUE_ERROR, "corrfunc2d_multipole_max");
+            exit(EXIT_FAILURE);
+        }
+        parse_int(conf, "corrfunc2d_sep_sampling", &par->corrfunc2d_sep_sampling, COFFE_FALSE);
+        if (par->corrfunc2d_sep_sampling < 10){
+            print_error_verbose(PROG_VALUE_ERROR, "corrfunc2d_sep_sampling");
+            exit(EXIT_FAILURE);
+        }
+    }
+
     /* number of points to sample the integral of the Bessel function */
     parse_int(conf, "bessel_sampling", &par->bessel_bins, COFFE_TRUE);
 
-#ifndef HAVE_CUBA
-    /* parsing the integration method */
-    parse_int(conf, "integration_method", &par->integration_method, COFFE_TRUE);
-    if (par->integration_method < 0 || par->integration_method > 2){
+    /* parsing the integration method (the ones of CUBA only if it's there) */
+#ifdef HAVE_CUBA
+    /* Cuhre, as CUBA builds always used before */
+    const int integration_method_max = 8;
+    par->integration_method = 5;
+#else
+    const int integration_method_max = 4;
+    par->integration_method = 2;
+#endif
+    parse_int(conf, "integration_method", &par->integration_method, COFFE_FALSE);
+    if (par->integration_method < 0 || par->integration_method > integration_method_max){
         print_error_verbose(PROG_VALUE_ERROR, "integration_method");
         exit(EXIT_FAILURE);
     }
+#ifdef HAVE_CUBA
+    if (par->integration_method != 5){
+        fprintf(
+            stderr,
+            "WARNING: integration_method = %d is used instead of Cuhre (5), "
+            "which was the only method with CUBA in previous versions!\n",
+            par->integration_method
+        );
+    }
 #endif
 
+    /* optionally a different one for each kind of terms */
+    const char *integration_methods[] = {
+        "integration_method_nonintegrated",
+        "integration_method_single_integrated",
+        "integration_method_double_integrated"
+    };
+    for (int i = 0; i<3; ++i){
+        par->integration_methods[i] = par->integration_method;
+        if (config_lookup(conf, integration_methods[i]) != NULL)
+            parse_int(conf, integration_methods[i], &par->integration_methods[i], COFFE_TRUE);
+        if (
+            par->integration_methods[i] < 0 ||
+            par->integration_methods[i] > integration_method_max
+        ){
+            print_error_verbose(PROG_VALUE_ERROR, integration_methods[i]);
+            exit(EXIT_FAILURE);
+        }
+    }
+
     /* number of points for the 2-3-4D integration */
     parse_int(conf, "integration_sampling", &par->integration_bins, COFFE_TRUE);
 
-    /* parsing the w parameter */
-    parse_double(conf, "w0", &par->w0, COFFE_TRUE);
-    parse_double(conf, "wa", &par->wa, COFFE_TRUE);
-
-    /* parsing the matter bias */
-    parse_int(conf, "read_matter_bias1", &par->read_matter_bias1, COFFE_FALSE);
-    if (par->read_matter_bias1 == COFFE_TRUE){
-        double *bias_z, *bias_value;
-        size_t bias_len;
-        parse_string(conf, "input_matter_bias1", par->file_matter_bias1, COFFE_TRUE);
-        read_2col(
-            par->file_matter_bias1,
-            &bias_z,
-            &bias_value,
-            &bias_len
-        );
-        init_spline(&par->matter_bias1, bias_z, bias_value, bias_len, par->interp_method);
-        free(bias_z);
-        free(bias_value);
-    }
-    else{
-        double bias;
-        parse_double(conf, "matter_bias1", &bias, COFFE_TRUE);
-        /* a hacky way to init; if you need more range, increase redshift */
-        double bias_redshift[] = {0, 25, 50, 75, 100};
-        double bias_value[] = {bias, bias, bias, bias, bias};
-        init_spline(&par->matter_bias1, bias_redshift, bias_value, sizeof(bias_redshift)/sizeof(bias_redshift[0]), par->interp_method);
+    /* order of the Gauss-Legendre quadrature along the line of sight */
+    par->integration_los_order = 0;
+    parse_int(conf, "integration_los_order", &par->integration_los_order, COFFE_FALSE);
+    if (par->integration_los_order < 0){
+        print_error_verbose(PROG_VALUE_ERROR, "integration_los_order");
+        exit(EXIT_FAILURE);
     }
 
-    parse_int(conf, "read_matter_bias2", &par->read_matter_bias2, COFFE_FALSE);
-    if (par->read_matter_bias2 == COFFE_TRUE){
-        double *bias_z, *bias_value;
-        size_t bias_len;
-        parse_string(conf, "input_matter_bias2", par->file_matter_bias2, COFFE_TRUE);
-        read_2col(
-            par->file_matter_bias2,
-            &bias_z,
-            &bias_value,
-            &bias_len
-        );
-        init_spline(&par->matter_bias2, bias_z, bias_value, bias_len, par->interp_method);
-        free(bias_z);
-        free(bias_value);
+    /* substitutions of the line of sight variables, optionally for each kind of terms */
+    int integration_transform = 0;
+    parse_int(conf, "integration_transform", &integration_transform, COFFE_FALSE);
+    if (integration_transform < 0 || integration_transform > 2){
+        print_error_verbose(PROG_VALUE_ERROR, "integration_transform");
+        exit(EXIT_FAILURE);
     }
-    else{
-        double bias;
-        parse_double(conf, "matter_bias2", &bias, COFFE_TRUE);
-        /* a hacky way to init; if you need more range, increase redshift */
-        double bias_redshift[] = {0, 25, 50, 75, 100};
-        double bias_value[] = {bias, bias, bias, bias, bias};
-        init_spline(&par->matter_bias2, bias_redshift, bias_value, sizeof(bias_redshift)/sizeof(bias_redshift[0]), par->interp_method);
+    const char *integration_transforms[] = {
+        "integration_transform_single_integrated",
+        "integration_transform_double_integrated"
+    };
+    for (int i = 0; i<2; ++i){
+        par->integration_transforms[i] = integration_transform;
+        if (config_lookup(conf, integration_transforms[i]) != NULL)
+            parse_int(conf, integration_transforms[i], &par->integration_transforms[i], COFFE_TRUE);
+        if (par->integration_transforms[i] < 0 || par->integration_transforms[i] > 2){
+            print_error_verbose(PROG_VALUE_ERROR, integration_transforms[i]);
+            exit(EXIT_FAILURE);
+        }
     }
 
+    /* order of the Gauss-Legendre quadrature in mu for the multipoles */
+    par->integration_mu_order = 0;
+    parse_int(conf, "integration_mu_order", &par->integration_mu_order, COFFE_FALSE);
+    if (par->integration_mu_order < 0){
+        print_error_verbose(PROG_VALUE_ERROR, "integration_mu_order");
+        exit(EXIT_FAILURE);
+    }
 
-    /* parsing the magnification bias (s) */
-    parse_int(conf, "read_magnification_bias1", &par->read_magnification_bias1, COFFE_FALSE);
-    if (par->read_magnification_bias1 == COFFE_TRUE){
-        double *s_z, *s_value;
-        size_t s_len;
-        parse_string(
-            conf,
-            "input_magnification_bias1",
-            par->file_magnification_bias1,
-            COFFE_TRUE
-        );
-        read_2col(
-            par->file_magnification_bias1,
-            &s_z,
-            &s_value,
-            &s_len
-        );
-        init_spline(
-            &par->magnification_bias1,
-            s_z, s_value, s_len,
-            par->interp_method
-        );
-        free(s_z);
-        free(s_value);
+    /* single precision path for the double integrated terms */
+    par->integration_single_precision = 0;
+    parse_int(conf, "integration_single_precision", &par->integration_single_precision, COFFE_FALSE);
+
+    /* keeping the VEGAS grids between separations */
+    par->integration_warm_start = 0;
+    parse_int(conf, "integration_warm_start", &par->integration_warm_start, COFFE_FALSE);
+
+    /* the error-targeted mode of the Monte Carlo integrations */
+    par->integration_target_relative = 0;
+    parse_double(conf, "integration_target_relative", &par->integration_target_relative, COFFE_FALSE);
+    par->integration_target_absolute = 0;
+    parse_double(conf, "integration_target_absolute", &par->integration_target_absolute, COFFE_FALSE);
+    if (par->integration_target_relative < 0){
+        print_error_verbose(PROG_VALUE_ERROR, "integration_target_relative");
+        exit(EXIT_FAILURE);
     }
-    else{
-        double s;
-        parse_double(conf, "magnification_bias1", &s, COFFE_TRUE);
-        /* a hacky way to init; if you need more range, increase redshift */
-        double s_redshift[] = {0, 25, 50, 75, 100};
-        double s_value[] = {s, s, s, s, s};
-        init_spline(&par->magnification_bias1, s_redshift, s_value, sizeof(s_redshift)/sizeof(s_redshift[0]), par->interp_method);
+    if (par->integration_target_absolute < 0){
+        print_error_verbose(PROG_VALUE_ERROR, "integration_target_absolute");
+        exit(EXIT_FAILURE);
     }
 
-    parse_int(conf, "read_magnification_bias2", &par->read_magnification_bias2, COFFE_FALSE);
-    if (par->read_magnification_bias2 == COFFE_TRUE){
-        double *s_z, *s_value;
-        size_t s_len;
-        parse_string(conf, "input_magnification_bias2", par->file_magnification_bias2, COFFE_TRUE);
-        read_2col(
-            par->file_magnification_bias2,
-            &s_z,
-            &s_value,
-            &s_len
-        );
-        init_spline(&par->magnification_bias2, s_z, s_value, s_len, par->interp_method);
-        free(s_z);
-        free(s_value);
-    }
-    else{
-        double s;
-        parse_double(conf, "magnification_bias2", &s, COFFE_TRUE);
-        /* a hacky way to init; if you need more range, increase redshift */
-        double s_redshift[] = {0, 25, 50, 75, 100};
-        double s_value[] = {s, s, s, s, s};
-        init_spline(&par->magnification_bias2, s_redshift, s_value, sizeof(s_redshift)/sizeof(s_redshift[0]), par->interp_method);
+    /* the flat-sky Kaiser limit as a control variate */
+    par->integration_control_variate = 0;
+    parse_int(conf, "integration_control_variate", &par->integration_control_variate, COFFE_FALSE);
+
+    /* parsing the w parameter */
+    parse_double(conf, "w0", &par->w0, COFFE_TRUE);
+    parse_double(conf, "wa", &par->wa, COFFE_TRUE);
+
+    /* the number of populations; without it, just the correlation of populations 1 and 2 */
+    int tracers = 0;
+    parse_int(conf, "tracers", &tracers, COFFE_FALSE);
+    if (tracers < 0 || (tracers > 0 && !(
+        par->output_type == 0 ||
+        par->output_type == 1 ||
+        par->output_type == 2 ||
+        par->output_type == 3 ||
+        par->output_type == 6
+    ))){
+        print_error_verbose(PROG_VALUE_ERROR, "tracers");
+        exit(EXIT_FAILURE);
     }
+    par->tracers_len = tracers > 0 ? tracers : 2;
 
-    /* parsing the evolution_bias (f_evo) */
-    parse_int(conf, "read_evolution_bias1", &par->read_evolution_bias1, COFFE_FALSE);
-    if (par->read_evolution_bias1 == COFFE_TRUE){
-        double *f_evo_z, *f_evo_value;
-        size_t f_evo_len;
-        parse_string(conf, "input_evolution_bias1", par->file_evolution_bias1, COFFE_TRUE);
-        read_2col(
-            par->file_evolution_bias1,
-            &f_evo_z,
-            &f_evo_value,
-            &f_evo_len
+    /* parsing the matter bias, the magnification bias (s), and the evolution bias (f_evo) */
+    par->tracer_matter_bias = (struct coffe_interpolation *)coffe_malloc(
+        sizeof(struct coffe_interpolation)*par->tracers_len
+    );
+    par->tracer_magnification_bias = (struct coffe_interpolation *)coffe_malloc(
+        sizeof(struct coffe_interpolation)*par->tracers_len
+    );
+    par->tracer_evolution_bias = (struct coffe_interpolation *)coffe_malloc(
+        sizeof(struct coffe_interpolation)*par->tracers_len
+    );
+    for (int n = 0; n<par->tracers_len; ++n){
+        parse_bias(
+            conf, "matter_bias", n + 1, 100, par->interp_method,
+            &par->tracer_matter_bias[n]
+        );
+        parse_bias(
+            conf, "magnification_bias", n + 1, 100, par->interp_method,
+            &par->tracer_magnification_bias[n]
+        );
+        parse_bias(
+            conf, "evolution_bias", n + 1, 200, par->interp_method,
+            &par->tracer_evolution_bias[n]
         );
-        init_spline(&par->evolution_bias1, f_evo_z, f_evo_value, f_evo_len, par->interp_method);
-        free(f_evo_z);
-        free(f_evo_value);
-    }
-    else{
-        double f_evo;
-        parse_double(conf, "evolution_bias1", &f_evo, COFFE_TRUE);
-        /* a hacky way to init; if you need more range, increase redshift */
-        double f_evo_redshift[] = {0, 25, 50, 75, 200};
-        double f_evo_value[] = {f_evo, f_evo, f_evo, f_evo, f_evo};
-        init_spline(&par->evolution_bias1, f_evo_redshift, f_evo_value, sizeof(f_evo_redshift)/sizeof(f_evo_redshift[0]), par->interp_method);
     }
 
-    parse_int(conf, "read_evolution_bias2", &par->read_evolution_bias2, COFFE_FALSE);
-    if (par->read_evolution_bias2 == COFFE_TRUE){
-        double *f_evo_z, *f_evo_value;
-        size_t f_evo_len;
-        parse_string(conf, "input_evolution_bias2", par->file_evolution_bias2, COFFE_TRUE);
-        read_2col(
-            par->file_evolution_bias2,
-            &f_evo_z,
-            &f_evo_value,
-            &f_evo_len
-        );
-        init_spline(&par->evolution_bias2, f_evo_z, f_evo_value, f_evo_len, par->interp_method);
-        free(f_evo_z);
-        free(f_evo_value);
+    /* all of the pairs (each once, as the other order is just mu -> -mu) */
+    if (tracers > 0){
+        par->tracer_pairs_len = tracers*(tracers + 1)/2;
+        par->tracer_pairs = (int *)coffe_malloc(sizeof(int)*2*par->tracer_pairs_len);
+        int pair = 0;
+        for (int i = 0; i<tracers; ++i){
+            for (int j = i; j<tracers; ++j){
+                par->tracer_pairs[2*pair] = i;
+                par->tracer_pairs[2*pair + 1] = j;
+                ++pair;
+            }
+        }
     }
     else{
-        double f_evo;
-        parse_double(conf, "evolution_bias2", &f_evo, COFFE_TRUE);
-        /* a hacky way to init; if you need more range, increase redshift */
-        double f_evo_redshift[] = {0, 25, 50, 75, 200};
-        double f_evo_value[] = {f_evo, f_evo, f_evo, f_evo, f_evo};
-        init_spline(&par->evolution_bias2, f_evo_redshift, f_evo_value, sizeof(f_evo_redshift)/sizeof(f_evo_redshift[0]), par->interp_method);
+        par->tracer_pairs_len = 1;
+        par->tracer_pairs = (int *)coffe_malloc(sizeof(int)*2);
+        par->tracer_pairs[0] = 0;
+        par->tracer_pairs[1] = 1;
     }
+    coffe_tracer_pair(par, 0);
 
     /* parsing the covariance parameters */
     if (par->output_type == 4 || par->output_type == 5){
@@ -518,6 +701,17 @@ int coffe_parser_init(
             &par->covariance_pixelsize,
             COFFE_TRUE
         );
+        par->covariance_integral_order = 0;
+        parse_int(
+            conf,
+            "covariance_integral_order",
+            &par->covariance_integral_order,
+            COFFE_FALSE
+        );
+        if (par->covariance_integral_order < 0){
+            print_error_verbose(PROG_VALUE_ERROR, "covariance_integral_order");
+            exit(EXIT_FAILURE);
+        }
     }
 
     if (par->output_type == 4){
@@ -805,11 +999,22 @@ int coffe_parser_init(
             &par->theta_len,
             COFFE_TRUE
         );
+
+        /* optionally from the Legendre expansion */
+        par->theta_multipole_max = 0;
+        parse_int(conf, "theta_multipole_max", &par->theta_multipole_max, COFFE_FALSE);
+        if (par->theta_multipole_max < 0){
+            print_error_verbose(PROG_VALUE_ERROR, "theta_multipole_max");
+            exit(EXIT_FAILURE);
+        }
     }
 
     for (int i = 0; i<9; ++i){
         par->nonzero_terms[i].l = -1, par->nonzero_terms[i].n = -1;
     }
+    par->terms = 0;
+    par->corr_terms_len = 0;
+    par->terms_kernel = 0;
 
     /* parsing the cotributions to the correlation function */
     if (
@@ -848,6 +1053,8 @@ int coffe_parser_init(
             }
         }
 
+        par->corr_terms_len = counter;
+
         par->divergent = 0;
 
         par->nonzero_terms[0].n = 0, par->nonzero_terms[0].l = 0;
@@ -859,33 +1066,84 @@ int coffe_parser_init(
         par->nonzero_terms[6].n = 2, par->nonzero_terms[6].l = 2;
         par->nonzero_terms[7].n = 3, par->nonzero_terms[7].l = 1;
 
-        /* isolating the term requiring renormalization */
+        /* the same terms as a bitmask, used by the kernels */
         for (int i = 0; i<counter; ++i){
-            if (
-                strcmp(par->corr_terms[i], "33") == 0 || // d2-d2 term
-                strcmp(par->corr_terms[i], "44") == 0 || // g1-g1 term
-                strcmp(par->corr_terms[i], "55") == 0 || // g2-g2 term
-                strcmp(par->corr_terms[i], "66") == 0 || // g3-g3 term
-                strcmp(par->corr_terms[i], "77") == 0 || // g4-g4 term
-                strcmp(par->corr_terms[i], "88") == 0 || // g5-g5 term
-                /* I don't think these are necessary anymore */
-                strcmp(par->corr_terms[i], "34") == 0 ||
-                strcmp(par->corr_terms[i], "43") == 0 ||
-                strcmp(par->corr_terms[i], "35") == 0 ||
-                strcmp(par->corr_terms[i], "53") == 0 ||
-                strcmp(par->corr_terms[i], "36") == 0 ||
-                strcmp(par->corr_terms[i], "63") == 0 ||
-                strcmp(par->corr_terms[i], "45") == 0 ||
-                strcmp(par->corr_terms[i], "54") == 0 ||
-                strcmp(par->corr_terms[i], "46") == 0 ||
-                strcmp(par->corr_terms[i], "64") == 0 ||
-                strcmp(par->corr_terms[i], "56") == 0 ||
-                strcmp(par->corr_terms[i], "65") == 0
-            ){
-                par->nonzero_terms[8].n = 4, par->nonzero_terms[8].l = 0;
-                par->divergent = 1;
+            if (strlen(par->corr_terms[i]) == 2){
+                par->terms |= COFFE_TERM(
+                    par->corr_terms[i][0] - '0',
+                    par->corr_terms[i][1] - '0'
+                );
             }
         }
+
+        /* picking the specialized kernel, if there is one */
+#define COFFE_KERNEL_MATCH(ID, NAME, TERMS) \
+        if (par->terms_kernel == 0 && par->terms == (TERMS)){ \
+            par->terms_kernel = ID; \
+            printf("Using the specialized kernel \"%s\"\n", #NAME); \
+        }
+        COFFE_KERNEL_SETS(COFFE_KERNEL_MATCH)
+#undef COFFE_KERNEL_MATCH
+
+        /* isolating the term requiring renormalization */
+        if (
+            par->terms & (
+                COFFE_TERM(3, 3) | // d2-d2 term
+                COFFE_TERM(4, 4) | // g1-g1 term
+                COFFE_TERM(5, 5) | // g2-g2 term
+                COFFE_TERM(6, 6) | // g3-g3 term
+                COFFE_TERM(7, 7) | // g4-g4 term
+                COFFE_TERM(8, 8) | // g5-g5 term
+                /* I don't think these are necessary anymore */
+                COFFE_TERM(3, 4) |
+                COFFE_TERM(3, 5) |
+                COFFE_TERM(3, 6) |
+                COFFE_TERM(4, 5) |
+                COFFE_TERM(4, 6) |
+                COFFE_TERM(5, 6)
+            )
+        ){
+            par->nonzero_terms[8].n = 4, par->nonzero_terms[8].l = 0;
+            par->divergent = 1;
+        }
+    }
+
+    /* the flat-sky (Kaiser) limit instead of the full-sky expressions */
+    par->flatsky = 0;
+    parse_int(conf, "flatsky", &par->flatsky, COFFE_FALSE);
+    if (
+        par->flatsky && (
+            !(par->output_type == 1 || par->output_type == 2 || par->output_type == 6) ||
+            (par->terms & ~COFFE_TERMS_FLATSKY)
+        )
+    ){
+        fprintf(
+            stderr,
+            "ERROR: flatsky is only available for output_type 1, 2 or 6, "
+            "with correlation_contributions \"den\" and \"rsd\"\n"
+        );
+        exit(EXIT_FAILURE);
+    }
+
+    /* the Limber approximation of the len-len term at large angles */
+    par->limber_angle_min = 0;
+    parse_double(conf, "limber_angle_min", &par->limber_angle_min, COFFE_FALSE);
+    if (par->limber_angle_min < 0){
+        print_error_verbose(PROG_VALUE_ERROR, "limber_angle_min");
+        exit(EXIT_FAILURE);
+    }
+    if (
+        par->limber_angle_min > 0 && (
+            !(par->output_type == 0 || par->output_type == 1 || par->output_type == 6) ||
+            (par->terms & COFFE_TERMS_DOUBLE_INTEGRATED & ~COFFE_TERM(9, 9))
+        )
+    ){
+        fprintf(
+            stderr,
+            "ERROR: limber_angle_min is only available for output_type 0, 1 or 6, "
+            "with len-len as the only double integrated term\n"
+        );
+        exit(EXIT_FAILURE);
     }
 
     /* the output path */
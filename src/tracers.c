@@ -0,0 +1,419 @@
+/*
+ * This file is part of COFFE
+ * Copyright (C) 2018 Goran Jelic-Cizmek
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <math.h>
+#include <string.h>
+
+#include "common.h"
+#include "errors.h"
+#include "background.h"
+#include "integrals.h"
+#include "corrfunc.h"
+#include "multipoles.h"
+#include "average_multipoles.h"
+#include "tracers.h"
+
+
+/* a contiguous block of values of one of the outputs */
+struct tracers_block
+{
+    double *data;
+    size_t len;
+    int error; /* whether the values are integration errors */
+};
+
+
+static void tracers_add(
+    struct tracers_block *blocks,
+    size_t *len,
+    double *data,
+    size_t data_len,
+    int error
+)
+{
+    if (data == NULL || data_len == 0) return;
+    if (blocks != NULL){
+        blocks[*len].data = data;
+        blocks[*len].len = data_len;
+        blocks[*len].error = error;
+    }
+    ++(*len);
+}
+
+
+/**
+    all of the values of the outputs which are set (the results, the
+    contributions and the errors) as blocks; with blocks == NULL
+    just counts them
+**/
+
+static size_t tracers_blocks(
+    struct coffe_corrfunc_ang_t *cf_ang,
+    struct coffe_corrfunc_t *cf,
+    struct coffe_corrfunc2d_t *cf2d,
+    struct coffe_multipoles_t *mp,
+    struct coffe_average_multipoles_t *ramp,
+    struct tracers_block *blocks
+)
+{
+    size_t len = 0;
+    if (cf_ang->flag){
+        tracers_add(blocks, &len, cf_ang->result, cf_ang->theta_len, COFFE_FALSE);
+        tracers_add(blocks, &len, cf_ang->contributions,
+            cf_ang->theta_len*cf_ang->contributions_len, COFFE_FALSE);
+        tracers_add(blocks, &len, cf_ang->error, cf_ang->theta_len, COFFE_TRUE);
+    }
+    if (cf->flag){
+        for (size_t i = 0; i<cf->mu_len; ++i)
+            tracers_add(blocks, &len, cf->result[i], cf->sep_len, COFFE_FALSE);
+        tracers_add(blocks, &len, cf->contributions,
+            cf->mu_len*cf->sep_len*cf->contributions_len, COFFE_FALSE);
+        tracers_add(blocks, &len, cf->error, cf->mu_len*cf->sep_len, COFFE_TRUE);
+    }
+    if (cf2d->flag){
+        for (size_t i = 0; i<cf2d->sep_parallel_len; ++i)
+            tracers_add(blocks, &len, cf2d->result[i], cf2d->sep_perpendicular_len, COFFE_FALSE);
+        tracers_add(blocks, &len, cf2d->contributions,
+            cf2d->sep_parallel_len*cf2d->sep_perpendicular_len*cf2d->contributions_len, COFFE_FALSE);
+        tracers_add(blocks, &len, cf2d->error,
+            cf2d->sep_parallel_len*cf2d->sep_perpendicular_len, COFFE_TRUE);
+    }
+    if (mp->flag){
+        for (size_t i = 0; i<mp->l_len; ++i)
+            tracers_add(blocks, &len, mp->result[i], mp->sep_len, COFFE_FALSE);
+        tracers_add(blocks, &len, mp->contributions,
+            mp->l_len*mp->sep_len*mp->contributions_len, COFFE_FALSE);
+        tracers_add(blocks, &len, mp->error, mp->l_len*mp->sep_len, COFFE_TRUE);
+    }
+    if (ramp->flag){
+        for (size_t i = 0; i<ramp->l_len; ++i)
+            tracers_add(blocks, &len, ramp->result[i], ramp->sep_len, COFFE_FALSE);
+        tracers_add(blocks, &len, ramp->contributions,
+            ramp->l_len*ramp->sep_len*ramp->contributions_len, COFFE_FALSE);
+        tracers_add(blocks, &len, ramp->error, ramp->l_len*ramp->sep_len, COFFE_TRUE);
+    }
+    return len;
+}
+
+
+/**
+    sets the multipoles which vanish for the current pair to zero
+**/
+
+static void tracers_vanishing(
+    const struct coffe_parameters_t *par,
+    const int l[],
+    size_t l_len,
+    size_t sep_len,
+    double **result,
+    double *error,
+    double *contributions,
+    size_t contributions_len
+)
+{
+    for (size_t i = 0; i<l_len; ++i){
+        if (!coffe_multipole_vanishes(par, l[i])) continue;
+        for (size_t j = 0; j<sep_len; ++j){
+            result[i][j] = 0;
+            if (error != NULL) error[i*sep_len + j] = 0;
+            if (contributions != NULL)
+                for (size_t t = 0; t<contributions_len; ++t)
+                    contributions[(i*sep_len + j)*contributions_len + t] = 0;
+        }
+    }
+}
+
+
+/**
+    decides whether the pairs are combined from the probe populations,
+    which requires the biases which differ between the populations to be
+    constant in z, and fewer runs than the pairs themselves
+**/
+
+int coffe_tracers_init(
+    struct coffe_parameters_t *par,
+    struct coffe_tracers_t *tracers
+)
+{
+    tracers->flag = 0;
+    tracers->probes_len = 0;
+    tracers->matter_bias = NULL;
+    tracers->magnification_bias = NULL;
+    tracers->evolution_bias = NULL;
+    tracers->owned = NULL;
+    tracers->coefficients = NULL;
+    tracers->values = NULL;
+    tracers->values_len = 0;
+
+    if (par->tracer_pairs_len <= 1) return EXIT_SUCCESS;
+
+    struct coffe_interpolation *biases[] = {
+        par->tracer_matter_bias,
+        par->tracer_magnification_bias,
+        par->tracer_evolution_bias
+    };
+
+    /* only the kinds of biases which differ between the populations need a probe */
+    int probe[3] = {0};
+    int probes_len = 1;
+    for (int kind = 0; kind<3; ++kind){
+        int varies = COFFE_FALSE;
+        for (int n = 1; n<par->tracers_len; ++n)
+            if (!coffe_same_interpolation(&biases[kind][n], &biases[kind][0]))
+                varies = COFFE_TRUE;
+        /* the matter bias only enters through the density */
+        if (kind == 0 && !(par->terms & COFFE_TERMS_WITH(0)))
+            varies = COFFE_FALSE;
+        if (!varies) continue;
+
+        for (int n = 0; n<par->tracers_len; ++n){
+            const gsl_spline *spline = biases[kind][n].spline;
+            for (size_t i = 1; i<spline->size; ++i){
+                if (spline->y[i] != spline->y[0]){
+                    printf(
+                        "The biases of the populations are not constant in z, "
+                        "so each pair is computed separately\n"
+                    );
+                    return EXIT_SUCCESS;
+                }
+            }
+        }
+        probe[kind] = probes_len++;
+    }
+
+    if (probes_len*probes_len >= par->tracer_pairs_len) return EXIT_SUCCESS;
+
+    tracers->flag = 1;
+    tracers->probes_len = probes_len;
+    tracers->matter_bias = (struct coffe_interpolation *)coffe_malloc(
+        sizeof(struct coffe_interpolation)*probes_len
+    );
+    tracers->magnification_bias = (struct coffe_interpolation *)coffe_malloc(
+        sizeof(struct coffe_interpolation)*probes_len
+    );
+    tracers->evolution_bias = (struct coffe_interpolation *)coffe_malloc(
+        sizeof(struct coffe_interpolation)*probes_len
+    );
+    tracers->owned = (int *)coffe_malloc(sizeof(int)*3*probes_len);
+    struct coffe_interpolation *probes[] = {
+        tracers->matter_bias,
+        tracers->magnification_bias,
+        tracers->evolution_bias
+    };
+
+    /* probe 0 has all of the differing biases equal to 0, probe <k> has just one of them equal to 1 */
+    for (int p = 0; p<probes_len; ++p){
+        for (int kind = 0; kind<3; ++kind){
+            tracers->owned[3*p + kind] = probe[kind] > 0;
+            if (probe[kind] == 0){
+                probes[kind][p] = biases[kind][0];
+                continue;
+            }
+            const gsl_spline *spline = biases[kind][0].spline;
+            double *y = (double *)coffe_malloc(sizeof(double)*spline->size);
+            for (size_t i = 0; i<spline->size; ++i)
+                y[i] = probe[kind] == p ? 1. : 0.;
+            init_spline(&probes[kind][p], spline->x, y, spline->size, par->interp_method);
+            free(y);
+        }
+    }
+
+    /* the biases of population <n> are (1 - sum_k v_k) probe 0 + sum_k v_k probe <k> */
+    tracers->coefficients = (double *)coffe_malloc(
+        sizeof(double)*par->tracers_len*probes_len
+    );
+    for (int n = 0; n<par->tracers_len; ++n){
+        double *coefficients = tracers->coefficients + n*probes_len;
+        coefficients[0] = 1;
+        for (int kind = 0; kind<3; ++kind){
+            if (probe[kind] == 0) continue;
+            const double value = biases[kind][n].spline->y[0];
+            coefficients[probe[kind]] = value;
+            coefficients[0] -= value;
+        }
+    }
+
+    tracers->values_len = probes_len*probes_len*par->z_bins_len;
+    tracers->values = (double **)coffe_malloc(sizeof(double *)*tracers->values_len);
+    for (int i = 0; i<tracers->values_len; ++i)
+        tracers->values[i] = NULL;
+
+    printf(
+        "Combining the %d pairs of populations from %d pairs of probe populations\n",
+        par->tracer_pairs_len, probes_len*probes_len
+    );
+
+    return EXIT_SUCCESS;
+}
+
+
+/**
+    sets the biases of populations 1 and 2 to the ones of the
+    pair of probe populations <pair>, and recomputes G1 and G2
+**/
+
+int coffe_tracers_probe(
+    struct coffe_parameters_t *par,
+    struct coffe_background_t *bg,
+    struct coffe_tracers_t *tracers,
+    int pair
+)
+{
+    if (!tracers->flag || pair < 0 || pair >= tracers->probes_len*tracers->probes_len){
+        print_error(PROG_VALUE_ERROR);
+        exit(EXIT_FAILURE);
+    }
+    const int first = pair / tracers->probes_len, second = pair % tracers->probes_len;
+    par->matter_bias1 = tracers->matter_bias[first];
+    par->matter_bias2 = tracers->matter_bias[second];
+    par->magnification_bias1 = tracers->magnification_bias[first];
+    par->magnification_bias2 = tracers->magnification_bias[second];
+    par->evolution_bias1 = tracers->evolution_bias[first];
+    par->evolution_bias2 = tracers->evolution_bias[second];
+    par->autocorrelation = first == second;
+    coffe_background_tracers(par, bg);
+    return EXIT_SUCCESS;
+}
+
+
+/**
+    keeps the outputs of the pair of probe populations <pair>
+    in the current redshift bin
+**/
+
+int coffe_tracers_store(
+    struct coffe_parameters_t *par,
+    struct coffe_tracers_t *tracers,
+    int pair,
+    struct coffe_corrfunc_ang_t *cf_ang,
+    struct coffe_corrfunc_t *cf,
+    struct coffe_corrfunc2d_t *cf2d,
+    struct coffe_multipoles_t *mp,
+    struct coffe_average_multipoles_t *ramp
+)
+{
+    const size_t blocks_len = tracers_blocks(cf_ang, cf, cf2d, mp, ramp, NULL);
+    struct tracers_block *blocks = (struct tracers_block *)coffe_malloc(
+        sizeof(struct tracers_block)*(blocks_len + 1)
+    );
+    tracers_blocks(cf_ang, cf, cf2d, mp, ramp, blocks);
+
+    size_t len = 0;
+    for (size_t b = 0; b<blocks_len; ++b)
+        len += blocks[b].len;
+
+    const int index = pair*par->z_bins_len + par->z_bin;
+    free(tracers->values[index]);
+    tracers->values[index] = (double *)coffe_malloc(sizeof(double)*(len + 1));
+    for (size_t b = 0, offset = 0; b<blocks_len; offset += blocks[b].len, ++b)
+        memcpy(tracers->values[index] + offset, blocks[b].data, sizeof(double)*blocks[b].len);
+
+    free(blocks);
+    return EXIT_SUCCESS;
+}
+
+
+/**
+    overwrites the outputs (those of any pair of probe populations in the
+    current redshift bin) with the ones of the current pair of populations
+    (see coffe_tracer_pair); the errors are added in absolute value, so
+    they are an upper bound
+**/
+
+int coffe_tracers_combine(
+    struct coffe_parameters_t *par,
+    struct coffe_tracers_t *tracers,
+    struct coffe_corrfunc_ang_t *cf_ang,
+    struct coffe_corrfunc_t *cf,
+    struct coffe_corrfunc2d_t *cf2d,
+    struct coffe_multipoles_t *mp,
+    struct coffe_average_multipoles_t *ramp
+)
+{
+    const int probes_len = tracers->probes_len;
+    const int pairs_len = probes_len*probes_len;
+    const double *first =
+        tracers->coefficients + par->tracer_pairs[2*par->tracer_pair]*probes_len;
+    const double *second =
+        tracers->coefficients + par->tracer_pairs[2*par->tracer_pair + 1]*probes_len;
+
+    const size_t blocks_len = tracers_blocks(cf_ang, cf, cf2d, mp, ramp, NULL);
+    struct tracers_block *blocks = (struct tracers_block *)coffe_malloc(
+        sizeof(struct tracers_block)*(blocks_len + 1)
+    );
+    tracers_blocks(cf_ang, cf, cf2d, mp, ramp, blocks);
+
+    for (int pair = 0; pair<pairs_len; ++pair){
+        if (tracers->values[pair*par->z_bins_len + par->z_bin] == NULL){
+            print_error(PROG_VALUE_ERROR);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    for (size_t b = 0, offset = 0; b<blocks_len; offset += blocks[b].len, ++b){
+        for (size_t i = 0; i<blocks[b].len; ++i){
+            double sum = 0;
+            for (int pair = 0; pair<pairs_len; ++pair){
+                const double weight =
+                    first[pair / probes_len]*second[pair % probes_len];
+                const double value =
+                    tracers->values[pair*par->z_bins_len + par->z_bin][offset + i];
+                sum += blocks[b].error ? fabs(weight)*value : weight*value;
+            }
+            blocks[b].data[i] = sum;
+        }
+    }
+    free(blocks);
+
+    /* the odd multipoles of auto-correlations only cancel up to the integration errors */
+    if (mp->flag)
+        tracers_vanishing(
+            par, mp->l, mp->l_len, mp->sep_len,
+            mp->result, mp->error, mp->contributions, mp->contributions_len
+        );
+    if (ramp->flag)
+        tracers_vanishing(
+            par, ramp->l, ramp->l_len, ramp->sep_len,
+            ramp->result, ramp->error, ramp->contributions, ramp->contributions_len
+        );
+
+    return EXIT_SUCCESS;
+}
+
+int coffe_tracers_free(
+    struct coffe_tracers_t *tracers
+)
+{
+    if (tracers->flag){
+        for (int p = 0; p<tracers->probes_len; ++p){
+            if (tracers->owned[3*p]) free_spline(&tracers->matter_bias[p]);
+            if (tracers->owned[3*p + 1]) free_spline(&tracers->magnification_bias[p]);
+            if (tracers->owned[3*p + 2]) free_spline(&tracers->evolution_bias[p]);
+        }
+        free(tracers->matter_bias);
+        free(tracers->magnification_bias);
+        free(tracers->evolution_bias);
+        free(tracers->owned);
+        free(tracers->coefficients);
+        for (int i = 0; i<tracers->values_len; ++i)
+            free(tracers->values[i]);
+        free(tracers->values);
+        tracers->flag = 0;
+    }
+    return EXIT_SUCCESS;
+}
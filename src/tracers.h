@@ -0,0 +1,81 @@
+/*
+ * This file is part of COFFE
+ * Copyright (C) 2018 Goran Jelic-Cizmek
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef COFFE_TRACERS_H
+#define COFFE_TRACERS_H
+
+/**
+    all of the pairs of populations from the pairs of a few probe
+    populations: every term is bilinear in (1, b, s, f_evo) of the first
+    population and (1, b, s, f_evo) of the second one, so with constant
+    biases the correlation of any pair is a combination of the ones of
+    the probe populations, with one probe for each kind of bias which
+    differs between the populations, plus one with all of them zero
+**/
+
+struct coffe_tracers_t
+{
+    int flag; /* whether the pairs are combined from the probes */
+    int probes_len;
+    /* the biases of each of the probe populations */
+    struct coffe_interpolation *matter_bias, *magnification_bias, *evolution_bias;
+    int *owned; /* whether the bias of the kind (index = 3*probe + kind) was allocated here */
+    double *coefficients; /* index = population*probes_len + probe */
+    /* the values of each pair of probes (index = pair*z_bins_len + bin) */
+    double **values;
+    int values_len;
+};
+
+int coffe_tracers_init(
+    struct coffe_parameters_t *par,
+    struct coffe_tracers_t *tracers
+);
+
+int coffe_tracers_probe(
+    struct coffe_parameters_t *par,
+    struct coffe_background_t *bg,
+    struct coffe_tracers_t *tracers,
+    int pair
+);
+
+int coffe_tracers_store(
+    struct coffe_parameters_t *par,
+    struct coffe_tracers_t *tracers,
+    int pair,
+    struct coffe_corrfunc_ang_t *cf_ang,
+    struct coffe_corrfunc_t *cf,
+    struct coffe_corrfunc2d_t *cf2d,
+    struct coffe_multipoles_t *mp,
+    struct coffe_average_multipoles_t *ramp
+);
+
+int coffe_tracers_combine(
+    struct coffe_parameters_t *par,
+    struct coffe_tracers_t *tracers,
+    struct coffe_corrfunc_ang_t *cf_ang,
+    struct coffe_corrfunc_t *cf,
+    struct coffe_corrfunc2d_t *cf2d,
+    struct coffe_multipoles_t *mp,
+    struct coffe_average_multipoles_t *ramp
+);
+
+int coffe_tracers_free(
+    struct coffe_tracers_t *tracers
+);
+
+#endif